@@ -100,6 +100,18 @@ void Application::run()
             }
         }
 
+#ifdef TX_DENOISE
+        // Denoise in the background, the latest result is displayed
+        if (this->enableAsyncDenoise)
+        {
+            this->renderer.pollDenoise();
+            if (this->isRendering)
+            {
+                this->renderer.denoiseAsync();
+            }
+        }
+#endif
+
         // UI
         this->ui.render();
 
@@ -119,6 +131,13 @@ void Application::loadScene(const std::string& fileName)
 
 GLint Application::getViewHandler() const
 {
+#ifdef TX_DENOISE
+    if (this->enableAsyncDenoise && this->renderer.getDenoisedFrameCount() > 0)
+    {
+        return this->renderer.getDenoisedTextureHandler();
+    }
+#endif
+
     return !this->enablePreview ||this->isRendering || this->renderer.getFrameCount() > 1 ?
         this->renderer.getTextureHandler() : this->renderer.getTextureAlbedoHandler();
 }
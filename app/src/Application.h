@@ -27,6 +27,9 @@ public:
     unsigned int perFrameCount = 1;
     bool isRendering = false;
     bool enablePreview = true;
+#ifdef TX_DENOISE
+    bool enableAsyncDenoise = false;
+#endif
 
     static inline const std::filesystem::path assetsFolder = std::filesystem::canonical(ASSETS_PATH).string();
     static inline const std::filesystem::path environmentFolder = Application::assetsFolder / "environments" / "";
@@ -251,6 +251,24 @@ void UI::barMenu()
     ImGui::Separator();
     ImGui::Text("Frame count: %u", renderer.getFrameCount());
 
+    // Frames accumulated per second over the last half second, restarted when the accumulation is cleared
+    unsigned int frameCount = renderer.getFrameCount();
+    this->sampleRateTime += elapsedTime;
+    if (frameCount < this->sampleRateFrameCount)
+    {
+        this->sampleRateFrameCount = frameCount;
+        this->sampleRateTime = 0;
+    }
+    else if (this->sampleRateTime >= .5f)
+    {
+        this->sampleRate = (frameCount - this->sampleRateFrameCount) / this->sampleRateTime;
+        this->sampleRateFrameCount = frameCount;
+        this->sampleRateTime = 0;
+    }
+
+    ImGui::Separator();
+    ImGui::Text("%.1f samples/s", this->sampleRate);
+
     ImGui::EndMainMenuBar();
 }
 
@@ -467,6 +485,7 @@ void UI::propertyMeshMenu()
     bool changed = false;
 
     ImGui::Text("%d triangles", (int)mesh.triangleSize);
+    ImGui::Text("BVH SAH cost: %.2f", scene.computeSAHCost(&mesh - scene.meshes.data()));
     if (ImGui::BeginCombo(
         "Material",
         (int)mesh.materialId == -1 ? "None" : scene.materialNames[(int)mesh.materialId].c_str()))
@@ -720,6 +739,69 @@ void UI::propertySceneMenu()
         renderer.clear();
     }
 
+    int russianRouletteDepth = renderer.russianRouletteDepth;
+    if (ImGui::DragInt("Russian roulette depth", &russianRouletteDepth, .01f, 0, 1000))
+    {
+        renderer.russianRouletteDepth = russianRouletteDepth;
+        renderer.clear();
+    }
+
+    ImGui::SameLine();
+    ImGui::TextDisabled("(?)");
+    if (ImGui::BeginItemTooltip())
+    {
+        ImGui::Text("Past this bounce the dim paths are randomly terminated without biasing the image, 0 disables Russian roulette");
+        ImGui::EndTooltip();
+    }
+
+    // Reading the length back waits for the queued frames, so it is only refreshed once per second
+    if (renderer.russianRouletteDepth > 0)
+    {
+        this->averagePathLengthTime += ImGui::GetIO().DeltaTime;
+        if (this->averagePathLengthTime >= 1)
+        {
+            this->averagePathLength = renderer.getAveragePathLength();
+            this->averagePathLengthTime = 0;
+        }
+
+        ImGui::Text("Average path length: %.2f", this->averagePathLength);
+    }
+
+    const char* backendNames[] = { "Fragment", "Wavefront" };
+    if (ImGui::BeginCombo("Backend", backendNames[(int)renderer.backend]))
+    {
+        if (ImGui::Selectable(backendNames[0], renderer.backend == Renderer::Backend::Fragment))
+        {
+            renderer.backend = Renderer::Backend::Fragment;
+        }
+
+        // The wavefront backend runs on compute shaders
+        ImGui::BeginDisabled(!GLEW_VERSION_4_3);
+        if (ImGui::Selectable(backendNames[1], renderer.backend == Renderer::Backend::Wavefront))
+        {
+            renderer.backend = Renderer::Backend::Wavefront;
+        }
+
+        ImGui::EndDisabled();
+        ImGui::EndCombo();
+    }
+
+    const char* samplerNames[] = { "Random", "Sobol", "Blue noise" };
+    if (ImGui::BeginCombo("Sampler", samplerNames[(int)renderer.sampler]))
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            // The accumulated samples were drawn from the previous sequence
+            if (ImGui::Selectable(samplerNames[i], renderer.sampler == (Sampler)i) && renderer.sampler != (Sampler)i)
+            {
+                renderer.sampler = (Sampler)i;
+                renderer.clear();
+            }
+        }
+
+        ImGui::EndCombo();
+    }
+
     int perFrameCount = this->app->perFrameCount;
     if (ImGui::DragInt("Render per frame", &perFrameCount, .1f, 1, 10000))
     {
@@ -740,6 +822,53 @@ void UI::propertySceneMenu()
         renderer.clear();
     }
 
+    int adaptiveMinFrameCount = renderer.adaptiveMinFrameCount;
+    if (ImGui::DragFloat("Adaptive threshold", &renderer.adaptiveThreshold, .001f, 0, 1, "%.3f") |
+        ImGui::DragInt("Adaptive min frames", &adaptiveMinFrameCount, .1f, 2, 10000))
+    {
+        renderer.adaptiveMinFrameCount = adaptiveMinFrameCount;
+        renderer.clear();
+    }
+
+    ImGui::SameLine();
+    ImGui::TextDisabled("(?)");
+    if (ImGui::BeginItemTooltip())
+    {
+        ImGui::Text("Pixels whose relative error falls below the threshold stop being sampled, 0 disables adaptive sampling");
+        ImGui::EndTooltip();
+    }
+
+    // Reading the ratio back waits for the queued frames, so it is only refreshed once per second
+    if (renderer.adaptiveThreshold > 0)
+    {
+        this->convergedRatioTime += ImGui::GetIO().DeltaTime;
+        if (this->convergedRatioTime >= 1)
+        {
+            this->convergedRatio = renderer.getConvergedRatio();
+            this->convergedRatioTime = 0;
+        }
+
+        ImGui::Text("Converged: %.1f%%", 100 * this->convergedRatio);
+    }
+
+    ImGui::Text("BVH memory: %.1f KiB", this->app->scene.getBVHMemorySize() / 1024.f);
+    ImGui::Text("Texture memory: %.1f MiB", renderer.getTextureMemorySize() / 1048576.f);
+
+    const Scene::LoadTimings& timings = this->app->scene.loadTimings;
+    ImGui::Text("Load time: %.2fs", timings.cache + timings.parse + timings.textureDecode + timings.textureConversion + timings.geometry + timings.bvh);
+    ImGui::SameLine();
+    ImGui::TextDisabled("(?)");
+    if (ImGui::BeginItemTooltip())
+    {
+        ImGui::Text("Cache: %.0fms", timings.cache * 1000);
+        ImGui::Text("Parse: %.0fms", timings.parse * 1000);
+        ImGui::Text("Texture decode: %.0fms", timings.textureDecode * 1000);
+        ImGui::Text("Texture conversion: %.0fms", timings.textureConversion * 1000);
+        ImGui::Text("Geometry: %.0fms", timings.geometry * 1000);
+        ImGui::Text("BVH: %.0fms", timings.bvh * 1000);
+        ImGui::EndTooltip();
+    }
+
     ImGui::Separator();
     if (ImGui::Checkbox("Enable preview", &this->app->enablePreview) & renderer.getFrameCount() == 1)
     {
@@ -756,6 +885,13 @@ void UI::propertySceneMenu()
     {
         renderer.denoise();
     }
+
+    ImGui::Checkbox("Denoise in background", &this->app->enableAsyncDenoise);
+
+    if (renderer.getDenoiseTime() > 0)
+    {
+        ImGui::Text("Denoise time: %4.0fms", 1000 * renderer.getDenoiseTime());
+    }
 #endif
 }
 
@@ -30,6 +30,13 @@ private:
     ImGuizmo::OPERATION operation = ImGuizmo::OPERATION::TRANSLATE;
     ImGuizmo::MODE mode = ImGuizmo::MODE::WORLD;
     TracerX::core::Texture textureView;
+    unsigned int sampleRateFrameCount = 0;
+    float sampleRateTime = 0;
+    float sampleRate = 0;
+    float convergedRatioTime = 1;
+    float convergedRatio = 0;
+    float averagePathLengthTime = 1;
+    float averagePathLength = 0;
 
     void barMenu();
     void mainWindowMenu();
@@ -0,0 +1,167 @@
+#include <TracerX/Scene.h>
+#include <TracerX/Renderer.h>
+#include <TracerX/CPURenderer.h>
+
+#include <cmath>
+#include <chrono>
+#include <string>
+#include <iostream>
+#include <GLFW/glfw3.h>
+
+using namespace std;
+using namespace TracerX;
+
+GLFWwindow* createWindow()
+{
+    glfwInit();
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow* window = glfwCreateWindow(1, 1, "", nullptr, nullptr);
+    glfwMakeContextCurrent(window);
+    return window;
+}
+
+double elapsedSeconds(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+template <typename R>
+void setupRenderer(R& renderer, const Scene& scene, float cameraDistance)
+{
+    renderer.camera.position = glm::vec3(0, 0, cameraDistance);
+    if (!scene.cameras.empty())
+    {
+        renderer.camera = scene.cameras[0];
+    }
+
+    renderer.loadScene(scene);
+}
+
+BVHSettings layoutSettings(BVHSettings::Layout layout, unsigned int quantizationBits = 8)
+{
+    BVHSettings settings;
+    settings.layout = layout;
+    settings.quantizationBits = quantizationBits;
+    return settings;
+}
+
+void printDifference(const Image& first, const Image& second)
+{
+    double difference = 0;
+    double maxDifference = 0;
+    for (size_t i = 0; i < first.pixels.size(); i++)
+    {
+        double pixelDifference = abs(first.pixels[i] - second.pixels[i]);
+        difference += pixelDifference;
+        maxDifference = max(maxDifference, pixelDifference);
+    }
+
+    cout << "    Mean difference: " << difference / first.pixels.size() << endl;
+    cout << "    Max difference: " << maxDifference << endl;
+}
+
+void benchmarkLayout(const string& fileName, const BVHSettings& settings, const string& name, glm::uvec2 size, unsigned int sampleCount, float cameraDistance)
+{
+    Scene scene = Scene::loadGLTF(fileName, settings);
+
+    // The CPU renderer counts the rays and the visited nodes
+    CPURenderer cpuRenderer;
+    cpuRenderer.init(size);
+    setupRenderer(cpuRenderer, scene, cameraDistance);
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    cpuRenderer.render(sampleCount);
+    double cpuTime = elapsedSeconds(start);
+
+    size_t rayCount = cpuRenderer.getRayCount();
+    double visitsPerRay = (double)cpuRenderer.getNodeVisitCount() / rayCount;
+    Image cpuImage = cpuRenderer.getAccumulationImage();
+    cpuRenderer.shutdown();
+
+    // The GPU traces the same paths, so it traces the same number of rays
+    Renderer renderer;
+    renderer.init(size);
+    setupRenderer(renderer, scene, cameraDistance);
+    renderer.render();
+    renderer.clear();
+    renderer.synchronize();
+
+    // The frames are only submitted by render, the clock stops once the GPU finished them
+    start = chrono::steady_clock::now();
+    renderer.render(sampleCount);
+    renderer.synchronize();
+    double gpuTime = elapsedSeconds(start);
+    Image gpuImage = renderer.getAccumulationImage();
+    renderer.shutdown();
+
+    cout << name << endl;
+    cout << "    BVH memory: " << scene.getBVHMemorySize() / 1024. << " KiB" << endl;
+    cout << "    Node visits per ray: " << visitsPerRay << endl;
+    cout << "    CPU: " << rayCount / cpuTime / 1e6 << " Mrays/s" << endl;
+    cout << "    GPU: " << rayCount / gpuTime / 1e6 << " Mrays/s" << endl;
+
+    // Both renderers trace the same paths, a large difference points at a broken layout
+    printDifference(cpuImage, gpuImage);
+}
+
+double renderBackend(Renderer& renderer, Renderer::Backend backend, unsigned int sampleCount)
+{
+    renderer.backend = backend;
+    renderer.render();
+    renderer.clear();
+    renderer.synchronize();
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    renderer.render(sampleCount);
+    renderer.synchronize();
+    return elapsedSeconds(start);
+}
+
+void benchmarkBackends(const string& fileName, glm::uvec2 size, unsigned int sampleCount, float cameraDistance)
+{
+    Scene scene = Scene::loadGLTF(fileName);
+
+    Renderer renderer;
+    renderer.init(size);
+    setupRenderer(renderer, scene, cameraDistance);
+
+    double fragmentTime = renderBackend(renderer, Renderer::Backend::Fragment, sampleCount);
+    Image fragmentImage = renderer.getAccumulationImage();
+    double wavefrontTime = renderBackend(renderer, Renderer::Backend::Wavefront, sampleCount);
+    Image wavefrontImage = renderer.getAccumulationImage();
+    renderer.shutdown();
+
+    cout << "Backends" << endl;
+    cout << "    Fragment: " << sampleCount / fragmentTime << " samples/s" << endl;
+    cout << "    Wavefront: " << sampleCount / wavefrontTime << " samples/s" << endl;
+
+    // Both backends trace the same paths, only the rounding of the pixel coordinates may differ
+    printDifference(fragmentImage, wavefrontImage);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        cout << "Usage: Benchmark <scene.glb> [size] [samples] [camera distance]" << endl;
+        return 1;
+    }
+
+    string fileName = argv[1];
+    unsigned int size = argc > 2 ? stoi(argv[2]) : 256;
+    unsigned int sampleCount = argc > 3 ? stoi(argv[3]) : 16;
+    float cameraDistance = argc > 4 ? stof(argv[4]) : 3;
+
+    GLFWwindow* window = createWindow();
+
+    cout << fileName << ", " << size << "x" << size << ", " << sampleCount << " samples" << endl << endl;
+    benchmarkLayout(fileName, layoutSettings(BVHSettings::Layout::Binary), "Binary BVH", glm::uvec2(size), sampleCount, cameraDistance);
+    benchmarkLayout(fileName, layoutSettings(BVHSettings::Layout::Wide), "Wide BVH", glm::uvec2(size), sampleCount, cameraDistance);
+    benchmarkLayout(fileName, layoutSettings(BVHSettings::Layout::Quantized, 8), "Quantized BVH (8 bits)", glm::uvec2(size), sampleCount, cameraDistance);
+    benchmarkLayout(fileName, layoutSettings(BVHSettings::Layout::Quantized, 16), "Quantized BVH (16 bits)", glm::uvec2(size), sampleCount, cameraDistance);
+    benchmarkBackends(fileName, glm::uvec2(size), sampleCount, cameraDistance);
+
+    glfwDestroyWindow(window);
+    glfwTerminate();
+    return 0;
+}
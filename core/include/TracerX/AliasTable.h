@@ -0,0 +1,21 @@
+/**
+ * @file AliasTable.h
+ */
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+namespace TracerX::core
+{
+
+class AliasTable
+{
+public:
+    std::vector<float> probabilities;
+    std::vector<int> aliases;
+
+    void build(const std::vector<double>& weights);
+};
+
+}
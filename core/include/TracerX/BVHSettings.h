@@ -0,0 +1,118 @@
+/**
+ * @file BVHSettings.h
+ */
+#pragma once
+
+namespace TracerX
+{
+
+/**
+ * @brief Represents the settings used to build the bounding volume hierarchies of the meshes.
+ * @see Scene::loadGLTF
+ */
+struct BVHSettings
+{
+    /**
+     * @brief The algorithms used to split the nodes of the hierarchy.
+     */
+    enum class Strategy
+    {
+        /**
+         * @brief Splits at the centroid midpoint of the longest axis. Fast to build.
+         */
+        Midpoint,
+
+        /**
+         * @brief Splits at the cheapest plane according to the binned surface area heuristic. Faster to traverse.
+         */
+        SAH,
+    };
+
+    /**
+     * @brief The node layouts of the hierarchy, as uploaded to the renderers.
+     */
+    enum class Layout
+    {
+        /**
+         * @brief Every node has two children, the bounds of a node are stored in the node itself.
+         * 
+         * The node offsets and primitive ranges are stored as floats, so they are only exact up to 2^24.
+         */
+        Binary,
+
+        /**
+         * @brief Every node has up to four children, collapsed from the binary tree.
+         * 
+         * The bounds of the children are stored together in their parent,
+         * so a single node fetch tests four boxes and the tree is half as deep.
+         * Like the binary layout, the node offsets and primitive ranges are only exact up to 2^24.
+         */
+        Wide,
+
+        /**
+         * @brief Same tree as the wide layout, with the bounds of the children quantized.
+         * 
+         * The bounds of the children are stored as 8 or 16-bit offsets inside the box of their parent,
+         * the primitive ranges and child offsets are stored as integers, so they stay exact in the largest scenes.
+         * Uses about half of the memory of the wide layout with 8 bits.
+         * 
+         * @see BVHSettings::quantizationBits
+         */
+        Quantized,
+    };
+
+    /**
+     * @brief The algorithm used to split the nodes.
+     */
+    Strategy strategy = Strategy::SAH;
+
+    /**
+     * @brief The node layout of the hierarchy.
+     */
+    Layout layout = Layout::Binary;
+
+    /**
+     * @brief The number of bits per child bound coordinate of the quantized layout, either 8 or 16.
+     */
+    unsigned int quantizationBits = 8;
+
+    /**
+     * @brief The number of bins evaluated per axis by the SAH strategy.
+     */
+    unsigned int binCount = 16;
+
+    /**
+     * @brief The cost of traversing a node, relative to the cost of intersecting a triangle.
+     * 
+     * Used by the SAH strategy and by Scene::computeSAHCost.
+     */
+    float traversalCost = 1;
+
+    /**
+     * @brief The cost of intersecting a triangle.
+     * 
+     * Used by the SAH strategy and by Scene::computeSAHCost.
+     */
+    float intersectionCost = 1;
+
+    /**
+     * @brief The maximum number of triangles in a leaf.
+     * 
+     * The SAH strategy may create smaller leaves. The midpoint strategy always uses 4.
+     */
+    unsigned int maxLeafSize = 4;
+
+    /**
+     * @brief The number of threads used to build the hierarchies. Use 0 to share the pool of all hardware threads used to load the scenes.
+     * 
+     * The meshes are built concurrently, the result does not depend on the number of threads.
+     */
+    unsigned int threadCount = 0;
+
+    /**
+     * @brief The number of triangles above which the subtrees of a node are built concurrently.
+     */
+    unsigned int parallelThreshold = 65536;
+};
+
+}
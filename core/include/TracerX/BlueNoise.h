@@ -0,0 +1,21 @@
+/**
+ * @file BlueNoise.h
+ */
+#pragma once
+
+#include <vector>
+
+namespace TracerX::core
+{
+
+class BlueNoise
+{
+public:
+    static const unsigned int size = 64;
+
+    static const std::vector<float>& getMask();
+private:
+    static std::vector<float> generate();
+};
+
+}
@@ -15,6 +15,7 @@ class Buffer
 public:
     void init(GLenum internalFormat);
     void update(const std::vector<T>& data);
+    void update(const std::vector<T>& data, size_t begin, size_t end);
     void bind(int binding);
     void shutdown();
 private:
@@ -26,6 +27,7 @@ private:
 template <class T>
 void Buffer<T>::init(GLenum internalFormat)
 {
+    this->size = 0;
     glPixelStorei(GL_PACK_ALIGNMENT, 1);
 
     glGenBuffers(1, &this->handler);
@@ -57,6 +59,25 @@ void Buffer<T>::update(const std::vector<T>& data)
     glBindBuffer(GL_TEXTURE_BUFFER, 0);
 }
 
+template <class T>
+void Buffer<T>::update(const std::vector<T>& data, size_t begin, size_t end)
+{
+    if (this->size != sizeof(T) * data.size())
+    {
+        this->update(data);
+        return;
+    }
+
+    if (begin >= end)
+    {
+        return;
+    }
+
+    glBindBuffer(GL_TEXTURE_BUFFER, this->handler);
+    glBufferSubData(GL_TEXTURE_BUFFER, sizeof(T) * begin, sizeof(T) * (end - begin), data.data() + begin);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
 template <class T>
 void Buffer<T>::bind(int binding)
 {
@@ -0,0 +1,306 @@
+/**
+ * @file CPURenderer.h
+ */
+#pragma once
+
+#include "Mesh.h"
+#include "Image.h"
+#include "Scene.h"
+#include "Camera.h"
+#include "Vertex.h"
+#include "Sampler.h"
+#include "Material.h"
+#include "Triangle.h"
+#include "ThreadPool.h"
+#include "Environment.h"
+
+#include <atomic>
+#include <vector>
+#include <glm/glm.hpp>
+
+namespace TracerX
+{
+
+/**
+ * @brief Represents a path tracer running on the CPU.
+ * 
+ * The CPU renderer is a C++ port of the accumulator shader used by the Renderer.
+ * It takes the same scene, camera, environment and material data and produces the same
+ * accumulation, albedo and normal buffers, without requiring OpenGL or a GPU.
+ * 
+ * The image is split into square tiles, the tiles are distributed over a work-stealing thread pool.
+ * Every pixel uses the same random sequence as the shader, so the output can be compared with the
+ * GPU output pixel by pixel.
+ * 
+ * @see CPURenderer::init
+ * @see CPURenderer::render
+ * @see CPURenderer::shutdown
+ */
+class CPURenderer
+{
+public:
+    /**
+     * @brief The camera used for rendering.
+     */
+    Camera camera;
+
+    /**
+     * @brief The maximum number of times a ray can bounce in the scene.
+     */
+    unsigned int maxBounceCount = 5;
+
+    /**
+     * @brief The gamma correction value used in tone mapping.
+     */
+    float gamma = 2.2f;
+
+    /**
+     * @brief The minimum distance for rendering objects.
+     */
+    float minRenderDistance = .0001f;
+
+    /**
+     * @brief The maximum distance for rendering objects.
+     */
+    float maxRenderDistance = 1000000;
+
+    /**
+     * @brief The relative error below which a pixel stops being sampled. Use 0 to sample every pixel in every frame.
+     * 
+     * The error is the standard error of the mean luminance of a pixel, divided by its mean luminance.
+     * Converged pixels keep their mean, so they cost almost nothing and the image stays consistent.
+     * 
+     * @see CPURenderer::getConvergedRatio
+     */
+    float adaptiveThreshold = 0;
+
+    /**
+     * @brief The number of frames a pixel is sampled before its error is estimated.
+     */
+    unsigned int adaptiveMinFrameCount = 16;
+
+    /**
+     * @brief The sequence the random numbers of the paths are drawn from.
+     */
+    Sampler sampler = Sampler::Sobol;
+
+    /**
+     * @brief The number of bounces after which the paths are randomly terminated. Use 0 to disable Russian roulette.
+     * 
+     * A path survives with the probability of its brightest throughput channel and is weighted up when it does,
+     * so the image keeps its mean while the dim paths stop early.
+     * 
+     * @see CPURenderer::getAveragePathLength
+     */
+    unsigned int russianRouletteDepth = 3;
+
+    /**
+     * @brief The size of the square tiles the image is split into.
+     */
+    unsigned int tileSize = 16;
+
+    /**
+     * @brief The environment settings for the scene.
+     * @see Environment::loadFromFile to load an environment from a file.
+     */
+    Environment environment;
+
+    /**
+     * @brief Initializes the renderer with the specified size.
+     * 
+     * Must be called before any other method. Starts the worker threads.
+     * 
+     * @param size The size of the renderer.
+     * @param threadCount The number of worker threads. Use 0 to use all hardware threads.
+     */
+    void init(glm::uvec2 size, unsigned int threadCount = 0);
+
+    /**
+     * @brief Resizes the renderer to the specified size.
+     * @param size The new size of the renderer.
+     */
+    void resize(glm::uvec2 size);
+
+    /**
+     * @brief Shuts down the renderer and stops the worker threads.
+     */
+    void shutdown();
+
+    /**
+     * @brief Renders the scene.
+     * 
+     * Renders the scene using CPURenderer::accumulate and CPURenderer::toneMap.
+     * 
+     * @param count The number of frames to render.
+     * @see CPURenderer::renderRect to render only a rectangular region of the image.
+     */
+    void render(unsigned int count = 1);
+
+    /**
+     * @brief Renders a rectangular region of the image.
+     * @param count The number of frames to render.
+     * @param position The position of the bottom-left corner of the region.
+     * @param size The size of the region.
+     * @see CPURenderer::render to render the entire image.
+     */
+    void renderRect(unsigned int count, glm::uvec2 position, glm::uvec2 size);
+
+    /**
+     * @brief Accumulates the colors of the rendered image.
+     * 
+     * This method does not update the output image.
+     * The frame count is incremented.
+     * 
+     * @param count The number of frames to accumulate.
+     * @param position The position of the bottom-left corner of the region.
+     * @param size The size of the region. Use CPURenderer::getSize to accumulate the entire image.
+     * @see CPURenderer::toneMap to update the output image with the tone-mapped colors.
+     */
+    void accumulate(unsigned int count, glm::uvec2 position, glm::uvec2 size);
+
+    /**
+     * @brief Applies tone mapping to the accumulated colors.
+     * @param position The position of the bottom-left corner of the region.
+     * @param size The size of the region. Use CPURenderer::getSize to tone map the entire image.
+     */
+    void toneMap(glm::uvec2 position, glm::uvec2 size);
+
+    /**
+     * @brief Clears the accumulated colors and resets the frame count.
+     */
+    void clear();
+
+    /**
+     * @brief Gets the tone-mapped image.
+     * @return The rendered image.
+     */
+    Image getImage() const;
+
+    /**
+     * @brief Gets the accumulated colors.
+     * 
+     * Same layout as the accumulation texture of the Renderer: the sum of all frames, bottom row first.
+     * 
+     * @return The accumulation image.
+     */
+    Image getAccumulationImage() const;
+
+    /**
+     * @brief Gets the ratio of the pixels that stopped being sampled in the last frame.
+     * 
+     * Always 0 unless CPURenderer::adaptiveThreshold is set. The frame is converged when the ratio reaches 1.
+     * 
+     * @return The converged ratio, between 0 and 1.
+     */
+    float getConvergedRatio() const;
+
+    /**
+     * @brief Gets the average number of bounces of the paths accumulated since the last clear.
+     * 
+     * The pixels skipped by adaptive sampling are not counted.
+     * 
+     * @return The average path length.
+     */
+    float getAveragePathLength() const;
+
+    /**
+     * @brief Gets the albedo image of the last frame.
+     * @return The albedo image.
+     */
+    Image getAlbedoImage() const;
+
+    /**
+     * @brief Gets the normal image of the last frame.
+     * @return The normal image.
+     */
+    Image getNormalImage() const;
+
+    /**
+     * @brief Gets the size of the renderer.
+     * @return The size of the renderer.
+     */
+    glm::uvec2 getSize() const;
+
+    /**
+     * @brief Gets the frame count.
+     * @return The frame count.
+     */
+    unsigned int getFrameCount() const;
+
+    /**
+     * @brief Gets the number of rays traced since the last CPURenderer::clear.
+     * 
+     * Every bounce of a path and every shadow ray counts as a ray.
+     * 
+     * @return The number of rays.
+     */
+    size_t getRayCount() const;
+
+    /**
+     * @brief Gets the number of mesh BVH nodes visited since the last CPURenderer::clear.
+     * 
+     * Together with CPURenderer::getRayCount, measures the traversal cost of a BVH layout.
+     * 
+     * @return The number of visited nodes.
+     */
+    size_t getNodeVisitCount() const;
+
+    /**
+     * @brief Loads the specified scene into the renderer.
+     * 
+     * The scene data is copied, the scene can be destroyed afterwards.
+     * 
+     * @param scene The scene to load.
+     */
+    void loadScene(const Scene& scene);
+
+    /**
+     * @brief Updates the materials in the scene.
+     * @param scene The scene containing the updated materials.
+     */
+    void updateSceneMaterials(const Scene& scene);
+
+    /**
+     * @brief Updates the meshes in the scene.
+     * @param scene The scene containing the updated meshes.
+     */
+    void updateSceneMeshes(const Scene& scene);
+
+    /**
+     * @brief Updates the vertices and the bounding volume hierarchies refitted by Scene::refitBVH.
+     * 
+     * Only the ranges marked dirty in the scene are copied. The meshes are updated as well.
+     * 
+     * @param scene The scene containing the updated vertices.
+     */
+    void updateSceneVertices(const Scene& scene);
+private:
+    class PathTracer;
+
+    unsigned int frameCount = 0;
+    std::atomic<size_t> rayCount = 0;
+    std::atomic<size_t> nodeVisitCount = 0;
+    Image accumulation = Image::empty;
+    Image albedo = Image::empty;
+    Image normal = Image::empty;
+    Image moments = Image::empty;
+    Image output = Image::empty;
+    core::ThreadPool threadPool;
+    std::vector<core::Vertex> vertices;
+    std::vector<core::Triangle> triangles;
+    std::vector<Mesh> meshes;
+    std::vector<Material> materials;
+    std::vector<Image> textures;
+    std::vector<std::vector<Image>> textureMipmaps;
+    std::vector<glm::vec3> bvh;
+    std::vector<glm::vec3> tlas;
+    std::vector<glm::vec4> lights;
+    std::vector<float> materialPowers;
+    std::vector<glm::uvec4> bvhData;
+    BVHSettings::Layout bvhLayout = BVHSettings::Layout::Binary;
+    unsigned int bvhQuantizationBits = 8;
+
+    void forEachTile(glm::uvec2 position, glm::uvec2 size, const std::function<void(glm::uvec2, glm::uvec2)>& func);
+};
+
+}
@@ -3,9 +3,12 @@
  */
 #pragma once
 
+#include "Image.h"
+#include "Buffer.h"
 #include "Texture.h"
 
 #include <string>
+#include <vector>
 #include <glm/glm.hpp>
 
 namespace TracerX
@@ -40,19 +43,34 @@ public:
     /**
      * @brief Resets the environment to its default state.
      * 
-     * This method sets the name of the environment to "None" and updates the texture with an empty black image.
+     * This method sets the name of the environment to "None" and replaces the image with an empty black one.
      */
     void reset();
 
     /**
      * @brief Loads environment data from a file.
+     * 
+     * The image and its mip chain are kept on the CPU, the renderer uploads them to the GPU before the next accumulation.
+     * A luminance distribution of the image is built in parallel alongside them, the renderers use it to sample
+     * the bright parts of the environment directly.
+     * Does not require an OpenGL context.
+     * 
      * @param fileName The name of the file to load the data from.
      */
     void loadFromFile(const std::string& fileName);
 private:
+    Image image = Image::empty;
+    std::vector<Image> mipmaps;
+    std::vector<glm::vec4> distribution = { glm::vec4(0) };
     core::Texture texture;
+    core::Buffer<glm::vec4> distributionBuffer;
+    bool textureOutdated = true;
 
     friend class Renderer;
+    friend class CPURenderer;
+
+    void initMipmaps();
+    void initDistribution();
 };
 
 }
@@ -20,17 +20,31 @@ public:
     Texture albedo;
     Texture normal;
     Texture toneMap;
+#ifdef TX_DENOISE
+    Texture denoised;
+#endif
+    Texture moments;
 
     void init();
     void resize(glm::uvec2 size);
     void shutdown();
     void use();
     void useRect(glm::uvec2 position, glm::uvec2 size);
+    void targetAccumulation();
+    void targetToneMap();
+#ifdef TX_DENOISE
+    void targetDenoised();
+#endif
     void clear();
+    float getConvergedRatio() const;
+    float getAveragePathLength() const;
 
+    static void barrier();
     static void stopUse(); 
 private:
     GLuint handler;
+
+    glm::dvec4 sumMoments() const;
 };
 
 }
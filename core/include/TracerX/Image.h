@@ -29,6 +29,14 @@ public:
      */
     std::vector<float> pixels;
 
+    /**
+     * @brief The 8-bit pixel data of the image, for images decoded from 8-bit sources.
+     * 
+     * Stored in the same order as Image::pixels, which stays empty, so the values are uploaded without conversion.
+     * Use Image::toFloat to get the float pixel data of either kind of image.
+     */
+    std::vector<unsigned char> bytes;
+
     /**
      * @brief An empty image.
      */
@@ -47,6 +55,21 @@ public:
      */
     Image resize(glm::uvec2 size) const;
 
+    /**
+     * @brief Halves the size of the image with a box filter.
+     * 
+     * Used to build mip chains. Odd sizes are rounded down, the last row or column is repeated.
+     * 
+     * @return The downsampled image, at least 1x1.
+     */
+    Image downsample() const;
+
+    /**
+     * @brief Converts the 8-bit pixel data to float pixel data.
+     * @return The image with float pixel data, a copy of the image if it already has float pixel data.
+     */
+    Image toFloat() const;
+
     /**
      * @brief Loads an image from a file.
      * @param fileName The name of the file to load the image from.
@@ -64,6 +87,16 @@ public:
      * @return The loaded image.
      */
     static Image loadFromMemory(glm::uvec2 size, const std::vector<float> pixels);
+
+    /**
+     * @brief Loads an image from 8-bit pixel data in memory.
+     * @param size The size of the image.
+     * @param bytes The 8-bit pixel data of the image.
+     * @remark The pixel data is stored in the order red, green, blue, alpha.
+     * @remark The size of the array must be size.x * size.y * 4.
+     * @return The loaded image.
+     */
+    static Image loadFromMemory(glm::uvec2 size, const std::vector<unsigned char> bytes);
 private:
     Image();
 };
@@ -0,0 +1,28 @@
+/**
+ * @file MappedFile.h
+ */
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+namespace TracerX::core
+{
+
+class MappedFile
+{
+public:
+    void init(const std::string& fileName);
+    void shutdown();
+    const unsigned char* getData() const;
+    size_t getSize() const;
+private:
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    void* file = nullptr;
+    void* mapping = nullptr;
+#endif
+};
+
+}
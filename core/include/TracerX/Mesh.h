@@ -3,6 +3,7 @@
  */
 #pragma once
 
+#include <cstdint>
 #include <glm/glm.hpp>
 
 namespace TracerX
@@ -10,6 +11,9 @@ namespace TracerX
 
 /**
  * @brief Represents a mesh in the TracerX system.
+ * 
+ * A mesh is an instance of its geometry: meshes loaded from the same GLTF primitive data
+ * share their triangles and bounding volume hierarchy, only the transform and the material differ.
  */
 struct Mesh
 {
@@ -35,18 +39,18 @@ public:
      */
     float materialId = -1;
 private:
-    float nodeOffset = 0;
-    float triangleOffset = 0;
+    uint32_t nodeOffset = 0;
+    uint32_t triangleOffset = 0;
 public:
     /**
-     * @brief The size of the triangles in the mesh.
+     * @brief The number of triangles in the mesh.
      * 
-     * Optional, does not affect the rendering of the mesh.
-     * Float value to avoid padding issues.
+     * Set by the scene loader, the hierarchy of the mesh is built over this many triangles.
      */
-    float triangleSize = 0;
+    uint32_t triangleSize = 0;
 
     friend class Scene;
+    friend class CPURenderer;
 };
 
 }
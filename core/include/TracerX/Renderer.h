@@ -10,14 +10,22 @@
 #include "Camera.h"
 #include "Buffer.h"
 #include "Vertex.h"
+#include "Sampler.h"
 #include "Material.h"
 #include "Triangle.h"
 #include "Environment.h"
 #include "FrameBuffer.h"
-#include "TextureArray.h"
+#include "TextureAtlas.h"
+#include "UniformBuffer.h"
+#include "WavefrontTracer.h"
 
 #include <vector>
 #include <glm/glm.hpp>
+#ifdef TX_DENOISE
+#include <chrono>
+#include <future>
+#include <OpenImageDenoise/oidn.hpp>
+#endif
 
 namespace TracerX
 {
@@ -47,6 +55,26 @@ namespace TracerX
 class Renderer
 {
 public:
+    /**
+     * @brief The ways of running the path tracing on the GPU.
+     */
+    enum class Backend
+    {
+        /**
+         * @brief A fragment shader drawn over the image traces the whole path of every pixel.
+         */
+        Fragment,
+
+        /**
+         * @brief Compute shaders run the ray generation, the intersection, the material evaluation, the shadow rays and the accumulation as separate stages.
+         * 
+         * The stages are linked by queues of the paths still bouncing and of the shadow rays of the light samples, so the threads
+         * of a stage run the same code instead of diverging over the materials and the traversal loops. Produces the same images as the fragment backend.
+         * Requires OpenGL 4.3.
+         */
+        Wavefront,
+    };
+
     /**
      * @brief The camera used for rendering.
      */
@@ -72,12 +100,47 @@ public:
      */
     float maxRenderDistance = 1000000;
 
+    /**
+     * @brief The relative error below which a pixel stops being sampled. Use 0 to sample every pixel in every frame.
+     * 
+     * The error is the standard error of the mean luminance of a pixel, divided by its mean luminance.
+     * Converged pixels keep their mean, so they cost almost nothing and the image stays consistent.
+     * 
+     * @see Renderer::getConvergedRatio
+     */
+    float adaptiveThreshold = 0;
+
+    /**
+     * @brief The number of frames a pixel is sampled before its error is estimated.
+     */
+    unsigned int adaptiveMinFrameCount = 16;
+
+    /**
+     * @brief The sequence the random numbers of the paths are drawn from.
+     */
+    Sampler sampler = Sampler::Sobol;
+
+    /**
+     * @brief The number of bounces after which the paths are randomly terminated. Use 0 to disable Russian roulette.
+     * 
+     * A path survives with the probability of its brightest throughput channel and is weighted up when it does,
+     * so the image keeps its mean while the dim paths stop early.
+     * 
+     * @see Renderer::getAveragePathLength
+     */
+    unsigned int russianRouletteDepth = 3;
+
     /**
      * @brief The environment settings for the scene.
      * @see Environment::loadFromFile to load an environment from a file.
      */
     Environment environment;
 
+    /**
+     * @brief The way the path tracing runs on the GPU.
+     */
+    Backend backend = Backend::Fragment;
+
     /**
      * @brief Initializes the renderer with the specified size.
      * 
@@ -134,6 +197,9 @@ public:
      * The frame count is incremented.
      * Can be used in motion blur to accumulate colors over a period of time.
      * 
+     * The frames are submitted as one batch and the method returns without waiting for the GPU.
+     * It only waits for the batch submitted by the previous call, so at most one batch is in flight.
+     * 
      * @param count The number of frames to accumulate.
      * @param position The position of the top-left corner of the region.
      * @param size The size of the region. Use Renderer::getSize to accumulate the entire image.
@@ -141,6 +207,13 @@ public:
      */
     void accumulate(unsigned int count, glm::uvec2 position, glm::uvec2 size);
 
+    /**
+     * @brief Waits until the GPU has finished the frames submitted by Renderer::accumulate.
+     * 
+     * Reading the images synchronizes implicitly, this is only needed to measure the rendering time.
+     */
+    void synchronize();
+
     /**
      * @brief Applies tone mapping to the accumulated colors.
      * 
@@ -154,8 +227,63 @@ public:
 #ifdef TX_DENOISE
     /**
      * @brief Applies denoising to the rendered image.
+     * 
+     * The denoising device, buffers and filter are created by the first call and reused by the next ones.
+     * They are only recreated when the size of the renderer changes.
+     * 
+     * @see Renderer::getDenoiseTime to get the duration of the last call.
      */
     void denoise();
+
+    /**
+     * @brief Starts denoising the rendered image on a background thread.
+     * 
+     * The accumulated colors, albedo and normal images are copied, then the copy is denoised while
+     * the renderer keeps accumulating. The accumulated colors are not modified, the result is tone mapped
+     * into a separate texture by Renderer::pollDenoise.
+     * Does nothing if a denoise is already running.
+     * 
+     * @see Renderer::getDenoisedTextureHandler to display the result.
+     */
+    void denoiseAsync();
+
+    /**
+     * @brief Publishes the result of the background denoise started by Renderer::denoiseAsync, if it has finished.
+     * 
+     * Must be called regularly, for instance once per frame, from the thread owning the OpenGL context.
+     * The result is discarded if the renderer was cleared since the denoise started.
+     * 
+     * @return True if a new denoised image was published.
+     */
+    bool pollDenoise();
+
+    /**
+     * @brief Checks whether a background denoise is running or waiting to be published.
+     * @return True if Renderer::denoiseAsync cannot start a new denoise yet.
+     */
+    bool isDenoising() const;
+
+    /**
+     * @brief Gets the OpenGL texture handler for the denoised image published by Renderer::pollDenoise.
+     * @return The texture handler.
+     */
+    GLuint getDenoisedTextureHandler() const;
+
+    /**
+     * @brief Gets the number of frames accumulated in the published denoised image.
+     * @return The frame count, or zero if no image was published since the last Renderer::clear.
+     */
+    unsigned int getDenoisedFrameCount() const;
+
+    /**
+     * @brief Gets the duration of the last denoise.
+     * 
+     * Includes reading the images from the GPU and writing the result back.
+     * For Renderer::denoiseAsync, this is the time between the start and the publication of the result.
+     * 
+     * @return The duration in seconds.
+     */
+    float getDenoiseTime() const;
 #endif
 
     /**
@@ -189,6 +317,59 @@ public:
      */
     Image getImage() const;
 
+    /**
+     * @brief Loads the accumulated colors from the GPU to the CPU.
+     * 
+     * Same layout as CPURenderer::getAccumulationImage: the sum of all frames, bottom row first.
+     * 
+     * @return The accumulation image.
+     */
+    Image getAccumulationImage() const;
+
+    /**
+     * @brief Loads the accumulated colors of a rectangle from the GPU to the CPU.
+     * 
+     * Only the rectangle is read back, e.g. the tile rendered by Renderer::accumulate.
+     * 
+     * @param position The bottom left corner of the rectangle.
+     * @param size The size of the rectangle, it must fit in the image.
+     * @return The accumulation image of the rectangle, bottom row first.
+     */
+    Image getAccumulationImage(glm::uvec2 position, glm::uvec2 size) const;
+
+    /**
+     * @brief Gets the ratio of the pixels that stopped being sampled in the last frame.
+     * 
+     * Always 0 unless Renderer::adaptiveThreshold is set. The frame is converged when the ratio reaches 1.
+     * The ratio is read back from the GPU, which waits for the queued frames.
+     * 
+     * @return The converged ratio, between 0 and 1.
+     */
+    float getConvergedRatio() const;
+
+    /**
+     * @brief Gets the average number of bounces of the paths accumulated since the last clear.
+     * 
+     * The pixels skipped by adaptive sampling are not counted.
+     * The length is read back from the GPU, which waits for the queued frames.
+     * 
+     * @return The average path length.
+     */
+    float getAveragePathLength() const;
+
+    /**
+     * @brief Replaces the accumulated colors, e.g. with the tiles accumulated by other renderers.
+     * 
+     * The output image is not updated, call Renderer::toneMap afterwards.
+     * The variance estimates used by adaptive sampling are reset, so the pixels are sampled again
+     * until the new estimates show them converged on their own.
+     * 
+     * @param image The accumulation image, its size must be the size of the renderer and it must have float pixels.
+     * @param frameCount The number of frames summed in the image.
+     * @throws std::runtime_error Thrown if the size of the image is not the size of the renderer or its float pixels are missing.
+     */
+    void loadAccumulationImage(const Image& image, unsigned int frameCount);
+
     /**
      * @brief Gets the size of the renderer.
      * 
@@ -207,13 +388,27 @@ public:
      */
     unsigned int getFrameCount() const;
 
+    /**
+     * @brief Gets the GPU memory used by the textures of the loaded scene.
+     * @return The size in bytes.
+     */
+    size_t getTextureMemorySize() const;
+
     /**
      * @brief Loads the specified scene into the renderer.
      * 
      * Use this method to load the entire scene into the renderer.
      * 
+     * The textures keep their resolution and are packed into atlas pages. Textures holding 8-bit values
+     * are stored with 8 bits per channel, the other ones as half floats.
+     * 
+     * The emissive triangles are gathered into a light list, Lambertian bounces sample a point on one of them
+     * picked in proportion to its power and weight it against the bounce direction with multiple importance sampling.
+     * The list is rebuilt when the materials or the meshes are updated, but the emitted power of the materials,
+     * which averages their emission textures, is only computed again when the materials are.
+     * 
      * @param scene The scene to load.
-     * @param texturesSize The size of textures in the scene.
+     * @param texturesSize The maximum size of the textures in the scene. Larger textures are downscaled.
      * @see Renderer::updateSceneMaterials to update only the materials.
      * @see Renderer::updateSceneMeshes to update only the meshes.
      */
@@ -238,24 +433,98 @@ public:
      * @see Renderer::loadScene to update the entire scene.
      */
     void updateSceneMeshes(const Scene& scene);
+
+    /**
+     * @brief Updates the vertices and the bounding volume hierarchies refitted by Scene::refitBVH.
+     * 
+     * Only the ranges marked dirty in the scene are uploaded. The meshes are updated as well,
+     * since their bounds changed.
+     * 
+     * @param scene The scene containing the updated vertices.
+     * @see Scene::clearDirtyRanges
+     */
+    void updateSceneVertices(const Scene& scene);
 private:
+    // std140 layout of the Settings uniform block of the accumulator shader
+    struct Settings
+    {
+        glm::vec3 cameraPosition;
+        float padding0;
+        glm::vec3 cameraForward;
+        float padding1;
+        glm::vec3 cameraUp;
+        float cameraFOV;
+        float cameraFocalDistance;
+        float cameraAperture;
+        float cameraBlur;
+        float padding2;
+        unsigned int environmentTransparent;
+        float environmentIntensity;
+        float padding3[2];
+        glm::vec4 environmentRotation[3];
+        unsigned int maxBounceCount;
+        float minRenderDistance;
+        float maxRenderDistance;
+        unsigned int bvhLayout;
+        unsigned int bvhQuantizationBits;
+        float gamma;
+        float adaptiveThreshold;
+        unsigned int adaptiveMinFrameCount;
+        unsigned int sampler;
+        unsigned int russianRouletteDepth;
+        float padding4[2];
+    };
+
+    static_assert(sizeof(Settings) == 176, "Settings must match the std140 layout of the shader");
+
     unsigned int frameCount = 0;
+    GLsync accumulationFence = nullptr;
+    BVHSettings::Layout bvhLayout = BVHSettings::Layout::Binary;
+    unsigned int bvhQuantizationBits = 8;
     core::Quad quad;
     core::Shader accumulatorShader;
     core::Shader toneMapperShader;
+    core::UniformBuffer<Settings> settingsBuffer;
+    core::WavefrontTracer wavefrontTracer;
+    GLint frameCountLocation = -1;
     core::FrameBuffer frameBuffer;
-    core::TextureArray textureArray;
+    core::TextureAtlas textureAtlas;
     core::Buffer<core::Vertex> vertexBuffer;
     core::Buffer<core::Triangle> triangleBuffer;
     core::Buffer<Mesh> meshBuffer;
+    core::Buffer<glm::uvec4> meshOffsetBuffer;
     core::Buffer<Material> materialBuffer;
     core::Buffer<glm::vec3> bvhBuffer;
+    core::Buffer<glm::vec3> tlasBuffer;
+    core::Buffer<glm::uvec4> bvhDataBuffer;
+    core::Buffer<glm::vec4> lightBuffer;
+    std::vector<float> materialPowers;
+    core::Buffer<float> blueNoiseBuffer;
+#ifdef TX_DENOISE
+    oidn::DeviceRef denoiseDevice;
+    oidn::FilterRef denoiseFilter;
+    oidn::BufferRef denoiseColorBuffer;
+    oidn::BufferRef denoiseAlbedoBuffer;
+    oidn::BufferRef denoiseNormalBuffer;
+    glm::uvec2 denoiseSize = glm::uvec2(0);
+    float denoiseTime = 0;
+    core::Texture denoiseAccumulation;
+    std::future<bool> denoiseTask;
+    std::chrono::steady_clock::time_point denoiseStart;
+    unsigned int denoiseFrameCount = 0;
+    unsigned int denoisedFrameCount = 0;
+    bool denoiseOutdated = false;
+#endif
 
     static const char* accumulatorShaderSrc;
     static const char* toneMapperShaderSrc;
     static const char* vertexShaderSrc;
 
     void initData();
+#ifdef TX_DENOISE
+    void initDenoiser();
+    void waitDenoise();
+#endif
 };
 
 }
@@ -0,0 +1,38 @@
+/**
+ * @file Sampler.h
+ */
+#pragma once
+
+namespace TracerX
+{
+
+/**
+ * @brief The sequences the renderers draw the random numbers of the paths from.
+ * 
+ * A sample takes its values in a fixed order of dimensions, the camera first and then a block per bounce,
+ * so that the same decisions of different samples of a pixel read the same dimension.
+ */
+enum class Sampler
+{
+    /**
+     * @brief Independent values from a PCG hash, seeded by the pixel and the frame.
+     */
+    Random,
+
+    /**
+     * @brief Owen-scrambled Sobol sequence, scrambled per pixel and indexed by the frame.
+     * 
+     * The samples of a pixel are stratified in every pair of dimensions, so the error falls faster than with independent values.
+     */
+    Sobol,
+
+    /**
+     * @brief Owen-scrambled Sobol sequence shared by all pixels and shifted per pixel by a blue noise mask.
+     * 
+     * Converges like the Sobol sampler, while the remaining error is spread as blue noise over the image.
+     * Looks smoother at low sample counts.
+     */
+    BlueNoise,
+};
+
+}
@@ -9,9 +9,14 @@
 #include "Vertex.h"
 #include "Material.h"
 #include "Triangle.h"
+#include "ThreadPool.h"
+#include "BVHSettings.h"
 
+#include <map>
+#include <array>
 #include <vector>
 #include <string>
+#include <ostream>
 #include <FastBVH.h>
 #include <glm/glm.hpp>
 #include <tiny_gltf.h>
@@ -25,6 +30,44 @@ namespace TracerX
 class Scene
 {
 public:
+    /**
+     * @brief The time spent in every stage of Scene::loadGLTF, in seconds.
+     */
+    struct LoadTimings
+    {
+        /**
+         * @brief Reading or writing the binary cache.
+         * 
+         * When Scene::loadGLTFCached finds a valid cache, the other stages are skipped and stay zero.
+         */
+        float cache = 0;
+
+        /**
+         * @brief Reading and parsing the file, the images are not decoded yet.
+         */
+        float parse = 0;
+
+        /**
+         * @brief Decoding the images, in parallel.
+         */
+        float textureDecode = 0;
+
+        /**
+         * @brief Converting the decoded images to the textures of the scene, in parallel.
+         */
+        float textureConversion = 0;
+
+        /**
+         * @brief Reading the materials, the meshes and the cameras.
+         */
+        float geometry = 0;
+
+        /**
+         * @brief Building the bounding volume hierarchies.
+         */
+        float bvh = 0;
+    };
+
     /**
      * @brief The vertices of the scene.
      */
@@ -39,6 +82,8 @@ public:
      * @brief The textures used in the scene.
      * 
      * The index of the texture in the vector is the texture ID used in the scene.
+     * Textures decoded from 8-bit images keep their values in Image::bytes and have no float Image::pixels,
+     * use Image::toFloat to read them as floats.
      */
     std::vector<Image> textures;
 
@@ -81,6 +126,11 @@ public:
      */
     std::string name = "Empty";
 
+    /**
+     * @brief The time spent loading the scene, filled by Scene::loadGLTF.
+     */
+    LoadTimings loadTimings;
+
     /**
      * @brief Loads a texture from a file and adds it to the scene.
      * @param fileName The name of the file containing the texture.
@@ -99,12 +149,86 @@ public:
     /**
      * @brief Loads a scene from a GLTF file.
      * @param fileName The name of the file to load the GLTF scene from.
+     * @param bvhSettings The settings used to build the bounding volume hierarchies of the meshes.
      * @return The loaded scene.
      * @throws std::runtime_error Thrown if the GLTF file fails to load.
      */
-    static Scene loadGLTF(const std::string& fileName);
+    static Scene loadGLTF(const std::string& fileName, const BVHSettings& bvhSettings = BVHSettings());
+
+    /**
+     * @brief Loads a scene from a GLTF file through a binary cache stored next to it.
+     * 
+     * The cache is named after the GLTF file with ".txcache" appended. It holds the loaded vertices, triangles,
+     * meshes, materials, cameras, textures and bounding volume hierarchies, and is memory-mapped when loading,
+     * so parsing, texture decoding and building the hierarchies are skipped.
+     * 8-bit textures are stored as bytes, as the Renderer uploads them.
+     * 
+     * The cache is rebuilt if it was written by another version, with other BVH settings, or for another source.
+     * The size and modification time of the GLTF file are compared first, its content hash is compared
+     * when only the time differs, e.g. after the file was copied.
+     * External buffers and images referenced by the GLTF file are not tracked.
+     * 
+     * @param fileName The name of the file to load the GLTF scene from.
+     * @param bvhSettings The settings used to build the bounding volume hierarchies of the meshes.
+     * @return The loaded scene.
+     * @throws std::runtime_error Thrown if the GLTF file fails to load.
+     */
+    static Scene loadGLTFCached(const std::string& fileName, const BVHSettings& bvhSettings = BVHSettings());
+
+    /**
+     * @brief Computes the surface area heuristic cost of the bounding volume hierarchy of a mesh.
+     * 
+     * The cost is the expected cost of tracing a ray that hits the root node of the mesh,
+     * lower values mean fewer traversal steps and triangle tests per ray.
+     * 
+     * @param meshId The index of the mesh in the meshes vector.
+     * @param traversalCost The cost of traversing a node.
+     * @param intersectionCost The cost of intersecting a triangle.
+     * @return The cost of the hierarchy.
+     */
+    float computeSAHCost(size_t meshId, float traversalCost = 1, float intersectionCost = 1) const;
+
+    /**
+     * @brief Gets the memory used by the bounding volume hierarchies of the meshes.
+     * 
+     * This is the size of the hierarchy buffers uploaded to the renderers,
+     * it depends on BVHSettings::layout and BVHSettings::quantizationBits.
+     * 
+     * @return The size in bytes.
+     */
+    size_t getBVHMemorySize() const;
+
+    /**
+     * @brief Refits the bounding volume hierarchy of a mesh to its vertices.
+     * 
+     * Call after moving the vertices of the mesh. The hierarchy keeps its structure, only the bounds
+     * of its nodes are updated, bottom-up. This is much faster than loading the scene again,
+     * but the hierarchy gets slower to traverse as the triangles move far from where they were built.
+     * 
+     * The vertices of the mesh and the nodes whose bounds changed are marked dirty,
+     * so Renderer::updateSceneVertices uploads only the dirty ranges.
+     * The meshes sharing the geometry of the mesh share its hierarchy, so they are refitted too.
+     * 
+     * @param meshId The index of the mesh in the meshes vector.
+     * @see Scene::clearDirtyRanges
+     */
+    void refitBVH(size_t meshId);
+
+    /**
+     * @brief Clears the ranges marked dirty by Scene::refitBVH.
+     * 
+     * Call once every renderer has been updated with Renderer::updateSceneVertices.
+     */
+    void clearDirtyRanges();
 private:
     std::vector<glm::vec3> bvh;
+    std::vector<glm::uvec4> bvhData;
+    BVHSettings::Layout bvhLayout = BVHSettings::Layout::Binary;
+    unsigned int bvhQuantizationBits = 8;
+    std::pair<size_t, size_t> dirtyVertices = { 0, 0 };
+    std::pair<size_t, size_t> dirtyBVH = { 0, 0 };
+    std::pair<size_t, size_t> dirtyBVHData = { 0, 0 };
+    std::map<std::array<int, 4>, size_t> geometryMeshes;
 
     void GLTFtextures(const std::vector<tinygltf::Texture>& textures, const std::vector<tinygltf::Image>& images);
     void GLTFmaterials(const std::vector<tinygltf::Material>& materials);
@@ -112,9 +236,26 @@ private:
     void GLTFcamera(const glm::mat4 transform);
     void GLTFnodes(const tinygltf::Model& model, const glm::mat4& world);
     void GLTFtraverseNode(const tinygltf::Model& model, const tinygltf::Node& node, const glm::mat4& globalTransform);
-    void buildBVH(Mesh& mesh);
+    void buildBVH(const BVHSettings& settings);
+    FastBVH::NodeArray<float> buildBVH(const Mesh& mesh, const BVHSettings& settings, core::ThreadPool& threadPool);
+    FastBVH::BBox<float> getNodeBounds(int node) const;
+    FastBVH::Node<float> getWideRecord(int node, int child) const;
+    FastBVH::BBox<float> getLeafBounds(const Mesh& mesh, uint32_t start, uint32_t count) const;
+    std::vector<glm::uvec4> buildMeshOffsets() const;
+    std::vector<glm::vec3> buildTLAS() const;
+    std::vector<float> buildMaterialPowers() const;
+    std::vector<glm::vec4> buildLightTable(const std::vector<float>& materialPowers) const;
+    void saveCache(std::ostream& stream) const;
+    void loadCache(const unsigned char* data, size_t size);
+
+    static FastBVH::NodeArray<float> collapseBVH(const FastBVH::NodeArray<float>& nodes);
+    static std::vector<glm::vec3> flattenBVH(const FastBVH::NodeArray<float>& nodes);
+    static std::vector<glm::vec3> quantizeBVH(const FastBVH::NodeArray<float>& nodes, unsigned int bits, std::vector<glm::uvec4>& data);
+    static unsigned int getQuantizedNodeSize(unsigned int bits);
+    static void markDirty(std::pair<size_t, size_t>& range, size_t begin, size_t end);
 
     friend class Renderer;
+    friend class CPURenderer;
 };
 
 }
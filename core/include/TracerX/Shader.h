@@ -6,6 +6,8 @@
 #include <string>
 #include <GL/glew.h>
 #include <glm/glm.hpp>
+#include <unordered_map>
+#include <initializer_list>
 
 namespace TracerX::core
 {
@@ -14,20 +16,29 @@ class Shader
 {
 public:
     void init(const std::string& vertexSrc, const std::string& fragmentSrc);
+    void init(const std::string& computeSrc);
     void shutdown();
     void use();
+    void updateParam(const std::string& name, int value);
     void updateParam(const std::string& name, unsigned int value);
     void updateParam(const std::string& name, float value);
+    void updateParam(const std::string& name, glm::uvec2 value);
     void updateParam(const std::string& name, glm::vec3 value);
     void updateParam(const std::string& name, glm::mat3 value);
     void updateParam(const std::string& name, bool value);
+    void updateParam(GLint location, unsigned int value);
+    void updateParam(GLint location, glm::uvec2 value);
+    GLint getParamLocation(const std::string& name) const;
 
     static void stopUse();
 private:
     GLuint handler;
+    std::unordered_map<std::string, GLint> locations;
+
+    void initLocations();
 
     static GLuint initShader(const std::string& src, GLenum shaderType);
-    static GLuint initProgram(GLuint vertexHandler, GLuint fragmentHandler);
+    static GLuint initProgram(std::initializer_list<GLuint> shaderHandlers);
 };
 
 }
@@ -5,6 +5,7 @@
 
 #include "Image.h"
 
+#include <vector>
 #include <GL/glew.h>
 
 namespace TracerX::core
@@ -18,7 +19,11 @@ public:
     void init();
     void bind(int binding);
     void update(const Image& image);
+    void update(const float* pixels);
+    void updateMipmaps(const std::vector<Image>& levels);
     Image upload() const;
+    void upload(float* pixels) const;
+    void upload(glm::uvec2 position, glm::uvec2 size, float* pixels) const;
     void shutdown();
     GLuint getHandler() const;
 private:
@@ -3,10 +3,6 @@
  */
 #pragma once
 
-#include "Image.h"
-#include "Texture.h"
-
-#include <vector>
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 
@@ -18,12 +14,14 @@ class TextureArray
 public:
     glm::uvec3 size;
 
-    void init();
+    void init(GLenum internalFormat);
     void bind(int binding);
-    void update(glm::uvec2 size, const std::vector<Image>& images);
+    void resize(glm::uvec3 size);
+    void update(glm::uvec3 position, glm::uvec2 size, GLenum type, const void* pixels);
     void shutdown();
 private:
     GLuint handler;
+    GLenum internalFormat;
 };
 
 }
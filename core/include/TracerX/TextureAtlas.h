@@ -0,0 +1,34 @@
+/**
+ * @file TextureAtlas.h
+ */
+#pragma once
+
+#include "Image.h"
+#include "Buffer.h"
+#include "TextureArray.h"
+
+#include <vector>
+#include <glm/glm.hpp>
+
+namespace TracerX::core
+{
+
+class TextureAtlas
+{
+public:
+    void init();
+    void bind(int byteBinding, int halfBinding, int infoBinding);
+    void update(const std::vector<Image>& images, glm::uvec2 maxSize);
+    void shutdown();
+    size_t getMemorySize() const;
+private:
+    TextureArray bytePages;
+    TextureArray halfPages;
+    Buffer<glm::vec4> info;
+
+    static unsigned int getLevelCount(glm::uvec2 size);
+    static bool isByteImage(const Image& image);
+    static glm::uvec3 pack(const std::vector<glm::uvec2>& sizes, std::vector<glm::uvec3>& positions);
+};
+
+}
@@ -0,0 +1,51 @@
+/**
+ * @file ThreadPool.h
+ */
+#pragma once
+
+#include <mutex>
+#include <deque>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <exception>
+#include <functional>
+#include <condition_variable>
+
+namespace TracerX::core
+{
+
+class ThreadPool
+{
+public:
+    ~ThreadPool();
+
+    // Pool of all hardware threads shared by the loaders, created on first use
+    static ThreadPool& getShared();
+
+    void init(size_t threadCount = 0);
+    void shutdown();
+    void parallelFor(size_t count, const std::function<void(size_t)>& task);
+    size_t getThreadCount() const;
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::thread> threads;
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::mutex sleepMutex;
+    std::condition_variable sleepCondition;
+    std::atomic<size_t> queuedCount = 0;
+    std::atomic<size_t> nextQueue = 0;
+    bool stopping = false;
+
+    void push(size_t queueId, std::function<void()> task);
+    bool runTask(size_t queueId);
+    void workerLoop(size_t queueId);
+};
+
+}
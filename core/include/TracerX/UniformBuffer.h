@@ -0,0 +1,64 @@
+/**
+ * @file UniformBuffer.h
+ */
+#pragma once
+
+#include <cstring>
+#include <GL/glew.h>
+
+namespace TracerX::core
+{
+
+template <class T>
+class UniformBuffer
+{
+public:
+    void init();
+    void update(const T& data);
+    void bind(int binding);
+    void shutdown();
+private:
+    GLuint handler;
+    T data;
+    bool uploaded;
+};
+
+template <class T>
+void UniformBuffer<T>::init()
+{
+    this->uploaded = false;
+    glGenBuffers(1, &this->handler);
+    glBindBuffer(GL_UNIFORM_BUFFER, this->handler);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(T), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+template <class T>
+void UniformBuffer<T>::update(const T& data)
+{
+    // The data is only uploaded when it changes
+    if (this->uploaded && std::memcmp(&this->data, &data, sizeof(T)) == 0)
+    {
+        return;
+    }
+
+    this->data = data;
+    this->uploaded = true;
+    glBindBuffer(GL_UNIFORM_BUFFER, this->handler);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(T), &this->data);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+template <class T>
+void UniformBuffer<T>::bind(int binding)
+{
+    glBindBufferBase(GL_UNIFORM_BUFFER, binding, this->handler);
+}
+
+template <class T>
+void UniformBuffer<T>::shutdown()
+{
+    glDeleteBuffers(1, &this->handler);
+}
+
+}
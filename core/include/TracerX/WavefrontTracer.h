@@ -0,0 +1,63 @@
+/**
+ * @file WavefrontTracer.h
+ */
+#pragma once
+
+#include "Shader.h"
+#include "FrameBuffer.h"
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+namespace TracerX::core
+{
+
+class WavefrontTracer
+{
+public:
+    void init();
+    void shutdown();
+    void accumulate(const FrameBuffer& frameBuffer, unsigned int frameCount, unsigned int maxBounceCount, glm::uvec2 position, glm::uvec2 size);
+    bool isInitialized() const;
+private:
+    struct Stage
+    {
+        Shader shader;
+        GLint frameCountLocation = -1;
+        GLint queueLocation = -1;
+        GLint queueCapacityLocation = -1;
+        GLint rectPositionLocation = -1;
+        GLint rectSizeLocation = -1;
+    };
+
+    Stage generateStage;
+    Stage intersectStage;
+    Stage shadeStage;
+    Stage occlusionStage;
+    Stage accumulateStage;
+    Stage dispatchStage;
+    GLuint pathBuffer;
+    GLuint hitBuffer;
+    GLuint shadowBuffer;
+    GLuint queueBuffer;
+    GLuint counterBuffer;
+    size_t capacity = 0;
+    bool initialized = false;
+
+    static const char* generateShaderSrc;
+    static const char* intersectShaderSrc;
+    static const char* shadeShaderSrc;
+    static const char* occlusionShaderSrc;
+    static const char* accumulateShaderSrc;
+    static const char* dispatchShaderSrc;
+
+    void reserve(size_t pathCount);
+    void updateStage(Stage& stage, unsigned int frameCount, glm::uvec2 position, glm::uvec2 size);
+
+    static void initStage(Stage& stage, const char* src);
+    static void useStage(Stage& stage, unsigned int queue);
+
+    static void dispatch(size_t invocationCount);
+};
+
+}
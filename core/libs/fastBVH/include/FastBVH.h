@@ -3,6 +3,7 @@
 #include <FastBVH/BVH.h>
 #include <FastBVH/BuildStrategy.h>
 #include <FastBVH/BuildStrategy1.h>
+#include <FastBVH/BuildStrategy2.h>
 #include <FastBVH/Config.h>
 #include <FastBVH/Iterable.h>
 #include <FastBVH/Vector3.h>
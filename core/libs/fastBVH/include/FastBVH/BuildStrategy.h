@@ -3,6 +3,9 @@
 #include <FastBVH/BVH.h>
 #include <FastBVH/Config.h>
 
+#include <limits>
+#include <functional>
+
 #ifdef FASTBVH_NO_STL
 #include <vector>
 #endif
@@ -70,10 +73,20 @@ class BuildStrategy final {
 };
 
 //! This is the first variant build strategy.
-//! It is a single threaded BVH builder.
+//! It splits the nodes at the center of the longest axis of
+//! the primitive centroids.
 template <typename Float>
 class BuildStrategy<Float, 1> final {
  public:
+  //! The number of primitives above which the two subtrees
+  //! of a node are built as separate tasks.
+  uint32_t parallel_threshold = 65536;
+
+  //! Runs a task for every index in [0, count), possibly concurrently.
+  //! When empty, the BVH is built on the calling thread.
+  //! The resulting tree does not depend on the executor.
+  std::function<void(std::size_t, const std::function<void(std::size_t)>&)> parallel_for;
+
   //! Builds a BVH using the original algorithm.
   template <typename Primitive, typename BoxConverter>
   BVH<Float, Primitive> operator()(Iterable<Primitive> primitives, BoxConverter converter);
@@ -90,6 +103,54 @@ class BuildStrategy<Float, 1> final {
 #endif
 };
 
+//! This is the second variant build strategy.
+//! It splits the nodes using the surface area heuristic (SAH),
+//! evaluated over a fixed number of bins on every axis.
+template <typename Float>
+class BuildStrategy<Float, 2> final {
+ public:
+  //! The number of bins evaluated per axis.
+  uint32_t bin_count = 16;
+
+  //! The cost of traversing an inner node, relative to the intersection cost.
+  Float traversal_cost = 1;
+
+  //! The cost of intersecting a primitive.
+  Float intersection_cost = 1;
+
+  //! The maximum number of primitives in a leaf.
+  //! Smaller leaves are split only when the heuristic favors it.
+  uint32_t max_leaf_size = 4;
+
+  //! The maximum depth of the tree. Nodes at this depth become leaves,
+  //! which keeps the tree within fixed size traversal stacks.
+  uint32_t max_depth = 48;
+
+  //! The number of primitives above which the two subtrees
+  //! of a node are built as separate tasks.
+  uint32_t parallel_threshold = 65536;
+
+  //! Runs a task for every index in [0, count), possibly concurrently.
+  //! When empty, the BVH is built on the calling thread.
+  //! The resulting tree does not depend on the executor.
+  std::function<void(std::size_t, const std::function<void(std::size_t)>&)> parallel_for;
+
+  //! Builds a BVH using the binned surface area heuristic.
+  template <typename Primitive, typename BoxConverter>
+  BVH<Float, Primitive> operator()(Iterable<Primitive> primitives, BoxConverter converter);
+
+#ifndef FASTBVH_NO_STL
+  //! This is a function that takes a STL vector of primitives,
+  //! instead of the @ref Iterable container.
+  template <typename Primitive, typename BoxConverter>
+  BVH<Float, Primitive> operator()(std::vector<Primitive>& primitives, BoxConverter converter) {
+    Iterable<Primitive> iterable(primitives.data(), primitives.size());
+
+    return (*this)(iterable, converter);
+  }
+#endif
+};
+
 //! This is the type definition for the default build strategy.
 //! The default is the original algorithm used for BVH construction.
 template <typename Float>
@@ -1,5 +1,7 @@
 #include <FastBVH/BuildStrategy.h>
 
+#include <vector>
+
 namespace FastBVH {
 
 //! \brief Contains details on the implementation
@@ -9,7 +11,7 @@ namespace Strategy1 {
 //! \brief Contains the context used while building
 //! a specific node in the BVH.
 struct BuildEntry final {
-  //! If non-zero then this is the index of the parent. (used in offsets)
+  //! The index of the parent node.
   uint32_t parent;
 
   //! The starting index of the range of primitives in this node.
@@ -17,88 +19,41 @@ struct BuildEntry final {
 
   //! The ending index of the range of primitives in this node.
   uint32_t end;
+
+  //! Indicates if this node is the right child of its parent.
+  bool is_right;
 };
 
-//! \brief Used while constructing the BVH
-//! to queue nodes to be built.
-class BuildStack final {
-  //! The maximum number of entries in the stack.
-  static constexpr std::size_t max_size = 128;
+//! \brief Builds the nodes of a tree. Subtrees cover disjoint
+//! ranges of primitives, so they can be built concurrently.
+template <typename Float, typename Primitive, typename BoxConverter>
+class Builder final {
+  //! The settings of the build.
+  const BuildStrategy<Float, 1>& strategy;
 
-  //! The entry array of the stack.
-  BuildEntry entries[max_size];
+  //! The primitives, reordered while building.
+  Iterable<Primitive> primitives;
 
-  //! The index of the current entry, plus one.
-  //! A value of zero indicates an empty stack.
-  std::size_t stack_ptr = 0;
+  //! The primitive-to-box converter.
+  BoxConverter& converter;
 
  public:
-  //! Pops the top entry from the stack.
-  //! This function does not check if the
-  //! stack is empty.
-  auto pop() noexcept { return entries[--stack_ptr]; }
-
-  //! Pushes an entry to the stack.
-  //! \param entry The entry to be pushed.
-  void push(const BuildEntry& entry) noexcept {
-    entries[stack_ptr] = entry;
-    stack_ptr++;
-  }
-
-  //! Indicates the size of the stack.
-  //! \return The number of entries in the stack.
-  //! A value of zero indicates the stack is empty.
-  auto size() const noexcept { return stack_ptr; }
-
-  //! Accesses an entry from the stack, by index.
-  //! \param index The index of the entry to get.
-  //! This is not a top-down index, so an index of
-  //! zero would reference the first item added to the stack.
-  //! \return A reference to the specified entry.
-  const auto& operator[](std::size_t index) const noexcept { return entries[index]; }
-};
-
-}  // namespace Strategy1
-
-template <typename Float>
-template <typename Primitive, typename BoxConverter>
-BVH<Float, Primitive> BuildStrategy<Float, 1>::operator()(Iterable<Primitive> primitives, BoxConverter converter) {
-  using namespace Strategy1;
-
-  // The threshold hold at which a leaf is made in the BVH.
+  //! The threshold hold at which a leaf is made in the BVH.
   static constexpr uint32_t leaf_size = 4;
 
-  BuildStack todo;
-
-  const uint32_t Untouched = 0xffffffff;
-  const uint32_t TouchedTwice = 0xfffffffd;
-  uint32_t node_count = 0;
+  Builder(const BuildStrategy<Float, 1>& s, Iterable<Primitive> p, BoxConverter& c)
+      : strategy(s), primitives(p), converter(c) {}
 
-  // Push the root
-  BuildEntry root{
-      0xfffffffc /* parent */,
-      0 /* start */,
-      (uint32_t)primitives.size() /* end */
-  };
-
-  todo.push(root);
-
-  Node<Float> node;
-  std::vector<Node<Float>> build_nodes;
-  build_nodes.reserve(primitives.size() * 2);
-
-  while (todo.size() > 0) {
-    auto bnode = todo.pop();
-
-    uint32_t start = bnode.start;
-    uint32_t end = bnode.end;
-    uint32_t primitive_count = end - start;
-
-    node_count++;
-    node.start = start;
-    node.primitive_count = primitive_count;
-    node.right_offset = Untouched;
+  //! Indicates if a range of primitives is large enough to be split into tasks.
+  bool parallel(std::size_t primitive_count) const noexcept {
+    return strategy.parallel_for && primitive_count >= strategy.parallel_threshold;
+  }
 
+  //! Creates the node of a range of primitives and partitions them
+  //! on the center of the longest axis of their centroids.
+  //! \return The index of the first primitive of the right child,
+  //! or zero if the node is a leaf.
+  uint32_t split(uint32_t start, uint32_t end, Node<Float>& node) {
     // Calculate the bounding box for this node
     auto bb = converter(primitives[start]);
     auto bc = BBox<Float>(bb.getCenter());
@@ -109,30 +64,11 @@ BVH<Float, Primitive> BuildStrategy<Float, 1>::operator()(Iterable<Primitive> pr
       bc.expandToInclude(box.getCenter());
     }
 
-    node.bbox = bb;
+    node = Node<Float>{bb, start, end - start, 0};
 
     // If the number of primitives at this point is less than the leaf
     // size, then this will become a leaf. (Signified by right_offset == 0)
-    if (primitive_count <= leaf_size) {
-      node.right_offset = 0;
-    }
-
-    build_nodes.push_back(node);
-
-    // Child touches parent...
-    // Special case: Don't do this for the root.
-    if (bnode.parent != 0xfffffffc) {
-      build_nodes[bnode.parent].right_offset--;
-
-      // When this is the second touch, this is the right child.
-      // The right child sets up the offset for the flat tree.
-      if (build_nodes[bnode.parent].right_offset == TouchedTwice) {
-        build_nodes[bnode.parent].right_offset = node_count - 1 - bnode.parent;
-      }
-    }
-
-    // If this is a leaf, no need to subdivide.
-    if (node.right_offset == 0) continue;
+    if (end - start <= leaf_size) return 0;
 
     // Set the split dimensions
     uint32_t split_dim = bc.maxDimension();
@@ -155,21 +91,85 @@ BVH<Float, Primitive> BuildStrategy<Float, 1>::operator()(Iterable<Primitive> pr
       mid = start + (end - start) / 2;
     }
 
-    BuildEntry right_child{node_count - 1, mid, end};
+    return mid;
+  }
+
+  //! Builds the subtree of a range of primitives on the calling thread.
+  //! The nodes are appended in depth-first order, left child first.
+  void buildSerial(uint32_t start, uint32_t end, NodeArray<Float>& nodes) {
+    std::vector<BuildEntry> todo;
+    todo.push_back(BuildEntry{(uint32_t)nodes.size(), start, end, false});
+
+    while (!todo.empty()) {
+      BuildEntry bnode = todo.back();
+      todo.pop_back();
 
-    BuildEntry left_child{node_count - 1, start, mid};
+      uint32_t index = (uint32_t)nodes.size();
+      Node<Float> node;
+      uint32_t mid = split(bnode.start, bnode.end, node);
+      nodes.push_back(node);
+
+      // The right child sets up the offset for the flat tree.
+      if (bnode.is_right) {
+        nodes[bnode.parent].right_offset = index - bnode.parent;
+      }
 
-    todo.push(right_child);
-    todo.push(left_child);
+      // If this is a leaf, no need to subdivide.
+      if (mid == 0) continue;
+
+      // Any non-zero value marks an inner node until the right child is built
+      nodes[index].right_offset = 1;
+
+      todo.push_back(BuildEntry{index, mid, bnode.end, true});
+      todo.push_back(BuildEntry{index, bnode.start, mid, false});
+    }
   }
 
-  NodeArray<Float> nodes;
+  //! Builds the subtree of a range of primitives, building the two
+  //! subtrees of large nodes as separate tasks. The nodes are the
+  //! same as the ones produced by @ref buildSerial.
+  void build(uint32_t start, uint32_t end, NodeArray<Float>& nodes) {
+    if (!parallel(end - start)) {
+      buildSerial(start, end, nodes);
+      return;
+    }
+
+    Node<Float> node;
+    uint32_t mid = split(start, end, node);
+    if (mid == 0) {
+      nodes.push_back(node);
+      return;
+    }
 
-  nodes.resize(node_count);
+    NodeArray<Float> children[2];
+    strategy.parallel_for(2, [&](std::size_t child) {
+      if (child == 0) {
+        build(start, mid, children[0]);
+      } else {
+        build(mid, end, children[1]);
+      }
+    });
 
-  for (uint32_t n = 0; n < node_count; n++) {
-    nodes[n] = build_nodes[n];
+    // Offsets are relative, so the subtrees can be appended as they are
+    node.right_offset = 1 + (uint32_t)children[0].size();
+    nodes.push_back(node);
+    nodes.insert(nodes.end(), children[0].begin(), children[0].end());
+    nodes.insert(nodes.end(), children[1].begin(), children[1].end());
   }
+};
+
+}  // namespace Strategy1
+
+template <typename Float>
+template <typename Primitive, typename BoxConverter>
+BVH<Float, Primitive> BuildStrategy<Float, 1>::operator()(Iterable<Primitive> primitives, BoxConverter converter) {
+  using namespace Strategy1;
+
+  Builder<Float, Primitive, BoxConverter> builder(*this, primitives, converter);
+
+  NodeArray<Float> nodes;
+  nodes.reserve(primitives.size() * 2);
+  builder.build(0, (uint32_t)primitives.size(), nodes);
 
   return BVH<Float, Primitive>(std::move(nodes), primitives);
 }
@@ -0,0 +1,301 @@
+#include <FastBVH/BuildStrategy.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace FastBVH {
+
+//! \brief Contains details on the implementation
+//! of the variant-2 BVH build strategy.
+namespace Strategy2 {
+
+//! \brief Contains the context used while building
+//! a specific node in the BVH.
+struct BuildEntry final {
+  //! The index of the parent node.
+  uint32_t parent;
+
+  //! The starting index of the range of primitives in this node.
+  uint32_t start;
+
+  //! The ending index of the range of primitives in this node.
+  uint32_t end;
+
+  //! The depth of the node in the tree.
+  uint32_t depth;
+
+  //! Indicates if this node is the right child of its parent.
+  bool is_right;
+};
+
+//! \brief A bin used to estimate the cost of a split.
+template <typename Float>
+struct Bin final {
+  //! The bounding box of the primitives in the bin.
+  BBox<Float> bbox;
+
+  //! The number of primitives in the bin.
+  uint32_t primitive_count;
+};
+
+//! Creates an empty bounding box, that any box can expand.
+template <typename Float>
+BBox<Float> emptyBox() noexcept {
+  Vector3<Float> init_min{std::numeric_limits<Float>::infinity(), std::numeric_limits<Float>::infinity(),
+                          std::numeric_limits<Float>::infinity()};
+
+  Vector3<Float> init_max{-std::numeric_limits<Float>::infinity(), -std::numeric_limits<Float>::infinity(),
+                          -std::numeric_limits<Float>::infinity()};
+
+  return BBox<Float>(init_min, init_max);
+}
+
+//! \brief The memory used to evaluate the splits of a node.
+//! Every task owns one, so it is reused for all the nodes it builds.
+template <typename Float>
+struct Scratch final {
+  //! The bins of the axis being evaluated.
+  std::vector<Bin<Float>> bins;
+
+  //! The surface area right of every split plane.
+  std::vector<Float> right_areas;
+
+  //! The number of primitives right of every split plane.
+  std::vector<uint32_t> right_counts;
+
+  //! Constructs the scratch memory for a given bin count.
+  explicit Scratch(uint32_t bin_count) : bins(bin_count), right_areas(bin_count), right_counts(bin_count) {}
+};
+
+//! \brief Builds the nodes of a tree. Subtrees cover disjoint
+//! ranges of primitives, so they can be built concurrently.
+template <typename Float, typename Primitive>
+class Builder final {
+  //! The settings of the build.
+  const BuildStrategy<Float, 2>& strategy;
+
+  //! The number of bins evaluated per axis.
+  uint32_t bins;
+
+  //! The primitives, reordered while building.
+  Iterable<Primitive> primitives;
+
+  //! The bounding boxes of the primitives, moved along with them.
+  std::vector<BBox<Float>> boxes;
+
+  //! The centers of the bounding boxes, moved along with them.
+  std::vector<Vector3<Float>> centers;
+
+ public:
+  //! Converts the primitives to boxes.
+  template <typename BoxConverter>
+  Builder(const BuildStrategy<Float, 2>& s, Iterable<Primitive> p, BoxConverter& converter)
+      : strategy(s), bins(s.bin_count < 2 ? 2 : s.bin_count), primitives(p), boxes(p.size()), centers(p.size()) {
+    static constexpr std::size_t chunk_size = 4096;
+    auto convert = [this, &converter](std::size_t chunk) {
+      std::size_t end = std::min(primitives.size(), (chunk + 1) * chunk_size);
+      for (std::size_t i = chunk * chunk_size; i < end; ++i) {
+        boxes[i] = converter(primitives[i]);
+        centers[i] = boxes[i].getCenter();
+      }
+    };
+
+    std::size_t chunk_count = (primitives.size() + chunk_size - 1) / chunk_size;
+    if (parallel(primitives.size())) {
+      strategy.parallel_for(chunk_count, convert);
+    } else {
+      for (std::size_t chunk = 0; chunk < chunk_count; ++chunk) convert(chunk);
+    }
+  }
+
+  //! Indicates if a range of primitives is large enough to be split into tasks.
+  bool parallel(std::size_t primitive_count) const noexcept {
+    return strategy.parallel_for && primitive_count >= strategy.parallel_threshold;
+  }
+
+  //! Creates the node of a range of primitives.
+  //! The node is a leaf until it is split.
+  Node<Float> makeNode(uint32_t start, uint32_t end, BBox<Float>& centroid_bounds) const noexcept {
+    BBox<Float> bb = emptyBox<Float>();
+    centroid_bounds = emptyBox<Float>();
+    for (uint32_t p = start; p < end; ++p) {
+      bb.expandToInclude(boxes[p]);
+      centroid_bounds.expandToInclude(centers[p]);
+    }
+
+    return Node<Float>{bb, start, end - start, 0};
+  }
+
+  //! Finds the cheapest split of a node and partitions its primitives.
+  //! \return The index of the first primitive of the right child,
+  //! or zero if the node should stay a leaf.
+  uint32_t split(const Node<Float>& node, const BBox<Float>& bc, uint32_t depth, Scratch<Float>& scratch) {
+    uint32_t start = node.start;
+    uint32_t end = node.start + node.primitive_count;
+    uint32_t primitive_count = node.primitive_count;
+
+    if (primitive_count <= 1 || depth >= strategy.max_depth) return 0;
+
+    // Find the cheapest split over the bins of every axis
+    Float leaf_cost = strategy.intersection_cost * primitive_count;
+    Float best_cost = std::numeric_limits<Float>::infinity();
+    uint32_t best_axis = 0;
+    uint32_t best_bin = 0;
+    Float area = node.bbox.surfaceArea();
+
+    for (uint32_t axis = 0; axis < 3 && area > 0; ++axis) {
+      Float extent = bc.extent[axis];
+      if (extent <= 0) continue;
+
+      Float scale = bins / extent;
+      for (auto& bin : scratch.bins) {
+        bin.bbox = emptyBox<Float>();
+        bin.primitive_count = 0;
+      }
+
+      for (uint32_t p = start; p < end; ++p) {
+        uint32_t b = std::min(bins - 1, (uint32_t)((centers[p][axis] - bc.min[axis]) * scale));
+        scratch.bins[b].bbox.expandToInclude(boxes[p]);
+        scratch.bins[b].primitive_count++;
+      }
+
+      // Sweep from the right to get the right side of every split plane
+      BBox<Float> right_box = emptyBox<Float>();
+      uint32_t right_count = 0;
+      for (uint32_t b = bins - 1; b > 0; --b) {
+        right_box.expandToInclude(scratch.bins[b].bbox);
+        right_count += scratch.bins[b].primitive_count;
+        scratch.right_areas[b] = right_count > 0 ? right_box.surfaceArea() : 0;
+        scratch.right_counts[b] = right_count;
+      }
+
+      // Sweep from the left, the split plane b puts bins [0, b) on the left
+      BBox<Float> left_box = emptyBox<Float>();
+      uint32_t left_count = 0;
+      for (uint32_t b = 1; b < bins; ++b) {
+        left_box.expandToInclude(scratch.bins[b - 1].bbox);
+        left_count += scratch.bins[b - 1].primitive_count;
+        if (left_count == 0 || scratch.right_counts[b] == 0) continue;
+
+        Float cost = strategy.traversal_cost +
+                     strategy.intersection_cost *
+                         (left_box.surfaceArea() * left_count + scratch.right_areas[b] * scratch.right_counts[b]) / area;
+        if (cost < best_cost) {
+          best_cost = cost;
+          best_axis = axis;
+          best_bin = b;
+        }
+      }
+    }
+
+    // Make a leaf when splitting does not pay off
+    bool found = best_cost < std::numeric_limits<Float>::infinity();
+    if ((!found || best_cost >= leaf_cost) && primitive_count <= strategy.max_leaf_size) return 0;
+
+    // Partition the list of objects on the best split
+    uint32_t mid = start;
+    if (found) {
+      Float scale = bins / bc.extent[best_axis];
+      for (uint32_t i = start; i < end; ++i) {
+        uint32_t b = std::min(bins - 1, (uint32_t)((centers[i][best_axis] - bc.min[best_axis]) * scale));
+        if (b < best_bin) {
+          std::swap(primitives[i], primitives[mid]);
+          std::swap(boxes[i], boxes[mid]);
+          std::swap(centers[i], centers[mid]);
+          ++mid;
+        }
+      }
+    }
+
+    // If we get a bad split, just choose the center...
+    if (mid == start || mid == end) {
+      mid = start + (end - start) / 2;
+    }
+
+    return mid;
+  }
+
+  //! Builds the subtree of a range of primitives on the calling thread.
+  //! The nodes are appended in depth-first order, left child first.
+  void buildSerial(uint32_t start, uint32_t end, uint32_t depth, NodeArray<Float>& nodes) {
+    Scratch<Float> scratch(bins);
+    std::vector<BuildEntry> todo;
+    uint32_t first = (uint32_t)nodes.size();
+    todo.push_back(BuildEntry{first, start, end, depth, false});
+
+    while (!todo.empty()) {
+      BuildEntry bnode = todo.back();
+      todo.pop_back();
+
+      uint32_t index = (uint32_t)nodes.size();
+      BBox<Float> bc;
+      nodes.push_back(makeNode(bnode.start, bnode.end, bc));
+
+      // The right child sets up the offset for the flat tree.
+      if (bnode.is_right) {
+        nodes[bnode.parent].right_offset = index - bnode.parent;
+      }
+
+      uint32_t mid = split(nodes[index], bc, bnode.depth, scratch);
+      if (mid == 0) continue;
+
+      // Any non-zero value marks an inner node until the right child is built
+      nodes[index].right_offset = 1;
+
+      todo.push_back(BuildEntry{index, mid, bnode.end, bnode.depth + 1, true});
+      todo.push_back(BuildEntry{index, bnode.start, mid, bnode.depth + 1, false});
+    }
+  }
+
+  //! Builds the subtree of a range of primitives, building the two
+  //! subtrees of large nodes as separate tasks. The nodes are the
+  //! same as the ones produced by @ref buildSerial.
+  void build(uint32_t start, uint32_t end, uint32_t depth, NodeArray<Float>& nodes) {
+    if (!parallel(end - start)) {
+      buildSerial(start, end, depth, nodes);
+      return;
+    }
+
+    Scratch<Float> scratch(bins);
+    BBox<Float> bc;
+    Node<Float> node = makeNode(start, end, bc);
+    uint32_t mid = split(node, bc, depth, scratch);
+    if (mid == 0) {
+      nodes.push_back(node);
+      return;
+    }
+
+    NodeArray<Float> children[2];
+    strategy.parallel_for(2, [&](std::size_t child) {
+      if (child == 0) {
+        build(start, mid, depth + 1, children[0]);
+      } else {
+        build(mid, end, depth + 1, children[1]);
+      }
+    });
+
+    // Offsets are relative, so the subtrees can be appended as they are
+    node.right_offset = 1 + (uint32_t)children[0].size();
+    nodes.push_back(node);
+    nodes.insert(nodes.end(), children[0].begin(), children[0].end());
+    nodes.insert(nodes.end(), children[1].begin(), children[1].end());
+  }
+};
+
+}  // namespace Strategy2
+
+template <typename Float>
+template <typename Primitive, typename BoxConverter>
+BVH<Float, Primitive> BuildStrategy<Float, 2>::operator()(Iterable<Primitive> primitives, BoxConverter converter) {
+  using namespace Strategy2;
+
+  Builder<Float, Primitive> builder(*this, primitives, converter);
+
+  NodeArray<Float> nodes;
+  nodes.reserve(primitives.size() * 2);
+  builder.build(0, (uint32_t)primitives.size(), 0, nodes);
+
+  return BVH<Float, Primitive>(std::move(nodes), primitives);
+}
+
+}  // namespace FastBVH
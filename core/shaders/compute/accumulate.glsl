@@ -0,0 +1,45 @@
+#version 430 core
+
+layout(local_size_x=64) in;
+
+#include ../fragment/common/structs.glsl
+#include ../fragment/common/uniforms.glsl
+#include ../fragment/common/random.glsl
+#include ../fragment/common/transforms.glsl
+#include common/wavefront.glsl
+
+// Adds the finished paths to the accumulation
+void main()
+{
+    uint pathId = GetInvocationIndex();
+    if (pathId >= RectSize.x * RectSize.y)
+    {
+        return;
+    }
+
+    ivec2 pixel = GetPixel(pathId);
+    vec4 accumColor = imageLoad(AccumulatorImage, pixel);
+    vec4 moments = imageLoad(MomentsImage, pixel);
+    uint bounce = Paths[pathId].State.y;
+    uint flags = Paths[pathId].State.w;
+
+    if ((flags & PATH_CONVERGED) != 0)
+    {
+        imageStore(AccumulatorImage, pixel, accumColor + accumColor / FrameCount);
+        imageStore(MomentsImage, pixel, vec4(moments.r, 1, moments.b, moments.a));
+        return;
+    }
+
+    vec4 pixelColor = vec4(Paths[pathId].IncomingLight.rgb, Environment.Transparent && (flags & PATH_BACKGROUND) != 0 ? 0 : 1);
+
+    // Invalid samples would spread through the filtered accumulation and poison the moments
+    if (any(isnan(pixelColor.rgb)) || any(isinf(pixelColor.rgb)))
+    {
+        pixelColor.rgb = vec3(0);
+    }
+
+    // The alpha of the moments sums the path lengths
+    float luminance = Luminance(pixelColor.rgb);
+    imageStore(AccumulatorImage, pixel, pixelColor + accumColor);
+    imageStore(MomentsImage, pixel, vec4(moments.r + luminance * luminance, 0, moments.b + 1, moments.a + bounce));
+}
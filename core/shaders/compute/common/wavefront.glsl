@@ -0,0 +1,88 @@
+const uint WORKGROUP_SIZE = 64u;
+
+const uint PATH_BACKGROUND = 1u;
+const uint PATH_CONVERGED  = 2u;
+
+// The queue of the paths whose shadow ray waits for the occlusion stage
+const uint SHADOW_QUEUE = 2u;
+
+// Origin.w is the cone width, Direction.w the cone spread, Color.w the scatter pdf, IncomingLight.w the scatter distance,
+// State holds the seed, the bounce, the sample dimension and the flags
+struct Path
+{
+    vec4 Origin;
+    vec4 Direction;
+    vec4 Color;
+    vec4 IncomingLight;
+    uvec4 State;
+};
+
+// The collision manifold found by the intersection stage, Info holds the material, the face and the hit flag
+struct Hit
+{
+    vec4 PointDepth;
+    vec4 NormalUVDensity;
+    vec4 TangentU;
+    vec4 BitangentV;
+    ivec4 Info;
+};
+
+// The shadow ray of a light sample, Origin.w is the distance left to the light, Direction.w the cone width, IncomingLight.w the cone spread
+struct Shadow
+{
+    vec4 Origin;
+    vec4 Direction;
+    vec4 IncomingLight;
+};
+
+layout(std430, binding=0) buffer PathBuffer { Path Paths[]; };
+layout(std430, binding=1) buffer HitBuffer { Hit Hits[]; };
+layout(std430, binding=2) buffer QueueBuffer { uint Queues[]; };
+layout(std430, binding=3) buffer CounterBuffer { uint DispatchX; uint DispatchY; uint DispatchZ; uint QueueSizes[3]; };
+layout(std430, binding=4) buffer ShadowBuffer { Shadow Shadows[]; };
+
+layout(binding=0, rgba32f) uniform image2D AccumulatorImage;
+layout(binding=1, rgba32f) uniform image2D AlbedoImage;
+layout(binding=2, rgba32f) uniform image2D NormalImage;
+layout(binding=3, rgba32f) uniform image2D MomentsImage;
+
+uniform uvec2 RectPosition;
+uniform uvec2 RectSize;
+uniform uint Queue;
+uniform uint QueueCapacity;
+
+uint GetInvocationIndex()
+{
+    return (gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x) * WORKGROUP_SIZE + gl_LocalInvocationID.x;
+}
+
+ivec2 GetPixel(uint pathId)
+{
+    return ivec2(RectPosition + uvec2(pathId % RectSize.x, pathId / RectSize.x));
+}
+
+void PushPath(uint queue, uint pathId)
+{
+    uint slot = atomicAdd(QueueSizes[queue], 1u);
+    Queues[queue * QueueCapacity + slot] = pathId;
+}
+
+Ray LoadRay(in Path path)
+{
+    return Ray(path.Origin.xyz, path.Direction.xyz, 1 / path.Direction.xyz, path.Color.rgb, path.IncomingLight.rgb, path.Origin.w, path.Direction.w, path.Color.w, path.IncomingLight.w);
+}
+
+Path StorePath(in Ray ray, uint bounce, uint flags)
+{
+    return Path(vec4(ray.Origin, ray.ConeWidth), vec4(ray.Direction, ray.ConeSpread), vec4(ray.Color, ray.ScatterPdf), vec4(ray.IncomingLight, ray.ScatterDistance), uvec4(Seed, bounce, SampleDimension, flags));
+}
+
+Ray LoadShadowRay(in Shadow shadow)
+{
+    return Ray(shadow.Origin.xyz, shadow.Direction.xyz, 1 / shadow.Direction.xyz, vec3(1), shadow.IncomingLight.rgb, shadow.Direction.w, shadow.IncomingLight.w, 0, 0);
+}
+
+Shadow StoreShadow(in Ray shadowRay, float distance)
+{
+    return Shadow(vec4(shadowRay.Origin, distance), vec4(shadowRay.Direction, shadowRay.ConeWidth), vec4(shadowRay.IncomingLight, shadowRay.ConeSpread));
+}
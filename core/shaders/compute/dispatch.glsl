@@ -0,0 +1,22 @@
+#version 430 core
+
+layout(local_size_x=1) in;
+
+#include ../fragment/common/structs.glsl
+#include ../fragment/common/uniforms.glsl
+#include ../fragment/common/random.glsl
+#include common/wavefront.glsl
+
+// Sizes the indirect dispatches over the current queue, the path queues also empty the other one and the shadow queue
+void main()
+{
+    uint groupCount = (QueueSizes[Queue] + WORKGROUP_SIZE - 1u) / WORKGROUP_SIZE;
+    DispatchX = min(groupCount, 65535u);
+    DispatchY = groupCount == 0u ? 0u : (groupCount + DispatchX - 1u) / DispatchX;
+    DispatchZ = 1u;
+    if (Queue != SHADOW_QUEUE)
+    {
+        QueueSizes[1u - Queue] = 0u;
+        QueueSizes[SHADOW_QUEUE] = 0u;
+    }
+}
@@ -0,0 +1,36 @@
+#version 430 core
+
+layout(local_size_x=64) in;
+
+#include ../fragment/common/structs.glsl
+#include ../fragment/common/uniforms.glsl
+#include ../fragment/common/random.glsl
+#include ../fragment/common/transforms.glsl
+#include ../fragment/common/camera.glsl
+#include ../fragment/common/adaptive.glsl
+#include common/wavefront.glsl
+
+// Creates the camera ray of every pixel of the rectangle and queues it for the intersection stage
+void main()
+{
+    uint pathId = GetInvocationIndex();
+    if (pathId >= RectSize.x * RectSize.y)
+    {
+        return;
+    }
+
+    ivec2 pixel = GetPixel(pathId);
+
+    // Converged pixels keep their mean without tracing new paths
+    if (IsConverged(imageLoad(AccumulatorImage, pixel), imageLoad(MomentsImage, pixel)))
+    {
+        Paths[pathId].State = uvec4(0, 0, 0, PATH_CONVERGED);
+        return;
+    }
+
+    vec2 size = imageSize(AccumulatorImage);
+    vec2 texCoords = (vec2(pixel) + .5) / size;
+    InitSampler(uvec2(pixel));
+    Paths[pathId] = StorePath(GetCameraRay(texCoords, size), 0, 0);
+    PushPath(0, pathId);
+}
@@ -0,0 +1,37 @@
+#version 430 core
+
+layout(local_size_x=64) in;
+
+#include ../fragment/common/structs.glsl
+#include ../fragment/common/uniforms.glsl
+#include ../fragment/common/random.glsl
+#include ../fragment/common/transforms.glsl
+#include ../fragment/common/intersection.glsl
+#include common/wavefront.glsl
+
+// Finds the closest collision of every queued path
+void main()
+{
+    uint index = GetInvocationIndex();
+    if (index >= QueueSizes[Queue])
+    {
+        return;
+    }
+
+    uint pathId = Queues[Queue * QueueCapacity + index];
+    Path path = Paths[pathId];
+
+    CollisionManifold manifold;
+    if (!FindIntersection(LoadRay(path), path.State.y == 0, manifold))
+    {
+        Hits[pathId].Info = ivec4(0);
+        return;
+    }
+
+    Hits[pathId] = Hit(
+        vec4(manifold.Point, manifold.Depth),
+        vec4(manifold.Normal, manifold.UVDensity),
+        vec4(manifold.Tangent, manifold.TextureCoordinate.x),
+        vec4(manifold.Bitangent, manifold.TextureCoordinate.y),
+        ivec4(manifold.MaterialId, manifold.IsFrontFace ? 1 : 0, 1, 0));
+}
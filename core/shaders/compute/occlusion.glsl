@@ -0,0 +1,41 @@
+#version 430 core
+
+layout(local_size_x=64) in;
+
+#include ../fragment/common/structs.glsl
+#include ../fragment/common/uniforms.glsl
+#include ../fragment/common/random.glsl
+#include ../fragment/common/transforms.glsl
+#include ../fragment/common/intersection.glsl
+#include ../fragment/common/light.glsl
+#include common/wavefront.glsl
+
+// Traces the queued shadow rays and adds the light of the ones reaching their light to their path
+void main()
+{
+    uint index = GetInvocationIndex();
+    if (index >= QueueSizes[SHADOW_QUEUE])
+    {
+        return;
+    }
+
+    uint pathId = Queues[SHADOW_QUEUE * QueueCapacity + index];
+    Path path = Paths[pathId];
+    Shadow shadow = Shadows[pathId];
+    Ray ray = LoadRay(path);
+    InitSampler(uvec2(GetPixel(pathId)));
+    Seed = path.State.x;
+    SampleDimension = path.State.z;
+    ShadowRay = LoadShadowRay(shadow);
+    ShadowDistance = shadow.Origin.w;
+
+    // The transparent surfaces crossed by the shadow ray draw from the sampler of the path
+    while (ShadowDistance > 0)
+    {
+        CollisionManifold manifold;
+        ContinueShadow(ray, FindIntersection(ShadowRay, false, manifold), manifold);
+    }
+
+    Paths[pathId].IncomingLight.rgb = ray.IncomingLight;
+    Paths[pathId].State.xz = uvec2(Seed, SampleDimension);
+}
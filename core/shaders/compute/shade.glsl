@@ -0,0 +1,93 @@
+#version 430 core
+
+layout(local_size_x=64) in;
+
+#include ../fragment/common/structs.glsl
+#include ../fragment/common/uniforms.glsl
+#include ../fragment/common/random.glsl
+#include ../fragment/common/transforms.glsl
+#include ../fragment/common/intersection.glsl
+#include ../fragment/common/light.glsl
+#include ../fragment/common/material.glsl
+#include common/wavefront.glsl
+
+// Evaluates the material of every queued path and queues the paths that keep bouncing
+void main()
+{
+    uint index = GetInvocationIndex();
+    if (index >= QueueSizes[Queue])
+    {
+        return;
+    }
+
+    uint pathId = Queues[Queue * QueueCapacity + index];
+    Path path = Paths[pathId];
+    Hit hit = Hits[pathId];
+    Ray ray = LoadRay(path);
+    uint bounce = path.State.y;
+    uint flags = path.State.w;
+    ivec2 pixel = GetPixel(pathId);
+    InitSampler(uvec2(pixel));
+    Seed = path.State.x;
+    SampleDimension = path.State.z;
+
+    if (hit.Info.z == 0)
+    {
+        ray.IncomingLight += GetEnvironmentLight(ray) * ray.Color;
+        if (bounce == 0)
+        {
+            flags |= PATH_BACKGROUND;
+            imageStore(AlbedoImage, pixel, ToneMap(vec4(ray.IncomingLight, 1), Gamma));
+            imageStore(NormalImage, pixel, vec4((1 - ray.Direction) / 2, 1));
+        }
+
+        Paths[pathId] = StorePath(ray, bounce, flags);
+        return;
+    }
+
+    CollisionManifold manifold = CollisionManifold(
+        hit.PointDepth.w,
+        hit.PointDepth.xyz,
+        vec2(hit.TangentU.w, hit.BitangentV.w),
+        hit.NormalUVDensity.w,
+        hit.NormalUVDensity.xyz,
+        hit.TangentU.xyz,
+        hit.BitangentV.xyz,
+        hit.Info.x,
+        hit.Info.y != 0);
+
+    ray.ConeWidth += ray.ConeSpread * manifold.Depth;
+    bool isBounce = CollisionReact(ray, manifold);
+    bool isTerminated = false;
+
+    if (isBounce)
+    {
+        if (bounce == 0)
+        {
+            imageStore(AlbedoImage, pixel, ToneMap(vec4(ray.Color, 1), Gamma));
+            imageStore(NormalImage, pixel, vec4((manifold.Normal + 1) / 2, 1));
+        }
+
+        bounce++;
+        StartSampleBounce(bounce);
+        isTerminated = !SurviveRoulette(ray, bounce);
+    }
+    else
+    {
+        ray.Origin = manifold.Point;
+    }
+
+    Paths[pathId] = StorePath(ray, bounce, flags);
+
+    // The shadow ray of a light sample is traced by the occlusion stage, so this stage never traverses the hierarchy
+    if (ShadowDistance > 0)
+    {
+        Shadows[pathId] = StoreShadow(ShadowRay, ShadowDistance);
+        PushPath(SHADOW_QUEUE, pathId);
+    }
+
+    if (bounce <= MaxBounceCount && !isTerminated)
+    {
+        PushPath(1u - Queue, pathId);
+    }
+}
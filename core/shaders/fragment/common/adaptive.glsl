@@ -0,0 +1,14 @@
+bool IsConverged(in vec4 accumColor, in vec4 moments)
+{
+    // The moments hold the sum of the squared luminances and the number of summed frames
+    if (AdaptiveThreshold <= 0 || moments.b < max(AdaptiveMinFrameCount, 2u))
+    {
+        return false;
+    }
+
+    // Relative standard error of the mean luminance, counted over the frames of the variance estimate,
+    // so an accumulation loaded without its moments is not trusted after a few frames
+    float mean = Luminance(accumColor.rgb) / FrameCount;
+    float variance = max(moments.r / moments.b - mean * mean, 0);
+    return sqrt(variance / moments.b) <= AdaptiveThreshold * max(mean, .01);
+}
@@ -0,0 +1,20 @@
+vec3 CameraRight = cross(Camera.Forward, Camera.Up);
+
+Ray GetCameraRay(in vec2 texCoords, in vec2 size)
+{
+    vec2 coord = (texCoords - vec2(.5)) * vec2(1, size.y / size.x) * 2 * tan(Camera.FOV / 2);
+    vec3 direction = normalize(Camera.Forward + CameraRight * coord.x + Camera.Up * coord.y);
+    vec3 rayOrigin = Camera.Position;
+
+    // Focal
+    vec3 focalPoint = rayOrigin + direction * Camera.FocalDistance;
+    vec2 focal = RandomVector2() * Camera.Aperture;
+    rayOrigin += focal.x * CameraRight + focal.y * Camera.Up;
+    vec3 rayDirection = normalize(focalPoint - rayOrigin);
+
+    // Blur
+    vec2 blur = RandomVector2() * Camera.Blur;
+    rayOrigin += blur.x * CameraRight + blur.y * Camera.Up;
+
+    return Ray(rayOrigin, rayDirection, 1 / rayDirection, vec3(1), vec3(0), 0, 2 * tan(Camera.FOV / 2) / size.x, 0, 0);
+}
@@ -41,12 +41,14 @@ bool TriangleIntersection(in Ray ray, in Vertex v1, in Vertex v2, in Vertex v3,
 
     vec2 edgeUV12 = v2.TextureCoordinate - v1.TextureCoordinate;
     vec2 edgeUV13 = v3.TextureCoordinate - v1.TextureCoordinate;
-    float invDetUV = 1.0 / (edgeUV12.x * edgeUV13.y - edgeUV12.y * edgeUV13.x);
+    float detUV = edgeUV12.x * edgeUV13.y - edgeUV12.y * edgeUV13.x;
+    float invDetUV = 1.0 / detUV;
 
     manifold = CollisionManifold(
         dst,
         ray.Origin + ray.Direction * dst,
         v1.TextureCoordinate * w + v2.TextureCoordinate * u + v3.TextureCoordinate * v,
+        0.5 * log2(abs(detUV) / length(normal)),
         normalize(v1.Normal * w + v2.Normal * u + v3.Normal * v),
         normalize((edge12 * edgeUV13.y - edge13 * edgeUV12.y) * invDetUV),
         normalize((edge13 * edgeUV12.x - edge12 * edgeUV13.x) * invDetUV),
@@ -66,17 +68,26 @@ bool AABBIntersection(in Ray ray, in vec3 boxMin, in vec3 boxMax, out float tNea
     return tNear <= tFar && tFar >= 0;
 }
 
-bool MeshIntersection(in Ray ray, in Mesh mesh, in bool firstHit, out CollisionManifold manifold)
+void LeafIntersection(in Ray ray, in Mesh mesh, in int start, in int count, in bool firstHit, in float localMinRenderDistance, inout CollisionManifold manifold)
 {
-    vec3 rayOrigin = ray.Origin;
-    ray.Origin = Transform(ray.Origin, mesh.TransformInv, true);
-    ray.Direction = normalize(Transform(ray.Direction, mesh.TransformInv, false));
-    ray.InvDirection = 1 / ray.Direction;
+    for (int o = 0; o < count; ++o)
+    {
+        Triangle triangle = GetTriangle(start + o + mesh.TriangleOffset);
 
-    float localMinRenderDistance = length(Transform(ray.Direction * MinRenderDistance, mesh.TransformInv, false));
-    float localMaxRenderDistance = length(Transform(ray.Direction * MaxRenderDistance, mesh.TransformInv, false));
-    manifold.Depth = localMaxRenderDistance;
+        Vertex v1 = GetVertex(triangle.V1);
+        Vertex v2 = GetVertex(triangle.V2);
+        Vertex v3 = GetVertex(triangle.V3);
 
+        CollisionManifold current;
+        if (TriangleIntersection(ray, v1, v2, v3, mesh.MaterialId, current) && current.Depth < manifold.Depth && (!firstHit || current.Depth >= localMinRenderDistance))
+        {
+            manifold = current;
+        }
+    }
+}
+
+void BinaryBVHIntersection(in Ray ray, in Mesh mesh, in bool firstHit, in float localMinRenderDistance, inout CollisionManifold manifold)
+{
     float bbhits[4];
 
     vec2 todo[64];
@@ -96,20 +107,7 @@ bool MeshIntersection(in Ray ray, in Mesh mesh, in bool firstHit, out CollisionM
 
         if (node.RightOffset == 0)
         {
-            for (int o = 0; o < node.PrimitiveCount; ++o)
-            {
-                Triangle triangle = GetTriangle(node.Start + o + mesh.TriangleOffset);
-
-                Vertex v1 = GetVertex(triangle.V1);
-                Vertex v2 = GetVertex(triangle.V2);
-                Vertex v3 = GetVertex(triangle.V3);
-
-                CollisionManifold current;
-                if (TriangleIntersection(ray, v1, v2, v3, mesh.MaterialId, current) && current.Depth < manifold.Depth && (!firstHit || current.Depth >= localMinRenderDistance))
-                {
-                    manifold = current;
-                }
-            }
+            LeafIntersection(ray, mesh, node.Start, node.PrimitiveCount, firstHit, localMinRenderDistance, manifold);
         }
         else
         {
@@ -144,11 +142,209 @@ bool MeshIntersection(in Ray ray, in Mesh mesh, in bool firstHit, out CollisionM
             }
         }
     }
+}
+
+void WideBVHIntersection(in Ray ray, in Mesh mesh, in bool firstHit, in float localMinRenderDistance, inout CollisionManifold manifold)
+{
+    // Up to 3 pending entries per level, the wide tree is at most half as deep as the binary one
+    vec2 todo[80];
+    int stackptr = 0;
+
+    todo[stackptr] = vec2(mesh.NodeOffset, -1);
+
+    while (stackptr >= 0)
+    {
+        int ni = int(todo[stackptr].x);
+        float near = todo[stackptr].y;
+        stackptr--;
+
+        if (near > manifold.Depth) continue;
+
+        if (ni < 0)
+        {
+            Node leaf = GetNode(-ni - 1);
+            LeafIntersection(ray, mesh, leaf.Start, leaf.PrimitiveCount, firstHit, localMinRenderDistance, manifold);
+            continue;
+        }
+
+        // Sort the hit children by distance
+        float nears[4];
+        int order[4];
+        int hitCount = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            Node child = GetNode(ni + i);
+
+            float tNear, tFar;
+            if ((child.PrimitiveCount == 0 && child.RightOffset == 0) ||
+                !AABBIntersection(ray, child.BboxMin, child.BboxMax, tNear, tFar))
+            {
+                continue;
+            }
+
+            int j = hitCount++;
+            for (; j > 0 && nears[j - 1] > tNear; j--)
+            {
+                nears[j] = nears[j - 1];
+                order[j] = order[j - 1];
+            }
+
+            nears[j] = tNear;
+            order[j] = i;
+        }
+
+        // Pushed farthest first, leaf children are pushed as negative record indices
+        for (int i = hitCount - 1; i >= 0; i--)
+        {
+            int rightOffset = int(texelFetch(BVH, (ni + order[i]) * 3 + 2).z);
+            todo[++stackptr] = vec2(rightOffset == 0 ? -(ni + order[i]) - 1 : ni + rightOffset, nears[i]);
+        }
+    }
+}
+
+void QuantizedBVHIntersection(in Ray ray, in Mesh mesh, in bool firstHit, in float localMinRenderDistance, inout CollisionManifold manifold)
+{
+    // See Scene::quantizeBVH for the layout of the words
+    uint boundWords = BVHQuantizationBits * 3u / 4u;
+    int nodeSize = int(boundWords + 9u) / 4;
+
+    // Integer indices, so large scenes do not lose precision
+    int todo[80];
+    float todoNear[80];
+    int stackptr = 0;
+
+    todo[stackptr] = int(mesh.NodeOffset);
+    todoNear[stackptr] = -1;
+
+    while (stackptr >= 0)
+    {
+        int ni = todo[stackptr];
+        float near = todoNear[stackptr];
+        stackptr--;
+
+        if (near > manifold.Depth) continue;
+
+        if (ni < 0)
+        {
+            // Leaf children are pushed as negative child indices
+            int record = -ni - 1;
+            uint child = uint(record & 3);
+            int base = (record >> 2) * nodeSize;
+            uint countWord = boundWords + child / 2u;
+            uint referenceWord = boundWords + 2u + child;
+            uint count = (texelFetch(BVHData, base + int(countWord / 4u))[countWord % 4u] >> (16u * (child % 2u))) & 0xFFFFu;
+            uint start = texelFetch(BVHData, base + int(referenceWord / 4u))[referenceWord % 4u];
+            LeafIntersection(ray, mesh, int(start), int(count), firstHit, localMinRenderDistance, manifold);
+            continue;
+        }
+
+        vec3 origin = texelFetch(BVH, ni * 2 + 0).xyz;
+        vec3 scale = texelFetch(BVH, ni * 2 + 1).xyz;
+        uvec4 data1 = texelFetch(BVHData, ni * nodeSize + 0);
+        uvec4 data2 = texelFetch(BVHData, ni * nodeSize + 1);
+        uvec4 data3 = texelFetch(BVHData, ni * nodeSize + 2);
+
+        // Unpack the four children at once
+        uvec4 minX, minY, minZ, maxX, maxY, maxZ, counts, references;
+        uvec4 countShifts = uvec4(0u, 16u, 0u, 16u);
+        if (BVHQuantizationBits == 8u)
+        {
+            uvec4 shifts = uvec4(0u, 8u, 16u, 24u);
+            minX = (uvec4(data1.x) >> shifts) & 0xFFu;
+            minY = (uvec4(data1.y) >> shifts) & 0xFFu;
+            minZ = (uvec4(data1.z) >> shifts) & 0xFFu;
+            maxX = (uvec4(data1.w) >> shifts) & 0xFFu;
+            maxY = (uvec4(data2.x) >> shifts) & 0xFFu;
+            maxZ = (uvec4(data2.y) >> shifts) & 0xFFu;
+            counts = (data2.zzww >> countShifts) & 0xFFFFu;
+            references = data3;
+        }
+        else
+        {
+            uvec4 data4 = texelFetch(BVHData, ni * nodeSize + 3);
+            uvec4 data5 = texelFetch(BVHData, ni * nodeSize + 4);
+            minX = (data1.xxyy >> countShifts) & 0xFFFFu;
+            minY = (data1.zzww >> countShifts) & 0xFFFFu;
+            minZ = (data2.xxyy >> countShifts) & 0xFFFFu;
+            maxX = (data2.zzww >> countShifts) & 0xFFFFu;
+            maxY = (data3.xxyy >> countShifts) & 0xFFFFu;
+            maxZ = (data3.zzww >> countShifts) & 0xFFFFu;
+            counts = (data4.xxyy >> countShifts) & 0xFFFFu;
+            references = uvec4(data4.zw, data5.xy);
+        }
+
+        // Slab test of the four children at once, same operations as AABBIntersection
+        vec4 x1 = (origin.x + vec4(minX) * scale.x - ray.Origin.x) * ray.InvDirection.x;
+        vec4 x2 = (origin.x + vec4(maxX) * scale.x - ray.Origin.x) * ray.InvDirection.x;
+        vec4 y1 = (origin.y + vec4(minY) * scale.y - ray.Origin.y) * ray.InvDirection.y;
+        vec4 y2 = (origin.y + vec4(maxY) * scale.y - ray.Origin.y) * ray.InvDirection.y;
+        vec4 z1 = (origin.z + vec4(minZ) * scale.z - ray.Origin.z) * ray.InvDirection.z;
+        vec4 z2 = (origin.z + vec4(maxZ) * scale.z - ray.Origin.z) * ray.InvDirection.z;
+        vec4 tNear = max(max(min(x1, x2), min(y1, y2)), min(z1, z2));
+        vec4 tFar = min(min(max(x1, x2), max(y1, y2)), max(z1, z2));
+        uvec4 hits = uvec4(lessThanEqual(tNear, tFar)) & uvec4(greaterThanEqual(tFar, vec4(0))) & uvec4(notEqual(counts | references, uvec4(0u)));
+
+        // Sort the hit children by distance
+        float nears[4];
+        int entries[4];
+        int hitCount = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            if (hits[i] == 0u)
+            {
+                continue;
+            }
+
+            int j = hitCount++;
+            for (; j > 0 && nears[j - 1] > tNear[i]; j--)
+            {
+                nears[j] = nears[j - 1];
+                entries[j] = entries[j - 1];
+            }
+
+            nears[j] = tNear[i];
+            entries[j] = counts[i] != 0u ? -(ni * 4 + i) - 1 : ni + int(references[i]);
+        }
+
+        // Pushed farthest first
+        for (int i = hitCount - 1; i >= 0; i--)
+        {
+            stackptr++;
+            todo[stackptr] = entries[i];
+            todoNear[stackptr] = nears[i];
+        }
+    }
+}
+
+bool MeshIntersection(in Ray ray, in Mesh mesh, in bool firstHit, out CollisionManifold manifold)
+{
+    vec3 rayOrigin = ray.Origin;
+    ray.Origin = Transform(ray.Origin, mesh.TransformInv, true);
+    ray.Direction = normalize(Transform(ray.Direction, mesh.TransformInv, false));
+    ray.InvDirection = 1 / ray.Direction;
+
+    float localMinRenderDistance = length(Transform(ray.Direction * MinRenderDistance, mesh.TransformInv, false));
+    float localMaxRenderDistance = length(Transform(ray.Direction * MaxRenderDistance, mesh.TransformInv, false));
+    manifold.Depth = localMaxRenderDistance;
+
+    if (BVHLayout == BVH_LAYOUT_WIDE)
+    {
+        WideBVHIntersection(ray, mesh, firstHit, localMinRenderDistance, manifold);
+    }
+    else if (BVHLayout == BVH_LAYOUT_QUANTIZED)
+    {
+        QuantizedBVHIntersection(ray, mesh, firstHit, localMinRenderDistance, manifold);
+    }
+    else
+    {
+        BinaryBVHIntersection(ray, mesh, firstHit, localMinRenderDistance, manifold);
+    }
 
     if (manifold.Depth < localMaxRenderDistance)
     {
         manifold.Point = Transform(manifold.Point, mesh.Transform, true);
         manifold.Depth = length(manifold.Point - rayOrigin);
+        manifold.UVDensity += log2(localMaxRenderDistance / MaxRenderDistance);
         manifold.Normal = normalize(Transform(manifold.Normal, mesh.Transform, false));
         manifold.Tangent = normalize(Transform(manifold.Tangent, mesh.Transform, false));
         manifold.Bitangent = normalize(Transform(manifold.Bitangent, mesh.Transform, false));
@@ -162,15 +358,74 @@ bool FindIntersection(in Ray ray, in bool firstHit, out CollisionManifold manifo
 {
     manifold.Depth = MaxRenderDistance;
 
-    int meshCount = GetMeshCount();
-    for (int meshId = 0; meshId < meshCount; meshId++)
+    if (textureSize(TLAS) == 0)
     {
-        Mesh mesh = GetMesh(meshId);
+        return false;
+    }
 
-        CollisionManifold current;
-        if (MeshIntersection(ray, mesh, firstHit, current) && current.Depth < manifold.Depth)
+    float bbhits[4];
+
+    Node root = GetTLASNode(0);
+    if (!AABBIntersection(ray, root.BboxMin, root.BboxMax, bbhits[0], bbhits[1]))
+    {
+        return false;
+    }
+
+    vec2 todo[64];
+    int stackptr = 0;
+
+    todo[stackptr] = vec2(0, bbhits[0]);
+
+    while (stackptr >= 0)
+    {
+        int ni = int(todo[stackptr].x);
+        float near = todo[stackptr].y;
+        stackptr--;
+
+        if (near > manifold.Depth) continue;
+
+        Node node = GetTLASNode(ni);
+
+        if (node.RightOffset == 0)
         {
-            manifold = current;
+            // Leaf nodes hold a single mesh
+            CollisionManifold current;
+            if (MeshIntersection(ray, GetMesh(node.Start), firstHit, current) && current.Depth < manifold.Depth)
+            {
+                manifold = current;
+            }
+        }
+        else
+        {
+            Node c0 = GetTLASNode(ni + 1);
+            Node c1 = GetTLASNode(ni + node.RightOffset);
+
+            bool hitc0 = AABBIntersection(ray, c0.BboxMin, c0.BboxMax, bbhits[0], bbhits[1]);
+            bool hitc1 = AABBIntersection(ray, c1.BboxMin, c1.BboxMax, bbhits[2], bbhits[3]);
+
+            if (hitc0 && hitc1)
+            {
+                int closer = ni + 1;
+                int other = ni + node.RightOffset;
+
+                if (bbhits[2] < bbhits[0])
+                {
+                    swap(bbhits[0], bbhits[2]);
+                    swap(bbhits[1], bbhits[3]);
+                    swap(closer, other);
+                }
+
+                todo[++stackptr] = vec2(other, bbhits[2]);
+                todo[++stackptr] = vec2(closer, bbhits[0]);
+            }
+            else if (hitc0)
+            {
+                todo[++stackptr] = vec2(ni + 1, bbhits[0]);
+            }
+            else if (hitc1)
+            {
+                todo[++stackptr] = vec2(ni + node.RightOffset, bbhits[2]);
+            }
         }
     }
 
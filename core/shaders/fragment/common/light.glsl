@@ -0,0 +1,255 @@
+// The light sample of the last Lambertian bounce, its light counts once the shadow ray reaches the light
+Ray ShadowRay;
+float ShadowDistance = 0;
+
+float PowerHeuristic(float pdf, float otherPdf)
+{
+    float pdf2 = pdf * pdf;
+    return pdf2 / (pdf2 + otherPdf * otherPdf);
+}
+
+bool HasEnvironmentLight()
+{
+    return Environment.Intensity > 0 && texelFetch(EnvironmentDistribution, 0).x > 0;
+}
+
+// Share of the light samples taken by the emissive triangles, the environment takes the rest
+float GetTriangleLightShare()
+{
+    if (GetLightCount() == 0)
+    {
+        return 0;
+    }
+
+    return HasEnvironmentLight() ? 0.5 : 1;
+}
+
+// Solid angle density of picking a point of an emissive material by light sampling
+float GetLightPdf(int materialId, float distance, float cosine)
+{
+    if (GetLightCount() == 0)
+    {
+        return 0;
+    }
+
+    return GetTriangleLightShare() * GetLightAreaPdf(materialId) * distance * distance / max(cosine, 1e-6);
+}
+
+// Solid angle density of picking a direction of the environment by light sampling
+float GetEnvironmentPdf(in vec3 direction)
+{
+    if (!HasEnvironmentLight())
+    {
+        return 0;
+    }
+
+    vec4 header = texelFetch(EnvironmentDistribution, 0);
+    ivec2 size = ivec2(header.xy);
+    direction = Environment.Rotation * direction;
+    float u = atan(direction.z, direction.x) * INV_TWO_PI + 0.5;
+    float v = acos(clamp(direction.y, -1.0, 1.0)) * INV_PI;
+    ivec2 pixel = min(ivec2(vec2(u, v) * size), size - 1);
+    float weight = texelFetch(EnvironmentDistribution, 1 + size.y + pixel.y * size.x + pixel.x).z;
+    float sinTheta = sqrt(max(1 - direction.y * direction.y, 0));
+    return (1 - GetTriangleLightShare()) * weight * header.z * size.x * size.y * INV_TWO_PI * INV_PI / max(sinTheta, 1e-6);
+}
+
+// Environment reached by the path, the escapes after a Lambertian bounce were sampled there as well
+vec3 GetEnvironmentLight(in Ray ray)
+{
+    vec3 light = GetEnvironment(ray);
+    if (ray.ScatterPdf > 0.0)
+    {
+        light *= PowerHeuristic(ray.ScatterPdf, GetEnvironmentPdf(ray.Direction));
+    }
+
+    return light;
+}
+
+// The shadow rays pass through the surfaces the paths pass through
+bool IsTransmitted(in Ray ray, in CollisionManifold manifold)
+{
+    Material material = GetMaterial(manifold.MaterialId);
+    float footprint = manifold.UVDensity + log2(ray.ConeWidth / max(abs(dot(manifold.Normal, ray.Direction)), 0.01));
+    if (material.AlbedoTextureId >= 0 && GetTexture(material.AlbedoTextureId, manifold.TextureCoordinate, footprint).a < RandomValue())
+    {
+        return true;
+    }
+
+    if (material.Density <= 0.0)
+    {
+        return false;
+    }
+
+    vec3 normal = manifold.IsFrontFace ? manifold.Normal : -manifold.Normal;
+    if (material.FresnelStrength > 0.0 &&
+        1.0 - pow(dot(normal, -ray.Direction), material.FresnelStrength) >= RandomValue())
+    {
+        return false;
+    }
+
+    return manifold.IsFrontFace || -log(RandomValue()) / material.Density >= manifold.Depth;
+}
+
+// Follows the shadow ray past the surface it found, the light is added once the ray reaches it
+void ContinueShadow(inout Ray ray, bool isHit, in CollisionManifold manifold)
+{
+    if (!isHit || manifold.Depth >= ShadowDistance)
+    {
+        ray.IncomingLight += ShadowRay.IncomingLight;
+        ShadowDistance = 0;
+        return;
+    }
+
+    ShadowRay.ConeWidth += ShadowRay.ConeSpread * manifold.Depth;
+    if (!IsTransmitted(ShadowRay, manifold))
+    {
+        ShadowDistance = 0;
+        return;
+    }
+
+    ShadowRay.Origin = manifold.Point;
+    ShadowDistance -= manifold.Depth;
+}
+
+// Picks a point on an emissive triangle in proportion to its power
+void SampleTriangleLight(in Ray ray, in CollisionManifold manifold, in vec3 albedo, float share)
+{
+    int lightCount = GetLightCount();
+
+    // Alias table
+    float slot = RandomValue() * lightCount;
+    int index = min(int(slot), lightCount - 1);
+    Light light = GetLight(index);
+    if (slot - index >= light.Probability)
+    {
+        light = GetLight(light.Alias);
+    }
+
+    Mesh mesh = GetMesh(light.MeshId);
+    Triangle triangle = GetTriangle(light.TriangleId);
+    Vertex v1 = GetVertex(triangle.V1);
+    Vertex v2 = GetVertex(triangle.V2);
+    Vertex v3 = GetVertex(triangle.V3);
+
+    // Uniform point on the triangle
+    vec2 value = RandomValue2();
+    float r = sqrt(value.x);
+    float s = value.y;
+    vec3 weights = vec3(1 - r, r * (1 - s), r * s);
+
+    vec3 p1 = Transform(v1.Position, mesh.Transform, true);
+    vec3 p2 = Transform(v2.Position, mesh.Transform, true);
+    vec3 p3 = Transform(v3.Position, mesh.Transform, true);
+    vec3 normal = cross(p2 - p1, p3 - p1);
+    vec3 toLight = p1 * weights.x + p2 * weights.y + p3 * weights.z - manifold.Point;
+    float distance = length(toLight);
+    vec3 direction = toLight / distance;
+    float cosine = dot(manifold.Normal, direction);
+    float lightCosine = abs(dot(normal, direction)) / length(normal);
+    if (cosine <= 0 || lightCosine <= 0)
+    {
+        return;
+    }
+
+    Material material = GetMaterial(mesh.MaterialId);
+    vec2 uv = v1.TextureCoordinate * weights.x + v2.TextureCoordinate * weights.y + v3.TextureCoordinate * weights.z;
+    vec2 edgeUV12 = v2.TextureCoordinate - v1.TextureCoordinate;
+    vec2 edgeUV13 = v3.TextureCoordinate - v1.TextureCoordinate;
+    float uvDensity = 0.5 * log2(abs(edgeUV12.x * edgeUV13.y - edgeUV12.y * edgeUV13.x) / length(normal));
+    float footprint = uvDensity + log2((ray.ConeWidth + ray.ConeSpread * distance) / max(lightCosine, 0.01));
+
+    vec3 emission = material.EmissionColor * material.EmissionStrength;
+    if (material.EmissionTextureId >= 0)
+    {
+        emission *= GetTexture(material.EmissionTextureId, uv, footprint).rgb;
+    }
+
+    // Alpha blended lights are only there for a part of the paths
+    if (material.AlbedoTextureId >= 0)
+    {
+        emission *= GetTexture(material.AlbedoTextureId, uv, footprint).a;
+    }
+
+    if (emission == vec3(0))
+    {
+        return;
+    }
+
+    // The hits of the BSDF sampling only know the interpolated normal, the weights use it on both sides
+    float areaPdf = GetLightAreaPdf(mesh.MaterialId);
+    vec3 lightNormal = normalize(Transform(v1.Normal * weights.x + v2.Normal * weights.y + v3.Normal * weights.z, mesh.Transform, false));
+    float weight = PowerHeuristic(GetLightPdf(mesh.MaterialId, distance, abs(dot(lightNormal, direction))), cosine * INV_PI);
+
+    vec3 contribution = emission * albedo * INV_PI * cosine * weight * lightCosine / (share * areaPdf * distance * distance);
+    ShadowRay = Ray(manifold.Point, direction, 1 / direction, vec3(1), contribution * ray.Color, ray.ConeWidth, ray.ConeSpread, 0, 0);
+
+    // Stop short of the light itself
+    ShadowDistance = distance * 0.999;
+}
+
+// Picks a direction of the environment in proportion to its luminance
+void SampleEnvironmentLight(in Ray ray, in CollisionManifold manifold, in vec3 albedo, float share)
+{
+    vec4 header = texelFetch(EnvironmentDistribution, 0);
+    ivec2 size = ivec2(header.xy);
+
+    // Row from the alias table of the rows, then the pixel from the alias table of the row
+    vec2 value = RandomValue2();
+    float slot = value.x * size.y;
+    int row = min(int(slot), size.y - 1);
+    vec4 entry = texelFetch(EnvironmentDistribution, 1 + row);
+    if (slot - row >= entry.x)
+    {
+        row = int(entry.y);
+    }
+
+    slot = value.y * size.x;
+    int column = min(int(slot), size.x - 1);
+    entry = texelFetch(EnvironmentDistribution, 1 + size.y + row * size.x + column);
+    if (slot - column >= entry.x)
+    {
+        column = int(entry.y);
+        entry = texelFetch(EnvironmentDistribution, 1 + size.y + row * size.x + column);
+    }
+
+    // Uniform point in the pixel, mapped the same way as GetEnvironment
+    value = RandomValue2();
+    float phi = ((column + value.x) / size.x - 0.5) * TWO_PI;
+    float theta = (row + value.y) / size.y * TWO_PI * 0.5;
+    float sinTheta = sin(theta);
+    vec3 direction = transpose(Environment.Rotation) * vec3(sinTheta * cos(phi), cos(theta), sinTheta * sin(phi));
+    float cosine = dot(manifold.Normal, direction);
+    if (cosine <= 0 || sinTheta <= 0)
+    {
+        return;
+    }
+
+    float pdf = share * entry.z * header.z * size.x * size.y * INV_TWO_PI * INV_PI / sinTheta;
+    float weight = PowerHeuristic(pdf, cosine * INV_PI);
+    ShadowRay = Ray(manifold.Point, direction, 1 / direction, vec3(1), vec3(0), ray.ConeWidth, ray.ConeSpread, 0, 0);
+    ShadowRay.IncomingLight = GetEnvironment(ShadowRay) * albedo * INV_PI * cosine * weight / pdf * ray.Color;
+
+    // Nothing lies beyond the environment
+    ShadowDistance = 1e30;
+}
+
+// Samples the lights for a Lambertian surface, the shadow ray carries their light weighted against the BSDF sampling
+void SampleLight(in Ray ray, in CollisionManifold manifold, in vec3 albedo)
+{
+    ShadowDistance = 0;
+    float triangleShare = GetTriangleLightShare();
+    if (triangleShare == 0 && !HasEnvironmentLight())
+    {
+        return;
+    }
+
+    if (RandomValue() < triangleShare)
+    {
+        SampleTriangleLight(ray, manifold, albedo, triangleShare);
+    }
+    else
+    {
+        SampleEnvironmentLight(ray, manifold, albedo, 1 - triangleShare);
+    }
+}
@@ -0,0 +1,155 @@
+// Starts the next segment of the path, the pdf is only known for Lambertian bounces
+void Bounce(inout Ray ray, in vec3 origin, in vec3 direction, float pdf)
+{
+    ray.Origin = origin;
+    ray.Direction = direction;
+    ray.ScatterPdf = pdf;
+    ray.ScatterDistance = 0;
+}
+
+bool CollisionReact(inout Ray ray, inout CollisionManifold manifold)
+{
+    Material material = GetMaterial(manifold.MaterialId);
+    ray.ScatterDistance += manifold.Depth;
+
+    // Ray cone footprint, without the size of the texture
+    float footprint = manifold.UVDensity + log2(ray.ConeWidth / max(abs(dot(manifold.Normal, ray.Direction)), 0.01));
+
+    if (material.AlbedoTextureId >= 0)
+    {
+        vec4 texAlbedo = GetTexture(material.AlbedoTextureId, manifold.TextureCoordinate, footprint);
+        material.AlbedoColor *= texAlbedo.rgb;
+
+        // Alpha blend
+        if (texAlbedo.a < RandomValue())
+        {
+            return false;
+        }
+    }
+
+    if (material.MetalnessTextureId >= 0)
+    {
+        material.Metalness *= GetTexture(material.MetalnessTextureId, manifold.TextureCoordinate, footprint).b;
+    }
+
+    if (material.RoughnessTextureId >= 0)
+    {
+        material.Roughness *= GetTexture(material.RoughnessTextureId, manifold.TextureCoordinate, footprint).g;
+    }
+
+    material.EmissionColor *= material.EmissionStrength;
+    if (material.EmissionTextureId >= 0)
+    {
+        material.EmissionColor *= GetTexture(material.EmissionTextureId, manifold.TextureCoordinate, footprint).rgb;
+    }
+
+    // Lights found after a Lambertian bounce were sampled there as well
+    if (ray.ScatterPdf > 0.0)
+    {
+        float lightPdf = GetLightPdf(manifold.MaterialId, ray.ScatterDistance, abs(dot(manifold.Normal, ray.Direction)));
+        material.EmissionColor *= PowerHeuristic(ray.ScatterPdf, lightPdf);
+    }
+
+    if (material.NormalTextureId >= 0)
+    {
+        vec3 texNormal = GetTexture(material.NormalTextureId, manifold.TextureCoordinate, footprint).rgb;
+        texNormal.y = 1 - texNormal.y;
+        texNormal = normalize(texNormal * 2 - 1);
+        manifold.Normal = normalize(manifold.Tangent * texNormal.x + manifold.Bitangent * texNormal.y + manifold.Normal * texNormal.z);
+    }
+
+    if (!manifold.IsFrontFace)
+    {
+        manifold.Normal *= -1;
+    }
+
+    vec3 specularDir = reflect(ray.Direction, manifold.Normal);
+    vec3 diffuseDir = normalize(RandomVector3() + manifold.Normal);
+
+    if (material.Metalness <= RandomValue() && RandomValue() >= 0.2)
+    {
+        material.Roughness = 1;
+    }
+
+    // Fresnel
+    if (material.FresnelStrength > 0.0 &&
+        1.0 - pow(dot(manifold.Normal, -ray.Direction), material.FresnelStrength) >= RandomValue())
+    {
+        Bounce(ray, manifold.Point, specularDir, 0);
+
+        ray.IncomingLight += material.EmissionColor * ray.Color;
+        ray.Color *= material.FresnelColor;
+        return true;
+    }
+
+    // Density
+    if (material.Density > 0.0)
+    {
+        float depth = -log(RandomValue()) / material.Density;
+        if (manifold.IsFrontFace || depth >= manifold.Depth)
+        {
+            return false;
+        }
+
+        Bounce(ray, ray.Origin + ray.Direction * depth, RandomVector3(), 0);
+
+        ray.IncomingLight += material.EmissionColor * ray.Color;
+        ray.Color *= material.AlbedoColor;
+        return true;
+    }
+
+    // Refract
+    if (material.IOR > 0.0)
+    {
+        vec3 refractedDir = refract(ray.Direction, manifold.Normal, manifold.IsFrontFace ? 1.0 / material.IOR : material.IOR);
+        if (refractedDir == vec3(0))
+        {
+            refractedDir = specularDir;
+        }
+
+        Bounce(ray, manifold.Point, refractedDir, 0);
+
+        ray.IncomingLight += material.EmissionColor * ray.Color;
+        ray.Color *= material.AlbedoColor;
+        return true;
+    }
+
+    // Scatter
+    ray.IncomingLight += material.EmissionColor * ray.Color;
+    if (material.Roughness >= 1.0)
+    {
+        // Lambertian, the cosine weighted direction is combined with a light sample
+        SampleLight(ray, manifold, material.AlbedoColor);
+        Bounce(ray, manifold.Point, diffuseDir, max(dot(manifold.Normal, diffuseDir), 0) * INV_PI);
+    }
+    else
+    {
+        Bounce(ray, manifold.Point, Slerp(specularDir, diffuseDir, material.Roughness), 0);
+    }
+
+    ray.Color *= material.AlbedoColor;
+    return true;
+}
+
+// Russian roulette, the paths carrying little light stop early and the survivors are weighted up so the mean is kept
+bool SurviveRoulette(inout Ray ray, uint bounce)
+{
+    if (RussianRouletteDepth == 0u || bounce < RussianRouletteDepth)
+    {
+        return true;
+    }
+
+    float probability = min(max(ray.Color.r, max(ray.Color.g, ray.Color.b)), 1.0);
+    if (probability >= 1.0)
+    {
+        return true;
+    }
+
+    if (RandomValue() >= probability)
+    {
+        return false;
+    }
+
+    ray.Color /= probability;
+    return true;
+}
@@ -1,32 +1,124 @@
 const float TWO_PI     = 6.28318530717958648;
 
-uint Seed = uint((TexCoords.x + TexCoords.y * TexCoords.x) * 549856.0) + FrameCount * 5458u;
+const uint SAMPLER_RANDOM     = 0u;
+const uint SAMPLER_SOBOL      = 1u;
+const uint SAMPLER_BLUE_NOISE = 2u;
+
+// The camera takes the first dimensions, every bounce starts a block so that the samples of a pixel line up
+const uint CAMERA_DIMENSIONS = 4u;
+const uint BOUNCE_DIMENSIONS = 16u;
+const uint BLUE_NOISE_SIZE   = 64u;
+
+uint Seed;
+uvec2 SamplePixel;
+uint SampleDimension;
+
+uint Hash(uint x)
+{
+    x = x * 747796405u + 2891336453u;
+    x = ((x >> ((x >> 28) + 4u)) ^ x) * 277803737u;
+    return (x >> 22) ^ x;
+}
+
+void InitSampler(uvec2 pixel)
+{
+    SamplePixel = pixel;
+    SampleDimension = 0u;
+    Seed = Hash(pixel.x ^ Hash(pixel.y ^ Hash(FrameCount)));
+}
+
+// Moves to the block of the bounce, unless the previous bounce already went past its start
+void StartSampleBounce(uint bounce)
+{
+    SampleDimension = max(SampleDimension, CAMERA_DIMENSIONS + bounce * BOUNCE_DIMENSIONS);
+}
+
+// Hash based Owen scrambling, every bit is flipped depending on the bits above it (Laine-Karras permutation)
+uint OwenScramble(uint x, uint seed)
+{
+    x = bitfieldReverse(x);
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return bitfieldReverse(x);
+}
+
+// Second dimension of the Sobol sequence, the first one is the index with its bits reversed
+uint Sobol1(uint index)
+{
+    uint result = 0u;
+    for (uint direction = 1u << 31; index != 0u; index >>= 1, direction ^= direction >> 1)
+    {
+        if ((index & 1u) != 0u)
+        {
+            result ^= direction;
+        }
+    }
+
+    return result;
+}
+
+// Every pair of dimensions is a two dimensional Sobol sequence with its samples shuffled, so that the pairs are independent
+uint SobolSample(uint index, uint dimension, uint seed)
+{
+    index = OwenScramble(index, Hash(seed ^ Hash(dimension >> 1)));
+    uint value = (dimension & 1u) == 0u ? bitfieldReverse(index) : Sobol1(index);
+    return OwenScramble(value, Hash(seed ^ Hash(dimension) ^ 0x68bc21ebu));
+}
 
 float RandomValue()
 {
-    Seed = Seed * 747796405u + 2891336453u;
-    uint result = ((Seed >> ((Seed >> 28) + 4u)) ^ Seed) * 277803737u;
-    result = (result >> 22) ^ result;
-    return float(result) / 4294967295.0;
+    if (SamplerType == SAMPLER_RANDOM)
+    {
+        Seed = Seed * 747796405u + 2891336453u;
+        uint result = ((Seed >> ((Seed >> 28) + 4u)) ^ Seed) * 277803737u;
+        result = (result >> 22) ^ result;
+        return float(result) / 4294967295.0;
+    }
+
+    uint dimension = SampleDimension++;
+    uint value;
+    if (SamplerType == SAMPLER_SOBOL)
+    {
+        value = SobolSample(FrameCount, dimension, Hash(SamplePixel.x ^ Hash(SamplePixel.y)));
+    }
+    else
+    {
+        // The same sequence for all pixels, shifted modulo 1 by the mask offset for the dimension
+        uint offset = Hash(dimension);
+        uvec2 maskPixel = (SamplePixel + uvec2(offset, offset >> 16)) % BLUE_NOISE_SIZE;
+        float shift = texelFetch(BlueNoise, int(maskPixel.y * BLUE_NOISE_SIZE + maskPixel.x)).r;
+        value = SobolSample(FrameCount, dimension, 0u) + uint(shift * 4294967296.0);
+    }
+
+    // Strictly between 0 and 1
+    return (float(value >> 9) + 0.5) / 8388608.0;
 }
 
-float RandomValueNormalDistribution()
+// Two values of the same pair of dimensions, the Sobol samplers stratify them together
+vec2 RandomValue2()
 {
-    float theta = TWO_PI * RandomValue();
-    float rho = sqrt(-2.0 * log(RandomValue()));
-    return rho * cos(theta);
+    SampleDimension += SampleDimension & 1u;
+    float x = RandomValue();
+    float y = RandomValue();
+    return vec2(x, y);
 }
 
 vec2 RandomVector2()
 {
-    float angle = RandomValue() * TWO_PI;
-    return vec2(cos(angle), sin(angle)) * sqrt(RandomValue());
+    vec2 value = RandomValue2();
+    float angle = value.x * TWO_PI;
+    return vec2(cos(angle), sin(angle)) * sqrt(value.y);
 }
 
+// Uniform direction, from two values so that it keeps the stratification of the samplers
 vec3 RandomVector3()
 {
-    float x = RandomValueNormalDistribution();
-    float y = RandomValueNormalDistribution();
-    float z = RandomValueNormalDistribution();
-    return normalize(vec3(x, y, z));
+    vec2 value = RandomValue2();
+    float z = 1 - 2 * value.x;
+    float radius = sqrt(max(1 - z * z, 0));
+    float angle = value.y * TWO_PI;
+    return vec3(radius * cos(angle), radius * sin(angle), z);
 }
@@ -5,6 +5,10 @@ struct Ray
     vec3 InvDirection;
     vec3 Color;
     vec3 IncomingLight;
+    float ConeWidth;
+    float ConeSpread;
+    float ScatterPdf;
+    float ScatterDistance;
 };
 
 struct Env
@@ -71,6 +75,7 @@ struct CollisionManifold
     float Depth;
     vec3 Point;
     vec2 TextureCoordinate;
+    float UVDensity;
     vec3 Normal;
     vec3 Tangent;
     vec3 Bitangent;
@@ -78,6 +83,14 @@ struct CollisionManifold
     bool IsFrontFace;
 };
 
+struct Light
+{
+    float Probability;
+    int Alias;
+    int MeshId;
+    int TriangleId;
+};
+
 struct Node
 {
     vec3 BboxMin;
@@ -9,6 +9,11 @@ vec3 Transform(in vec3 v, in mat4 matrix, in bool translate)
     return (matrix * vec4(v, translate ? 1 : 0)).xyz;
 }
 
+float Luminance(in vec3 color)
+{
+    return dot(color, vec3(.2126, .7152, .0722));
+}
+
 vec4 ToneMap(in vec4 pixel, in float gamma)
 {
     // Reinhard tone mapping
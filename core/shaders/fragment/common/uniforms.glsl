@@ -1,6 +1,10 @@
 const float INV_PI     = 0.31830988618379067;
 const float INV_TWO_PI = 0.15915494309189533;
 
+const uint BVH_LAYOUT_BINARY = 0u;
+const uint BVH_LAYOUT_WIDE   = 1u;
+const uint BVH_LAYOUT_QUANTIZED = 2u;
+
 layout(binding=0) uniform sampler2D AccumulatorTexture;
 layout(binding=1) uniform sampler2D EnvironmentTexture;
 layout(binding=2) uniform sampler2DArray Textures;
@@ -9,14 +13,36 @@ layout(binding=4) uniform isamplerBuffer Triangles;
 layout(binding=5) uniform samplerBuffer Meshes;
 layout(binding=6) uniform samplerBuffer Materials;
 layout(binding=7) uniform samplerBuffer BVH;
+layout(binding=8) uniform samplerBuffer TLAS;
+layout(binding=9) uniform usamplerBuffer BVHData;
+layout(binding=11) uniform sampler2DArray HalfTextures;
+layout(binding=12) uniform samplerBuffer TextureInfo;
+layout(binding=13) uniform sampler2D MomentsTexture;
+layout(binding=14) uniform sampler2D AlbedoTexture;
+layout(binding=15) uniform sampler2D NormalTexture;
+layout(binding=16) uniform samplerBuffer Lights;
+layout(binding=17) uniform samplerBuffer EnvironmentDistribution;
+layout(binding=18) uniform samplerBuffer BlueNoise;
+layout(binding=19) uniform usamplerBuffer MeshOffsets;
+
+// Only uploaded when the settings change, the layout is mirrored by Renderer::Settings
+layout(std140, binding=0) uniform Settings
+{
+    Cam Camera;
+    Env Environment;
+    uint MaxBounceCount;
+    float MinRenderDistance;
+    float MaxRenderDistance;
+    uint BVHLayout;
+    uint BVHQuantizationBits;
+    float Gamma;
+    float AdaptiveThreshold;
+    uint AdaptiveMinFrameCount;
+    uint SamplerType;
+    uint RussianRouletteDepth;
+};
 
-uniform uint MaxBounceCount;
-uniform float MinRenderDistance;
-uniform float MaxRenderDistance;
 uniform uint FrameCount;
-uniform Cam Camera;
-uniform Env Environment;
-uniform float Gamma;
 
 Triangle GetTriangle(int index)
 {
@@ -42,7 +68,8 @@ Mesh GetMesh(int index)
     vec4 data7 = texelFetch(Meshes, index * 9 + 6);
     vec4 data8 = texelFetch(Meshes, index * 9 + 7);
     vec4 data9 = texelFetch(Meshes, index * 9 + 8);
-    return Mesh(mat4(data1, data2, data3, data4), mat4(data5, data6, data7, data8), int(data9.x), int(data9.y), int(data9.z));
+    uvec4 offsets = texelFetch(MeshOffsets, index);
+    return Mesh(mat4(data1, data2, data3, data4), mat4(data5, data6, data7, data8), int(data9.x), int(offsets.x), int(offsets.y));
 }
 
 int GetMeshCount()
@@ -52,6 +79,12 @@ int GetMeshCount()
 
 Material GetMaterial(int index)
 {
+    // Meshes without a material get the default one of the Material class
+    if (index < 0 || index >= textureSize(Materials) / 5)
+    {
+        return Material(vec3(1), 0, vec3(1), 0, vec3(1), 0, 0, 0, 0, -1, -1, -1, -1, -1);
+    }
+
     vec4 data1 = texelFetch(Materials, index * 5 + 0);
     vec4 data2 = texelFetch(Materials, index * 5 + 1);
     vec4 data3 = texelFetch(Materials, index * 5 + 2);
@@ -60,6 +93,22 @@ Material GetMaterial(int index)
     return Material(data1.rgb, data1.a, data2.rgb, data2.a, data3.rgb, data3.a, data4.x, data4.y, data4.z, int(data4.w), int(data5.x), int(data5.y), int(data5.z), int(data5.w));
 }
 
+int GetLightCount()
+{
+    return textureSize(Lights) == 0 ? 0 : int(texelFetch(Lights, 0).x);
+}
+
+Light GetLight(int index)
+{
+    vec4 data = texelFetch(Lights, index + 1);
+    return Light(data.x, int(data.y), int(data.z), int(data.w));
+}
+
+float GetLightAreaPdf(int materialId)
+{
+    return texelFetch(Lights, GetLightCount() + 1 + materialId).x;
+}
+
 Node GetNode(int index)
 {
     vec4 data1 = texelFetch(BVH, index * 3 + 0);
@@ -68,10 +117,69 @@ Node GetNode(int index)
     return Node(data1.xyz, data2.xyz, int(data3.x), int(data3.y), int(data3.z));
 }
 
+Node GetTLASNode(int index)
+{
+    vec4 data1 = texelFetch(TLAS, index * 3 + 0);
+    vec4 data2 = texelFetch(TLAS, index * 3 + 1);
+    vec4 data3 = texelFetch(TLAS, index * 3 + 2);
+    return Node(data1.xyz, data2.xyz, int(data3.x), int(data3.y), int(data3.z));
+}
+
+vec4 GetTexel(ivec3 coord, bool isHalf)
+{
+    return isHalf ? texelFetch(HalfTextures, coord, 0) : texelFetch(Textures, coord, 0);
+}
+
+vec4 GetTextureLevel(int entry, vec2 uv)
+{
+    // Bilinear filtering with repeat wrapping inside the atlas rectangle of the level
+    vec4 rect = texelFetch(TextureInfo, entry + 0);
+    vec4 info = texelFetch(TextureInfo, entry + 1);
+    bool isHalf = info.y > 0;
+
+    vec2 coord = uv * rect.zw - 0.5;
+    vec2 base = floor(coord);
+    vec2 t = coord - base;
+    ivec2 p0 = ivec2(rect.xy + mod(base, rect.zw));
+    ivec2 p1 = ivec2(rect.xy + mod(base + 1, rect.zw));
+    int layer = int(info.x);
+
+    vec4 c00 = GetTexel(ivec3(p0.x, p0.y, layer), isHalf);
+    vec4 c10 = GetTexel(ivec3(p1.x, p0.y, layer), isHalf);
+    vec4 c01 = GetTexel(ivec3(p0.x, p1.y, layer), isHalf);
+    vec4 c11 = GetTexel(ivec3(p1.x, p1.y, layer), isHalf);
+    return mix(mix(c00, c10, t.x), mix(c01, c11, t.x), t.y);
+}
+
+vec4 GetTexture(int textureId, vec2 uv, float footprint)
+{
+    if (any(isnan(uv)) || any(isinf(uv)))
+    {
+        return vec4(0);
+    }
+
+    // Trilinear filtering, the level of detail is the footprint measured in texels of the first level
+    vec4 header = texelFetch(TextureInfo, textureId);
+    int entry = int(header.x);
+    vec4 rect = texelFetch(TextureInfo, entry);
+    float lod = clamp(footprint + 0.5 * log2(rect.z * rect.w), 0, header.y - 1);
+    int level = int(lod);
+    float t = lod - level;
+
+    vec4 color = GetTextureLevel(entry + level * 2, uv);
+    if (t > 0)
+    {
+        color = mix(color, GetTextureLevel(entry + level * 2 + 2, uv), t);
+    }
+
+    return color;
+}
+
 vec3 GetEnvironment(in Ray ray)
 {
     vec3 direction = Environment.Rotation * ray.Direction;
     float u = atan(direction.z, direction.x) * INV_TWO_PI + 0.5;
     float v = acos(direction.y) * INV_PI;
-    return texture(EnvironmentTexture, vec2(u, v)).rgb * Environment.Intensity;
+    float lod = log2(ray.ConeSpread * textureSize(EnvironmentTexture, 0).y * INV_PI);
+    return textureLod(EnvironmentTexture, vec2(u, v), lod).rgb * Environment.Intensity;
 }
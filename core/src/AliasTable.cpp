@@ -0,0 +1,55 @@
+/**
+ * @file AliasTable.cpp
+ */
+#include "TracerX/AliasTable.h"
+
+using namespace TracerX::core;
+
+void AliasTable::build(const std::vector<double>& weights)
+{
+    size_t count = weights.size();
+    double totalWeight = 0;
+    for (double weight : weights)
+    {
+        totalWeight += weight;
+    }
+
+    // Vose's method, a slot keeps its own index with its probability and otherwise takes its alias
+    std::vector<double> probabilities(count);
+    std::vector<size_t> small;
+    std::vector<size_t> large;
+    this->aliases.resize(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        probabilities[i] = totalWeight > 0 ? weights[i] * count / totalWeight : 1;
+        this->aliases[i] = (int)i;
+        (probabilities[i] < 1 ? small : large).push_back(i);
+    }
+
+    while (!small.empty() && !large.empty())
+    {
+        size_t lower = small.back();
+        size_t upper = large.back();
+        small.pop_back();
+        this->aliases[lower] = (int)upper;
+        probabilities[upper] -= 1 - probabilities[lower];
+        if (probabilities[upper] < 1)
+        {
+            large.pop_back();
+            small.push_back(upper);
+        }
+    }
+
+    // The slots left over only hold rounding errors
+    for (size_t i : small)
+    {
+        probabilities[i] = 1;
+    }
+
+    for (size_t i : large)
+    {
+        probabilities[i] = 1;
+    }
+
+    this->probabilities.assign(probabilities.begin(), probabilities.end());
+}
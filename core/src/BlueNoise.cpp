@@ -0,0 +1,135 @@
+/**
+ * @file BlueNoise.cpp
+ */
+#include "TracerX/BlueNoise.h"
+
+#include <cmath>
+#include <random>
+#include <algorithm>
+
+using namespace TracerX::core;
+
+const std::vector<float>& BlueNoise::getMask()
+{
+    static const std::vector<float> mask = BlueNoise::generate();
+    return mask;
+}
+
+std::vector<float> BlueNoise::generate()
+{
+    // Void and cluster, the energy of a pixel is the sum of a Gaussian of its distance to the set pixels on the torus
+    const int pixelCount = size * size;
+    const int wrap = size - 1;
+    const float sigma = 1.5f;
+
+    std::vector<float> kernel(pixelCount);
+    for (int y = 0; y < (int)size; y++)
+    {
+        for (int x = 0; x < (int)size; x++)
+        {
+            int dx = std::min(x, (int)size - x);
+            int dy = std::min(y, (int)size - y);
+            kernel[y * size + x] = std::exp(-(dx * dx + dy * dy) / (2 * sigma * sigma));
+        }
+    }
+
+    std::vector<float> energy(pixelCount, 0);
+    std::vector<bool> isSet(pixelCount, false);
+    auto toggle = [&](int index)
+    {
+        isSet[index] = !isSet[index];
+        float sign = isSet[index] ? 1.f : -1.f;
+        int x0 = index % size;
+        int y0 = index / size;
+        for (int y = 0; y < (int)size; y++)
+        {
+            for (int x = 0; x < (int)size; x++)
+            {
+                energy[y * size + x] += sign * kernel[((y - y0) & wrap) * size + ((x - x0) & wrap)];
+            }
+        }
+    };
+
+    auto findTightestCluster = [&]()
+    {
+        int best = -1;
+        for (int i = 0; i < pixelCount; i++)
+        {
+            if (isSet[i] && (best < 0 || energy[i] > energy[best]))
+            {
+                best = i;
+            }
+        }
+
+        return best;
+    };
+
+    auto findLargestVoid = [&]()
+    {
+        int best = -1;
+        for (int i = 0; i < pixelCount; i++)
+        {
+            if (!isSet[i] && (best < 0 || energy[i] < energy[best]))
+            {
+                best = i;
+            }
+        }
+
+        return best;
+    };
+
+    // Initial pattern of a tenth of the pixels, spread by moving the tightest cluster to the largest void until it stays
+    std::mt19937 random(1);
+    int initialCount = pixelCount / 10;
+    for (int count = 0; count < initialCount; )
+    {
+        int index = (int)(random() % pixelCount);
+        if (!isSet[index])
+        {
+            toggle(index);
+            count++;
+        }
+    }
+
+    for (int i = 0; i < pixelCount; i++)
+    {
+        int cluster = findTightestCluster();
+        toggle(cluster);
+        int largestVoid = findLargestVoid();
+        toggle(largestVoid);
+        if (largestVoid == cluster)
+        {
+            break;
+        }
+    }
+
+    std::vector<float> initialEnergy = energy;
+    std::vector<bool> initialIsSet = isSet;
+    std::vector<int> ranks(pixelCount);
+
+    // The initial pixels are ranked from the tightest clusters down
+    for (int rank = initialCount - 1; rank >= 0; rank--)
+    {
+        int cluster = findTightestCluster();
+        toggle(cluster);
+        ranks[cluster] = rank;
+    }
+
+    // The other pixels fill the largest voids, the last half the same way instead of the inverted pattern
+    energy = initialEnergy;
+    isSet = initialIsSet;
+    for (int rank = initialCount; rank < pixelCount; rank++)
+    {
+        int largestVoid = findLargestVoid();
+        toggle(largestVoid);
+        ranks[largestVoid] = rank;
+    }
+
+    std::vector<float> mask(pixelCount);
+    for (int i = 0; i < pixelCount; i++)
+    {
+        mask[i] = (ranks[i] + .5f) / pixelCount;
+    }
+
+    return mask;
+}
@@ -0,0 +1,1487 @@
+/**
+ * @file CPURenderer.cpp
+ */
+#include "TracerX/CPURenderer.h"
+#include "TracerX/BlueNoise.h"
+
+#include <cmath>
+#include <algorithm>
+#include <glm/gtc/type_ptr.hpp>
+
+using namespace TracerX;
+using namespace TracerX::core;
+
+namespace
+{
+
+const float TWO_PI = 6.28318530717958648f;
+const float INV_PI = 0.31830988618379067f;
+const float INV_TWO_PI = 0.15915494309189533f;
+
+// The camera takes the first dimensions, every bounce starts a block so that the samples of a pixel line up
+const unsigned int CAMERA_DIMENSIONS = 4;
+const unsigned int BOUNCE_DIMENSIONS = 16;
+
+struct Ray
+{
+    glm::vec3 origin;
+    glm::vec3 direction;
+    glm::vec3 invDirection;
+    glm::vec3 color;
+    glm::vec3 incomingLight;
+    float coneWidth;
+    float coneSpread;
+    float scatterPdf;
+    float scatterDistance;
+};
+
+struct CollisionManifold
+{
+    float depth;
+    glm::vec3 point;
+    glm::vec2 textureCoordinate;
+    float uvDensity;
+    glm::vec3 normal;
+    glm::vec3 tangent;
+    glm::vec3 bitangent;
+    int materialId;
+    bool isFrontFace;
+};
+
+struct Node
+{
+    glm::vec3 bboxMin;
+    glm::vec3 bboxMax;
+    int start;
+    int primitiveCount;
+    int rightOffset;
+};
+
+glm::vec4 sampleTexture(const Image& image, glm::vec2 uv)
+{
+    // Bilinear filtering with repeat wrapping (GL_LINEAR, GL_REPEAT)
+    if (image.size.x == 0 || image.size.y == 0)
+    {
+        return glm::vec4(0, 0, 0, 1);
+    }
+
+    if (!std::isfinite(uv.x) || !std::isfinite(uv.y))
+    {
+        return glm::vec4(0);
+    }
+
+    glm::vec2 coord = uv * glm::vec2(image.size) - .5f;
+    glm::vec2 base = glm::floor(coord);
+    glm::vec2 t = coord - base;
+    glm::ivec2 size(image.size);
+    glm::ivec2 p0 = ((glm::ivec2(base) % size) + size) % size;
+    glm::ivec2 p1 = (p0 + 1) % size;
+
+    const glm::vec4* pixels = (const glm::vec4*)image.pixels.data();
+    glm::vec4 c00 = pixels[p0.y * size.x + p0.x];
+    glm::vec4 c10 = pixels[p0.y * size.x + p1.x];
+    glm::vec4 c01 = pixels[p1.y * size.x + p0.x];
+    glm::vec4 c11 = pixels[p1.y * size.x + p1.x];
+    return glm::mix(glm::mix(c00, c10, t.x), glm::mix(c01, c11, t.x), t.y);
+}
+
+glm::vec4 sampleTexture(const Image& image, const std::vector<Image>& mipmaps, glm::vec2 uv, float lod)
+{
+    // Trilinear filtering (GL_LINEAR_MIPMAP_LINEAR), the image is the first level
+    lod = glm::clamp(lod, 0.f, (float)mipmaps.size());
+    size_t level = (size_t)lod;
+    float t = lod - level;
+
+    glm::vec4 color = sampleTexture(level == 0 ? image : mipmaps[level - 1], uv);
+    if (t > 0)
+    {
+        color = glm::mix(color, sampleTexture(mipmaps[level], uv), t);
+    }
+
+    return color;
+}
+
+glm::vec3 slerp(glm::vec3 a, glm::vec3 b, float t)
+{
+    float angle = std::acos(glm::dot(a, b));
+    return std::isnan(angle) || angle == 0 ? b : (std::sin((1 - t) * angle) * a + std::sin(t * angle) * b) / std::sin(angle);
+}
+
+glm::vec3 transform(glm::vec3 v, const glm::mat4& matrix, bool translate)
+{
+    return glm::vec3(matrix * glm::vec4(v, translate ? 1 : 0));
+}
+
+float luminance(glm::vec3 color)
+{
+    return glm::dot(color, glm::vec3(.2126f, .7152f, .0722f));
+}
+
+bool isConverged(glm::vec4 accumColor, glm::vec4 moments, unsigned int frameCount, float threshold, unsigned int minFrameCount)
+{
+    // The moments hold the sum of the squared luminances and the number of summed frames
+    if (threshold <= 0 || moments.b < std::max(minFrameCount, 2u))
+    {
+        return false;
+    }
+
+    // Relative standard error of the mean luminance, counted over the frames of the variance estimate,
+    // so an accumulation loaded without its moments is not trusted after a few frames
+    float mean = luminance(glm::vec3(accumColor)) / frameCount;
+    float variance = std::max(moments.r / moments.b - mean * mean, 0.f);
+    return std::sqrt(variance / moments.b) <= threshold * std::max(mean, .01f);
+}
+
+unsigned int hash(unsigned int x)
+{
+    x = x * 747796405u + 2891336453u;
+    x = ((x >> ((x >> 28) + 4u)) ^ x) * 277803737u;
+    return (x >> 22) ^ x;
+}
+
+unsigned int reverseBits(unsigned int x)
+{
+    x = (x << 16) | (x >> 16);
+    x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+    x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+    x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+    return ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+}
+
+// Hash based Owen scrambling, every bit is flipped depending on the bits above it (Laine-Karras permutation)
+unsigned int owenScramble(unsigned int x, unsigned int seed)
+{
+    x = reverseBits(x);
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return reverseBits(x);
+}
+
+// Second dimension of the Sobol sequence, the first one is the index with its bits reversed
+unsigned int sobol1(unsigned int index)
+{
+    unsigned int result = 0;
+    for (unsigned int direction = 1u << 31; index != 0; index >>= 1, direction ^= direction >> 1)
+    {
+        if (index & 1)
+        {
+            result ^= direction;
+        }
+    }
+
+    return result;
+}
+
+// Every pair of dimensions is a two dimensional Sobol sequence with its samples shuffled, so that the pairs are independent
+unsigned int sobolSample(unsigned int index, unsigned int dimension, unsigned int seed)
+{
+    index = owenScramble(index, hash(seed ^ hash(dimension >> 1)));
+    unsigned int value = (dimension & 1) == 0 ? reverseBits(index) : sobol1(index);
+    return owenScramble(value, hash(seed ^ hash(dimension) ^ 0x68bc21ebu));
+}
+
+glm::vec4 toneMapPixel(glm::vec4 pixel, float gamma)
+{
+    // Reinhard tone mapping
+    glm::vec3 rgb = glm::vec3(pixel) / (glm::vec3(pixel) + glm::vec3(1));
+
+    // Gamma correction
+    rgb = glm::pow(rgb, glm::vec3(1 / gamma));
+
+    return glm::vec4(rgb, pixel.a);
+}
+
+}
+
+class CPURenderer::PathTracer
+{
+public:
+    PathTracer(const CPURenderer& renderer, glm::uvec2 pixel, unsigned int frameCount)
+        : renderer(renderer), pixel(pixel), frameCount(frameCount)
+    {
+        glm::vec2 size(renderer.accumulation.size);
+        this->texCoords = (glm::vec2(pixel) + .5f) / size;
+        this->seed = hash(pixel.x ^ hash(pixel.y ^ hash(frameCount)));
+        this->cameraRight = glm::cross(renderer.camera.forward, renderer.camera.up);
+    }
+
+    glm::vec4 run(glm::vec4& albedoColor, glm::vec4& normalColor)
+    {
+        const Camera& camera = this->renderer.camera;
+        float aspect = (float)this->renderer.accumulation.size.y / this->renderer.accumulation.size.x;
+        glm::vec2 coord = (this->texCoords - glm::vec2(.5f)) * glm::vec2(1, aspect) * 2.f * std::tan(camera.fov / 2);
+        Ray ray{ camera.position, glm::normalize(camera.forward + this->cameraRight * coord.x + camera.up * coord.y), glm::vec3(0), glm::vec3(1), glm::vec3(0), 0, 2 * std::tan(camera.fov / 2) / this->renderer.accumulation.size.x, 0, 0 };
+        return this->pathTrace(ray, albedoColor, normalColor);
+    }
+
+    size_t rayCount = 0;
+    size_t nodeVisitCount = 0;
+    unsigned int bounceCount = 0;
+private:
+    const CPURenderer& renderer;
+    glm::vec2 texCoords;
+    glm::vec3 cameraRight;
+    glm::uvec2 pixel;
+    unsigned int frameCount;
+    unsigned int seed;
+    unsigned int sampleDimension = 0;
+
+    // Moves to the block of the bounce, unless the previous bounce already went past its start
+    void startSampleBounce(unsigned int bounce)
+    {
+        this->sampleDimension = std::max(this->sampleDimension, CAMERA_DIMENSIONS + bounce * BOUNCE_DIMENSIONS);
+    }
+
+    float randomValue()
+    {
+        if (this->renderer.sampler == Sampler::Random)
+        {
+            this->seed = this->seed * 747796405u + 2891336453u;
+            unsigned int result = ((this->seed >> ((this->seed >> 28) + 4u)) ^ this->seed) * 277803737u;
+            result = (result >> 22) ^ result;
+            return (float)result / 4294967295.f;
+        }
+
+        unsigned int dimension = this->sampleDimension++;
+        unsigned int value;
+        if (this->renderer.sampler == Sampler::Sobol)
+        {
+            value = sobolSample(this->frameCount, dimension, hash(this->pixel.x ^ hash(this->pixel.y)));
+        }
+        else
+        {
+            // The same sequence for all pixels, shifted modulo 1 by the mask offset for the dimension
+            unsigned int offset = hash(dimension);
+            glm::uvec2 maskPixel = (this->pixel + glm::uvec2(offset, offset >> 16)) % BlueNoise::size;
+            float shift = BlueNoise::getMask()[maskPixel.y * BlueNoise::size + maskPixel.x];
+            value = sobolSample(this->frameCount, dimension, 0) + (unsigned int)(shift * 4294967296.f);
+        }
+
+        // Strictly between 0 and 1
+        return ((float)(value >> 9) + .5f) / 8388608.f;
+    }
+
+    // Two values of the same pair of dimensions, the Sobol samplers stratify them together
+    glm::vec2 randomValue2()
+    {
+        this->sampleDimension += this->sampleDimension & 1;
+        float x = this->randomValue();
+        float y = this->randomValue();
+        return glm::vec2(x, y);
+    }
+
+    glm::vec2 randomVector2()
+    {
+        glm::vec2 value = this->randomValue2();
+        float angle = value.x * TWO_PI;
+        return glm::vec2(std::cos(angle), std::sin(angle)) * std::sqrt(value.y);
+    }
+
+    // Uniform direction, from two values so that it keeps the stratification of the samplers
+    glm::vec3 randomVector3()
+    {
+        glm::vec2 value = this->randomValue2();
+        float z = 1 - 2 * value.x;
+        float radius = std::sqrt(std::max(1 - z * z, 0.f));
+        float angle = value.y * TWO_PI;
+        return glm::vec3(radius * std::cos(angle), radius * std::sin(angle), z);
+    }
+
+    Node getNode(int index) const
+    {
+        const glm::vec3* data = this->renderer.bvh.data() + index * 3;
+        return Node{ data[0], data[1], (int)data[2].x, (int)data[2].y, (int)data[2].z };
+    }
+
+    Node getTLASNode(int index) const
+    {
+        const glm::vec3* data = this->renderer.tlas.data() + index * 3;
+        return Node{ data[0], data[1], (int)data[2].x, (int)data[2].y, (int)data[2].z };
+    }
+
+    const Material& getMaterial(int index) const
+    {
+        // Meshes without a material get the default one, as in the shaders
+        static const Material defaultMaterial;
+        const std::vector<Material>& materials = this->renderer.materials;
+        return index >= 0 && (size_t)index < materials.size() ? materials[index] : defaultMaterial;
+    }
+
+    glm::vec3 getEnvironment(const Ray& ray) const
+    {
+        const Environment& environment = this->renderer.environment;
+        glm::vec3 direction = environment.rotation * ray.direction;
+        float u = std::atan2(direction.z, direction.x) * INV_TWO_PI + .5f;
+        float v = std::acos(direction.y) * INV_PI;
+        float lod = std::log2(ray.coneSpread * environment.image.size.y * INV_PI);
+        return glm::vec3(sampleTexture(environment.image, environment.mipmaps, glm::vec2(u, v), lod)) * environment.intensity;
+    }
+
+    glm::vec4 getTexture(float textureId, glm::vec2 uv, float footprint) const
+    {
+        if (this->renderer.textures.empty())
+        {
+            return glm::vec4(0, 0, 0, 1);
+        }
+
+        // The level of detail is the footprint measured in texels of the first level
+        size_t index = std::min((size_t)textureId, this->renderer.textures.size() - 1);
+        const Image& texture = this->renderer.textures[index];
+        float lod = footprint + .5f * std::log2((float)texture.size.x * texture.size.y);
+        return sampleTexture(texture, this->renderer.textureMipmaps[index], uv, lod);
+    }
+
+    static bool triangleIntersection(const Ray& ray, const Vertex& v1, const Vertex& v2, const Vertex& v3, int materialId, CollisionManifold& manifold)
+    {
+        glm::vec3 p1 = v1.positionU, p2 = v2.positionU, p3 = v3.positionU;
+        glm::vec3 edge12 = p2 - p1;
+        glm::vec3 edge13 = p3 - p1;
+        glm::vec3 normal = glm::cross(edge12, edge13);
+        float det = -glm::dot(ray.direction, normal);
+
+        if (std::abs(det) <= glm::length(normal) * .01f)
+        {
+            return false;
+        }
+
+        glm::vec3 ao = ray.origin - p1;
+        glm::vec3 dao = glm::cross(ao, ray.direction);
+
+        float invDet = 1.f / det;
+
+        float dst = glm::dot(ao, normal) * invDet;
+        float u = glm::dot(edge13, dao) * invDet;
+        float v = -glm::dot(edge12, dao) * invDet;
+        float w = 1.f - u - v;
+
+        if (dst <= .001f || u < 0 || v < 0 || w < 0)
+        {
+            return false;
+        }
+
+        glm::vec2 uv1(v1.positionU.w, v1.normalV.w), uv2(v2.positionU.w, v2.normalV.w), uv3(v3.positionU.w, v3.normalV.w);
+        glm::vec2 edgeUV12 = uv2 - uv1;
+        glm::vec2 edgeUV13 = uv3 - uv1;
+        float detUV = edgeUV12.x * edgeUV13.y - edgeUV12.y * edgeUV13.x;
+        float invDetUV = 1.f / detUV;
+
+        manifold = CollisionManifold{
+            dst,
+            ray.origin + ray.direction * dst,
+            uv1 * w + uv2 * u + uv3 * v,
+            .5f * std::log2(std::abs(detUV) / glm::length(normal)),
+            glm::normalize(glm::vec3(v1.normalV) * w + glm::vec3(v2.normalV) * u + glm::vec3(v3.normalV) * v),
+            glm::normalize((edge12 * edgeUV13.y - edge13 * edgeUV12.y) * invDetUV),
+            glm::normalize((edge13 * edgeUV12.x - edge12 * edgeUV13.x) * invDetUV),
+            materialId,
+            det >= 0 };
+        return true;
+    }
+
+    static bool AABBIntersection(const Ray& ray, glm::vec3 boxMin, glm::vec3 boxMax, float& tNear, float& tFar)
+    {
+        glm::vec3 tMin = (boxMin - ray.origin) * ray.invDirection;
+        glm::vec3 tMax = (boxMax - ray.origin) * ray.invDirection;
+        glm::vec3 t1 = glm::min(tMin, tMax);
+        glm::vec3 t2 = glm::max(tMin, tMax);
+        tNear = std::max(std::max(t1.x, t1.y), t1.z);
+        tFar = std::min(std::min(t2.x, t2.y), t2.z);
+        return tNear <= tFar && tFar >= 0;
+    }
+
+    void leafIntersection(const Ray& ray, const Mesh& mesh, int start, int count, bool firstHit, float localMinRenderDistance, CollisionManifold& manifold) const
+    {
+        const CPURenderer& renderer = this->renderer;
+        for (int o = 0; o < count; ++o)
+        {
+            const Triangle& triangle = renderer.triangles[start + o + (int)mesh.triangleOffset];
+
+            const Vertex& v1 = renderer.vertices[triangle.v1];
+            const Vertex& v2 = renderer.vertices[triangle.v2];
+            const Vertex& v3 = renderer.vertices[triangle.v3];
+
+            CollisionManifold current{};
+            if (triangleIntersection(ray, v1, v2, v3, (int)mesh.materialId, current) && current.depth < manifold.depth && (!firstHit || current.depth >= localMinRenderDistance))
+            {
+                manifold = current;
+            }
+        }
+    }
+
+    void binaryBVHIntersection(const Ray& ray, const Mesh& mesh, bool firstHit, float localMinRenderDistance, CollisionManifold& manifold)
+    {
+        float bbhits[4];
+
+        std::pair<int, float> todo[64];
+        int stackptr = 0;
+
+        todo[stackptr] = { (int)mesh.nodeOffset, -1.f };
+
+        while (stackptr >= 0)
+        {
+            int ni = todo[stackptr].first;
+            float near = todo[stackptr].second;
+            stackptr--;
+
+            Node node = this->getNode(ni);
+
+            if (near > manifold.depth) continue;
+
+            this->nodeVisitCount++;
+
+            if (node.rightOffset == 0)
+            {
+                this->leafIntersection(ray, mesh, node.start, node.primitiveCount, firstHit, localMinRenderDistance, manifold);
+            }
+            else
+            {
+                Node c0 = this->getNode(ni + 1);
+                Node c1 = this->getNode(ni + node.rightOffset);
+
+                bool hitc0 = AABBIntersection(ray, c0.bboxMin, c0.bboxMax, bbhits[0], bbhits[1]);
+                bool hitc1 = AABBIntersection(ray, c1.bboxMin, c1.bboxMax, bbhits[2], bbhits[3]);
+
+                if (hitc0 && hitc1)
+                {
+                    int closer = ni + 1;
+                    int other = ni + node.rightOffset;
+
+                    if (bbhits[2] < bbhits[0])
+                    {
+                        std::swap(bbhits[0], bbhits[2]);
+                        std::swap(bbhits[1], bbhits[3]);
+                        std::swap(closer, other);
+                    }
+
+                    todo[++stackptr] = { other, bbhits[2] };
+                    todo[++stackptr] = { closer, bbhits[0] };
+                }
+                else if (hitc0)
+                {
+                    todo[++stackptr] = { ni + 1, bbhits[0] };
+                }
+                else if (hitc1)
+                {
+                    todo[++stackptr] = { ni + node.rightOffset, bbhits[2] };
+                }
+            }
+        }
+    }
+
+    void wideBVHIntersection(const Ray& ray, const Mesh& mesh, bool firstHit, float localMinRenderDistance, CollisionManifold& manifold)
+    {
+        // Up to 3 pending entries per level, the wide tree is at most half as deep as the binary one
+        std::pair<int, float> todo[80];
+        int stackptr = 0;
+
+        todo[stackptr] = { (int)mesh.nodeOffset, -1.f };
+
+        while (stackptr >= 0)
+        {
+            int ni = todo[stackptr].first;
+            float near = todo[stackptr].second;
+            stackptr--;
+
+            if (near > manifold.depth) continue;
+
+            if (ni < 0)
+            {
+                Node leaf = this->getNode(-ni - 1);
+                this->leafIntersection(ray, mesh, leaf.start, leaf.primitiveCount, firstHit, localMinRenderDistance, manifold);
+                continue;
+            }
+
+            this->nodeVisitCount++;
+
+            // Sort the hit children by distance
+            const glm::vec3* records = this->renderer.bvh.data() + ni * 3;
+            float nears[4];
+            int order[4];
+            int hitCount = 0;
+            for (int i = 0; i < 4; i++)
+            {
+                const glm::vec3* record = records + i * 3;
+
+                float tNear, tFar;
+                if (record[2] == glm::vec3(0) || !AABBIntersection(ray, record[0], record[1], tNear, tFar))
+                {
+                    continue;
+                }
+
+                int j = hitCount++;
+                for (; j > 0 && nears[j - 1] > tNear; j--)
+                {
+                    nears[j] = nears[j - 1];
+                    order[j] = order[j - 1];
+                }
+
+                nears[j] = tNear;
+                order[j] = i;
+            }
+
+            // Pushed farthest first, leaf children are pushed as negative record indices
+            for (int i = hitCount - 1; i >= 0; i--)
+            {
+                int rightOffset = (int)records[order[i] * 3 + 2].z;
+                todo[++stackptr] = { rightOffset == 0 ? -(ni + order[i]) - 1 : ni + rightOffset, nears[i] };
+            }
+        }
+    }
+
+    void quantizedBVHIntersection(const Ray& ray, const Mesh& mesh, bool firstHit, float localMinRenderDistance, CollisionManifold& manifold)
+    {
+        // See Scene::quantizeBVH for the layout of the words
+        const CPURenderer& renderer = this->renderer;
+        unsigned int bits = renderer.bvhQuantizationBits;
+        unsigned int perWord = 32 / bits;
+        unsigned int boundWords = bits * 3 / 4;
+        uint32_t mask = (1u << bits) - 1;
+        size_t nodeSize = Scene::getQuantizedNodeSize(bits);
+
+        std::pair<int, float> todo[80];
+        int stackptr = 0;
+
+        todo[stackptr] = { (int)mesh.nodeOffset, -1.f };
+
+        while (stackptr >= 0)
+        {
+            int ni = todo[stackptr].first;
+            float near = todo[stackptr].second;
+            stackptr--;
+
+            if (near > manifold.depth) continue;
+
+            if (ni < 0)
+            {
+                // Leaf children are pushed as negative child indices
+                int record = -ni - 1;
+                unsigned int child = record & 3;
+                const uint32_t* words = glm::value_ptr(renderer.bvhData[(size_t)(record >> 2) * nodeSize]);
+                uint32_t count = (words[boundWords + child / 2] >> (16 * (child % 2))) & 0xFFFF;
+                this->leafIntersection(ray, mesh, (int)words[boundWords + 2 + child], (int)count, firstHit, localMinRenderDistance, manifold);
+                continue;
+            }
+
+            this->nodeVisitCount++;
+
+            glm::vec3 origin = renderer.bvh[(size_t)ni * 2];
+            glm::vec3 scale = renderer.bvh[(size_t)ni * 2 + 1];
+            const uint32_t* words = glm::value_ptr(renderer.bvhData[(size_t)ni * nodeSize]);
+
+            // Sort the hit children by distance
+            float nears[4];
+            int entries[4];
+            int hitCount = 0;
+            for (unsigned int i = 0; i < 4; i++)
+            {
+                uint32_t count = (words[boundWords + i / 2] >> (16 * (i % 2))) & 0xFFFF;
+                uint32_t reference = words[boundWords + 2 + i];
+                if (count == 0 && reference == 0)
+                {
+                    continue;
+                }
+
+                unsigned int shift = bits * (i % perWord);
+                glm::vec3 qMin, qMax;
+                for (unsigned int axis = 0; axis < 3; axis++)
+                {
+                    qMin[axis] = (float)((words[axis * 4 / perWord + i / perWord] >> shift) & mask);
+                    qMax[axis] = (float)((words[(axis + 3) * 4 / perWord + i / perWord] >> shift) & mask);
+                }
+
+                float tNear, tFar;
+                if (!AABBIntersection(ray, origin + qMin * scale, origin + qMax * scale, tNear, tFar))
+                {
+                    continue;
+                }
+
+                int j = hitCount++;
+                for (; j > 0 && nears[j - 1] > tNear; j--)
+                {
+                    nears[j] = nears[j - 1];
+                    entries[j] = entries[j - 1];
+                }
+
+                nears[j] = tNear;
+                entries[j] = count != 0 ? -(ni * 4 + (int)i) - 1 : ni + (int)reference;
+            }
+
+            // Pushed farthest first
+            for (int i = hitCount - 1; i >= 0; i--)
+            {
+                todo[++stackptr] = { entries[i], nears[i] };
+            }
+        }
+    }
+
+    bool meshIntersection(Ray ray, const Mesh& mesh, bool firstHit, CollisionManifold& manifold)
+    {
+        const CPURenderer& renderer = this->renderer;
+
+        glm::vec3 rayOrigin = ray.origin;
+        ray.origin = transform(ray.origin, mesh.transformInv, true);
+        ray.direction = glm::normalize(transform(ray.direction, mesh.transformInv, false));
+        ray.invDirection = 1.f / ray.direction;
+
+        float localMinRenderDistance = glm::length(transform(ray.direction * renderer.minRenderDistance, mesh.transformInv, false));
+        float localMaxRenderDistance = glm::length(transform(ray.direction * renderer.maxRenderDistance, mesh.transformInv, false));
+        manifold.depth = localMaxRenderDistance;
+
+        if (renderer.bvhLayout == BVHSettings::Layout::Wide)
+        {
+            this->wideBVHIntersection(ray, mesh, firstHit, localMinRenderDistance, manifold);
+        }
+        else if (renderer.bvhLayout == BVHSettings::Layout::Quantized)
+        {
+            this->quantizedBVHIntersection(ray, mesh, firstHit, localMinRenderDistance, manifold);
+        }
+        else
+        {
+            this->binaryBVHIntersection(ray, mesh, firstHit, localMinRenderDistance, manifold);
+        }
+
+        if (manifold.depth < localMaxRenderDistance)
+        {
+            manifold.point = transform(manifold.point, mesh.transform, true);
+            manifold.depth = glm::length(manifold.point - rayOrigin);
+            manifold.uvDensity += std::log2(localMaxRenderDistance / renderer.maxRenderDistance);
+            manifold.normal = glm::normalize(transform(manifold.normal, mesh.transform, false));
+            manifold.tangent = glm::normalize(transform(manifold.tangent, mesh.transform, false));
+            manifold.bitangent = glm::normalize(transform(manifold.bitangent, mesh.transform, false));
+            return true;
+        }
+
+        return false;
+    }
+
+    bool findIntersection(const Ray& ray, bool firstHit, CollisionManifold& manifold)
+    {
+        const CPURenderer& renderer = this->renderer;
+        manifold.depth = renderer.maxRenderDistance;
+        this->rayCount++;
+
+        if (renderer.tlas.empty())
+        {
+            return false;
+        }
+
+        float bbhits[4];
+
+        Node root = this->getTLASNode(0);
+        if (!AABBIntersection(ray, root.bboxMin, root.bboxMax, bbhits[0], bbhits[1]))
+        {
+            return false;
+        }
+
+        std::pair<int, float> todo[64];
+        int stackptr = 0;
+
+        todo[stackptr] = { 0, bbhits[0] };
+
+        while (stackptr >= 0)
+        {
+            int ni = todo[stackptr].first;
+            float near = todo[stackptr].second;
+            stackptr--;
+
+            if (near > manifold.depth) continue;
+
+            Node node = this->getTLASNode(ni);
+
+            if (node.rightOffset == 0)
+            {
+                // Leaf nodes hold a single mesh
+                CollisionManifold current{};
+                if (this->meshIntersection(ray, renderer.meshes[node.start], firstHit, current) && current.depth < manifold.depth)
+                {
+                    manifold = current;
+                }
+            }
+            else
+            {
+                Node c0 = this->getTLASNode(ni + 1);
+                Node c1 = this->getTLASNode(ni + node.rightOffset);
+
+                bool hitc0 = AABBIntersection(ray, c0.bboxMin, c0.bboxMax, bbhits[0], bbhits[1]);
+                bool hitc1 = AABBIntersection(ray, c1.bboxMin, c1.bboxMax, bbhits[2], bbhits[3]);
+
+                if (hitc0 && hitc1)
+                {
+                    int closer = ni + 1;
+                    int other = ni + node.rightOffset;
+
+                    if (bbhits[2] < bbhits[0])
+                    {
+                        std::swap(bbhits[0], bbhits[2]);
+                        std::swap(bbhits[1], bbhits[3]);
+                        std::swap(closer, other);
+                    }
+
+                    todo[++stackptr] = { other, bbhits[2] };
+                    todo[++stackptr] = { closer, bbhits[0] };
+                }
+                else if (hitc0)
+                {
+                    todo[++stackptr] = { ni + 1, bbhits[0] };
+                }
+                else if (hitc1)
+                {
+                    todo[++stackptr] = { ni + node.rightOffset, bbhits[2] };
+                }
+            }
+        }
+
+        return manifold.depth < renderer.maxRenderDistance;
+    }
+
+    int getLightCount() const
+    {
+        return this->renderer.lights.empty() ? 0 : (int)this->renderer.lights[0].x;
+    }
+
+    bool hasEnvironmentLight() const
+    {
+        const Environment& environment = this->renderer.environment;
+        return environment.intensity > 0 && environment.distribution[0].x > 0;
+    }
+
+    // Share of the light samples taken by the emissive triangles, the environment takes the rest
+    float getTriangleLightShare() const
+    {
+        if (this->getLightCount() == 0)
+        {
+            return 0;
+        }
+
+        return this->hasEnvironmentLight() ? .5f : 1;
+    }
+
+    float getLightPdf(int materialId, float distance, float cosine) const
+    {
+        if (this->getLightCount() == 0)
+        {
+            return 0;
+        }
+
+        return this->getTriangleLightShare() * this->renderer.lights[this->getLightCount() + 1 + materialId].x * distance * distance / std::max(cosine, 1e-6f);
+    }
+
+    float getEnvironmentPdf(glm::vec3 direction) const
+    {
+        if (!this->hasEnvironmentLight())
+        {
+            return 0;
+        }
+
+        const Environment& environment = this->renderer.environment;
+        glm::vec4 header = environment.distribution[0];
+        glm::ivec2 size(header.x, header.y);
+        direction = environment.rotation * direction;
+        float u = std::atan2(direction.z, direction.x) * INV_TWO_PI + .5f;
+        float v = std::acos(glm::clamp(direction.y, -1.f, 1.f)) * INV_PI;
+        glm::ivec2 pixel = glm::min(glm::ivec2(glm::vec2(u, v) * glm::vec2(size)), size - 1);
+        float weight = environment.distribution[1 + size.y + pixel.y * size.x + pixel.x].z;
+        float sinTheta = std::sqrt(std::max(1 - direction.y * direction.y, 0.f));
+        return (1 - this->getTriangleLightShare()) * weight * header.z * size.x * size.y * INV_TWO_PI * INV_PI / std::max(sinTheta, 1e-6f);
+    }
+
+    static float powerHeuristic(float pdf, float otherPdf)
+    {
+        float pdf2 = pdf * pdf;
+        return pdf2 / (pdf2 + otherPdf * otherPdf);
+    }
+
+    // Environment reached by the path, the escapes after a Lambertian bounce were sampled there as well
+    glm::vec3 getEnvironmentLight(const Ray& ray) const
+    {
+        glm::vec3 light = this->getEnvironment(ray);
+        if (ray.scatterPdf > 0)
+        {
+            light *= powerHeuristic(ray.scatterPdf, this->getEnvironmentPdf(ray.direction));
+        }
+
+        return light;
+    }
+
+    bool isTransmitted(const Ray& ray, const CollisionManifold& manifold)
+    {
+        const Material& material = this->getMaterial(manifold.materialId);
+        float footprint = manifold.uvDensity + std::log2(ray.coneWidth / std::max(std::abs(glm::dot(manifold.normal, ray.direction)), .01f));
+        if (material.albedoTextureId >= 0 && this->getTexture(material.albedoTextureId, manifold.textureCoordinate, footprint).a < this->randomValue())
+        {
+            return true;
+        }
+
+        if (material.density <= 0)
+        {
+            return false;
+        }
+
+        glm::vec3 normal = manifold.isFrontFace ? manifold.normal : -manifold.normal;
+        if (material.fresnelStrength > 0 &&
+            1 - std::pow(glm::dot(normal, -ray.direction), material.fresnelStrength) >= this->randomValue())
+        {
+            return false;
+        }
+
+        return manifold.isFrontFace || -std::log(this->randomValue()) / material.density >= manifold.depth;
+    }
+
+    bool isVisible(Ray ray, float distance)
+    {
+        // Stop short of the light itself
+        distance *= .999f;
+
+        CollisionManifold manifold{};
+        while (this->findIntersection(ray, false, manifold) && manifold.depth < distance)
+        {
+            ray.coneWidth += ray.coneSpread * manifold.depth;
+            if (!this->isTransmitted(ray, manifold))
+            {
+                return false;
+            }
+
+            ray.origin = manifold.point;
+            distance -= manifold.depth;
+        }
+
+        return true;
+    }
+
+    glm::vec3 sampleTriangleLight(const Ray& ray, const CollisionManifold& manifold, glm::vec3 albedo, float share)
+    {
+        const CPURenderer& renderer = this->renderer;
+        int lightCount = this->getLightCount();
+
+        // Alias table
+        float slot = this->randomValue() * lightCount;
+        int index = std::min((int)slot, lightCount - 1);
+        glm::vec4 light = renderer.lights[index + 1];
+        if (slot - index >= light.x)
+        {
+            light = renderer.lights[(int)light.y + 1];
+        }
+
+        const Mesh& mesh = renderer.meshes[(int)light.z];
+        const Triangle& triangle = renderer.triangles[(int)light.w];
+        const Vertex& v1 = renderer.vertices[triangle.v1];
+        const Vertex& v2 = renderer.vertices[triangle.v2];
+        const Vertex& v3 = renderer.vertices[triangle.v3];
+
+        // Uniform point on the triangle
+        glm::vec2 value = this->randomValue2();
+        float r = std::sqrt(value.x);
+        float s = value.y;
+        glm::vec3 weights(1 - r, r * (1 - s), r * s);
+
+        glm::vec3 p1 = transform(v1.positionU, mesh.transform, true);
+        glm::vec3 p2 = transform(v2.positionU, mesh.transform, true);
+        glm::vec3 p3 = transform(v3.positionU, mesh.transform, true);
+        glm::vec3 normal = glm::cross(p2 - p1, p3 - p1);
+        glm::vec3 toLight = p1 * weights.x + p2 * weights.y + p3 * weights.z - manifold.point;
+        float distance = glm::length(toLight);
+        glm::vec3 direction = toLight / distance;
+        float cosine = glm::dot(manifold.normal, direction);
+        float lightCosine = std::abs(glm::dot(normal, direction)) / glm::length(normal);
+        if (cosine <= 0 || lightCosine <= 0)
+        {
+            return glm::vec3(0);
+        }
+
+        const Material& material = this->getMaterial((int)mesh.materialId);
+        glm::vec2 uv1(v1.positionU.w, v1.normalV.w), uv2(v2.positionU.w, v2.normalV.w), uv3(v3.positionU.w, v3.normalV.w);
+        glm::vec2 uv = uv1 * weights.x + uv2 * weights.y + uv3 * weights.z;
+        glm::vec2 edgeUV12 = uv2 - uv1;
+        glm::vec2 edgeUV13 = uv3 - uv1;
+        float uvDensity = .5f * std::log2(std::abs(edgeUV12.x * edgeUV13.y - edgeUV12.y * edgeUV13.x) / glm::length(normal));
+        float footprint = uvDensity + std::log2((ray.coneWidth + ray.coneSpread * distance) / std::max(lightCosine, .01f));
+
+        glm::vec3 emission = material.emissionColor * material.emissionStrength;
+        if (material.emissionTextureId >= 0)
+        {
+            emission *= glm::vec3(this->getTexture(material.emissionTextureId, uv, footprint));
+        }
+
+        // Alpha blended lights are only there for a part of the paths
+        if (material.albedoTextureId >= 0)
+        {
+            emission *= this->getTexture(material.albedoTextureId, uv, footprint).a;
+        }
+
+        if (emission == glm::vec3(0))
+        {
+            return glm::vec3(0);
+        }
+
+        // The hits of the BSDF sampling only know the interpolated normal, the weights use it on both sides
+        float areaPdf = renderer.lights[lightCount + 1 + (int)mesh.materialId].x;
+        glm::vec3 lightNormal = glm::normalize(transform(glm::vec3(v1.normalV) * weights.x + glm::vec3(v2.normalV) * weights.y + glm::vec3(v3.normalV) * weights.z, mesh.transform, false));
+        float weight = powerHeuristic(this->getLightPdf((int)mesh.materialId, distance, std::abs(glm::dot(lightNormal, direction))), cosine * INV_PI);
+
+        Ray shadowRay{ manifold.point, direction, 1.f / direction, glm::vec3(1), glm::vec3(0), ray.coneWidth, ray.coneSpread, 0, 0 };
+        if (!this->isVisible(shadowRay, distance))
+        {
+            return glm::vec3(0);
+        }
+
+        return emission * albedo * INV_PI * cosine * weight * lightCosine / (share * areaPdf * distance * distance);
+    }
+
+    glm::vec3 sampleEnvironmentLight(const Ray& ray, const CollisionManifold& manifold, glm::vec3 albedo, float share)
+    {
+        const Environment& environment = this->renderer.environment;
+        glm::vec4 header = environment.distribution[0];
+        glm::ivec2 size(header.x, header.y);
+
+        // Row from the alias table of the rows, then the pixel from the alias table of the row
+        glm::vec2 value = this->randomValue2();
+        float slot = value.x * size.y;
+        int row = std::min((int)slot, size.y - 1);
+        glm::vec4 entry = environment.distribution[1 + row];
+        if (slot - row >= entry.x)
+        {
+            row = (int)entry.y;
+        }
+
+        slot = value.y * size.x;
+        int column = std::min((int)slot, size.x - 1);
+        entry = environment.distribution[1 + size.y + row * size.x + column];
+        if (slot - column >= entry.x)
+        {
+            column = (int)entry.y;
+            entry = environment.distribution[1 + size.y + row * size.x + column];
+        }
+
+        // Uniform point in the pixel, mapped the same way as getEnvironment
+        value = this->randomValue2();
+        float phi = ((column + value.x) / size.x - .5f) * TWO_PI;
+        float theta = (row + value.y) / size.y * TWO_PI * .5f;
+        float sinTheta = std::sin(theta);
+        glm::vec3 direction = glm::transpose(environment.rotation) * glm::vec3(sinTheta * std::cos(phi), std::cos(theta), sinTheta * std::sin(phi));
+        float cosine = glm::dot(manifold.normal, direction);
+        if (cosine <= 0 || sinTheta <= 0)
+        {
+            return glm::vec3(0);
+        }
+
+        float pdf = share * entry.z * header.z * size.x * size.y * INV_TWO_PI * INV_PI / sinTheta;
+        float weight = powerHeuristic(pdf, cosine * INV_PI);
+
+        // Nothing lies beyond the environment
+        Ray shadowRay{ manifold.point, direction, 1.f / direction, glm::vec3(1), glm::vec3(0), ray.coneWidth, ray.coneSpread, 0, 0 };
+        if (!this->isVisible(shadowRay, 1e30f))
+        {
+            return glm::vec3(0);
+        }
+
+        return this->getEnvironment(shadowRay) * albedo * INV_PI * cosine * weight / pdf;
+    }
+
+    // Samples the lights for a Lambertian surface, weighted against the BSDF sampling
+    glm::vec3 sampleLight(const Ray& ray, const CollisionManifold& manifold, glm::vec3 albedo)
+    {
+        float triangleShare = this->getTriangleLightShare();
+        if (triangleShare == 0 && !this->hasEnvironmentLight())
+        {
+            return glm::vec3(0);
+        }
+
+        if (this->randomValue() < triangleShare)
+        {
+            return this->sampleTriangleLight(ray, manifold, albedo, triangleShare);
+        }
+
+        return this->sampleEnvironmentLight(ray, manifold, albedo, 1 - triangleShare);
+    }
+
+    // Starts the next segment of the path, the pdf is only known for Lambertian bounces
+    static void bounce(Ray& ray, glm::vec3 origin, glm::vec3 direction, float pdf)
+    {
+        ray.origin = origin;
+        ray.direction = direction;
+        ray.scatterPdf = pdf;
+        ray.scatterDistance = 0;
+    }
+
+    bool collisionReact(Ray& ray, CollisionManifold& manifold)
+    {
+        Material material = this->getMaterial(manifold.materialId);
+        ray.scatterDistance += manifold.depth;
+
+        // Ray cone footprint, without the size of the texture
+        float footprint = manifold.uvDensity + std::log2(ray.coneWidth / std::max(std::abs(glm::dot(manifold.normal, ray.direction)), .01f));
+
+        if (material.albedoTextureId >= 0)
+        {
+            glm::vec4 texAlbedo = this->getTexture(material.albedoTextureId, manifold.textureCoordinate, footprint);
+            material.albedoColor *= glm::vec3(texAlbedo);
+
+            // Alpha blend
+            if (texAlbedo.a < this->randomValue())
+            {
+                return false;
+            }
+        }
+
+        if (material.metalnessTextureId >= 0)
+        {
+            material.metalness *= this->getTexture(material.metalnessTextureId, manifold.textureCoordinate, footprint).b;
+        }
+
+        if (material.roughnessTextureId >= 0)
+        {
+            material.roughness *= this->getTexture(material.roughnessTextureId, manifold.textureCoordinate, footprint).g;
+        }
+
+        material.emissionColor *= material.emissionStrength;
+        if (material.emissionTextureId >= 0)
+        {
+            material.emissionColor *= glm::vec3(this->getTexture(material.emissionTextureId, manifold.textureCoordinate, footprint));
+        }
+
+        // Lights found after a Lambertian bounce were sampled there as well
+        if (ray.scatterPdf > 0)
+        {
+            float lightPdf = this->getLightPdf(manifold.materialId, ray.scatterDistance, std::abs(glm::dot(manifold.normal, ray.direction)));
+            material.emissionColor *= powerHeuristic(ray.scatterPdf, lightPdf);
+        }
+
+        if (material.normalTextureId >= 0)
+        {
+            glm::vec3 texNormal = this->getTexture(material.normalTextureId, manifold.textureCoordinate, footprint);
+            texNormal.y = 1 - texNormal.y;
+            texNormal = glm::normalize(texNormal * 2.f - 1.f);
+            manifold.normal = glm::normalize(manifold.tangent * texNormal.x + manifold.bitangent * texNormal.y + manifold.normal * texNormal.z);
+        }
+
+        if (!manifold.isFrontFace)
+        {
+            manifold.normal *= -1;
+        }
+
+        glm::vec3 specularDir = glm::reflect(ray.direction, manifold.normal);
+        glm::vec3 diffuseDir = glm::normalize(this->randomVector3() + manifold.normal);
+
+        if (material.metalness <= this->randomValue() && this->randomValue() >= .2f)
+        {
+            material.roughness = 1;
+        }
+
+        // Fresnel
+        if (material.fresnelStrength > 0 &&
+            1 - std::pow(glm::dot(manifold.normal, -ray.direction), material.fresnelStrength) >= this->randomValue())
+        {
+            bounce(ray, manifold.point, specularDir, 0);
+
+            ray.incomingLight += material.emissionColor * ray.color;
+            ray.color *= material.fresnelColor;
+            return true;
+        }
+
+        // Density
+        if (material.density > 0)
+        {
+            float depth = -std::log(this->randomValue()) / material.density;
+            if (manifold.isFrontFace || depth >= manifold.depth)
+            {
+                return false;
+            }
+
+            bounce(ray, ray.origin + ray.direction * depth, this->randomVector3(), 0);
+
+            ray.incomingLight += material.emissionColor * ray.color;
+            ray.color *= material.albedoColor;
+            return true;
+        }
+
+        // Refract
+        if (material.ior > 0)
+        {
+            glm::vec3 refractedDir = glm::refract(ray.direction, manifold.normal, manifold.isFrontFace ? 1 / material.ior : material.ior);
+            if (refractedDir == glm::vec3(0))
+            {
+                refractedDir = specularDir;
+            }
+
+            bounce(ray, manifold.point, refractedDir, 0);
+
+            ray.incomingLight += material.emissionColor * ray.color;
+            ray.color *= material.albedoColor;
+            return true;
+        }
+
+        // Scatter
+        ray.incomingLight += material.emissionColor * ray.color;
+        if (material.roughness >= 1)
+        {
+            // Lambertian, the cosine weighted direction is combined with a light sample
+            ray.incomingLight += this->sampleLight(ray, manifold, material.albedoColor) * ray.color;
+            bounce(ray, manifold.point, diffuseDir, std::max(glm::dot(manifold.normal, diffuseDir), 0.f) * INV_PI);
+        }
+        else
+        {
+            bounce(ray, manifold.point, slerp(specularDir, diffuseDir, material.roughness), 0);
+        }
+
+        ray.color *= material.albedoColor;
+        return true;
+    }
+
+    // Russian roulette, the paths carrying little light stop early and the survivors are weighted up so the mean is kept
+    bool surviveRoulette(Ray& ray, unsigned int bounce)
+    {
+        if (this->renderer.russianRouletteDepth == 0 || bounce < this->renderer.russianRouletteDepth)
+        {
+            return true;
+        }
+
+        float probability = std::min(std::max(ray.color.r, std::max(ray.color.g, ray.color.b)), 1.f);
+        if (probability >= 1)
+        {
+            return true;
+        }
+
+        if (this->randomValue() >= probability)
+        {
+            return false;
+        }
+
+        ray.color /= probability;
+        return true;
+    }
+
+    glm::vec4 sendRay(Ray ray, glm::vec4& albedoColor, glm::vec4& normalColor)
+    {
+        bool isBackground = false;
+
+        unsigned int bounce = 0;
+        while (bounce <= this->renderer.maxBounceCount)
+        {
+            CollisionManifold manifold{};
+            if (!this->findIntersection(ray, bounce == 0, manifold))
+            {
+                ray.incomingLight += this->getEnvironmentLight(ray) * ray.color;
+                if (bounce == 0)
+                {
+                    isBackground = true;
+                    albedoColor = toneMapPixel(glm::vec4(ray.incomingLight, 1), this->renderer.gamma);
+                    normalColor = glm::vec4((1.f - ray.direction) / 2.f, 1);
+                }
+
+                break;
+            }
+
+            ray.coneWidth += ray.coneSpread * manifold.depth;
+            if (this->collisionReact(ray, manifold))
+            {
+                ray.invDirection = 1.f / ray.direction;
+                if (bounce == 0)
+                {
+                    albedoColor = toneMapPixel(glm::vec4(ray.color, 1), this->renderer.gamma);
+                    normalColor = glm::vec4((manifold.normal + 1.f) / 2.f, 1);
+                }
+
+                bounce++;
+                this->startSampleBounce(bounce);
+                if (!this->surviveRoulette(ray, bounce))
+                {
+                    break;
+                }
+            }
+            else
+            {
+                ray.origin = manifold.point;
+            }
+        }
+
+        this->bounceCount = bounce;
+        return glm::vec4(ray.incomingLight, this->renderer.environment.transparent && isBackground ? 0 : 1);
+    }
+
+    glm::vec4 pathTrace(const Ray& ray, glm::vec4& albedoColor, glm::vec4& normalColor)
+    {
+        const Camera& camera = this->renderer.camera;
+        glm::vec3 rayOrigin = ray.origin;
+        glm::vec3 rayDirection = ray.direction;
+
+        // Focal
+        glm::vec3 focalPoint = ray.origin + ray.direction * camera.focalDistance;
+        glm::vec2 focal = this->randomVector2() * camera.aperture;
+        rayOrigin += focal.x * this->cameraRight + focal.y * camera.up;
+        rayDirection = glm::normalize(focalPoint - rayOrigin);
+
+        // Blur
+        glm::vec2 blur = this->randomVector2() * camera.blur;
+        rayOrigin += blur.x * this->cameraRight + blur.y * camera.up;
+
+        return this->sendRay(Ray{ rayOrigin, rayDirection, 1.f / rayDirection, ray.color, ray.incomingLight, ray.coneWidth, ray.coneSpread, ray.scatterPdf, ray.scatterDistance }, albedoColor, normalColor);
+    }
+};
+
+void CPURenderer::init(glm::uvec2 size, unsigned int threadCount)
+{
+    this->threadPool.init(threadCount);
+    this->resize(size);
+}
+
+void CPURenderer::resize(glm::uvec2 size)
+{
+    std::vector<float> pixels(size.x * size.y * 4);
+    this->accumulation = Image::loadFromMemory(size, pixels);
+    this->albedo = Image::loadFromMemory(size, pixels);
+    this->normal = Image::loadFromMemory(size, pixels);
+    this->moments = Image::loadFromMemory(size, pixels);
+    this->output = Image::loadFromMemory(size, pixels);
+    this->clear();
+}
+
+void CPURenderer::shutdown()
+{
+    this->threadPool.shutdown();
+}
+
+void CPURenderer::render(unsigned int count)
+{
+    this->renderRect(count, glm::uvec2(0, 0), this->accumulation.size);
+}
+
+void CPURenderer::renderRect(unsigned int count, glm::uvec2 position, glm::uvec2 size)
+{
+    this->accumulate(count, position, size);
+    this->toneMap(position, size);
+}
+
+void CPURenderer::accumulate(unsigned int count, glm::uvec2 position, glm::uvec2 size)
+{
+    unsigned int frameCount = this->frameCount;
+    this->forEachTile(position, size, [this, count, frameCount](glm::uvec2 tilePosition, glm::uvec2 tileSize)
+    {
+        glm::vec4* accumulation = (glm::vec4*)this->accumulation.pixels.data();
+        glm::vec4* albedo = (glm::vec4*)this->albedo.pixels.data();
+        glm::vec4* normal = (glm::vec4*)this->normal.pixels.data();
+        glm::vec4* moments = (glm::vec4*)this->moments.pixels.data();
+        size_t rayCount = 0;
+        size_t nodeVisitCount = 0;
+        for (unsigned int y = tilePosition.y; y < tilePosition.y + tileSize.y; y++)
+        {
+            for (unsigned int x = tilePosition.x; x < tilePosition.x + tileSize.x; x++)
+            {
+                size_t index = (size_t)y * this->accumulation.size.x + x;
+                for (unsigned int i = 0; i < count; i++)
+                {
+                    // Converged pixels keep their mean without tracing new paths
+                    if (isConverged(accumulation[index], moments[index], frameCount + i, this->adaptiveThreshold, this->adaptiveMinFrameCount))
+                    {
+                        accumulation[index] += accumulation[index] / (float)(frameCount + i);
+                        moments[index].g = 1;
+                        continue;
+                    }
+
+                    PathTracer pathTracer(*this, glm::uvec2(x, y), frameCount + i);
+                    glm::vec4 pixelColor = pathTracer.run(albedo[index], normal[index]);
+                    if (glm::any(glm::isnan(glm::vec3(pixelColor))) || glm::any(glm::isinf(glm::vec3(pixelColor))))
+                    {
+                        pixelColor = glm::vec4(glm::vec3(0), pixelColor.a);
+                    }
+
+                    float pixelLuminance = luminance(glm::vec3(pixelColor));
+                    accumulation[index] += pixelColor;
+                    moments[index] = glm::vec4(moments[index].r + pixelLuminance * pixelLuminance, 0, moments[index].b + 1, moments[index].a + pathTracer.bounceCount);
+                    rayCount += pathTracer.rayCount;
+                    nodeVisitCount += pathTracer.nodeVisitCount;
+                }
+            }
+        }
+
+        this->rayCount += rayCount;
+        this->nodeVisitCount += nodeVisitCount;
+    });
+
+    this->frameCount = frameCount + count;
+}
+
+void CPURenderer::toneMap(glm::uvec2 position, glm::uvec2 size)
+{
+    unsigned int frameCount = this->frameCount;
+    this->forEachTile(position, size, [this, frameCount](glm::uvec2 tilePosition, glm::uvec2 tileSize)
+    {
+        const glm::vec4* accumulation = (const glm::vec4*)this->accumulation.pixels.data();
+        glm::vec4* output = (glm::vec4*)this->output.pixels.data();
+        for (unsigned int y = tilePosition.y; y < tilePosition.y + tileSize.y; y++)
+        {
+            for (unsigned int x = tilePosition.x; x < tilePosition.x + tileSize.x; x++)
+            {
+                size_t index = (size_t)y * this->accumulation.size.x + x;
+                output[index] = toneMapPixel(accumulation[index] / (float)frameCount, this->gamma);
+            }
+        }
+    });
+}
+
+void CPURenderer::clear()
+{
+    std::fill(this->accumulation.pixels.begin(), this->accumulation.pixels.end(), 0.f);
+    std::fill(this->moments.pixels.begin(), this->moments.pixels.end(), 0.f);
+    this->frameCount = 0;
+    this->rayCount = 0;
+    this->nodeVisitCount = 0;
+}
+
+Image CPURenderer::getImage() const
+{
+    return this->output;
+}
+
+Image CPURenderer::getAccumulationImage() const
+{
+    return this->accumulation;
+}
+
+float CPURenderer::getConvergedRatio() const
+{
+    size_t pixelCount = (size_t)this->moments.size.x * this->moments.size.y;
+    size_t convergedCount = 0;
+    for (size_t i = 0; i < pixelCount; i++)
+    {
+        convergedCount += this->moments.pixels[i * 4 + 1] > .5f;
+    }
+
+    return pixelCount == 0 ? 0 : (float)convergedCount / pixelCount;
+}
+
+float CPURenderer::getAveragePathLength() const
+{
+    // The moments sum the sample counts in their blue channel and the path lengths in their alpha channel
+    size_t pixelCount = (size_t)this->moments.size.x * this->moments.size.y;
+    double sampleCount = 0;
+    double bounceCount = 0;
+    for (size_t i = 0; i < pixelCount; i++)
+    {
+        sampleCount += this->moments.pixels[i * 4 + 2];
+        bounceCount += this->moments.pixels[i * 4 + 3];
+    }
+
+    return sampleCount == 0 ? 0 : (float)(bounceCount / sampleCount);
+}
+
+Image CPURenderer::getAlbedoImage() const
+{
+    return this->albedo;
+}
+
+Image CPURenderer::getNormalImage() const
+{
+    return this->normal;
+}
+
+glm::uvec2 CPURenderer::getSize() const
+{
+    return this->accumulation.size;
+}
+
+unsigned int CPURenderer::getFrameCount() const
+{
+    return this->frameCount;
+}
+
+size_t CPURenderer::getRayCount() const
+{
+    return this->rayCount;
+}
+
+size_t CPURenderer::getNodeVisitCount() const
+{
+    return this->nodeVisitCount;
+}
+
+void CPURenderer::loadScene(const Scene& scene)
+{
+    this->textures = scene.textures;
+    this->textureMipmaps.assign(this->textures.size(), std::vector<Image>());
+    this->threadPool.parallelFor(this->textures.size(), [this](size_t index)
+    {
+        std::vector<Image>& mipmaps = this->textureMipmaps[index];
+        const Image* level = &this->textures[index];
+        while ((!level->pixels.empty() || !level->bytes.empty()) && (level->size.x > 1 || level->size.y > 1))
+        {
+            mipmaps.push_back(level->downsample());
+            level = &mipmaps.back();
+        }
+
+        // The textures are sampled as floats, 8-bit levels are converted once built to match the ones of the Renderer
+        if (!this->textures[index].bytes.empty())
+        {
+            this->textures[index] = this->textures[index].toFloat();
+            for (Image& mipmap : mipmaps)
+            {
+                mipmap = mipmap.toFloat();
+            }
+        }
+    });
+    this->bvh = scene.bvh;
+    this->bvhData = scene.bvhData;
+    this->bvhLayout = scene.bvhLayout;
+    this->bvhQuantizationBits = scene.bvhQuantizationBits;
+    this->vertices = scene.vertices;
+    this->triangles = scene.triangles;
+    this->meshes = scene.meshes;
+    this->tlas = scene.buildTLAS();
+
+    // The light table is built once, with the meshes and the materials in place
+    this->updateSceneMaterials(scene);
+}
+
+void CPURenderer::updateSceneMaterials(const Scene& scene)
+{
+    this->materials = scene.materials;
+    this->materialPowers = scene.buildMaterialPowers();
+    this->lights = scene.buildLightTable(this->materialPowers);
+}
+
+void CPURenderer::updateSceneMeshes(const Scene& scene)
+{
+    // Moving the meshes changes the areas of the lights but not the power of their materials
+    this->meshes = scene.meshes;
+    this->tlas = scene.buildTLAS();
+    this->lights = scene.buildLightTable(this->materialPowers);
+}
+
+void CPURenderer::updateSceneVertices(const Scene& scene)
+{
+    auto copyRange = [](auto& target, const auto& source, std::pair<size_t, size_t> range)
+    {
+        if (target.size() != source.size())
+        {
+            target = source;
+            return;
+        }
+
+        if (range.first < range.second)
+        {
+            std::copy(source.begin() + range.first, source.begin() + range.second, target.begin() + range.first);
+        }
+    };
+
+    copyRange(this->vertices, scene.vertices, scene.dirtyVertices);
+    copyRange(this->bvh, scene.bvh, scene.dirtyBVH);
+    copyRange(this->bvhData, scene.bvhData, scene.dirtyBVHData);
+    this->updateSceneMeshes(scene);
+}
+
+void CPURenderer::forEachTile(glm::uvec2 position, glm::uvec2 size, const std::function<void(glm::uvec2, glm::uvec2)>& func)
+{
+    position = glm::min(position, this->accumulation.size);
+    size = glm::min(size, this->accumulation.size - position);
+
+    glm::uvec2 tileCount = (size + this->tileSize - 1u) / this->tileSize;
+    this->threadPool.parallelFor(tileCount.x * tileCount.y, [&](size_t index)
+    {
+        glm::uvec2 tile(index % tileCount.x, index / tileCount.x);
+        glm::uvec2 tilePosition = position + tile * this->tileSize;
+        glm::uvec2 tileSize = glm::min(glm::uvec2(this->tileSize), position + size - tilePosition);
+        func(tilePosition, tileSize);
+    });
+}
@@ -2,18 +2,112 @@
  * @file Environment.cpp
  */
 #include "TracerX/Image.h"
+#include "TracerX/AliasTable.h"
+#include "TracerX/ThreadPool.h"
 #include "TracerX/Environment.h"
 
+#include <cmath>
+#include <algorithm>
+#include <glm/gtc/constants.hpp>
+
 using namespace TracerX;
 
+namespace
+{
+
+// The distribution is built from the first mip level at most this wide
+const unsigned int maxDistributionWidth = 1024;
+
+}
+
 void Environment::reset()
 {
     this->name = "None";
-    this->texture.update(Image::empty);
+    this->image = Image::empty;
+    this->mipmaps.clear();
+    this->distribution = { glm::vec4(0) };
+    this->textureOutdated = true;
 }
 
 void Environment::loadFromFile(const std::string& fileName)
 {
-    this->texture.update(Image::loadFromFile(fileName));
+    this->image = Image::loadFromFile(fileName);
+    this->initMipmaps();
+    this->initDistribution();
+    this->textureOutdated = true;
     this->name = fileName.substr(fileName.find_last_of("/\\") + 1);
 }
+
+void Environment::initMipmaps()
+{
+    this->mipmaps.clear();
+    const Image* level = &this->image;
+    while (level->size.x > 1 || level->size.y > 1)
+    {
+        this->mipmaps.push_back(level->downsample());
+        level = &this->mipmaps.back();
+    }
+}
+
+void Environment::initDistribution()
+{
+    const Image* level = &this->image;
+    for (size_t i = 0; i < this->mipmaps.size() && level->size.x > maxDistributionWidth; i++)
+    {
+        level = &this->mipmaps[i];
+    }
+
+    glm::uvec2 size = level->size;
+    this->distribution = { glm::vec4(0) };
+    if (size.x == 0 || size.y == 0)
+    {
+        return;
+    }
+
+    // Header, the alias table of the rows, then the alias table of the pixels of every row
+    this->distribution.resize(1 + size.y + (size_t)size.x * size.y);
+    std::vector<double> rowWeights(size.y);
+
+    // Luminance weighted by the solid angle of the pixels, the rows are independent
+    core::ThreadPool::getShared().parallelFor(size.y, [this, level, size, &rowWeights](size_t row)
+    {
+        double sinTheta = std::sin((row + .5) * glm::pi<double>() / size.y);
+        std::vector<double> weights(size.x);
+        for (size_t column = 0; column < size.x; column++)
+        {
+            const float* pixel = &level->pixels[(row * size.x + column) * 4];
+            weights[column] = std::max(glm::dot(glm::vec3(pixel[0], pixel[1], pixel[2]), glm::vec3(.2126f, .7152f, .0722f)), 0.f) * sinTheta;
+            rowWeights[row] += weights[column];
+        }
+
+        core::AliasTable aliasTable;
+        aliasTable.build(weights);
+        glm::vec4* slots = &this->distribution[1 + size.y + row * size.x];
+        for (size_t column = 0; column < size.x; column++)
+        {
+            slots[column] = glm::vec4(aliasTable.probabilities[column], aliasTable.aliases[column], weights[column], 0);
+        }
+    });
+
+    double totalWeight = 0;
+    for (double weight : rowWeights)
+    {
+        totalWeight += weight;
+    }
+
+    if (totalWeight <= 0)
+    {
+        this->distribution = { glm::vec4(0) };
+        return;
+    }
+
+    core::AliasTable aliasTable;
+    aliasTable.build(rowWeights);
+    for (size_t row = 0; row < size.y; row++)
+    {
+        this->distribution[1 + row] = glm::vec4(aliasTable.probabilities[row], aliasTable.aliases[row], 0, 0);
+    }
+
+    // The pixel weights are normalized by the shaders
+    this->distribution[0] = glm::vec4(size.x, size.y, 1 / totalWeight, 0);
+}
@@ -4,6 +4,8 @@
 #include "TracerX/Image.h"
 #include "TracerX/FrameBuffer.h"
 
+#include <vector>
+
 using namespace TracerX::core;
 
 void FrameBuffer::init()
@@ -28,8 +30,15 @@ void FrameBuffer::init()
     this->toneMap.init();
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT3, GL_TEXTURE_2D, this->toneMap.getHandler(), 0);
 
-    GLenum attachments[4] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3 };
-    glDrawBuffers(4, attachments);
+#ifdef TX_DENOISE
+    // Attach denoised texture
+    this->denoised.init();
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT4, GL_TEXTURE_2D, this->denoised.getHandler(), 0);
+#endif
+
+    // Attach moments texture
+    this->moments.init();
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT5, GL_TEXTURE_2D, this->moments.getHandler(), 0);
 
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
@@ -41,6 +50,10 @@ void FrameBuffer::resize(glm::uvec2 size)
     this->albedo.update(Image::loadFromMemory(size, std::vector<float>()));
     this->normal.update(Image::loadFromMemory(size, std::vector<float>()));
     this->toneMap.update(Image::loadFromMemory(size, std::vector<float>()));
+#ifdef TX_DENOISE
+    this->denoised.update(Image::loadFromMemory(size, std::vector<float>()));
+#endif
+    this->moments.update(Image::loadFromMemory(size, std::vector<float>()));
 }
 
 void FrameBuffer::shutdown()
@@ -49,6 +62,10 @@ void FrameBuffer::shutdown()
     this->albedo.shutdown();
     this->normal.shutdown();
     this->toneMap.shutdown();
+#ifdef TX_DENOISE
+    this->denoised.shutdown();
+#endif
+    this->moments.shutdown();
     glDeleteFramebuffers(1, &this->handler);
 }
 
@@ -66,9 +83,64 @@ void FrameBuffer::useRect(glm::uvec2 position, glm::uvec2 size)
     glScissor(position.x, position.y, size.x, size.y);
 }
 
+void FrameBuffer::targetAccumulation()
+{
+    // The tone map and denoised attachments are not written by the accumulator shader
+    GLenum attachments[6] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_NONE, GL_NONE, GL_COLOR_ATTACHMENT5 };
+    glDrawBuffers(6, attachments);
+}
+
+void FrameBuffer::targetToneMap()
+{
+    // Unwritten outputs are undefined, so the accumulation attachments must be disabled
+    GLenum attachments[4] = { GL_NONE, GL_NONE, GL_NONE, GL_COLOR_ATTACHMENT3 };
+    glDrawBuffers(4, attachments);
+}
+
+#ifdef TX_DENOISE
+void FrameBuffer::targetDenoised()
+{
+    // The tone mapper output is redirected to the denoised attachment
+    GLenum attachments[4] = { GL_NONE, GL_NONE, GL_NONE, GL_COLOR_ATTACHMENT4 };
+    glDrawBuffers(4, attachments);
+}
+#endif
+
 void FrameBuffer::clear()
 {
     glClearTexImage(this->accumulation.getHandler(), 0, GL_RGBA, GL_FLOAT, 0);
+    glClearTexImage(this->moments.getHandler(), 0, GL_RGBA, GL_FLOAT, 0);
+}
+
+float FrameBuffer::getConvergedRatio() const
+{
+    // The green channel of the moments holds the converged flags
+    size_t pixelCount = (size_t)this->size.x * this->size.y;
+    return pixelCount == 0 ? 0 : (float)(this->sumMoments().g / pixelCount);
+}
+
+float FrameBuffer::getAveragePathLength() const
+{
+    // The blue channel of the moments sums the sample counts and the alpha channel the path lengths
+    glm::dvec4 sum = this->sumMoments();
+    return sum.b > 0 ? (float)(sum.a / sum.b) : 0;
+}
+
+void FrameBuffer::barrier()
+{
+    // The attachments written by the previous draws are sampled by the next ones
+    if (GLEW_VERSION_4_5 || GLEW_ARB_texture_barrier)
+    {
+        glTextureBarrier();
+    }
+    else if (GLEW_NV_texture_barrier)
+    {
+        glTextureBarrierNV();
+    }
+    else
+    {
+        glFinish();
+    }
 }
 
 void FrameBuffer::stopUse()
@@ -76,3 +148,22 @@ void FrameBuffer::stopUse()
     glDisable(GL_SCISSOR_TEST);
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
+
+glm::dvec4 FrameBuffer::sumMoments() const
+{
+    if (this->size.x == 0 || this->size.y == 0)
+    {
+        return glm::dvec4(0);
+    }
+
+    // Summed on the CPU from the full level, the mipmaps drop texels when a side is not a power of two
+    std::vector<float> pixels((size_t)this->size.x * this->size.y * 4);
+    this->moments.upload(pixels.data());
+    glm::dvec4 sum(0);
+    for (size_t i = 0; i < pixels.size(); i += 4)
+    {
+        sum += glm::dvec4(pixels[i], pixels[i + 1], pixels[i + 2], pixels[i + 3]);
+    }
+
+    return sum;
+}
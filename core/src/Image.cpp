@@ -8,6 +8,7 @@
 #include "TracerX/Image.h"
 
 #include <iostream>
+#include <algorithm>
 #include <stdexcept>
 #include <stb_image.h>
 #include <stb_image_write.h>
@@ -19,10 +20,14 @@ Image Image::empty;
 
 void Image::saveToFile(const std::string& name) const
 {
-    std::vector<unsigned char> data(this->pixels.size());
-    for (size_t i = 0; i < this->pixels.size(); i++)
+    std::vector<unsigned char> data = this->bytes;
+    if (data.empty())
     {
-        data[i] = (unsigned char)(this->pixels[i] * 255);
+        data.resize(this->pixels.size());
+        for (size_t i = 0; i < this->pixels.size(); i++)
+        {
+            data[i] = (unsigned char)(this->pixels[i] * 255);
+        }
     }
 
     stbi_flip_vertically_on_write(true);
@@ -36,11 +41,80 @@ Image Image::resize(glm::uvec2 size) const
 {
     Image img;
     img.size = size;
+    if (!this->bytes.empty())
+    {
+        img.bytes.resize(size.x * size.y * 4);
+        stbir_resize_uint8_linear(this->bytes.data(), this->size.x, this->size.y, 0, img.bytes.data(), size.x, size.y, 0, stbir_pixel_layout::STBIR_RGBA);
+        return img;
+    }
+
     img.pixels.resize(size.x * size.y * 4);
     stbir_resize_float_linear(this->pixels.data(), this->size.x, this->size.y, 0, img.pixels.data(), size.x, size.y, 0, stbir_pixel_layout::STBIR_RGBA);
     return img;
 }
 
+Image Image::downsample() const
+{
+    Image img;
+    img.size = glm::max(this->size / 2u, glm::uvec2(1));
+    glm::uvec2 last = glm::max(this->size, glm::uvec2(1)) - 1u;
+    if (!this->bytes.empty())
+    {
+        // Rounded to the nearest value, as the float levels are when uploaded as bytes
+        img.bytes.resize(img.size.x * img.size.y * 4);
+        const glm::u8vec4* source = (const glm::u8vec4*)this->bytes.data();
+        glm::u8vec4* target = (glm::u8vec4*)img.bytes.data();
+        for (unsigned int y = 0; y < img.size.y; y++)
+        {
+            unsigned int y0 = std::min(y * 2, last.y), y1 = std::min(y * 2 + 1, last.y);
+            for (unsigned int x = 0; x < img.size.x; x++)
+            {
+                unsigned int x0 = std::min(x * 2, last.x), x1 = std::min(x * 2 + 1, last.x);
+                target[y * img.size.x + x] = glm::u8vec4((
+                    glm::uvec4(source[y0 * this->size.x + x0]) + glm::uvec4(source[y0 * this->size.x + x1]) +
+                    glm::uvec4(source[y1 * this->size.x + x0]) + glm::uvec4(source[y1 * this->size.x + x1]) + 2u) / 4u);
+            }
+        }
+
+        return img;
+    }
+
+    img.pixels.resize(img.size.x * img.size.y * 4);
+    const glm::vec4* source = (const glm::vec4*)this->pixels.data();
+    glm::vec4* target = (glm::vec4*)img.pixels.data();
+    for (unsigned int y = 0; y < img.size.y; y++)
+    {
+        unsigned int y0 = std::min(y * 2, last.y), y1 = std::min(y * 2 + 1, last.y);
+        for (unsigned int x = 0; x < img.size.x; x++)
+        {
+            unsigned int x0 = std::min(x * 2, last.x), x1 = std::min(x * 2 + 1, last.x);
+            target[y * img.size.x + x] = (
+                source[y0 * this->size.x + x0] + source[y0 * this->size.x + x1] +
+                source[y1 * this->size.x + x0] + source[y1 * this->size.x + x1]) * .25f;
+        }
+    }
+
+    return img;
+}
+
+Image Image::toFloat() const
+{
+    if (this->bytes.empty())
+    {
+        return *this;
+    }
+
+    Image img;
+    img.size = this->size;
+    img.pixels.resize(this->bytes.size());
+    for (size_t i = 0; i < this->bytes.size(); i++)
+    {
+        img.pixels[i] = this->bytes[i] / 255.f;
+    }
+
+    return img;
+}
+
 Image Image::loadFromFile(const std::string& fileName)
 {
     Image img;
@@ -68,6 +142,14 @@ Image Image::loadFromMemory(glm::uvec2 size, const std::vector<float> pixels)
     return img;
 }
 
+Image Image::loadFromMemory(glm::uvec2 size, const std::vector<unsigned char> bytes)
+{
+    Image img;
+    img.size = size;
+    img.bytes = bytes;
+    return img;
+}
+
 Image::Image()
 {
 }
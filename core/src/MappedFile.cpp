@@ -0,0 +1,116 @@
+/**
+ * @file MappedFile.cpp
+ */
+#include "TracerX/MappedFile.h"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+using namespace TracerX::core;
+
+void MappedFile::init(const std::string& fileName)
+{
+#ifdef _WIN32
+    HANDLE file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    LARGE_INTEGER size;
+    if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &size))
+    {
+        if (file != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(file);
+        }
+
+        throw std::runtime_error("Failed to open the file: " + fileName);
+    }
+
+    this->file = file;
+    this->size = (size_t)size.QuadPart;
+    if (this->size == 0)
+    {
+        return;
+    }
+
+    this->mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    this->data = this->mapping != nullptr ? (const unsigned char*)MapViewOfFile(this->mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+#else
+    int file = open(fileName.c_str(), O_RDONLY);
+    struct stat status;
+    if (file < 0 || fstat(file, &status) != 0)
+    {
+        if (file >= 0)
+        {
+            close(file);
+        }
+
+        throw std::runtime_error("Failed to open the file: " + fileName);
+    }
+
+    this->size = (size_t)status.st_size;
+    if (this->size == 0)
+    {
+        close(file);
+        return;
+    }
+
+    // The mapping stays valid after the descriptor is closed
+    void* data = mmap(nullptr, this->size, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    this->data = data != MAP_FAILED ? (const unsigned char*)data : nullptr;
+#endif
+
+    if (this->data == nullptr)
+    {
+        this->shutdown();
+        throw std::runtime_error("Failed to map the file: " + fileName);
+    }
+}
+
+void MappedFile::shutdown()
+{
+#ifdef _WIN32
+    if (this->data != nullptr)
+    {
+        UnmapViewOfFile(this->data);
+    }
+
+    if (this->mapping != nullptr)
+    {
+        CloseHandle(this->mapping);
+    }
+
+    if (this->file != nullptr)
+    {
+        CloseHandle(this->file);
+    }
+
+    this->file = nullptr;
+    this->mapping = nullptr;
+#else
+    if (this->data != nullptr)
+    {
+        munmap((void*)this->data, this->size);
+    }
+#endif
+
+    this->data = nullptr;
+    this->size = 0;
+}
+
+const unsigned char* MappedFile::getData() const
+{
+    return this->data;
+}
+
+size_t MappedFile::getSize() const
+{
+    return this->size;
+}
@@ -2,11 +2,11 @@
  * @file Renderer.cpp
  */
 #include "TracerX/Renderer.h"
+#include "TracerX/BlueNoise.h"
 
+#include <chrono>
 #include <iostream>
-#ifdef TX_DENOISE
-#include <OpenImageDenoise/oidn.hpp>
-#endif
+#include <stdexcept>
 
 using namespace TracerX;
 using namespace TracerX::core;
@@ -14,14 +14,16 @@ using namespace TracerX::core;
 void Renderer::init(glm::uvec2 size)
 {
     // Init GLEW
+    // Without an X display (headless EGL contexts) only the GLX entry points fail to load
     GLenum status = glewInit();
-    if (status != GLEW_OK)
+    if (status != GLEW_OK && status != GLEW_ERROR_NO_GLX_DISPLAY)
     {
         throw std::runtime_error((const char*)glewGetErrorString(status));
     }
 
     this->accumulatorShader.init(Renderer::vertexShaderSrc, Renderer::accumulatorShaderSrc);
     this->toneMapperShader.init(Renderer::vertexShaderSrc, Renderer::toneMapperShaderSrc);
+    this->frameCountLocation = this->accumulatorShader.getParamLocation("FrameCount");
 
     this->initData();
 
@@ -30,27 +32,53 @@ void Renderer::init(glm::uvec2 size)
 
 void Renderer::resize(glm::uvec2 size)
 {
+#ifdef TX_DENOISE
+    this->waitDenoise();
+#endif
     this->frameBuffer.resize(size);
     this->clear();
 }
 
 void Renderer::shutdown()
 {
+#ifdef TX_DENOISE
+    this->waitDenoise();
+#endif
+    this->synchronize();
+
     this->quad.shutdown();
 
     this->frameBuffer.shutdown();
 
     this->environment.texture.shutdown();
-    this->textureArray.shutdown();
+    this->environment.distributionBuffer.shutdown();
+    this->textureAtlas.shutdown();
 
     this->vertexBuffer.shutdown();
     this->triangleBuffer.shutdown();
     this->meshBuffer.shutdown();
+    this->meshOffsetBuffer.shutdown();
     this->materialBuffer.shutdown();
     this->bvhBuffer.shutdown();
+    this->bvhDataBuffer.shutdown();
+    this->tlasBuffer.shutdown();
+    this->lightBuffer.shutdown();
+    this->blueNoiseBuffer.shutdown();
 
+    this->settingsBuffer.shutdown();
+    this->wavefrontTracer.shutdown();
     this->accumulatorShader.shutdown();
     this->toneMapperShader.shutdown();
+
+#ifdef TX_DENOISE
+    this->denoiseAccumulation.shutdown();
+    this->denoiseFilter.release();
+    this->denoiseColorBuffer.release();
+    this->denoiseAlbedoBuffer.release();
+    this->denoiseNormalBuffer.release();
+    this->denoiseDevice.release();
+    this->denoiseSize = glm::uvec2(0);
+#endif
 }
 
 void Renderer::render(unsigned int count)
@@ -66,33 +94,94 @@ void Renderer::renderRect(unsigned int count, glm::uvec2 position, glm::uvec2 si
 
 void Renderer::accumulate(unsigned int count, glm::uvec2 position, glm::uvec2 size)
 {
-    this->accumulatorShader.use();
-    this->accumulatorShader.updateParam("Gamma", this->gamma);
-    this->accumulatorShader.updateParam("MaxBounceCount", this->maxBounceCount);
-    this->accumulatorShader.updateParam("MinRenderDistance", this->minRenderDistance);
-    this->accumulatorShader.updateParam("MaxRenderDistance", this->maxRenderDistance);
-    this->accumulatorShader.updateParam("Camera.Position", this->camera.position);
-    this->accumulatorShader.updateParam("Camera.Forward", this->camera.forward);
-    this->accumulatorShader.updateParam("Camera.Up", this->camera.up);
-    this->accumulatorShader.updateParam("Camera.FOV", this->camera.fov);
-    this->accumulatorShader.updateParam("Camera.FocalDistance", this->camera.focalDistance);
-    this->accumulatorShader.updateParam("Camera.Aperture", this->camera.aperture);
-    this->accumulatorShader.updateParam("Camera.Blur", this->camera.blur);
-    this->accumulatorShader.updateParam("Environment.Transparent", this->environment.transparent);
-    this->accumulatorShader.updateParam("Environment.Intensity", this->environment.intensity);
-    this->accumulatorShader.updateParam("Environment.Rotation", this->environment.rotation);
+    Settings settings{};
+    settings.cameraPosition = this->camera.position;
+    settings.cameraForward = this->camera.forward;
+    settings.cameraUp = this->camera.up;
+    settings.cameraFOV = this->camera.fov;
+    settings.cameraFocalDistance = this->camera.focalDistance;
+    settings.cameraAperture = this->camera.aperture;
+    settings.cameraBlur = this->camera.blur;
+    settings.environmentTransparent = this->environment.transparent;
+    settings.environmentIntensity = this->environment.intensity;
+    for (int i = 0; i < 3; i++)
+    {
+        settings.environmentRotation[i] = glm::vec4(this->environment.rotation[i], 0);
+    }
 
-    this->frameBuffer.useRect(position, size);
-    for (unsigned int i = 0; i < count; i++)
+    settings.maxBounceCount = this->maxBounceCount;
+    settings.minRenderDistance = this->minRenderDistance;
+    settings.maxRenderDistance = this->maxRenderDistance;
+    settings.bvhLayout = (unsigned int)this->bvhLayout;
+    settings.bvhQuantizationBits = this->bvhQuantizationBits;
+    settings.gamma = this->gamma;
+    settings.adaptiveThreshold = this->adaptiveThreshold;
+    settings.adaptiveMinFrameCount = this->adaptiveMinFrameCount;
+    settings.sampler = (unsigned int)this->sampler;
+    settings.russianRouletteDepth = this->russianRouletteDepth;
+    this->settingsBuffer.update(settings);
+
+    if (this->environment.textureOutdated)
     {
-        this->accumulatorShader.updateParam("FrameCount", this->frameCount);
-        this->quad.draw();
-        this->frameCount++;
-        glFinish();
+        this->environment.texture.update(this->environment.image);
+        this->environment.texture.updateMipmaps(this->environment.mipmaps);
+        this->environment.distributionBuffer.update(this->environment.distribution);
+        this->environment.textureOutdated = false;
     }
 
-    FrameBuffer::stopUse();
-    Shader::stopUse();
+    // Keep at most one batch in flight, the previous one ran while the caller was busy
+    this->synchronize();
+
+    if (this->backend == Backend::Wavefront)
+    {
+        if (!this->wavefrontTracer.isInitialized())
+        {
+            this->wavefrontTracer.init();
+        }
+
+        for (unsigned int i = 0; i < count; i++)
+        {
+            this->wavefrontTracer.accumulate(this->frameBuffer, this->frameCount, this->maxBounceCount, position, size);
+            this->frameCount++;
+        }
+    }
+    else
+    {
+        this->accumulatorShader.use();
+        this->frameBuffer.useRect(position, size);
+        this->frameBuffer.targetAccumulation();
+        for (unsigned int i = 0; i < count; i++)
+        {
+            this->accumulatorShader.updateParam(this->frameCountLocation, this->frameCount);
+            FrameBuffer::barrier();
+            this->quad.draw();
+            this->frameCount++;
+        }
+
+        FrameBuffer::stopUse();
+        Shader::stopUse();
+    }
+
+    this->accumulationFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+}
+
+void Renderer::synchronize()
+{
+    if (this->accumulationFence == nullptr)
+    {
+        return;
+    }
+
+    GLenum status;
+    do
+    {
+        status = glClientWaitSync(this->accumulationFence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+    }
+    while (status == GL_TIMEOUT_EXPIRED);
+
+    glDeleteSync(this->accumulationFence);
+    this->accumulationFence = nullptr;
 }
 
 void Renderer::toneMap(glm::uvec2 position, glm::uvec2 size)
@@ -102,6 +191,8 @@ void Renderer::toneMap(glm::uvec2 position, glm::uvec2 size)
     this->toneMapperShader.updateParam("Gamma", this->gamma);
 
     this->frameBuffer.useRect(position, size);
+    this->frameBuffer.targetToneMap();
+    FrameBuffer::barrier();
     this->quad.draw();
 
     FrameBuffer::stopUse();
@@ -111,63 +202,129 @@ void Renderer::toneMap(glm::uvec2 position, glm::uvec2 size)
 #ifdef TX_DENOISE
 void Renderer::denoise()
 {
-    // Create device
-    oidn::DeviceRef device = oidn::newDevice();
-    device.commit();
-
-    glm::uvec2 size = this->frameBuffer.size;
-
-    // Create color buffer
-    Image colorImage = this->frameBuffer.accumulation.upload();
-    oidn::BufferRef colorBuf = device.newBuffer(size.x * size.y * 4 * sizeof(float));
-    colorBuf.writeAsync(0, colorImage.pixels.size() * sizeof(float), colorImage.pixels.data());
-
-    // Create albedo buffer
-    Image albedoImage = this->frameBuffer.albedo.upload();
-    oidn::BufferRef albedoBuf = device.newBuffer(size.x * size.y * 4 * sizeof(float));
-    albedoBuf.writeAsync(0, albedoImage.pixels.size() * sizeof(float), albedoImage.pixels.data());
-
-    // Create normal buffer
-    Image normalImage = this->frameBuffer.normal.upload();
-    oidn::BufferRef normalBuf = device.newBuffer(size.x * size.y * 4 * sizeof(float));
-    normalBuf.writeAsync(0, normalImage.pixels.size() * sizeof(float), normalImage.pixels.data());
-
-    // Create filter
-    device.sync();
-    oidn::FilterRef filter = device.newFilter("RT");
-    filter.setImage("color", colorBuf, oidn::Format::Float3, size.x, size.y, 0, 4 * sizeof(float));
-    filter.setImage("albedo", albedoBuf, oidn::Format::Float3, size.x, size.y, 0, 4 * sizeof(float));
-    filter.setImage("normal", normalBuf, oidn::Format::Float3, size.x, size.y, 0, 4 * sizeof(float));
-    filter.setImage("output", colorBuf, oidn::Format::Float3, size.x, size.y, 0, 4 * sizeof(float));
-    filter.set("hdr", true);
-    filter.commit();
+    this->waitDenoise();
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    if (this->denoiseSize != this->frameBuffer.size)
+    {
+        this->initDenoiser();
+    }
+
+    // Read the images straight into the buffers of the device
+    this->frameBuffer.accumulation.upload((float*)this->denoiseColorBuffer.getData());
+    this->frameBuffer.albedo.upload((float*)this->denoiseAlbedoBuffer.getData());
+    this->frameBuffer.normal.upload((float*)this->denoiseNormalBuffer.getData());
 
     // Denoise
-    filter.execute();
+    this->denoiseFilter.execute();
     const char* errorMessage;
-    if (device.getError(errorMessage) != oidn::Error::None)
+    if (this->denoiseDevice.getError(errorMessage) != oidn::Error::None)
     {
         std::cerr << "Failed to denoise: " << errorMessage << std::endl;
     }
     else
     {
         // Update accumulator
-        float* data = (float*)colorBuf.getData();
-        std::vector<float> pixels(data, data + colorImage.pixels.size());
-        this->frameBuffer.accumulation.update(Image::loadFromMemory(size, pixels));
+        this->frameBuffer.accumulation.update((const float*)this->denoiseColorBuffer.getData());
 
         // Update output
         this->toneMapperShader.use();
         this->frameBuffer.use();
+        this->frameBuffer.targetToneMap();
         this->quad.draw();
         Shader::stopUse();
         FrameBuffer::stopUse();
     }
 
-    // Release buffers
-    colorBuf.release();
-    albedoBuf.release();
-    normalBuf.release();
+    this->denoiseTime = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+}
+
+void Renderer::denoiseAsync()
+{
+    this->pollDenoise();
+    if (this->denoiseTask.valid())
+    {
+        return;
+    }
+
+    this->denoiseStart = std::chrono::steady_clock::now();
+
+    if (this->denoiseSize != this->frameBuffer.size)
+    {
+        this->initDenoiser();
+    }
+
+    // Snapshot the images, the accumulation can go on while the copy is denoised
+    this->frameBuffer.accumulation.upload((float*)this->denoiseColorBuffer.getData());
+    this->frameBuffer.albedo.upload((float*)this->denoiseAlbedoBuffer.getData());
+    this->frameBuffer.normal.upload((float*)this->denoiseNormalBuffer.getData());
+    this->denoiseFrameCount = this->frameCount;
+    this->denoiseOutdated = false;
+
+    this->denoiseTask = std::async(std::launch::async, [this]()
+    {
+        this->denoiseFilter.execute();
+        const char* errorMessage;
+        if (this->denoiseDevice.getError(errorMessage) != oidn::Error::None)
+        {
+            std::cerr << "Failed to denoise: " << errorMessage << std::endl;
+            return false;
+        }
+
+        return true;
+    });
+}
+
+bool Renderer::pollDenoise()
+{
+    if (!this->denoiseTask.valid() || this->denoiseTask.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+    {
+        return false;
+    }
+
+    if (!this->denoiseTask.get() || this->denoiseOutdated || this->denoiseFrameCount == 0)
+    {
+        return false;
+    }
+
+    this->denoiseAccumulation.update((const float*)this->denoiseColorBuffer.getData());
+
+    // Tone map the denoised colors into the denoised texture
+    this->toneMapperShader.use();
+    this->toneMapperShader.updateParam("Accumulator", 10);
+    this->toneMapperShader.updateParam("FrameCount", this->denoiseFrameCount);
+    this->toneMapperShader.updateParam("Gamma", this->gamma);
+    this->frameBuffer.use();
+    this->frameBuffer.targetDenoised();
+    this->quad.draw();
+    this->toneMapperShader.updateParam("Accumulator", 0);
+    Shader::stopUse();
+    FrameBuffer::stopUse();
+
+    this->denoisedFrameCount = this->denoiseFrameCount;
+    this->denoiseTime = std::chrono::duration<float>(std::chrono::steady_clock::now() - this->denoiseStart).count();
+    return true;
+}
+
+bool Renderer::isDenoising() const
+{
+    return this->denoiseTask.valid();
+}
+
+GLuint Renderer::getDenoisedTextureHandler() const
+{
+    return this->frameBuffer.denoised.getHandler();
+}
+
+unsigned int Renderer::getDenoisedFrameCount() const
+{
+    return this->denoisedFrameCount;
+}
+
+float Renderer::getDenoiseTime() const
+{
+    return this->denoiseTime;
 }
 #endif
 
@@ -175,6 +332,10 @@ void Renderer::clear()
 {
     this->frameBuffer.clear();
     this->frameCount = 0;
+#ifdef TX_DENOISE
+    this->denoiseOutdated = true;
+    this->denoisedFrameCount = 0;
+#endif
 }
 
 GLuint Renderer::getTextureHandler() const
@@ -192,6 +353,50 @@ Image Renderer::getImage() const
     return this->frameBuffer.toneMap.upload();
 }
 
+Image Renderer::getAccumulationImage() const
+{
+    return this->frameBuffer.accumulation.upload();
+}
+
+Image Renderer::getAccumulationImage(glm::uvec2 position, glm::uvec2 size) const
+{
+    std::vector<float> pixels((size_t)size.x * size.y * 4);
+    this->frameBuffer.accumulation.upload(position, size, pixels.data());
+    return Image::loadFromMemory(size, pixels);
+}
+
+float Renderer::getConvergedRatio() const
+{
+    return this->frameBuffer.getConvergedRatio();
+}
+
+float Renderer::getAveragePathLength() const
+{
+    return this->frameBuffer.getAveragePathLength();
+}
+
+void Renderer::loadAccumulationImage(const Image& image, unsigned int frameCount)
+{
+    if (image.size != this->frameBuffer.size)
+    {
+        throw std::runtime_error("The accumulation image must have the size of the renderer");
+    }
+
+    if (image.pixels.size() != (size_t)image.size.x * image.size.y * 4)
+    {
+        throw std::runtime_error("The accumulation image must have float pixels");
+    }
+
+#ifdef TX_DENOISE
+    this->waitDenoise();
+    this->denoiseOutdated = true;
+    this->denoisedFrameCount = 0;
+#endif
+    this->frameBuffer.accumulation.update(image.pixels.data());
+    glClearTexImage(this->frameBuffer.moments.getHandler(), 0, GL_RGBA, GL_FLOAT, 0);
+    this->frameCount = frameCount;
+}
+
 glm::uvec2 Renderer::getSize() const
 {
     return this->frameBuffer.size;
@@ -202,25 +407,50 @@ unsigned int Renderer::getFrameCount() const
     return this->frameCount;
 }
 
+size_t Renderer::getTextureMemorySize() const
+{
+    return this->textureAtlas.getMemorySize();
+}
+
 void Renderer::loadScene(const Scene& scene, glm::uvec2 texturesSize)
 {
-    this->textureArray.update(texturesSize, scene.textures);
+    this->textureAtlas.update(scene.textures, texturesSize);
     this->bvhBuffer.update(scene.bvh);
+    this->bvhDataBuffer.update(scene.bvhData);
+    this->bvhLayout = scene.bvhLayout;
+    this->bvhQuantizationBits = scene.bvhQuantizationBits;
     this->vertexBuffer.update(scene.vertices);
     this->triangleBuffer.update(scene.triangles);
+    this->meshBuffer.update(scene.meshes);
+    this->meshOffsetBuffer.update(scene.buildMeshOffsets());
+    this->tlasBuffer.update(scene.buildTLAS());
 
-    this->updateSceneMeshes(scene);
+    // The light table is built once, with the meshes and the materials in place
     this->updateSceneMaterials(scene);
 }
 
 void Renderer::updateSceneMaterials(const Scene& scene)
 {
     this->materialBuffer.update(scene.materials);
+    this->materialPowers = scene.buildMaterialPowers();
+    this->lightBuffer.update(scene.buildLightTable(this->materialPowers));
 }
 
 void Renderer::updateSceneMeshes(const Scene& scene)
 {
+    // Moving the meshes changes the areas of the lights but not the power of their materials
     this->meshBuffer.update(scene.meshes);
+    this->meshOffsetBuffer.update(scene.buildMeshOffsets());
+    this->tlasBuffer.update(scene.buildTLAS());
+    this->lightBuffer.update(scene.buildLightTable(this->materialPowers));
+}
+
+void Renderer::updateSceneVertices(const Scene& scene)
+{
+    this->vertexBuffer.update(scene.vertices, scene.dirtyVertices.first, scene.dirtyVertices.second);
+    this->bvhBuffer.update(scene.bvh, scene.dirtyBVH.first, scene.dirtyBVH.second);
+    this->bvhDataBuffer.update(scene.bvhData, scene.dirtyBVHData.first, scene.dirtyBVHData.second);
+    this->updateSceneMeshes(scene);
 }
 
 void Renderer::initData()
@@ -229,24 +459,91 @@ void Renderer::initData()
 
     // Textures
     this->environment.texture.init();
-    this->textureArray.init();
+    this->textureAtlas.init();
 
     this->frameBuffer.init();
+#ifdef TX_DENOISE
+    this->denoiseAccumulation.init();
+#endif
 
     // Buffers
     this->vertexBuffer.init(GL_RGBA32F);
     this->triangleBuffer.init(GL_RGB32I);
     this->meshBuffer.init(GL_RGBA32F);
+    this->meshOffsetBuffer.init(GL_RGBA32UI);
     this->materialBuffer.init(GL_RGBA32F);
     this->bvhBuffer.init(GL_RGB32F);
+    this->tlasBuffer.init(GL_RGB32F);
+    this->bvhDataBuffer.init(GL_RGBA32UI);
+    this->lightBuffer.init(GL_RGBA32F);
+    this->blueNoiseBuffer.init(GL_R32F);
+    this->blueNoiseBuffer.update(core::BlueNoise::getMask());
+    this->environment.distributionBuffer.init(GL_RGBA32F);
+    this->settingsBuffer.init();
 
     // Bind textures
     this->frameBuffer.accumulation.bind(0);
+    this->frameBuffer.moments.bind(13);
+    this->frameBuffer.albedo.bind(14);
+    this->frameBuffer.normal.bind(15);
+    this->lightBuffer.bind(16);
+    this->environment.distributionBuffer.bind(17);
+    this->blueNoiseBuffer.bind(18);
+#ifdef TX_DENOISE
+    this->denoiseAccumulation.bind(10);
+#endif
     this->environment.texture.bind(1);
-    this->textureArray.bind(2);
+    this->textureAtlas.bind(2, 11, 12);
     this->vertexBuffer.bind(3);
     this->triangleBuffer.bind(4);
     this->meshBuffer.bind(5);
     this->materialBuffer.bind(6);
     this->bvhBuffer.bind(7);
+    this->tlasBuffer.bind(8);
+    this->bvhDataBuffer.bind(9);
+    this->meshOffsetBuffer.bind(19);
+
+    // Bind uniform buffers
+    this->settingsBuffer.bind(0);
+}
+
+#ifdef TX_DENOISE
+void Renderer::initDenoiser()
+{
+    // Create device
+    if (!this->denoiseDevice)
+    {
+        this->denoiseDevice = oidn::newDevice();
+        this->denoiseDevice.commit();
+    }
+
+    this->denoiseSize = this->frameBuffer.size;
+    size_t pixelSize = 4 * sizeof(float);
+    size_t byteSize = this->denoiseSize.x * this->denoiseSize.y * pixelSize;
+
+    // Create buffers, host storage keeps them accessible by OpenGL on every device
+    this->denoiseColorBuffer = this->denoiseDevice.newBuffer(byteSize, oidn::Storage::Host);
+    this->denoiseAlbedoBuffer = this->denoiseDevice.newBuffer(byteSize, oidn::Storage::Host);
+    this->denoiseNormalBuffer = this->denoiseDevice.newBuffer(byteSize, oidn::Storage::Host);
+
+    // Create filter, denoises the color in place
+    this->denoiseFilter = this->denoiseDevice.newFilter("RT");
+    this->denoiseFilter.setImage("color", this->denoiseColorBuffer, oidn::Format::Float3, this->denoiseSize.x, this->denoiseSize.y, 0, pixelSize);
+    this->denoiseFilter.setImage("albedo", this->denoiseAlbedoBuffer, oidn::Format::Float3, this->denoiseSize.x, this->denoiseSize.y, 0, pixelSize);
+    this->denoiseFilter.setImage("normal", this->denoiseNormalBuffer, oidn::Format::Float3, this->denoiseSize.x, this->denoiseSize.y, 0, pixelSize);
+    this->denoiseFilter.setImage("output", this->denoiseColorBuffer, oidn::Format::Float3, this->denoiseSize.x, this->denoiseSize.y, 0, pixelSize);
+    this->denoiseFilter.set("hdr", true);
+    this->denoiseFilter.commit();
+
+    this->denoiseAccumulation.update(Image::loadFromMemory(this->denoiseSize, std::vector<float>()));
+}
+
+void Renderer::waitDenoise()
+{
+    if (this->denoiseTask.valid())
+    {
+        this->denoiseTask.wait();
+        this->pollDenoise();
+    }
 }
+#endif
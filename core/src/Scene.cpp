@@ -4,14 +4,404 @@
 #define TINYGLTF_IMPLEMENTATION
 
 #include "TracerX/Scene.h"
+#include "TracerX/MappedFile.h"
+#include "TracerX/AliasTable.h"
 
+#include <cmath>
+#include <chrono>
+#include <limits>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
 #include <stdexcept>
+#include <filesystem>
+#include <type_traits>
+#include <functional>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/quaternion.hpp>
 
 using namespace TracerX;
 using namespace TracerX::core;
 
+namespace
+{
+
+// Copies the elements that differ and returns their range
+template <class T>
+std::pair<size_t, size_t> updateRange(std::vector<T>& target, const std::vector<T>& source, size_t offset)
+{
+    size_t begin = 0;
+    while (begin < source.size() && target[offset + begin] == source[begin])
+    {
+        begin++;
+    }
+
+    size_t end = source.size();
+    while (end > begin && target[offset + end - 1] == source[end - 1])
+    {
+        end--;
+    }
+
+    std::copy(source.begin() + begin, source.begin() + end, target.begin() + offset + begin);
+    return { offset + begin, offset + end };
+}
+
+// Returns the seconds elapsed since start and restarts it
+float lap(std::chrono::steady_clock::time_point& start)
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    float seconds = std::chrono::duration<float>(now - start).count();
+    start = now;
+    return seconds;
+}
+
+// Keeps the encoded bytes, the images are decoded in parallel by Scene::GLTFtextures
+bool keepEncodedImage(tinygltf::Image* image, const int, std::string*, std::string*, int, int, const unsigned char* bytes, int size, void*)
+{
+    image->image.assign(bytes, bytes + size);
+    image->as_is = true;
+    return true;
+}
+
+// Bump when the layout of the cache or of the cached structures changes
+constexpr uint32_t cacheVersion = 4;
+
+struct CacheHeader
+{
+    char magic[8] = { 'T', 'X', 'S', 'C', 'E', 'N', 'E', 0 };
+    uint32_t version = cacheVersion;
+    uint32_t bvhStrategy = 0;
+    uint32_t bvhLayout = 0;
+    uint32_t bvhQuantizationBits = 0;
+    uint32_t bvhBinCount = 0;
+    uint32_t bvhMaxLeafSize = 0;
+    float bvhTraversalCost = 0;
+    float bvhIntersectionCost = 0;
+    uint64_t sourceSize = 0;
+    int64_t sourceTime = 0;
+    uint64_t sourceHash = 0;
+};
+
+CacheHeader createCacheHeader(const BVHSettings& settings, uint64_t sourceSize, int64_t sourceTime)
+{
+    CacheHeader header;
+    header.bvhStrategy = (uint32_t)settings.strategy;
+    header.bvhLayout = (uint32_t)settings.layout;
+    header.bvhQuantizationBits = settings.quantizationBits;
+    header.bvhBinCount = settings.binCount;
+    header.bvhMaxLeafSize = settings.maxLeafSize;
+    header.bvhTraversalCost = settings.traversalCost;
+    header.bvhIntersectionCost = settings.intersectionCost;
+    header.sourceSize = sourceSize;
+    header.sourceTime = sourceTime;
+    return header;
+}
+
+// Everything but the source time and hash, which are checked separately
+bool isCacheCompatible(const CacheHeader& cached, const CacheHeader& header)
+{
+    return std::memcmp(cached.magic, header.magic, sizeof(header.magic)) == 0 &&
+        cached.version == header.version &&
+        cached.bvhStrategy == header.bvhStrategy &&
+        cached.bvhLayout == header.bvhLayout &&
+        cached.bvhQuantizationBits == header.bvhQuantizationBits &&
+        cached.bvhBinCount == header.bvhBinCount &&
+        cached.bvhMaxLeafSize == header.bvhMaxLeafSize &&
+        cached.bvhTraversalCost == header.bvhTraversalCost &&
+        cached.bvhIntersectionCost == header.bvhIntersectionCost &&
+        cached.sourceSize == header.sourceSize;
+}
+
+// FNV-1a
+uint64_t hashFile(const std::string& fileName)
+{
+    MappedFile file;
+    file.init(fileName);
+
+    uint64_t hash = 14695981039346656037ull;
+    const unsigned char* data = file.getData();
+    for (size_t i = 0; i < file.getSize(); i++)
+    {
+        hash = (hash ^ data[i]) * 1099511628211ull;
+    }
+
+    file.shutdown();
+    return hash;
+}
+
+template <class T>
+void writeValue(std::ostream& stream, const T& value)
+{
+    stream.write((const char*)&value, sizeof(T));
+}
+
+template <class T>
+void writeArray(std::ostream& stream, const std::vector<T>& values)
+{
+    writeValue<uint64_t>(stream, values.size());
+    stream.write((const char*)values.data(), values.size() * sizeof(T));
+}
+
+void writeStrings(std::ostream& stream, const std::vector<std::string>& strings)
+{
+    writeValue<uint64_t>(stream, strings.size());
+    for (const std::string& string : strings)
+    {
+        writeValue<uint64_t>(stream, string.size());
+        stream.write(string.data(), string.size());
+    }
+}
+
+class CacheReader
+{
+public:
+    CacheReader(const unsigned char* data, size_t size) : data(data), size(size)
+    {
+    }
+
+    const unsigned char* read(size_t byteCount)
+    {
+        if (byteCount > this->size - this->offset)
+        {
+            throw std::runtime_error("The scene cache is truncated");
+        }
+
+        const unsigned char* data = this->data + this->offset;
+        this->offset += byteCount;
+        return data;
+    }
+
+    template <class T>
+    T readValue()
+    {
+        T value;
+        std::memcpy(&value, this->read(sizeof(T)), sizeof(T));
+        return value;
+    }
+
+    // One copy straight from the mapped pages into a vector of the final size
+    template <class T>
+    void readArray(std::vector<T>& values)
+    {
+        uint64_t count = this->readValue<uint64_t>();
+        if (count > (this->size - this->offset) / sizeof(T))
+        {
+            throw std::runtime_error("The scene cache is truncated");
+        }
+
+        values.resize(count);
+        std::memcpy(values.data(), this->read(count * sizeof(T)), count * sizeof(T));
+    }
+
+    void readStrings(std::vector<std::string>& strings)
+    {
+        strings.resize(this->readValue<uint64_t>());
+        for (std::string& string : strings)
+        {
+            uint64_t length = this->readValue<uint64_t>();
+            string.assign((const char*)this->read(length), length);
+        }
+    }
+private:
+    const unsigned char* data;
+    size_t size;
+    size_t offset = 0;
+};
+
+int getAttribute(const tinygltf::Primitive& primitive, const std::string& name)
+{
+    auto attribute = primitive.attributes.find(name);
+    return attribute != primitive.attributes.end() ? attribute->second : -1;
+}
+
+const unsigned char* getBufferData(const tinygltf::Model& model, int bufferViewId, size_t byteOffset, size_t stride, size_t count, size_t elementSize)
+{
+    const tinygltf::BufferView& bufferView = model.bufferViews.at(bufferViewId);
+    const tinygltf::Buffer& buffer = model.buffers.at(bufferView.buffer);
+    size_t begin = bufferView.byteOffset + byteOffset;
+    if (count > 0 && begin + (count - 1) * stride + elementSize > buffer.data.size())
+    {
+        throw std::runtime_error("Accessor out of buffer bounds");
+    }
+
+    return buffer.data.data() + begin;
+}
+
+// Normalized integers map to [0, 1] or [-1, 1], the others keep their value (KHR_mesh_quantization)
+template <class T>
+void convertComponents(const unsigned char* data, size_t stride, size_t count, int firstComponent, int componentCount, bool normalized, float* output, size_t outputStride)
+{
+    float scale = std::is_integral_v<T> && normalized ? 1.f / std::numeric_limits<T>::max() : 1.f;
+    float minimum = std::is_signed_v<T> && normalized ? -1.f : -std::numeric_limits<float>::max();
+    for (size_t i = 0; i < count; i++)
+    {
+        const unsigned char* element = data + i * stride + firstComponent * sizeof(T);
+        float* target = output + i * outputStride;
+        for (int component = 0; component < componentCount; component++)
+        {
+            T value;
+            std::memcpy(&value, element + component * sizeof(T), sizeof(T));
+            target[component] = std::max((float)value * scale, minimum);
+        }
+    }
+}
+
+void convertComponents(int componentType, const unsigned char* data, size_t stride, size_t count, int firstComponent, int componentCount, bool normalized, float* output, size_t outputStride)
+{
+    switch (componentType)
+    {
+    case TINYGLTF_COMPONENT_TYPE_FLOAT:
+        convertComponents<float>(data, stride, count, firstComponent, componentCount, normalized, output, outputStride);
+        break;
+    case TINYGLTF_COMPONENT_TYPE_BYTE:
+        convertComponents<int8_t>(data, stride, count, firstComponent, componentCount, normalized, output, outputStride);
+        break;
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+        convertComponents<uint8_t>(data, stride, count, firstComponent, componentCount, normalized, output, outputStride);
+        break;
+    case TINYGLTF_COMPONENT_TYPE_SHORT:
+        convertComponents<int16_t>(data, stride, count, firstComponent, componentCount, normalized, output, outputStride);
+        break;
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+        convertComponents<uint16_t>(data, stride, count, firstComponent, componentCount, normalized, output, outputStride);
+        break;
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+        convertComponents<uint32_t>(data, stride, count, firstComponent, componentCount, normalized, output, outputStride);
+        break;
+    default:
+        throw std::runtime_error("Unsupported accessor component type: " + std::to_string(componentType));
+    }
+}
+
+uint32_t readIndex(int componentType, const unsigned char* data, size_t i)
+{
+    switch (componentType)
+    {
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+        return data[i];
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+    {
+        uint16_t index;
+        std::memcpy(&index, data + i * sizeof(uint16_t), sizeof(uint16_t));
+        return index;
+    }
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+    {
+        uint32_t index;
+        std::memcpy(&index, data + i * sizeof(uint32_t), sizeof(uint32_t));
+        return index;
+    }
+    default:
+        throw std::runtime_error("Unsupported index component type: " + std::to_string(componentType));
+    }
+}
+
+// Writes the components [firstComponent, firstComponent + componentCount) of every element to output, outputStride floats apart
+void readAccessor(const tinygltf::Model& model, const tinygltf::Accessor& accessor, int firstComponent, int componentCount, float* output, size_t outputStride)
+{
+    int componentSize = tinygltf::GetComponentSizeInBytes(accessor.componentType);
+    int elementComponentCount = tinygltf::GetNumComponentsInType(accessor.type);
+    if (componentSize <= 0 || firstComponent + componentCount > elementComponentCount)
+    {
+        throw std::runtime_error("Unsupported accessor type");
+    }
+
+    size_t elementSize = (size_t)componentSize * elementComponentCount;
+    if (accessor.bufferView >= 0)
+    {
+        int stride = accessor.ByteStride(model.bufferViews.at(accessor.bufferView));
+        if (stride <= 0)
+        {
+            throw std::runtime_error("Invalid accessor stride");
+        }
+
+        const unsigned char* data = getBufferData(model, accessor.bufferView, accessor.byteOffset, stride, accessor.count, elementSize);
+        convertComponents(accessor.componentType, data, stride, accessor.count, firstComponent, componentCount, accessor.normalized, output, outputStride);
+    }
+    else
+    {
+        // Sparse accessors without a buffer view start from zeros
+        for (size_t i = 0; i < accessor.count; i++)
+        {
+            std::fill(output + i * outputStride, output + i * outputStride + componentCount, 0.f);
+        }
+    }
+
+    if (!accessor.sparse.isSparse)
+    {
+        return;
+    }
+
+    // The sparse values replace the elements at the sparse indices
+    size_t sparseCount = accessor.sparse.count;
+    int indexType = accessor.sparse.indices.componentType;
+    const unsigned char* indices = getBufferData(model, accessor.sparse.indices.bufferView, accessor.sparse.indices.byteOffset,
+        tinygltf::GetComponentSizeInBytes(indexType), sparseCount, tinygltf::GetComponentSizeInBytes(indexType));
+    const unsigned char* values = getBufferData(model, accessor.sparse.values.bufferView, accessor.sparse.values.byteOffset, elementSize, sparseCount, elementSize);
+    for (size_t i = 0; i < sparseCount; i++)
+    {
+        uint32_t index = readIndex(indexType, indices, i);
+        if (index >= accessor.count)
+        {
+            throw std::runtime_error("Sparse accessor index out of range");
+        }
+
+        convertComponents(accessor.componentType, values + i * elementSize, elementSize, 1, firstComponent, componentCount, accessor.normalized, output + index * outputStride, outputStride);
+    }
+}
+
+struct DecodedImage
+{
+    glm::ivec2 size = glm::ivec2(0);
+    stbi_uc* bytes = nullptr;
+    stbi_us* shorts = nullptr;
+    const char* error = nullptr;
+};
+
+DecodedImage decodeImage(const tinygltf::Image& image)
+{
+    DecodedImage decoded;
+    const stbi_uc* data = image.image.data();
+    int size = (int)image.image.size();
+    if (stbi_is_16_bit_from_memory(data, size))
+    {
+        decoded.shorts = stbi_load_16_from_memory(data, size, &decoded.size.x, &decoded.size.y, nullptr, 4);
+    }
+    else
+    {
+        decoded.bytes = stbi_load_from_memory(data, size, &decoded.size.x, &decoded.size.y, nullptr, 4);
+    }
+
+    if (decoded.bytes == nullptr && decoded.shorts == nullptr)
+    {
+        decoded.error = stbi_failure_reason();
+    }
+
+    return decoded;
+}
+
+// 8-bit images keep their bytes, as they are uploaded, the 16-bit ones are converted by a plain loop the compiler vectorizes
+void convertImage(const DecodedImage& decoded, Image& texture)
+{
+    size_t count = (size_t)decoded.size.x * decoded.size.y * 4;
+    texture.size = glm::uvec2(decoded.size);
+    if (decoded.bytes != nullptr)
+    {
+        texture.bytes.assign(decoded.bytes, decoded.bytes + count);
+        return;
+    }
+
+    texture.pixels.resize(count);
+    float* pixels = texture.pixels.data();
+    const stbi_us* shorts = decoded.shorts;
+    for (size_t i = 0; i < count; i++)
+    {
+        pixels[i] = shorts[i] / 65535.f;
+    }
+}
+
+}
+
 int Scene::loadTexture(const std::string& fileName)
 {
     this->textures.push_back(Image::loadFromFile(fileName));
@@ -25,14 +415,17 @@ int Scene::loadMaterial(const Material& material, const std::string& name)
     return this->materials.size() - 1;
 }
 
-Scene Scene::loadGLTF(const std::string& fileName)
+Scene Scene::loadGLTF(const std::string& fileName, const BVHSettings& bvhSettings)
 {
     Scene scene;
     scene.name = fileName.substr(fileName.find_last_of("/\\") + 1);
 
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
     tinygltf::TinyGLTF loader;
     tinygltf::Model model;
     std::string err;
+    loader.SetImageLoader(keepEncodedImage, nullptr);
 
     if (fileName.substr(fileName.find_last_of('.') + 1) == "glb")
     {
@@ -49,41 +442,237 @@ Scene Scene::loadGLTF(const std::string& fileName)
         }
     }
 
+    scene.loadTimings.parse = lap(start);
+
     scene.GLTFtextures(model.textures, model.images);
+    start = std::chrono::steady_clock::now();
+
     scene.GLTFmaterials(model.materials);
     scene.GLTFnodes(model, glm::mat4(1));
+    scene.loadTimings.geometry = lap(start);
+
+    scene.buildBVH(bvhSettings);
+    scene.loadTimings.bvh = lap(start);
+
+    return scene;
+}
+
+Scene Scene::loadGLTFCached(const std::string& fileName, const BVHSettings& bvhSettings)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    std::error_code error;
+    uint64_t sourceSize = std::filesystem::file_size(fileName, error);
+    int64_t sourceTime = std::filesystem::last_write_time(fileName, error).time_since_epoch().count();
+    if (error)
+    {
+        return Scene::loadGLTF(fileName, bvhSettings);
+    }
+
+    CacheHeader header = createCacheHeader(bvhSettings, sourceSize, sourceTime);
+    bool isHashed = false;
 
-    for (Mesh& mesh : scene.meshes)
+    std::string cacheName = fileName + ".txcache";
+    MappedFile cache;
+    try
     {
-        scene.buildBVH(mesh);
+        cache.init(cacheName);
+
+        CacheHeader cached;
+        if (cache.getSize() >= sizeof(CacheHeader))
+        {
+            std::memcpy(&cached, cache.getData(), sizeof(CacheHeader));
+        }
+
+        // A copied source has a new time, but the same content
+        bool isValid = cache.getSize() >= sizeof(CacheHeader) && isCacheCompatible(cached, header);
+        if (isValid && cached.sourceTime != header.sourceTime)
+        {
+            header.sourceHash = hashFile(fileName);
+            isHashed = true;
+            isValid = cached.sourceHash == header.sourceHash;
+        }
+
+        if (isValid)
+        {
+            Scene scene;
+            scene.name = fileName.substr(fileName.find_last_of("/\\") + 1);
+            scene.loadCache(cache.getData() + sizeof(CacheHeader), cache.getSize() - sizeof(CacheHeader));
+            cache.shutdown();
+
+            // Store the new time, so the next loads do not hash the source again
+            if (isHashed)
+            {
+                std::fstream stream(cacheName, std::ios::binary | std::ios::in | std::ios::out);
+                writeValue(stream, header);
+            }
+
+            scene.loadTimings.cache = lap(start);
+            return scene;
+        }
+    }
+    catch (const std::runtime_error&)
+    {
+    }
+
+    cache.shutdown();
+
+    Scene scene = Scene::loadGLTF(fileName, bvhSettings);
+    start = std::chrono::steady_clock::now();
+    if (!isHashed)
+    {
+        header.sourceHash = hashFile(fileName);
+    }
+
+    // Concurrent loaders write their own file, the last rename wins
+    std::string tempName = cacheName + "." + std::to_string(start.time_since_epoch().count()) + ".tmp";
+    {
+        std::ofstream stream(tempName, std::ios::binary);
+        writeValue(stream, header);
+        scene.saveCache(stream);
+        if (!stream)
+        {
+            stream.close();
+            std::filesystem::remove(tempName, error);
+            scene.loadTimings.cache = lap(start);
+            return scene;
+        }
     }
 
+    std::filesystem::rename(tempName, cacheName, error);
+    if (error)
+    {
+        std::filesystem::remove(tempName, error);
+    }
+
+    scene.loadTimings.cache = lap(start);
     return scene;
 }
 
+float Scene::computeSAHCost(size_t meshId, float traversalCost, float intersectionCost) const
+{
+    const Mesh& mesh = this->meshes.at(meshId);
+    if (mesh.triangleSize <= 0)
+    {
+        return 0;
+    }
+
+    int root = (int)mesh.nodeOffset;
+    float rootArea = this->getNodeBounds(root).surfaceArea();
+    if (rootArea <= 0)
+    {
+        return intersectionCost * mesh.triangleSize;
+    }
+
+    float cost = 0;
+    std::vector<int> stack = { root };
+    while (!stack.empty())
+    {
+        int node = stack.back();
+        stack.pop_back();
+
+        float area = this->getNodeBounds(node).surfaceArea() / rootArea;
+        if (this->bvhLayout != BVHSettings::Layout::Binary)
+        {
+            // Every wide node is traversed, the leaf children are intersected
+            cost += area * traversalCost;
+            for (int child = 0; child < 4; child++)
+            {
+                FastBVH::Node<float> record = this->getWideRecord(node, child);
+                if (record.right_offset != 0)
+                {
+                    stack.push_back(node + (int)record.right_offset);
+                    continue;
+                }
+
+                cost += record.bbox.surfaceArea() / rootArea * intersectionCost * record.primitive_count;
+            }
+
+            continue;
+        }
+
+        glm::vec3 data = this->bvh[node * 3 + 2];
+        if (data.z == 0)
+        {
+            cost += area * intersectionCost * data.y;
+            continue;
+        }
+
+        cost += area * traversalCost;
+        stack.push_back(node + 1);
+        stack.push_back(node + (int)data.z);
+    }
+
+    return cost;
+}
+
 void Scene::GLTFtextures(const std::vector<tinygltf::Texture>& textures, const std::vector<tinygltf::Image>& images)
 {
-    for (size_t textureId = 0; textureId < textures.size(); textureId++)
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    core::ThreadPool& threadPool = core::ThreadPool::getShared();
+
+    // Decode every image used by a texture once, even if several textures share it.
+    // Textures whose image comes from an unsupported extension have no source and stay empty
+    std::vector<bool> isUsed(images.size(), false);
+    for (const tinygltf::Texture& gltfTexture : textures)
     {
-        const tinygltf::Texture& gltfTexture = textures[textureId];
-        const tinygltf::Image& gltfImage = images[gltfTexture.source];
+        if (gltfTexture.source >= 0)
+        {
+            isUsed.at(gltfTexture.source) = true;
+        }
+    }
+
+    std::vector<DecodedImage> decoded(images.size());
+    threadPool.parallelFor(images.size(), [&images, &isUsed, &decoded](size_t imageId)
+    {
+        if (isUsed[imageId])
+        {
+            decoded[imageId] = decodeImage(images[imageId]);
+        }
+    });
+
+    this->loadTimings.textureDecode = lap(start);
 
-        std::string name = gltfTexture.name != "" ? gltfTexture.name : std::to_string(textureId);
-        glm::uvec2 size(gltfImage.width, gltfImage.height);
+    for (size_t imageId = 0; imageId < images.size(); imageId++)
+    {
+        if (isUsed[imageId] && decoded[imageId].error != nullptr)
+        {
+            for (DecodedImage& image : decoded)
+            {
+                stbi_image_free(image.bytes);
+                stbi_image_free(image.shorts);
+            }
 
-        std::vector<float> pixels;
-        pixels.reserve(gltfImage.width * gltfImage.height * 4);
-        for (size_t i = 0; i < gltfImage.image.size(); i += gltfImage.component)
+            throw std::runtime_error("Failed to decode image " + std::to_string(imageId) + ": " + decoded[imageId].error);
+        }
+    }
+
+    // Convert into the textures of the scene, every texture owns its pixels
+    size_t offset = this->textures.size();
+    this->textures.resize(offset + textures.size(), Image::empty);
+    threadPool.parallelFor(textures.size(), [this, &textures, &decoded, offset](size_t textureId)
+    {
+        int source = textures[textureId].source;
+        if (source >= 0)
         {
-            pixels.push_back(gltfImage.component > 0 ? gltfImage.image[i + 0] / 255.f : 0);
-            pixels.push_back(gltfImage.component > 1 ? gltfImage.image[i + 1] / 255.f : 0);
-            pixels.push_back(gltfImage.component > 2 ? gltfImage.image[i + 2] / 255.f : 0);
-            pixels.push_back(gltfImage.component > 3 ? gltfImage.image[i + 3] / 255.f : 1);
+            convertImage(decoded[source], this->textures[offset + textureId]);
         }
+    });
 
-        this->textures.push_back(Image::loadFromMemory(size, pixels));
-        this->textureNames.push_back(name);
+    for (size_t textureId = 0; textureId < textures.size(); textureId++)
+    {
+        const tinygltf::Texture& gltfTexture = textures[textureId];
+        this->textureNames.push_back(gltfTexture.name != "" ? gltfTexture.name : std::to_string(textureId));
+    }
+
+    for (DecodedImage& image : decoded)
+    {
+        stbi_image_free(image.bytes);
+        stbi_image_free(image.shorts);
     }
+
+    this->loadTimings.textureConversion = lap(start);
 }
 
 void Scene::GLTFmaterials(const std::vector<tinygltf::Material>& materials)
@@ -142,108 +731,113 @@ void Scene::GLTFmaterials(const std::vector<tinygltf::Material>& materials)
 
 void Scene::GLTFmesh(const tinygltf::Model& model, const tinygltf::Mesh& gltfMesh, const glm::mat4 transform)
 {
-    for (tinygltf::Primitive primitive : gltfMesh.primitives)
+    for (const tinygltf::Primitive& primitive : gltfMesh.primitives)
     {
-        if (primitive.mode != TINYGLTF_MODE_TRIANGLES)
+        int positionId = getAttribute(primitive, "POSITION");
+        int normalId = getAttribute(primitive, "NORMAL");
+        int uvId = getAttribute(primitive, "TEXCOORD_0");
+        if (primitive.mode != TINYGLTF_MODE_TRIANGLES || positionId < 0)
         {
             continue;
         }
 
-        const tinygltf::Accessor& positionAccessor = model.accessors[primitive.attributes["POSITION"]];
-        const tinygltf::BufferView& positionBufferView = model.bufferViews[positionAccessor.bufferView];
-        const tinygltf::Buffer& positionBuffer = model.buffers[positionBufferView.buffer];
-        const uint8_t* positionBufferAddress = positionBuffer.data.data();
-
-        const tinygltf::Accessor& normalAccessor = model.accessors[primitive.attributes["NORMAL"]];
-        const tinygltf::BufferView& normalBufferView = model.bufferViews[normalAccessor.bufferView];
-        const tinygltf::Buffer& normalBuffer = model.buffers[normalBufferView.buffer];
-        const uint8_t* normalBufferAddress = normalBuffer.data.data();
-
-        const tinygltf::Accessor& uvAccessor = model.accessors[primitive.attributes["TEXCOORD_0"]];
-        const tinygltf::BufferView& uvBufferView = model.bufferViews[uvAccessor.bufferView];
-        const tinygltf::Buffer& uvBuffer = model.buffers[uvBufferView.buffer];
-        const uint8_t* uvBufferAddress = uvBuffer.data.data();
-
-        size_t vertexOffset = this->vertices.size();
-        for (size_t i = 0; i < positionAccessor.count; i++)
+        // Primitives reading the same accessors are instances of the same geometry, they share its triangles and hierarchy
+        std::array<int, 4> geometry = { positionId, normalId, uvId, primitive.indices };
+        auto instanced = this->geometryMeshes.find(geometry);
+        if (instanced != this->geometryMeshes.end())
         {
-            Vertex v;
+            Mesh mesh = this->meshes[instanced->second];
+            mesh.materialId = primitive.material;
+            mesh.transform = transform;
+            mesh.transformInv = glm::inverse(transform);
+            this->meshes.push_back(mesh);
+            this->meshNames.push_back(gltfMesh.name);
+            continue;
+        }
 
-            // Position
-            const uint8_t* positionData = positionBufferAddress + positionBufferView.byteOffset + positionAccessor.byteOffset + (i * sizeof(float) * 3);
-            std::memcpy(glm::value_ptr(v.positionU), positionData, sizeof(float) * 3);
+        this->geometryMeshes[geometry] = this->meshes.size();
 
-            // Normal
-            const uint8_t* normalData = normalBufferAddress + normalBufferView.byteOffset + normalAccessor.byteOffset + (i * sizeof(float) * 3);
-            std::memcpy(glm::value_ptr(v.normalV), normalData, sizeof(float) * 3);
+        // Every attribute is written straight into its place in the vertex array, the texture coordinates go to the w components
+        const tinygltf::Accessor& positionAccessor = model.accessors.at(positionId);
+        size_t vertexOffset = this->vertices.size();
+        size_t vertexCount = positionAccessor.count;
+        this->vertices.resize(vertexOffset + vertexCount, Vertex{ glm::vec4(0), glm::vec4(0) });
+        Vertex* vertices = this->vertices.data() + vertexOffset;
+        constexpr size_t vertexStride = sizeof(Vertex) / sizeof(float);
 
-            // Texture coordinate
-            const uint8_t* uvData = uvBufferAddress + uvBufferView.byteOffset + uvAccessor.byteOffset + (i * sizeof(float) * 2);
-            glm::vec2 uv;
-            std::memcpy(glm::value_ptr(uv), uvData, sizeof(float) * 2);
-            v.positionU.w = uv.x;
-            v.normalV.w = uv.y;
+        readAccessor(model, positionAccessor, 0, 3, glm::value_ptr(vertices->positionU), vertexStride);
+        if (normalId >= 0)
+        {
+            readAccessor(model, model.accessors.at(normalId), 0, 3, glm::value_ptr(vertices->normalV), vertexStride);
+        }
 
-            this->vertices.push_back(v);
+        if (uvId >= 0)
+        {
+            readAccessor(model, model.accessors.at(uvId), 0, 1, &vertices->positionU.w, vertexStride);
+            readAccessor(model, model.accessors.at(uvId), 1, 1, &vertices->normalV.w, vertexStride);
         }
 
-        // Indices
-        const tinygltf::Accessor& indexAccessor = model.accessors[primitive.indices];
-        const tinygltf::BufferView& indexBufferView = model.bufferViews[indexAccessor.bufferView];
-        const tinygltf::Buffer& indexBuffer = model.buffers[indexBufferView.buffer];
-        const uint8_t* indexBufferAddress = indexBuffer.data.data();
-        int indexStride = tinygltf::GetComponentSizeInBytes(indexAccessor.componentType) * tinygltf::GetNumComponentsInType(indexAccessor.type);
+        // Indices, primitives without indices use the vertices in order
         size_t triangleOffset = this->triangles.size();
-        for (size_t i = 0; i < indexAccessor.count; i += 3)
+        size_t triangleCount = (primitive.indices >= 0 ? model.accessors.at(primitive.indices).count : vertexCount) / 3;
+        this->triangles.resize(triangleOffset + triangleCount);
+        Triangle* triangles = this->triangles.data() + triangleOffset;
+        if (primitive.indices >= 0)
         {
-            const uint8_t* data = indexBufferAddress + indexBufferView.byteOffset + indexAccessor.byteOffset + (i * indexStride);
-
-            Triangle triangle;
-            if (indexStride == 1)
+            const tinygltf::Accessor& indexAccessor = model.accessors[primitive.indices];
+            int indexSize = tinygltf::GetComponentSizeInBytes(indexAccessor.componentType);
+            const unsigned char* data = getBufferData(model, indexAccessor.bufferView, indexAccessor.byteOffset, indexSize, triangleCount * 3, indexSize);
+            for (size_t i = 0; i < triangleCount; i++)
             {
-                glm::vec<3, uint8_t> index;
-                std::memcpy(glm::value_ptr(index), data, sizeof(uint8_t) * 3);
-                triangle.v1 = (int)(index.x + vertexOffset);
-                triangle.v2 = (int)(index.y + vertexOffset);
-                triangle.v3 = (int)(index.z + vertexOffset);
+                uint32_t v1 = readIndex(indexAccessor.componentType, data, i * 3 + 0);
+                uint32_t v2 = readIndex(indexAccessor.componentType, data, i * 3 + 1);
+                uint32_t v3 = readIndex(indexAccessor.componentType, data, i * 3 + 2);
+                if (std::max(std::max(v1, v2), v3) >= vertexCount)
+                {
+                    throw std::runtime_error("Vertex index out of range");
+                }
+
+                triangles[i] = Triangle{ (int)(v1 + vertexOffset), (int)(v2 + vertexOffset), (int)(v3 + vertexOffset) };
             }
-            else if (indexStride == 2)
+        }
+        else
+        {
+            for (size_t i = 0; i < triangleCount; i++)
             {
-                glm::vec<3, uint16_t> index;
-                std::memcpy(glm::value_ptr(index), data, sizeof(uint16_t) * 3);
-                triangle.v1 = (int)(index.x + vertexOffset);
-                triangle.v2 = (int)(index.y + vertexOffset);
-                triangle.v3 = (int)(index.z + vertexOffset);
+                int v1 = (int)(vertexOffset + i * 3);
+                triangles[i] = Triangle{ v1, v1 + 1, v1 + 2 };
             }
-            else if (indexStride == 4)
+        }
+
+        // Smooth normals, the area-weighted normals of the triangles summed on their shared vertices
+        if (normalId < 0)
+        {
+            for (size_t i = 0; i < triangleCount; i++)
             {
-                glm::vec<3, uint32_t> index;
-                std::memcpy(glm::value_ptr(index), data, sizeof(uint32_t) * 3);
-                triangle.v1 = (int)(index.x + vertexOffset);
-                triangle.v2 = (int)(index.y + vertexOffset);
-                triangle.v3 = (int)(index.z + vertexOffset);
+                const Triangle& triangle = triangles[i];
+                glm::vec3 v1 = this->vertices[triangle.v1].positionU;
+                glm::vec3 v2 = this->vertices[triangle.v2].positionU;
+                glm::vec3 v3 = this->vertices[triangle.v3].positionU;
+                glm::vec3 normal = glm::cross(v2 - v1, v3 - v1);
+                for (int v : { triangle.v1, triangle.v2, triangle.v3 })
+                {
+                    this->vertices[v].normalV += glm::vec4(normal, 0);
+                }
             }
-            else if (indexStride == 8)
-            {
-                glm::vec<3, uint64_t> index;
-                std::memcpy(glm::value_ptr(index), data, sizeof(uint64_t) * 3);
-                triangle.v1 = (int)(index.x + vertexOffset);
-                triangle.v2 = (int)(index.y + vertexOffset);
-                triangle.v3 = (int)(index.z + vertexOffset);
-            }
-            else
+
+            for (size_t i = 0; i < vertexCount; i++)
             {
-                throw std::runtime_error("Unsupported index stride");
+                glm::vec3 normal = vertices[i].normalV;
+                float length = glm::length(normal);
+                vertices[i].normalV = glm::vec4(length > 0 ? normal / length : glm::vec3(0, 0, 1), vertices[i].normalV.w);
             }
-
-            this->triangles.push_back(triangle);
         }
 
         // Mesh
         Mesh mesh;
         mesh.materialId = primitive.material;
-        mesh.triangleOffset = triangleOffset;
-        mesh.triangleSize = indexAccessor.count / 3;
+        mesh.triangleOffset = (uint32_t)triangleOffset;
+        mesh.triangleSize = (uint32_t)triangleCount;
         mesh.transform = transform;
         mesh.transformInv = glm::inverse(transform);
         this->meshes.push_back(mesh);
@@ -266,6 +860,8 @@ void Scene::GLTFnodes(const tinygltf::Model& model, const glm::mat4& world)
     {
         this->GLTFtraverseNode(model, model.nodes[index], world);
     }
+
+    this->geometryMeshes.clear();
 }
 
 void Scene::GLTFtraverseNode(const tinygltf::Model& model, const tinygltf::Node& node, const glm::mat4& globalTransform)
@@ -332,7 +928,87 @@ void Scene::GLTFtraverseNode(const tinygltf::Model& model, const tinygltf::Node&
     }
 }
 
-void Scene::buildBVH(Mesh& mesh)
+void Scene::buildBVH(const BVHSettings& settings)
+{
+    if (settings.layout == BVHSettings::Layout::Quantized)
+    {
+        if (settings.quantizationBits != 8 && settings.quantizationBits != 16)
+        {
+            throw std::runtime_error("Unsupported BVH quantization bits: " + std::to_string(settings.quantizationBits));
+        }
+
+        if (settings.maxLeafSize > 0xFFFF)
+        {
+            throw std::runtime_error("Quantized BVH leaves are limited to 65535 triangles");
+        }
+    }
+
+    // A thread count other than the default gets its own pool
+    core::ThreadPool ownPool;
+    if (settings.threadCount > 0)
+    {
+        ownPool.init(settings.threadCount);
+    }
+
+    core::ThreadPool& threadPool = settings.threadCount > 0 ? ownPool : core::ThreadPool::getShared();
+
+    // Instances copy the triangle range of their geometry, they share the hierarchy of the first mesh with that range
+    std::vector<size_t> sourceMeshes(this->meshes.size());
+    std::map<std::pair<uint32_t, uint32_t>, size_t> triangleRanges;
+    for (size_t meshId = 0; meshId < this->meshes.size(); meshId++)
+    {
+        const Mesh& mesh = this->meshes[meshId];
+        sourceMeshes[meshId] = triangleRanges.emplace(std::make_pair(mesh.triangleOffset, mesh.triangleSize), meshId).first->second;
+    }
+
+    // The unique meshes own disjoint triangle ranges, so they can be built concurrently
+    std::vector<std::vector<glm::vec3>> nodes(this->meshes.size());
+    std::vector<std::vector<glm::uvec4>> data(this->meshes.size());
+    threadPool.parallelFor(this->meshes.size(), [this, &settings, &threadPool, &sourceMeshes, &nodes, &data](size_t meshId)
+    {
+        if (sourceMeshes[meshId] != meshId)
+        {
+            return;
+        }
+
+        FastBVH::NodeArray<float> meshNodes = this->buildBVH(this->meshes[meshId], settings, threadPool);
+        switch (settings.layout)
+        {
+        case BVHSettings::Layout::Binary:
+            nodes[meshId] = Scene::flattenBVH(meshNodes);
+            break;
+        case BVHSettings::Layout::Wide:
+            nodes[meshId] = Scene::flattenBVH(Scene::collapseBVH(meshNodes));
+            break;
+        case BVHSettings::Layout::Quantized:
+            nodes[meshId] = Scene::quantizeBVH(Scene::collapseBVH(meshNodes), settings.quantizationBits, data[meshId]);
+            break;
+        }
+    });
+
+    // Merged in mesh order, so the offsets do not depend on the thread count
+    this->bvhLayout = settings.layout;
+    this->bvhQuantizationBits = settings.quantizationBits;
+    this->bvh.clear();
+    this->bvhData.clear();
+    size_t nodeSize = settings.layout == BVHSettings::Layout::Quantized ? 2 : 3;
+    for (size_t meshId = 0; meshId < this->meshes.size(); meshId++)
+    {
+        if (sourceMeshes[meshId] != meshId)
+        {
+            this->meshes[meshId].nodeOffset = this->meshes[sourceMeshes[meshId]].nodeOffset;
+            continue;
+        }
+
+        this->meshes[meshId].nodeOffset = (uint32_t)(this->bvh.size() / nodeSize);
+        this->bvh.insert(this->bvh.end(), nodes[meshId].begin(), nodes[meshId].end());
+        this->bvhData.insert(this->bvhData.end(), data[meshId].begin(), data[meshId].end());
+    }
+
+    this->clearDirtyRanges();
+}
+
+FastBVH::NodeArray<float> Scene::buildBVH(const Mesh& mesh, const BVHSettings& settings, core::ThreadPool& threadPool)
 {
     class TriangleConverter
     {
@@ -345,7 +1021,7 @@ void Scene::buildBVH(Mesh& mesh)
         {
         }
 
-        FastBVH::BBox<float> operator()(const Triangle& triangle) const noexcept
+        FastBVH::BBox<float> operator()(const Triangle& triangle) const
         {
             glm::vec3 v1 = this->vertices->at(triangle.v1).positionU;
             glm::vec3 v2 = this->vertices->at(triangle.v2).positionU;
@@ -354,15 +1030,680 @@ void Scene::buildBVH(Mesh& mesh)
         }
     };
 
-    FastBVH::BVH<float, Triangle> bvh = FastBVH::DefaultBuilder<float>()(
-        FastBVH::Iterable<Triangle>(this->triangles.data() + (size_t)mesh.triangleOffset, (size_t)mesh.triangleSize),
-        TriangleConverter(&this->vertices, &mesh));
+    FastBVH::Iterable<Triangle> primitives(this->triangles.data() + (size_t)mesh.triangleOffset, (size_t)mesh.triangleSize);
+    TriangleConverter converter(&this->vertices, &mesh);
+
+    // Large subtrees are built as tasks of the pool that builds the meshes
+    auto parallelFor = [&threadPool](size_t count, const std::function<void(size_t)>& task)
+    {
+        threadPool.parallelFor(count, task);
+    };
+
+    FastBVH::BVH<float, Triangle> bvh = settings.strategy == BVHSettings::Strategy::Midpoint
+        ? [&]()
+        {
+            FastBVH::DefaultBuilder<float> builder;
+            builder.parallel_threshold = settings.parallelThreshold;
+            builder.parallel_for = parallelFor;
+            return builder(primitives, converter);
+        }()
+        : [&]()
+        {
+            FastBVH::BuildStrategy<float, 2> builder;
+            builder.bin_count = settings.binCount;
+            builder.traversal_cost = settings.traversalCost;
+            builder.intersection_cost = settings.intersectionCost;
+            builder.max_leaf_size = settings.maxLeafSize;
+            builder.parallel_threshold = settings.parallelThreshold;
+            builder.parallel_for = parallelFor;
+            return builder(primitives, converter);
+        }();
+
+    FastBVH::ConstIterable<FastBVH::Node<float>> nodes = bvh.getNodes();
+    return FastBVH::NodeArray<float>(nodes.begin(), nodes.end());
+}
+
+FastBVH::BBox<float> Scene::getNodeBounds(int node) const
+{
+    if (this->bvhLayout == BVHSettings::Layout::Binary)
+    {
+        return FastBVH::BBox<float>(this->bvh[node * 3], this->bvh[node * 3 + 1]);
+    }
+
+    // Union of the children, empty child slots are all zeros
+    FastBVH::BBox<float> bbox = this->getWideRecord(node, 0).bbox;
+    for (int child = 1; child < 4; child++)
+    {
+        FastBVH::Node<float> record = this->getWideRecord(node, child);
+        if (record.primitive_count != 0 || record.right_offset != 0)
+        {
+            bbox.expandToInclude(record.bbox);
+        }
+    }
+
+    return bbox;
+}
+
+FastBVH::BBox<float> Scene::getLeafBounds(const Mesh& mesh, uint32_t start, uint32_t count) const
+{
+    FastBVH::BBox<float> bbox(glm::vec3(this->vertices[this->triangles[(size_t)mesh.triangleOffset + start].v1].positionU));
+    for (size_t i = (size_t)mesh.triangleOffset + start; i < (size_t)mesh.triangleOffset + start + count; i++)
+    {
+        const Triangle& triangle = this->triangles[i];
+        bbox.expandToInclude(glm::vec3(this->vertices[triangle.v1].positionU));
+        bbox.expandToInclude(glm::vec3(this->vertices[triangle.v2].positionU));
+        bbox.expandToInclude(glm::vec3(this->vertices[triangle.v3].positionU));
+    }
+
+    return bbox;
+}
+
+FastBVH::Node<float> Scene::getWideRecord(int node, int child) const
+{
+    if (this->bvhLayout == BVHSettings::Layout::Wide)
+    {
+        size_t record = (size_t)(node + child) * 3;
+        glm::vec3 data = this->bvh[record + 2];
+        return FastBVH::Node<float>{ FastBVH::BBox<float>(this->bvh[record], this->bvh[record + 1]), (uint32_t)data.x, (uint32_t)data.y, (uint32_t)data.z };
+    }
+
+    // See Scene::quantizeBVH for the layout of the words
+    unsigned int bits = this->bvhQuantizationBits;
+    unsigned int perWord = 32 / bits;
+    unsigned int boundWords = bits * 3 / 4;
+    uint32_t mask = (1u << bits) - 1;
+    const uint32_t* words = glm::value_ptr(this->bvhData[(size_t)node * Scene::getQuantizedNodeSize(bits)]);
+
+    uint32_t quantized[6];
+    for (unsigned int coordinate = 0; coordinate < 6; coordinate++)
+    {
+        quantized[coordinate] = (words[coordinate * 4 / perWord + child / perWord] >> (bits * (child % perWord))) & mask;
+    }
+
+    glm::vec3 origin = this->bvh[(size_t)node * 2];
+    glm::vec3 scale = this->bvh[(size_t)node * 2 + 1];
+    FastBVH::BBox<float> bbox(
+        origin + glm::vec3(quantized[0], quantized[1], quantized[2]) * scale,
+        origin + glm::vec3(quantized[3], quantized[4], quantized[5]) * scale);
+
+    uint32_t count = (words[boundWords + child / 2] >> (16 * (child % 2))) & 0xFFFF;
+    uint32_t reference = words[boundWords + 2 + child];
+    return count != 0
+        ? FastBVH::Node<float>{ bbox, reference, count, 0 }
+        : FastBVH::Node<float>{ bbox, 0, 0, reference };
+}
+
+size_t Scene::getBVHMemorySize() const
+{
+    return this->bvh.size() * sizeof(glm::vec3) + this->bvhData.size() * sizeof(glm::uvec4);
+}
+
+void Scene::refitBVH(size_t meshId)
+{
+    const Mesh& mesh = this->meshes.at(meshId);
+    if (mesh.triangleSize <= 0)
+    {
+        return;
+    }
+
+    // The nodes of a mesh end where the nodes of the next unique mesh start, instances share them
+    bool quantized = this->bvhLayout == BVHSettings::Layout::Quantized;
+    size_t nodeSize = quantized ? 2 : 3;
+    size_t begin = (size_t)mesh.nodeOffset;
+    size_t end = this->bvh.size() / nodeSize;
+    for (const Mesh& other : this->meshes)
+    {
+        if ((size_t)other.nodeOffset > begin)
+        {
+            end = std::min(end, (size_t)other.nodeOffset);
+        }
+    }
+
+    // Binary nodes or wide records, the offsets of the inner records are in records
+    FastBVH::NodeArray<float> nodes;
+    for (size_t node = begin; node < end; node++)
+    {
+        if (quantized)
+        {
+            for (int child = 0; child < 4; child++)
+            {
+                FastBVH::Node<float> record = this->getWideRecord((int)node, child);
+                record.right_offset *= 4;
+                nodes.push_back(record);
+            }
+
+            continue;
+        }
+
+        glm::vec3 data = this->bvh[node * 3 + 2];
+        nodes.push_back(FastBVH::Node<float>{ FastBVH::BBox<float>(glm::vec3(0)), (uint32_t)data.x, (uint32_t)data.y, (uint32_t)data.z });
+    }
+
+    // The children are always after their parent, so the bounds are updated bottom-up in reverse order
+    if (this->bvhLayout == BVHSettings::Layout::Binary)
+    {
+        for (size_t node = nodes.size(); node-- > 0;)
+        {
+            FastBVH::Node<float>& current = nodes[node];
+            if (current.isLeaf())
+            {
+                current.bbox = this->getLeafBounds(mesh, current.start, current.primitive_count);
+                continue;
+            }
+
+            current.bbox = nodes[node + 1].bbox;
+            current.bbox.expandToInclude(nodes[node + current.right_offset].bbox);
+        }
+    }
+    else
+    {
+        for (size_t wideNode = nodes.size(); wideNode >= 4;)
+        {
+            wideNode -= 4;
+            for (size_t i = wideNode; i < wideNode + 4; i++)
+            {
+                FastBVH::Node<float>& record = nodes[i];
+                if (record.primitive_count != 0)
+                {
+                    record.bbox = this->getLeafBounds(mesh, record.start, record.primitive_count);
+                }
+                else if (record.right_offset != 0)
+                {
+                    size_t child = wideNode + record.right_offset;
+                    record.bbox = nodes[child].bbox;
+                    for (size_t j = child + 1; j < child + 4; j++)
+                    {
+                        if (nodes[j].primitive_count != 0 || nodes[j].right_offset != 0)
+                        {
+                            record.bbox.expandToInclude(nodes[j].bbox);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // Only the nodes whose encoding changed are marked dirty
+    if (quantized)
+    {
+        std::vector<glm::uvec4> data;
+        std::vector<glm::vec3> boxes = Scene::quantizeBVH(nodes, this->bvhQuantizationBits, data);
+        std::pair<size_t, size_t> range = updateRange(this->bvh, boxes, begin * 2);
+        Scene::markDirty(this->dirtyBVH, range.first, range.second);
+        range = updateRange(this->bvhData, data, begin * Scene::getQuantizedNodeSize(this->bvhQuantizationBits));
+        Scene::markDirty(this->dirtyBVHData, range.first, range.second);
+    }
+    else
+    {
+        std::pair<size_t, size_t> range = updateRange(this->bvh, Scene::flattenBVH(nodes), begin * 3);
+        Scene::markDirty(this->dirtyBVH, range.first, range.second);
+    }
+
+    // The vertices referenced by the triangles of the mesh
+    size_t vertexBegin = this->vertices.size();
+    size_t vertexEnd = 0;
+    for (size_t i = (size_t)mesh.triangleOffset; i < (size_t)(mesh.triangleOffset + mesh.triangleSize); i++)
+    {
+        const Triangle& triangle = this->triangles[i];
+        vertexBegin = std::min(vertexBegin, (size_t)std::min(std::min(triangle.v1, triangle.v2), triangle.v3));
+        vertexEnd = std::max(vertexEnd, (size_t)std::max(std::max(triangle.v1, triangle.v2), triangle.v3) + 1);
+    }
+
+    Scene::markDirty(this->dirtyVertices, vertexBegin, vertexEnd);
+}
+
+void Scene::clearDirtyRanges()
+{
+    this->dirtyVertices = { 0, 0 };
+    this->dirtyBVH = { 0, 0 };
+    this->dirtyBVHData = { 0, 0 };
+}
+
+std::vector<glm::uvec4> Scene::buildMeshOffsets() const
+{
+    // Kept out of the float mesh buffer, so the offsets stay exact past 2^24
+    std::vector<glm::uvec4> offsets;
+    offsets.reserve(this->meshes.size());
+    for (const Mesh& mesh : this->meshes)
+    {
+        offsets.push_back(glm::uvec4(mesh.nodeOffset, mesh.triangleOffset, 0, 0));
+    }
+
+    return offsets;
+}
+
+std::vector<glm::vec3> Scene::buildTLAS() const
+{
+    struct MeshBounds
+    {
+        int meshId;
+        FastBVH::BBox<float> bbox;
+    };
 
-    mesh.nodeOffset = (float)(this->bvh.size() / 3);
-    for (const FastBVH::Node<float>& node : bvh.getNodes())
+    // World space bounds of the root node of each mesh
+    std::vector<MeshBounds> bounds;
+    for (size_t meshId = 0; meshId < this->meshes.size(); meshId++)
     {
-        this->bvh.push_back(node.bbox.min);
-        this->bvh.push_back(node.bbox.max);
-        this->bvh.push_back(glm::vec3(node.start, node.primitive_count, node.right_offset));
+        const Mesh& mesh = this->meshes[meshId];
+        if (mesh.triangleSize <= 0)
+        {
+            continue;
+        }
+
+        FastBVH::BBox<float> localBounds = this->getNodeBounds((int)mesh.nodeOffset);
+        glm::vec3 localMin = localBounds.min;
+        glm::vec3 localMax = localBounds.max;
+        FastBVH::BBox<float> bbox(glm::vec3(mesh.transform * glm::vec4(localMin, 1)));
+        for (int corner = 1; corner < 8; corner++)
+        {
+            glm::vec3 point(corner & 1 ? localMax.x : localMin.x, corner & 2 ? localMax.y : localMin.y, corner & 4 ? localMax.z : localMin.z);
+            bbox.expandToInclude(glm::vec3(mesh.transform * glm::vec4(point, 1)));
+        }
+
+        bounds.push_back({ (int)meshId, bbox });
     }
+
+    // Same node layout as the mesh BVH, every leaf holds a single mesh (start is the mesh ID)
+    std::vector<glm::vec3> tlas;
+    std::function<void(size_t, size_t)> buildNode = [&](size_t start, size_t end)
+    {
+        FastBVH::BBox<float> bbox = bounds[start].bbox;
+        FastBVH::BBox<float> centers(bbox.getCenter());
+        for (size_t i = start + 1; i < end; i++)
+        {
+            bbox.expandToInclude(bounds[i].bbox);
+            centers.expandToInclude(bounds[i].bbox.getCenter());
+        }
+
+        size_t nodeIndex = tlas.size() / 3;
+        tlas.push_back(bbox.min);
+        tlas.push_back(bbox.max);
+        tlas.push_back(glm::vec3(bounds[start].meshId, 1, 0));
+        if (end - start == 1)
+        {
+            return;
+        }
+
+        // Split on the center of the longest axis
+        uint32_t splitDim = centers.maxDimension();
+        float splitCoord = centers.getCenter()[splitDim];
+        size_t mid = std::partition(bounds.begin() + start, bounds.begin() + end, [&](const MeshBounds& mesh)
+        {
+            return mesh.bbox.getCenter()[splitDim] < splitCoord;
+        }) - bounds.begin();
+
+        // If we get a bad split, just choose the center
+        if (mid == start || mid == end)
+        {
+            mid = start + (end - start) / 2;
+        }
+
+        buildNode(start, mid);
+        size_t rightIndex = tlas.size() / 3;
+        buildNode(mid, end);
+        tlas[nodeIndex * 3 + 2] = glm::vec3(0, 0, rightIndex - nodeIndex);
+    };
+
+    if (!bounds.empty())
+    {
+        buildNode(0, bounds.size());
+    }
+
+    return tlas;
+}
+
+std::vector<float> Scene::buildMaterialPowers() const
+{
+    // Emitted luminance of the materials, emission textures count with their mean
+    std::vector<float> materialPowers(this->materials.size(), 0);
+    for (size_t materialId = 0; materialId < this->materials.size(); materialId++)
+    {
+        const Material& material = this->materials[materialId];
+        glm::vec3 emission = material.emissionColor * material.emissionStrength;
+        if (material.emissionTextureId >= 0 && (size_t)material.emissionTextureId < this->textures.size())
+        {
+            const Image& texture = this->textures[(size_t)material.emissionTextureId];
+            glm::dvec3 sum(0);
+            for (size_t i = 0; i < texture.pixels.size(); i += 4)
+            {
+                sum += glm::dvec3(texture.pixels[i], texture.pixels[i + 1], texture.pixels[i + 2]);
+            }
+
+            for (size_t i = 0; i < texture.bytes.size(); i += 4)
+            {
+                sum += glm::dvec3(texture.bytes[i], texture.bytes[i + 1], texture.bytes[i + 2]) / 255.0;
+            }
+
+            size_t pixelCount = (texture.pixels.size() + texture.bytes.size()) / 4;
+            emission *= pixelCount == 0 ? glm::vec3(0) : glm::vec3(sum / (double)pixelCount);
+        }
+
+        // Dense media only emit where the paths scatter inside them
+        if (material.density <= 0)
+        {
+            materialPowers[materialId] = std::max(glm::dot(emission, glm::vec3(.2126f, .7152f, .0722f)), 0.f);
+        }
+    }
+
+    return materialPowers;
+}
+
+std::vector<glm::vec4> Scene::buildLightTable(const std::vector<float>& materialPowers) const
+{
+    // Emissive triangles in world space, weighted by their power
+    struct Light
+    {
+        double power;
+        int meshId;
+        int triangleId;
+    };
+
+    std::vector<Light> lights;
+    double totalPower = 0;
+    for (size_t meshId = 0; meshId < this->meshes.size(); meshId++)
+    {
+        const Mesh& mesh = this->meshes[meshId];
+        if (mesh.materialId < 0 || (size_t)mesh.materialId >= materialPowers.size() || materialPowers[(size_t)mesh.materialId] <= 0)
+        {
+            continue;
+        }
+
+        for (int triangleId = (int)mesh.triangleOffset; triangleId < (int)(mesh.triangleOffset + mesh.triangleSize); triangleId++)
+        {
+            const Triangle& triangle = this->triangles[triangleId];
+            glm::vec3 p1 = mesh.transform * glm::vec4(glm::vec3(this->vertices[triangle.v1].positionU), 1);
+            glm::vec3 p2 = mesh.transform * glm::vec4(glm::vec3(this->vertices[triangle.v2].positionU), 1);
+            glm::vec3 p3 = mesh.transform * glm::vec4(glm::vec3(this->vertices[triangle.v3].positionU), 1);
+            double power = .5 * glm::length(glm::cross(p2 - p1, p3 - p1)) * materialPowers[(size_t)mesh.materialId];
+            if (power > 0)
+            {
+                lights.push_back({ power, (int)meshId, triangleId });
+                totalPower += power;
+            }
+        }
+    }
+
+    std::vector<double> powers(lights.size());
+    for (size_t i = 0; i < lights.size(); i++)
+    {
+        powers[i] = lights[i].power;
+    }
+
+    core::AliasTable aliasTable;
+    aliasTable.build(powers);
+
+    // Header, slots and the area density of the emissive materials
+    std::vector<glm::vec4> table;
+    table.push_back(glm::vec4(lights.size(), 0, 0, 0));
+    for (size_t i = 0; i < lights.size(); i++)
+    {
+        table.push_back(glm::vec4(aliasTable.probabilities[i], aliasTable.aliases[i], lights[i].meshId, lights[i].triangleId));
+    }
+
+    if (!lights.empty())
+    {
+        for (float power : materialPowers)
+        {
+            table.push_back(glm::vec4(power / totalPower, 0, 0, 0));
+        }
+    }
+
+    return table;
+}
+
+void Scene::saveCache(std::ostream& stream) const
+{
+    writeValue<uint32_t>(stream, (uint32_t)this->bvhLayout);
+    writeValue<uint32_t>(stream, this->bvhQuantizationBits);
+    writeArray(stream, this->vertices);
+    writeArray(stream, this->triangles);
+    writeArray(stream, this->materials);
+    writeStrings(stream, this->materialNames);
+    writeArray(stream, this->meshes);
+    writeStrings(stream, this->meshNames);
+    writeArray(stream, this->cameras);
+    writeArray(stream, this->bvh);
+    writeArray(stream, this->bvhData);
+
+    // 8-bit textures are stored as bytes, the others as floats
+    writeValue<uint64_t>(stream, this->textures.size());
+    std::vector<unsigned char> bytes;
+    for (const Image& texture : this->textures)
+    {
+        bool isByte = std::all_of(texture.pixels.begin(), texture.pixels.end(), [](float value)
+        {
+            return value >= 0 && value <= 1 && std::round(value * 255) / 255.f == value;
+        });
+
+        writeValue(stream, texture.size);
+        writeValue<uint32_t>(stream, isByte);
+        if (!texture.bytes.empty())
+        {
+            writeArray(stream, texture.bytes);
+            continue;
+        }
+
+        if (!isByte)
+        {
+            writeArray(stream, texture.pixels);
+            continue;
+        }
+
+        bytes.resize(texture.pixels.size());
+        std::transform(texture.pixels.begin(), texture.pixels.end(), bytes.begin(), [](float value) { return (unsigned char)std::round(value * 255); });
+        writeArray(stream, bytes);
+    }
+
+    writeStrings(stream, this->textureNames);
+}
+
+void Scene::loadCache(const unsigned char* data, size_t size)
+{
+    CacheReader reader(data, size);
+    this->bvhLayout = (BVHSettings::Layout)reader.readValue<uint32_t>();
+    this->bvhQuantizationBits = reader.readValue<uint32_t>();
+    reader.readArray(this->vertices);
+    reader.readArray(this->triangles);
+    reader.readArray(this->materials);
+    reader.readStrings(this->materialNames);
+    reader.readArray(this->meshes);
+    reader.readStrings(this->meshNames);
+    reader.readArray(this->cameras);
+    reader.readArray(this->bvh);
+    reader.readArray(this->bvhData);
+
+    // 8-bit textures are read as bytes, as the Renderer uploads them
+    this->textures.resize(reader.readValue<uint64_t>(), Image::empty);
+    for (Image& texture : this->textures)
+    {
+        texture.size = reader.readValue<glm::uvec2>();
+        if (reader.readValue<uint32_t>())
+        {
+            reader.readArray(texture.bytes);
+        }
+        else
+        {
+            reader.readArray(texture.pixels);
+        }
+    }
+
+    reader.readStrings(this->textureNames);
+}
+
+FastBVH::NodeArray<float> Scene::collapseBVH(const FastBVH::NodeArray<float>& nodes)
+{
+    // Every wide node is four child records in the binary node format:
+    // leaf (start, count, 0), inner (0, 0, offset of the child wide node), empty (0, 0, 0)
+    FastBVH::NodeArray<float> wideNodes;
+    wideNodes.reserve(nodes.size());
+
+    std::function<uint32_t(uint32_t)> collapse = [&](uint32_t node)
+    {
+        uint32_t wideNode = (uint32_t)wideNodes.size();
+        wideNodes.resize(wideNodes.size() + 4, FastBVH::Node<float>{ FastBVH::BBox<float>(glm::vec3(0)), 0, 0, 0 });
+
+        // Takes the binary children and grandchildren, so the wide tree is at most half as deep
+        std::vector<uint32_t> children;
+        if (nodes[node].isLeaf())
+        {
+            children = { node };
+        }
+        else
+        {
+            for (uint32_t child : { node + 1, node + nodes[node].right_offset })
+            {
+                if (nodes[child].isLeaf())
+                {
+                    children.push_back(child);
+                }
+                else
+                {
+                    children.push_back(child + 1);
+                    children.push_back(child + nodes[child].right_offset);
+                }
+            }
+        }
+
+        for (size_t i = 0; i < children.size(); i++)
+        {
+            FastBVH::Node<float> record = nodes[children[i]];
+            if (!record.isLeaf())
+            {
+                record.start = 0;
+                record.primitive_count = 0;
+                record.right_offset = collapse(children[i]) - wideNode;
+            }
+
+            wideNodes[wideNode + i] = record;
+        }
+
+        return wideNode;
+    };
+
+    if (!nodes.empty())
+    {
+        collapse(0);
+    }
+
+    return wideNodes;
+}
+
+std::vector<glm::vec3> Scene::flattenBVH(const FastBVH::NodeArray<float>& nodes)
+{
+    std::vector<glm::vec3> flatNodes;
+    flatNodes.reserve(nodes.size() * 3);
+    for (const FastBVH::Node<float>& node : nodes)
+    {
+        flatNodes.push_back(node.bbox.min);
+        flatNodes.push_back(node.bbox.max);
+        flatNodes.push_back(glm::vec3(node.start, node.primitive_count, node.right_offset));
+    }
+
+    return flatNodes;
+}
+
+std::vector<glm::vec3> Scene::quantizeBVH(const FastBVH::NodeArray<float>& nodes, unsigned int bits, std::vector<glm::uvec4>& data)
+{
+    // Every wide node is its origin and scale in the float buffer, and words in the integer buffer:
+    // the child bounds (min x, y, z then max x, y, z, 32 / bits children per word),
+    // the child primitive counts (16 bits each) and the child references
+    // (start of the leaf, or offset of the child wide node when the count is zero)
+    unsigned int nodeSize = Scene::getQuantizedNodeSize(bits);
+    unsigned int perWord = 32 / bits;
+    unsigned int boundWords = bits * 3 / 4;
+    float maxValue = (float)((1u << bits) - 1);
+
+    size_t nodeCount = nodes.size() / 4;
+    std::vector<glm::vec3> boxes(nodeCount * 2);
+    data.assign(nodeCount * nodeSize, glm::uvec4(0));
+    for (size_t node = 0; node < nodeCount; node++)
+    {
+        const FastBVH::Node<float>* records = nodes.data() + node * 4;
+        FastBVH::BBox<float> bbox = records[0].bbox;
+        for (int i = 1; i < 4; i++)
+        {
+            if (records[i].primitive_count != 0 || records[i].right_offset != 0)
+            {
+                bbox.expandToInclude(records[i].bbox);
+            }
+        }
+
+        // Power of two scales, so the decoded offsets are exact
+        glm::vec3 origin = bbox.min;
+        glm::vec3 scale(0);
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float extent = bbox.max[axis] - origin[axis];
+            if (extent <= 0)
+            {
+                continue;
+            }
+
+            scale[axis] = std::max(std::exp2(std::ceil(std::log2(extent / maxValue))), std::numeric_limits<float>::min());
+            while (origin[axis] + maxValue * scale[axis] < bbox.max[axis])
+            {
+                scale[axis] *= 2;
+            }
+        }
+
+        boxes[node * 2] = origin;
+        boxes[node * 2 + 1] = scale;
+
+        uint32_t* words = glm::value_ptr(data[node * nodeSize]);
+        for (unsigned int i = 0; i < 4; i++)
+        {
+            const FastBVH::Node<float>& record = records[i];
+            if (record.primitive_count == 0 && record.right_offset == 0)
+            {
+                continue;
+            }
+
+            for (int axis = 0; axis < 3; axis++)
+            {
+                uint32_t qMin = 0;
+                uint32_t qMax = 0;
+                if (scale[axis] > 0)
+                {
+                    // Rounded outwards, so the decoded box contains the child
+                    qMin = (uint32_t)glm::clamp(std::floor((record.bbox.min[axis] - origin[axis]) / scale[axis]), 0.f, maxValue);
+                    qMax = (uint32_t)glm::clamp(std::ceil((record.bbox.max[axis] - origin[axis]) / scale[axis]), 0.f, maxValue);
+                    while (qMin > 0 && origin[axis] + qMin * scale[axis] > record.bbox.min[axis])
+                    {
+                        qMin--;
+                    }
+
+                    while (qMax < maxValue && origin[axis] + qMax * scale[axis] < record.bbox.max[axis])
+                    {
+                        qMax++;
+                    }
+                }
+
+                words[axis * 4 / perWord + i / perWord] |= qMin << (bits * (i % perWord));
+                words[(axis + 3) * 4 / perWord + i / perWord] |= qMax << (bits * (i % perWord));
+            }
+
+            words[boundWords + i / 2] |= record.primitive_count << (16 * (i % 2));
+            words[boundWords + 2 + i] = record.isLeaf() ? record.start : record.right_offset / 4;
+        }
+    }
+
+    return boxes;
+}
+
+unsigned int Scene::getQuantizedNodeSize(unsigned int bits)
+{
+    // Bound words, two count words and four reference words, in texels of four words
+    return (bits * 3 / 4 + 6 + 3) / 4;
+}
+
+void Scene::markDirty(std::pair<size_t, size_t>& range, size_t begin, size_t end)
+{
+    if (begin >= end)
+    {
+        return;
+    }
+
+    range = range.first < range.second
+        ? std::make_pair(std::min(range.first, begin), std::max(range.second, end))
+        : std::make_pair(begin, end);
 }
@@ -15,11 +15,50 @@ void Shader::init(const std::string& vertexSrc, const std::string& fragmentSrc)
     GLuint fragmentHandler = this->initShader(fragmentSrc, GL_FRAGMENT_SHADER);
 
     // Create OpenGL program
-    this->handler = this->initProgram(vertexHandler, fragmentHandler);
+    this->handler = this->initProgram({ vertexHandler, fragmentHandler });
 
     // Clean OpenGL shaders
     glDeleteShader(vertexHandler);
     glDeleteShader(fragmentHandler);
+
+    this->initLocations();
+}
+
+void Shader::init(const std::string& computeSrc)
+{
+    // Create OpenGL shader
+    GLuint computeHandler = this->initShader(computeSrc, GL_COMPUTE_SHADER);
+
+    // Create OpenGL program
+    this->handler = this->initProgram({ computeHandler });
+
+    // Clean OpenGL shader
+    glDeleteShader(computeHandler);
+
+    this->initLocations();
+}
+
+void Shader::initLocations()
+{
+    // Cache the uniform locations, the uniforms of the blocks have none
+    this->locations.clear();
+    GLint uniformCount = 0;
+    GLint maxNameLength = 0;
+    glGetProgramiv(this->handler, GL_ACTIVE_UNIFORMS, &uniformCount);
+    glGetProgramiv(this->handler, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+    std::string name(maxNameLength, '\0');
+    for (GLint i = 0; i < uniformCount; i++)
+    {
+        GLsizei length = 0;
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(this->handler, i, maxNameLength, &length, &size, &type, name.data());
+        GLint location = glGetUniformLocation(this->handler, name.c_str());
+        if (location >= 0)
+        {
+            this->locations[name.substr(0, length)] = location;
+        }
+    }
 }
 
 void Shader::shutdown()
@@ -32,29 +71,55 @@ void Shader::use()
     glUseProgram(this->handler);
 }
 
+void Shader::updateParam(const std::string& name, int value)
+{
+    glUniform1i(this->getParamLocation(name), value);
+}
+
 void Shader::updateParam(const std::string& name, unsigned int value)
 {
-    glUniform1ui(glGetUniformLocation(this->handler, name.c_str()), value);
+    glUniform1ui(this->getParamLocation(name), value);
 }
 
 void Shader::updateParam(const std::string& name, float value)
 {
-    glUniform1f(glGetUniformLocation(this->handler, name.c_str()), value);
+    glUniform1f(this->getParamLocation(name), value);
+}
+
+void Shader::updateParam(const std::string& name, glm::uvec2 value)
+{
+    glUniform2ui(this->getParamLocation(name), value.x, value.y);
 }
 
 void Shader::updateParam(const std::string& name, glm::vec3 value)
 {
-    glUniform3f(glGetUniformLocation(this->handler, name.c_str()), value.x, value.y, value.z);
+    glUniform3f(this->getParamLocation(name), value.x, value.y, value.z);
 }
 
 void Shader::updateParam(const std::string& name, glm::mat3 value)
 {
-    glUniformMatrix3fv(glGetUniformLocation(this->handler, name.c_str()), 1, GL_FALSE, glm::value_ptr(value));
+    glUniformMatrix3fv(this->getParamLocation(name), 1, GL_FALSE, glm::value_ptr(value));
 }
 
 void Shader::updateParam(const std::string& name, bool value)
 {
-    glUniform1i(glGetUniformLocation(this->handler, name.c_str()), value);
+    glUniform1i(this->getParamLocation(name), value);
+}
+
+void Shader::updateParam(GLint location, unsigned int value)
+{
+    glUniform1ui(location, value);
+}
+
+void Shader::updateParam(GLint location, glm::uvec2 value)
+{
+    glUniform2ui(location, value.x, value.y);
+}
+
+GLint Shader::getParamLocation(const std::string& name) const
+{
+    auto location = this->locations.find(name);
+    return location == this->locations.end() ? -1 : location->second;
 }
 
 void Shader::stopUse()
@@ -87,11 +152,14 @@ GLuint Shader::initShader(const std::string& src, GLenum shaderType)
     return handler;
 }
 
-GLuint Shader::initProgram(GLuint vertexHandler, GLuint fragmentHandler)
+GLuint Shader::initProgram(std::initializer_list<GLuint> shaderHandlers)
 {
     GLuint handler = glCreateProgram();
-    glAttachShader(handler, vertexHandler);
-    glAttachShader(handler, fragmentHandler);
+    for (GLuint shaderHandler : shaderHandlers)
+    {
+        glAttachShader(handler, shaderHandler);
+    }
+
     glLinkProgram(handler);
 
     GLint success = 0;
@@ -3,11 +3,14 @@
  */
 #include "TracerX/Texture.h"
 
+#include <algorithm>
+
 using namespace TracerX;
 using namespace TracerX::core;
 
 void Texture::init()
 {
+    this->size = glm::uvec2(0);
     glGenTextures(1, &this->handler);
     glBindTexture(GL_TEXTURE_2D, this->handler);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -25,27 +28,75 @@ void Texture::update(const Image& image)
 {
     glBindTexture(GL_TEXTURE_2D, this->handler);
 
+    // 8-bit images are normalized by the upload
+    GLenum type = image.bytes.empty() ? GL_FLOAT : GL_UNSIGNED_BYTE;
+    const void* pixels = image.bytes.empty() ? (const void*)image.pixels.data() : image.bytes.data();
     if (image.size != this->size)
     {
         this->size = image.size;
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, this->size.x, this->size.y, 0, GL_RGBA, GL_FLOAT, image.pixels.data());
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, this->size.x, this->size.y, 0, GL_RGBA, type, pixels);
     }
     else
     {
-        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, this->size.x, this->size.y, GL_RGBA, GL_FLOAT, image.pixels.data());
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, this->size.x, this->size.y, GL_RGBA, type, pixels);
     }
 
     glBindTexture(GL_TEXTURE_2D, 0);
 
 }
 
+void Texture::update(const float* pixels)
+{
+    glBindTexture(GL_TEXTURE_2D, this->handler);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, this->size.x, this->size.y, GL_RGBA, GL_FLOAT, pixels);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void Texture::updateMipmaps(const std::vector<Image>& levels)
+{
+    glBindTexture(GL_TEXTURE_2D, this->handler);
+    for (size_t i = 0; i < levels.size(); i++)
+    {
+        const Image& level = levels[i];
+        glTexImage2D(GL_TEXTURE_2D, (GLint)i + 1, GL_RGBA32F, level.size.x, level.size.y, 0, GL_RGBA, GL_FLOAT, level.pixels.data());
+    }
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)levels.size());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, levels.empty() ? GL_LINEAR : GL_LINEAR_MIPMAP_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
 Image Texture::upload() const
 {
     std::vector<float> pixels(this->size.x * this->size.y * 4);
+    this->upload(pixels.data());
+    return Image::loadFromMemory(this->size, pixels);
+}
+
+void Texture::upload(float* pixels) const
+{
     glBindTexture(GL_TEXTURE_2D, this->handler);
-    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, pixels.data());
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, pixels);
     glBindTexture(GL_TEXTURE_2D, 0);
-    return Image::loadFromMemory(this->size, pixels);
+}
+
+void Texture::upload(glm::uvec2 position, glm::uvec2 size, float* pixels) const
+{
+    if (GLEW_VERSION_4_5 || GLEW_ARB_get_texture_sub_image)
+    {
+        GLsizei bufferSize = (GLsizei)((size_t)size.x * size.y * 4 * sizeof(float));
+        glGetTextureSubImage(this->handler, 0, position.x, position.y, 0, size.x, size.y, 1, GL_RGBA, GL_FLOAT, bufferSize, pixels);
+        return;
+    }
+
+    // Older drivers read back the whole level, the rectangle is copied out of it
+    std::vector<float> texture((size_t)this->size.x * this->size.y * 4);
+    this->upload(texture.data());
+    for (unsigned int y = 0; y < size.y; y++)
+    {
+        const float* row = texture.data() + ((size_t)(position.y + y) * this->size.x + position.x) * 4;
+        std::copy(row, row + (size_t)size.x * 4, pixels + (size_t)y * size.x * 4);
+    }
 }
 
 void Texture::shutdown()
@@ -5,12 +5,14 @@
 
 using namespace TracerX::core;
 
-void TextureArray::init()
+void TextureArray::init(GLenum internalFormat)
 {
+    this->size = glm::uvec3(0);
+    this->internalFormat = internalFormat;
     glGenTextures(1, &this->handler);
     glBindTexture(GL_TEXTURE_2D_ARRAY, this->handler);
-    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
 }
 
@@ -20,30 +22,23 @@ void TextureArray::bind(int binding)
     glBindTexture(GL_TEXTURE_2D_ARRAY, this->handler);
 }
 
-void TextureArray::update(glm::uvec2 size, const std::vector<Image>& images)
+void TextureArray::resize(glm::uvec3 size)
 {
-    size_t count = size.x * size.y * 4;
-    std::vector<float> data(count * images.size());
-    for (size_t i = 0; i < images.size(); i++)
+    if (this->size == size)
     {
-        const Image& img = images[i];
-        const Image& resizedImg = img.resize(size);
-        data.insert(data.begin() + count * i, resizedImg.pixels.begin(), resizedImg.pixels.end());
+        return;
     }
 
+    this->size = size;
     glBindTexture(GL_TEXTURE_2D_ARRAY, this->handler);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, this->internalFormat, this->size.x, this->size.y, this->size.z, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
 
-    glm::uvec3 size3(size, images.size());
-    if (this->size != size3)
-    {
-        this->size = size3;
-        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA32F, this->size.x, this->size.y, this->size.z, 0, GL_RGBA, GL_FLOAT, data.data());
-    }
-    else
-    {
-        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0, this->size.x, this->size.y, this->size.z, GL_RGBA, GL_FLOAT, data.data());
-    }
-
+void TextureArray::update(glm::uvec3 position, glm::uvec2 size, GLenum type, const void* pixels)
+{
+    glBindTexture(GL_TEXTURE_2D_ARRAY, this->handler);
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, position.x, position.y, position.z, size.x, size.y, 1, GL_RGBA, type, pixels);
     glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
 }
 
@@ -0,0 +1,223 @@
+/**
+ * @file TextureAtlas.cpp
+ */
+#include "TracerX/TextureAtlas.h"
+
+#include <cmath>
+#include <numeric>
+#include <algorithm>
+#include <glm/gtc/packing.hpp>
+
+using namespace TracerX;
+using namespace TracerX::core;
+
+void TextureAtlas::init()
+{
+    this->bytePages.init(GL_RGBA8);
+    this->halfPages.init(GL_RGBA16F);
+    this->info.init(GL_RGBA32F);
+}
+
+void TextureAtlas::bind(int byteBinding, int halfBinding, int infoBinding)
+{
+    this->bytePages.bind(byteBinding);
+    this->halfPages.bind(halfBinding);
+    this->info.bind(infoBinding);
+}
+
+void TextureAtlas::update(const std::vector<Image>& images, glm::uvec2 maxSize)
+{
+    GLint maxTextureSize;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+    maxSize = glm::min(maxSize, glm::uvec2(maxTextureSize));
+
+    // Downscale the textures larger than the maximum size, keeping their aspect ratio
+    std::vector<Image> resized;
+    resized.reserve(images.size());
+    std::vector<const Image*> sources(images.size());
+    for (size_t i = 0; i < images.size(); i++)
+    {
+        const Image& image = images[i];
+        sources[i] = &image;
+        if (image.size.x > maxSize.x || image.size.y > maxSize.y)
+        {
+            float scale = std::min((float)maxSize.x / image.size.x, (float)maxSize.y / image.size.y);
+            glm::uvec2 size = glm::max(glm::uvec2(glm::round(glm::vec2(image.size) * scale)), glm::uvec2(1));
+            resized.push_back(image.resize(size));
+            sources[i] = &resized.back();
+        }
+    }
+
+    // Every level of the mip chains is a separate rectangle of the pages of its format
+    std::vector<bool> isByte(images.size());
+    std::vector<unsigned int> levelCounts(images.size());
+    std::vector<glm::uvec2> byteSizes, halfSizes;
+    for (size_t i = 0; i < images.size(); i++)
+    {
+        // Empty images are stored as a single black texel
+        glm::uvec2 size = glm::max(sources[i]->size, glm::uvec2(1));
+        isByte[i] = TextureAtlas::isByteImage(*sources[i]);
+        levelCounts[i] = sources[i]->pixels.empty() && sources[i]->bytes.empty() ? 1 : TextureAtlas::getLevelCount(size);
+        for (unsigned int level = 0; level < levelCounts[i]; level++)
+        {
+            (isByte[i] ? byteSizes : halfSizes).push_back(size);
+            size = glm::max(size / 2u, glm::uvec2(1));
+        }
+    }
+
+    std::vector<glm::uvec3> bytePositions, halfPositions;
+    this->bytePages.resize(TextureAtlas::pack(byteSizes, bytePositions));
+    this->halfPages.resize(TextureAtlas::pack(halfSizes, halfPositions));
+
+    // Upload the levels and fill the lookup table, one header per texture followed by two texels per level
+    std::vector<glm::vec4> info(images.size());
+    std::vector<Image> levels;
+    std::vector<glm::u8vec4> bytePixels;
+    std::vector<glm::uint64> halfPixels;
+    for (size_t i = 0, byteId = 0, halfId = 0; i < images.size(); i++)
+    {
+        info[i] = glm::vec4(info.size(), levelCounts[i], 0, 0);
+
+        levels.clear();
+        levels.reserve(levelCounts[i]);
+        const Image* image = sources[i];
+        for (unsigned int level = 0; level < levelCounts[i]; level++)
+        {
+            if (level > 0)
+            {
+                levels.push_back(image->downsample());
+                image = &levels.back();
+            }
+
+            glm::uvec2 size = isByte[i] ? byteSizes[byteId] : halfSizes[halfId];
+            glm::uvec3 position = isByte[i] ? bytePositions[byteId++] : halfPositions[halfId++];
+            const glm::vec4* pixels = (const glm::vec4*)image->pixels.data();
+            size_t pixelCount = (size_t)size.x * size.y;
+            size_t sourceCount = std::min(pixelCount, image->pixels.size() / 4);
+
+            if (image->bytes.size() == pixelCount * 4)
+            {
+                // 8-bit images are uploaded as they are
+                this->bytePages.update(position, size, GL_UNSIGNED_BYTE, image->bytes.data());
+            }
+            else if (isByte[i])
+            {
+                bytePixels.assign(pixelCount, glm::u8vec4(0, 0, 0, 255));
+                for (size_t p = 0; p < sourceCount; p++)
+                {
+                    bytePixels[p] = glm::u8vec4(glm::round(glm::clamp(pixels[p], 0.f, 1.f) * 255.f));
+                }
+
+                this->bytePages.update(position, size, GL_UNSIGNED_BYTE, bytePixels.data());
+            }
+            else
+            {
+                halfPixels.assign(pixelCount, glm::packHalf4x16(glm::vec4(0, 0, 0, 1)));
+                for (size_t p = 0; p < sourceCount; p++)
+                {
+                    halfPixels[p] = glm::packHalf4x16(pixels[p]);
+                }
+
+                this->halfPages.update(position, size, GL_HALF_FLOAT, halfPixels.data());
+            }
+
+            info.push_back(glm::vec4(position.x, position.y, size.x, size.y));
+            info.push_back(glm::vec4(position.z, isByte[i] ? 0 : 1, 0, 0));
+        }
+    }
+
+    this->info.update(info);
+}
+
+void TextureAtlas::shutdown()
+{
+    this->bytePages.shutdown();
+    this->halfPages.shutdown();
+    this->info.shutdown();
+}
+
+size_t TextureAtlas::getMemorySize() const
+{
+    glm::uvec3 byteSize = this->bytePages.size;
+    glm::uvec3 halfSize = this->halfPages.size;
+    return (size_t)byteSize.x * byteSize.y * byteSize.z * 4 + (size_t)halfSize.x * halfSize.y * halfSize.z * 8;
+}
+
+unsigned int TextureAtlas::getLevelCount(glm::uvec2 size)
+{
+    unsigned int count = 1;
+    while (size.x > 1 || size.y > 1)
+    {
+        size = glm::max(size / 2u, glm::uvec2(1));
+        count++;
+    }
+
+    return count;
+}
+
+bool TextureAtlas::isByteImage(const Image& image)
+{
+    // 8-bit sources are stored losslessly, anything else needs more precision
+    if (!image.bytes.empty())
+    {
+        return true;
+    }
+
+    for (float value : image.pixels)
+    {
+        float scaled = value * 255;
+        if (!(value >= 0 && value <= 1) || std::abs(scaled - std::round(scaled)) > .001f)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+glm::uvec3 TextureAtlas::pack(const std::vector<glm::uvec2>& sizes, std::vector<glm::uvec3>& positions)
+{
+    positions.resize(sizes.size());
+    if (sizes.empty())
+    {
+        return glm::uvec3(0);
+    }
+
+    // The pages are as large as the largest texture
+    glm::uvec2 pageSize(0);
+    for (glm::uvec2 size : sizes)
+    {
+        pageSize = glm::max(pageSize, size);
+    }
+
+    pageSize = glm::uvec2(std::max(pageSize.x, pageSize.y));
+
+    // Shelf packing, the tallest textures first
+    std::vector<size_t> order(sizes.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&sizes](size_t a, size_t b) { return sizes[a].y > sizes[b].y; });
+
+    glm::uvec3 cursor(0);
+    unsigned int shelfHeight = 0;
+    for (size_t i : order)
+    {
+        glm::uvec2 size = sizes[i];
+        if (cursor.x + size.x > pageSize.x)
+        {
+            cursor = glm::uvec3(0, cursor.y + shelfHeight, cursor.z);
+            shelfHeight = 0;
+        }
+
+        if (cursor.y + size.y > pageSize.y)
+        {
+            cursor = glm::uvec3(0, 0, cursor.z + 1);
+            shelfHeight = 0;
+        }
+
+        positions[i] = cursor;
+        cursor.x += size.x;
+        shelfHeight = std::max(shelfHeight, size.y);
+    }
+
+    return glm::uvec3(pageSize, cursor.z + 1);
+}
@@ -0,0 +1,202 @@
+/**
+ * @file ThreadPool.cpp
+ */
+#include "TracerX/ThreadPool.h"
+
+using namespace TracerX::core;
+
+static thread_local const ThreadPool* currentPool = nullptr;
+static thread_local size_t currentQueueId = 0;
+
+ThreadPool::~ThreadPool()
+{
+    this->shutdown();
+}
+
+ThreadPool& ThreadPool::getShared()
+{
+    static ThreadPool pool;
+    static std::once_flag initialized;
+    std::call_once(initialized, []() { pool.init(); });
+    return pool;
+}
+
+void ThreadPool::init(size_t threadCount)
+{
+    if (threadCount == 0)
+    {
+        threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    this->stopping = false;
+    for (size_t i = 0; i < threadCount; i++)
+    {
+        this->queues.push_back(std::make_unique<Queue>());
+    }
+
+    for (size_t i = 0; i < threadCount; i++)
+    {
+        this->threads.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+void ThreadPool::shutdown()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->sleepMutex);
+        this->stopping = true;
+    }
+
+    this->sleepCondition.notify_all();
+    for (std::thread& thread : this->threads)
+    {
+        thread.join();
+    }
+
+    this->threads.clear();
+    this->queues.clear();
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& task)
+{
+    if (this->queues.empty())
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            task(i);
+        }
+
+        return;
+    }
+
+    // Tasks spawned from a worker stay in its own queue, the others steal them
+    bool isWorker = currentPool == this;
+    std::atomic<size_t> remaining = count;
+    std::atomic<bool> failed = false;
+    std::exception_ptr error;
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t queueId = isWorker ? currentQueueId : this->nextQueue++ % this->queues.size();
+        this->push(queueId, [this, &task, &remaining, &failed, &error, i]()
+        {
+            // The first exception is rethrown by the caller, the tasks left are skipped
+            try
+            {
+                if (!failed)
+                {
+                    task(i);
+                }
+            }
+            catch (...)
+            {
+                if (!failed.exchange(true))
+                {
+                    error = std::current_exception();
+                }
+            }
+
+            // The caller may return as soon as the count reaches 0, only the pool is used past it
+            if (--remaining == 0)
+            {
+                std::lock_guard<std::mutex> lock(this->sleepMutex);
+                this->sleepCondition.notify_all();
+            }
+        });
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(this->sleepMutex);
+    }
+
+    this->sleepCondition.notify_all();
+
+    // Help with the work instead of blocking, so that nested calls cannot deadlock,
+    // and sleep once the queues are empty until the last task ends or new ones are queued
+    size_t queueId = isWorker ? currentQueueId : this->nextQueue % this->queues.size();
+    while (remaining > 0)
+    {
+        if (this->runTask(queueId))
+        {
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(this->sleepMutex);
+        this->sleepCondition.wait(lock, [this, &remaining]() { return remaining == 0 || this->queuedCount > 0; });
+    }
+
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+}
+
+size_t ThreadPool::getThreadCount() const
+{
+    return this->threads.size();
+}
+
+void ThreadPool::push(size_t queueId, std::function<void()> task)
+{
+    Queue& queue = *this->queues[queueId];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.tasks.push_back(std::move(task));
+    this->queuedCount++;
+}
+
+bool ThreadPool::runTask(size_t queueId)
+{
+    std::function<void()> task;
+
+    // Own queue (LIFO)
+    {
+        Queue& queue = *this->queues[queueId];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty())
+        {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        }
+    }
+
+    // Steal from the other queues (FIFO)
+    for (size_t i = 1; !task && i < this->queues.size(); i++)
+    {
+        Queue& queue = *this->queues[(queueId + i) % this->queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty())
+        {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+    }
+
+    if (!task)
+    {
+        return false;
+    }
+
+    this->queuedCount--;
+    task();
+    return true;
+}
+
+void ThreadPool::workerLoop(size_t queueId)
+{
+    currentPool = this;
+    currentQueueId = queueId;
+
+    while (true)
+    {
+        if (this->runTask(queueId))
+        {
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(this->sleepMutex);
+        this->sleepCondition.wait(lock, [this]() { return this->stopping || this->queuedCount > 0; });
+        if (this->stopping)
+        {
+            return;
+        }
+    }
+}
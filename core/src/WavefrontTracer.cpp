@@ -0,0 +1,223 @@
+/**
+ * @file WavefrontTracer.cpp
+ */
+#include "TracerX/WavefrontTracer.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace TracerX::core;
+
+namespace
+{
+
+// Layout of the shader storage blocks of common/wavefront.glsl
+const size_t pathSize = 80;
+const size_t hitSize = 80;
+const size_t shadowSize = 48;
+const GLuint queueCount = 3;
+const GLuint shadowQueue = 2;
+const GLintptr queueSizesOffset = 3 * sizeof(GLuint);
+const GLuint workgroupSize = 64;
+
+}
+
+void WavefrontTracer::init()
+{
+    if (!GLEW_VERSION_4_3)
+    {
+        throw std::runtime_error("The wavefront backend requires OpenGL 4.3");
+    }
+
+    WavefrontTracer::initStage(this->generateStage, WavefrontTracer::generateShaderSrc);
+    WavefrontTracer::initStage(this->intersectStage, WavefrontTracer::intersectShaderSrc);
+    WavefrontTracer::initStage(this->shadeStage, WavefrontTracer::shadeShaderSrc);
+    WavefrontTracer::initStage(this->occlusionStage, WavefrontTracer::occlusionShaderSrc);
+    WavefrontTracer::initStage(this->accumulateStage, WavefrontTracer::accumulateShaderSrc);
+    WavefrontTracer::initStage(this->dispatchStage, WavefrontTracer::dispatchShaderSrc);
+
+    glGenBuffers(1, &this->pathBuffer);
+    glGenBuffers(1, &this->hitBuffer);
+    glGenBuffers(1, &this->shadowBuffer);
+    glGenBuffers(1, &this->queueBuffer);
+    glGenBuffers(1, &this->counterBuffer);
+
+    // Indirect dispatch size followed by the sizes of the two path queues and the shadow queue
+    GLuint counters[6] = { 0, 0, 0, 0, 0, 0 };
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->counterBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(counters), counters, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    this->capacity = 0;
+    this->initialized = true;
+}
+
+void WavefrontTracer::shutdown()
+{
+    if (!this->initialized)
+    {
+        return;
+    }
+
+    this->generateStage.shader.shutdown();
+    this->intersectStage.shader.shutdown();
+    this->shadeStage.shader.shutdown();
+    this->occlusionStage.shader.shutdown();
+    this->accumulateStage.shader.shutdown();
+    this->dispatchStage.shader.shutdown();
+
+    glDeleteBuffers(1, &this->pathBuffer);
+    glDeleteBuffers(1, &this->hitBuffer);
+    glDeleteBuffers(1, &this->shadowBuffer);
+    glDeleteBuffers(1, &this->queueBuffer);
+    glDeleteBuffers(1, &this->counterBuffer);
+
+    this->capacity = 0;
+    this->initialized = false;
+}
+
+void WavefrontTracer::accumulate(const FrameBuffer& frameBuffer, unsigned int frameCount, unsigned int maxBounceCount, glm::uvec2 position, glm::uvec2 size)
+{
+    size_t pathCount = (size_t)size.x * size.y;
+    if (pathCount == 0)
+    {
+        return;
+    }
+
+    this->reserve(pathCount);
+
+    glBindImageTexture(0, frameBuffer.accumulation.getHandler(), 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+    glBindImageTexture(1, frameBuffer.albedo.getHandler(), 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+    glBindImageTexture(2, frameBuffer.normal.getHandler(), 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+    glBindImageTexture(3, frameBuffer.moments.getHandler(), 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, this->pathBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, this->hitBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, this->queueBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, this->counterBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, this->shadowBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->counterBuffer);
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, this->counterBuffer);
+
+    // Ray generation fills the first queue
+    GLuint zero = 0;
+    glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, queueSizesOffset, sizeof(GLuint), GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    // Only the queue changes between passes, the other uniforms are set once per frame
+    this->updateStage(this->generateStage, frameCount, position, size);
+    this->updateStage(this->intersectStage, frameCount, position, size);
+    this->updateStage(this->shadeStage, frameCount, position, size);
+    this->updateStage(this->occlusionStage, frameCount, position, size);
+    this->updateStage(this->accumulateStage, frameCount, position, size);
+    this->updateStage(this->dispatchStage, frameCount, position, size);
+
+    WavefrontTracer::useStage(this->generateStage, 0);
+    WavefrontTracer::dispatch(pathCount);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    // Every bounce takes one pass, only the paths crossing transparent surfaces need more
+    unsigned int queue = 0;
+    for (unsigned int pass = 0; ; pass++)
+    {
+        if (pass > maxBounceCount)
+        {
+            GLuint queueSize = 0;
+            glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+            glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, queueSizesOffset + queue * sizeof(GLuint), sizeof(GLuint), &queueSize);
+            if (queueSize == 0)
+            {
+                break;
+            }
+        }
+
+        WavefrontTracer::useStage(this->dispatchStage, queue);
+        glDispatchCompute(1, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+        WavefrontTracer::useStage(this->intersectStage, queue);
+        glDispatchComputeIndirect(0);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        WavefrontTracer::useStage(this->shadeStage, queue);
+        glDispatchComputeIndirect(0);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+        // The shadow rays queued by the material evaluation are traced apart, like the paths
+        WavefrontTracer::useStage(this->dispatchStage, shadowQueue);
+        glDispatchCompute(1, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+        WavefrontTracer::useStage(this->occlusionStage, shadowQueue);
+        glDispatchComputeIndirect(0);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        queue = 1 - queue;
+    }
+
+    WavefrontTracer::useStage(this->accumulateStage, 0);
+    WavefrontTracer::dispatch(pathCount);
+
+    // The accumulation is sampled by the tone mapper and read back by the caller
+    glMemoryBarrier(GL_ALL_BARRIER_BITS);
+
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    Shader::stopUse();
+}
+
+bool WavefrontTracer::isInitialized() const
+{
+    return this->initialized;
+}
+
+void WavefrontTracer::reserve(size_t pathCount)
+{
+    if (pathCount <= this->capacity)
+    {
+        return;
+    }
+
+    this->capacity = pathCount;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->pathBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, pathSize * pathCount, nullptr, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->hitBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, hitSize * pathCount, nullptr, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->shadowBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, shadowSize * pathCount, nullptr, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->queueBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, queueCount * sizeof(GLuint) * pathCount, nullptr, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void WavefrontTracer::updateStage(Stage& stage, unsigned int frameCount, glm::uvec2 position, glm::uvec2 size)
+{
+    stage.shader.use();
+    stage.shader.updateParam(stage.frameCountLocation, frameCount);
+    stage.shader.updateParam(stage.queueCapacityLocation, (unsigned int)this->capacity);
+    stage.shader.updateParam(stage.rectPositionLocation, position);
+    stage.shader.updateParam(stage.rectSizeLocation, size);
+}
+
+void WavefrontTracer::initStage(Stage& stage, const char* src)
+{
+    stage.shader.init(src);
+    stage.frameCountLocation = stage.shader.getParamLocation("FrameCount");
+    stage.queueLocation = stage.shader.getParamLocation("Queue");
+    stage.queueCapacityLocation = stage.shader.getParamLocation("QueueCapacity");
+    stage.rectPositionLocation = stage.shader.getParamLocation("RectPosition");
+    stage.rectSizeLocation = stage.shader.getParamLocation("RectSize");
+}
+
+void WavefrontTracer::useStage(Stage& stage, unsigned int queue)
+{
+    stage.shader.use();
+    stage.shader.updateParam(stage.queueLocation, queue);
+}
+
+void WavefrontTracer::dispatch(size_t invocationCount)
+{
+    // Same split as the dispatch shader, a dimension holds at most 65535 workgroups
+    GLuint groupCount = (GLuint)((invocationCount + workgroupSize - 1) / workgroupSize);
+    GLuint groupCountX = std::min(groupCount, 65535u);
+    glDispatchCompute(groupCountX, (groupCount + groupCountX - 1) / groupCountX, 1);
+}
@@ -0,0 +1,5386 @@
+#include <TracerX/WavefrontTracer.h>
+
+using namespace TracerX::core;
+
+const char* WavefrontTracer::generateShaderSrc =
+R"(
+#version 430 core
+
+layout(local_size_x=64) in;
+
+struct Ray
+{
+    vec3 Origin;
+    vec3 Direction;
+    vec3 InvDirection;
+    vec3 Color;
+    vec3 IncomingLight;
+    float ConeWidth;
+    float ConeSpread;
+    float ScatterPdf;
+    float ScatterDistance;
+};
+
+struct Env
+{
+    bool Transparent;
+    float Intensity;
+    mat3 Rotation;
+};
+
+struct Cam
+{
+    vec3 Position;
+    vec3 Forward;
+    vec3 Up;
+    float FOV;
+    float FocalDistance;
+    float Aperture;
+    float Blur;
+};
+
+struct Material
+{
+    vec3 AlbedoColor;
+    float Roughness;
+    vec3 EmissionColor;
+    float EmissionStrength;
+    vec3 FresnelColor;
+    float FresnelStrength;
+    float Metalness;
+    float IOR;
+    float Density;
+    int AlbedoTextureId;
+    int MetalnessTextureId;
+    int EmissionTextureId;
+    int RoughnessTextureId;
+    int NormalTextureId;
+};
+
+struct Vertex
+{
+    vec3 Position;
+    vec3 Normal;
+    vec2 TextureCoordinate;
+};
+
+struct Triangle
+{
+    int V1;
+    int V2;
+    int V3;
+};
+
+struct Mesh
+{
+    mat4 Transform;
+    mat4 TransformInv;
+    int MaterialId;
+    int NodeOffset;
+    int TriangleOffset;
+};
+
+struct CollisionManifold
+{
+    float Depth;
+    vec3 Point;
+    vec2 TextureCoordinate;
+    float UVDensity;
+    vec3 Normal;
+    vec3 Tangent;
+    vec3 Bitangent;
+    int MaterialId;
+    bool IsFrontFace;
+};
+
+struct Light
+{
+    float Probability;
+    int Alias;
+    int MeshId;
+    int TriangleId;
+};
+
+struct Node
+{
+    vec3 BboxMin;
+    vec3 BboxMax;
+    int Start;
+    int PrimitiveCount;
+    int RightOffset;
+};
+const float INV_PI     = 0.31830988618379067;
+const float INV_TWO_PI = 0.15915494309189533;
+
+const uint BVH_LAYOUT_BINARY = 0u;
+const uint BVH_LAYOUT_WIDE   = 1u;
+const uint BVH_LAYOUT_QUANTIZED = 2u;
+
+layout(binding=0) uniform sampler2D AccumulatorTexture;
+layout(binding=1) uniform sampler2D EnvironmentTexture;
+layout(binding=2) uniform sampler2DArray Textures;
+layout(binding=3) uniform samplerBuffer Vertices;
+layout(binding=4) uniform isamplerBuffer Triangles;
+layout(binding=5) uniform samplerBuffer Meshes;
+layout(binding=6) uniform samplerBuffer Materials;
+layout(binding=7) uniform samplerBuffer BVH;
+layout(binding=8) uniform samplerBuffer TLAS;
+layout(binding=9) uniform usamplerBuffer BVHData;
+layout(binding=11) uniform sampler2DArray HalfTextures;
+layout(binding=12) uniform samplerBuffer TextureInfo;
+layout(binding=13) uniform sampler2D MomentsTexture;
+layout(binding=14) uniform sampler2D AlbedoTexture;
+layout(binding=15) uniform sampler2D NormalTexture;
+layout(binding=16) uniform samplerBuffer Lights;
+layout(binding=17) uniform samplerBuffer EnvironmentDistribution;
+layout(binding=18) uniform samplerBuffer BlueNoise;
+layout(binding=19) uniform usamplerBuffer MeshOffsets;
+
+// Only uploaded when the settings change, the layout is mirrored by Renderer::Settings
+layout(std140, binding=0) uniform Settings
+{
+    Cam Camera;
+    Env Environment;
+    uint MaxBounceCount;
+    float MinRenderDistance;
+    float MaxRenderDistance;
+    uint BVHLayout;
+    uint BVHQuantizationBits;
+    float Gamma;
+    float AdaptiveThreshold;
+    uint AdaptiveMinFrameCount;
+    uint SamplerType;
+    uint RussianRouletteDepth;
+};
+
+uniform uint FrameCount;
+
+Triangle GetTriangle(int index)
+{
+    ivec4 data = texelFetch(Triangles, index);
+    return Triangle(data.x, data.y, data.z);
+}
+
+Vertex GetVertex(int index)
+{
+    vec4 data1 = texelFetch(Vertices, index * 2 + 0);
+    vec4 data2 = texelFetch(Vertices, index * 2 + 1);
+    return Vertex(data1.xyz, data2.xyz, vec2(data1.w, data2.w));
+}
+
+Mesh GetMesh(int index)
+{
+    vec4 data1 = texelFetch(Meshes, index * 9 + 0);
+    vec4 data2 = texelFetch(Meshes, index * 9 + 1);
+    vec4 data3 = texelFetch(Meshes, index * 9 + 2);
+    vec4 data4 = texelFetch(Meshes, index * 9 + 3);
+    vec4 data5 = texelFetch(Meshes, index * 9 + 4);
+    vec4 data6 = texelFetch(Meshes, index * 9 + 5);
+    vec4 data7 = texelFetch(Meshes, index * 9 + 6);
+    vec4 data8 = texelFetch(Meshes, index * 9 + 7);
+    vec4 data9 = texelFetch(Meshes, index * 9 + 8);
+    uvec4 offsets = texelFetch(MeshOffsets, index);
+    return Mesh(mat4(data1, data2, data3, data4), mat4(data5, data6, data7, data8), int(data9.x), int(offsets.x), int(offsets.y));
+}
+
+int GetMeshCount()
+{
+    return textureSize(Meshes) / 9;
+}
+
+Material GetMaterial(int index)
+{
+    // Meshes without a material get the default one of the Material class
+    if (index < 0 || index >= textureSize(Materials) / 5)
+    {
+        return Material(vec3(1), 0, vec3(1), 0, vec3(1), 0, 0, 0, 0, -1, -1, -1, -1, -1);
+    }
+
+    vec4 data1 = texelFetch(Materials, index * 5 + 0);
+    vec4 data2 = texelFetch(Materials, index * 5 + 1);
+    vec4 data3 = texelFetch(Materials, index * 5 + 2);
+    vec4 data4 = texelFetch(Materials, index * 5 + 3);
+    vec4 data5 = texelFetch(Materials, index * 5 + 4);
+    return Material(data1.rgb, data1.a, data2.rgb, data2.a, data3.rgb, data3.a, data4.x, data4.y, data4.z, int(data4.w), int(data5.x), int(data5.y), int(data5.z), int(data5.w));
+}
+
+int GetLightCount()
+{
+    return textureSize(Lights) == 0 ? 0 : int(texelFetch(Lights, 0).x);
+}
+
+Light GetLight(int index)
+{
+    vec4 data = texelFetch(Lights, index + 1);
+    return Light(data.x, int(data.y), int(data.z), int(data.w));
+}
+
+float GetLightAreaPdf(int materialId)
+{
+    return texelFetch(Lights, GetLightCount() + 1 + materialId).x;
+}
+
+Node GetNode(int index)
+{
+    vec4 data1 = texelFetch(BVH, index * 3 + 0);
+    vec4 data2 = texelFetch(BVH, index * 3 + 1);
+    vec4 data3 = texelFetch(BVH, index * 3 + 2);
+    return Node(data1.xyz, data2.xyz, int(data3.x), int(data3.y), int(data3.z));
+}
+
+Node GetTLASNode(int index)
+{
+    vec4 data1 = texelFetch(TLAS, index * 3 + 0);
+    vec4 data2 = texelFetch(TLAS, index * 3 + 1);
+    vec4 data3 = texelFetch(TLAS, index * 3 + 2);
+    return Node(data1.xyz, data2.xyz, int(data3.x), int(data3.y), int(data3.z));
+}
+
+vec4 GetTexel(ivec3 coord, bool isHalf)
+{
+    return isHalf ? texelFetch(HalfTextures, coord, 0) : texelFetch(Textures, coord, 0);
+}
+
+vec4 GetTextureLevel(int entry, vec2 uv)
+{
+    // Bilinear filtering with repeat wrapping inside the atlas rectangle of the level
+    vec4 rect = texelFetch(TextureInfo, entry + 0);
+    vec4 info = texelFetch(TextureInfo, entry + 1);
+    bool isHalf = info.y > 0;
+
+    vec2 coord = uv * rect.zw - 0.5;
+    vec2 base = floor(coord);
+    vec2 t = coord - base;
+    ivec2 p0 = ivec2(rect.xy + mod(base, rect.zw));
+    ivec2 p1 = ivec2(rect.xy + mod(base + 1, rect.zw));
+    int layer = int(info.x);
+
+    vec4 c00 = GetTexel(ivec3(p0.x, p0.y, layer), isHalf);
+    vec4 c10 = GetTexel(ivec3(p1.x, p0.y, layer), isHalf);
+    vec4 c01 = GetTexel(ivec3(p0.x, p1.y, layer), isHalf);
+    vec4 c11 = GetTexel(ivec3(p1.x, p1.y, layer), isHalf);
+    return mix(mix(c00, c10, t.x), mix(c01, c11, t.x), t.y);
+}
+
+vec4 GetTexture(int textureId, vec2 uv, float footprint)
+{
+    if (any(isnan(uv)) || any(isinf(uv)))
+    {
+        return vec4(0);
+    }
+
+    // Trilinear filtering, the level of detail is the footprint measured in texels of the first level
+    vec4 header = texelFetch(TextureInfo, textureId);
+    int entry = int(header.x);
+    vec4 rect = texelFetch(TextureInfo, entry);
+    float lod = clamp(footprint + 0.5 * log2(rect.z * rect.w), 0, header.y - 1);
+    int level = int(lod);
+    float t = lod - level;
+
+    vec4 color = GetTextureLevel(entry + level * 2, uv);
+    if (t > 0)
+    {
+        color = mix(color, GetTextureLevel(entry + level * 2 + 2, uv), t);
+    }
+
+    return color;
+}
+
+vec3 GetEnvironment(in Ray ray)
+{
+    vec3 direction = Environment.Rotation * ray.Direction;
+    float u = atan(direction.z, direction.x) * INV_TWO_PI + 0.5;
+    float v = acos(direction.y) * INV_PI;
+    float lod = log2(ray.ConeSpread * textureSize(EnvironmentTexture, 0).y * INV_PI);
+    return textureLod(EnvironmentTexture, vec2(u, v), lod).rgb * Environment.Intensity;
+}
+const float TWO_PI     = 6.28318530717958648;
+
+const uint SAMPLER_RANDOM     = 0u;
+const uint SAMPLER_SOBOL      = 1u;
+const uint SAMPLER_BLUE_NOISE = 2u;
+
+// The camera takes the first dimensions, every bounce starts a block so that the samples of a pixel line up
+const uint CAMERA_DIMENSIONS = 4u;
+const uint BOUNCE_DIMENSIONS = 16u;
+const uint BLUE_NOISE_SIZE   = 64u;
+
+uint Seed;
+uvec2 SamplePixel;
+uint SampleDimension;
+
+uint Hash(uint x)
+{
+    x = x * 747796405u + 2891336453u;
+    x = ((x >> ((x >> 28) + 4u)) ^ x) * 277803737u;
+    return (x >> 22) ^ x;
+}
+
+void InitSampler(uvec2 pixel)
+{
+    SamplePixel = pixel;
+    SampleDimension = 0u;
+    Seed = Hash(pixel.x ^ Hash(pixel.y ^ Hash(FrameCount)));
+}
+
+// Moves to the block of the bounce, unless the previous bounce already went past its start
+void StartSampleBounce(uint bounce)
+{
+    SampleDimension = max(SampleDimension, CAMERA_DIMENSIONS + bounce * BOUNCE_DIMENSIONS);
+}
+
+// Hash based Owen scrambling, every bit is flipped depending on the bits above it (Laine-Karras permutation)
+uint OwenScramble(uint x, uint seed)
+{
+    x = bitfieldReverse(x);
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return bitfieldReverse(x);
+}
+
+// Second dimension of the Sobol sequence, the first one is the index with its bits reversed
+uint Sobol1(uint index)
+{
+    uint result = 0u;
+    for (uint direction = 1u << 31; index != 0u; index >>= 1, direction ^= direction >> 1)
+    {
+        if ((index & 1u) != 0u)
+        {
+            result ^= direction;
+        }
+    }
+
+    return result;
+}
+
+// Every pair of dimensions is a two dimensional Sobol sequence with its samples shuffled, so that the pairs are independent
+uint SobolSample(uint index, uint dimension, uint seed)
+{
+    index = OwenScramble(index, Hash(seed ^ Hash(dimension >> 1)));
+    uint value = (dimension & 1u) == 0u ? bitfieldReverse(index) : Sobol1(index);
+    return OwenScramble(value, Hash(seed ^ Hash(dimension) ^ 0x68bc21ebu));
+}
+
+float RandomValue()
+{
+    if (SamplerType == SAMPLER_RANDOM)
+    {
+        Seed = Seed * 747796405u + 2891336453u;
+        uint result = ((Seed >> ((Seed >> 28) + 4u)) ^ Seed) * 277803737u;
+        result = (result >> 22) ^ result;
+        return float(result) / 4294967295.0;
+    }
+
+    uint dimension = SampleDimension++;
+    uint value;
+    if (SamplerType == SAMPLER_SOBOL)
+    {
+        value = SobolSample(FrameCount, dimension, Hash(SamplePixel.x ^ Hash(SamplePixel.y)));
+    }
+    else
+    {
+        // The same sequence for all pixels, shifted modulo 1 by the mask offset for the dimension
+        uint offset = Hash(dimension);
+        uvec2 maskPixel = (SamplePixel + uvec2(offset, offset >> 16)) % BLUE_NOISE_SIZE;
+        float shift = texelFetch(BlueNoise, int(maskPixel.y * BLUE_NOISE_SIZE + maskPixel.x)).r;
+        value = SobolSample(FrameCount, dimension, 0u) + uint(shift * 4294967296.0);
+    }
+
+    // Strictly between 0 and 1
+    return (float(value >> 9) + 0.5) / 8388608.0;
+}
+
+// Two values of the same pair of dimensions, the Sobol samplers stratify them together
+vec2 RandomValue2()
+{
+    SampleDimension += SampleDimension & 1u;
+    float x = RandomValue();
+    float y = RandomValue();
+    return vec2(x, y);
+}
+
+vec2 RandomVector2()
+{
+    vec2 value = RandomValue2();
+    float angle = value.x * TWO_PI;
+    return vec2(cos(angle), sin(angle)) * sqrt(value.y);
+}
+
+// Uniform direction, from two values so that it keeps the stratification of the samplers
+vec3 RandomVector3()
+{
+    vec2 value = RandomValue2();
+    float z = 1 - 2 * value.x;
+    float radius = sqrt(max(1 - z * z, 0));
+    float angle = value.y * TWO_PI;
+    return vec3(radius * cos(angle), radius * sin(angle), z);
+}
+vec3 Slerp(in vec3 a, in vec3 b, float t)
+{
+    float angle = acos(dot(a, b));
+    return isnan(angle) || angle == 0 ? b : (sin((1 - t) * angle) * a + sin(t * angle) * b) / sin(angle);
+}
+
+vec3 Transform(in vec3 v, in mat4 matrix, in bool translate)
+{
+    return (matrix * vec4(v, translate ? 1 : 0)).xyz;
+}
+
+float Luminance(in vec3 color)
+{
+    return dot(color, vec3(.2126, .7152, .0722));
+}
+
+vec4 ToneMap(in vec4 pixel, in float gamma)
+{
+    // Reinhard tone mapping
+    pixel.rgb = pixel.rgb / (pixel.rgb + vec3(1));
+
+    // Gamma correction
+    pixel.rgb = pow(pixel.rgb, vec3(1 / gamma));
+
+    return pixel;
+}
+vec3 CameraRight = cross(Camera.Forward, Camera.Up);
+
+Ray GetCameraRay(in vec2 texCoords, in vec2 size)
+{
+    vec2 coord = (texCoords - vec2(.5)) * vec2(1, size.y / size.x) * 2 * tan(Camera.FOV / 2);
+    vec3 direction = normalize(Camera.Forward + CameraRight * coord.x + Camera.Up * coord.y);
+    vec3 rayOrigin = Camera.Position;
+
+    // Focal
+    vec3 focalPoint = rayOrigin + direction * Camera.FocalDistance;
+    vec2 focal = RandomVector2() * Camera.Aperture;
+    rayOrigin += focal.x * CameraRight + focal.y * Camera.Up;
+    vec3 rayDirection = normalize(focalPoint - rayOrigin);
+
+    // Blur
+    vec2 blur = RandomVector2() * Camera.Blur;
+    rayOrigin += blur.x * CameraRight + blur.y * Camera.Up;
+
+    return Ray(rayOrigin, rayDirection, 1 / rayDirection, vec3(1), vec3(0), 0, 2 * tan(Camera.FOV / 2) / size.x, 0, 0);
+}
+bool IsConverged(in vec4 accumColor, in vec4 moments)
+{
+    // The moments hold the sum of the squared luminances and the number of summed frames
+    if (AdaptiveThreshold <= 0 || moments.b < max(AdaptiveMinFrameCount, 2u))
+    {
+        return false;
+    }
+
+    // Relative standard error of the mean luminance, counted over the frames of the variance estimate,
+    // so an accumulation loaded without its moments is not trusted after a few frames
+    float mean = Luminance(accumColor.rgb) / FrameCount;
+    float variance = max(moments.r / moments.b - mean * mean, 0);
+    return sqrt(variance / moments.b) <= AdaptiveThreshold * max(mean, .01);
+}
+const uint WORKGROUP_SIZE = 64u;
+
+const uint PATH_BACKGROUND = 1u;
+const uint PATH_CONVERGED  = 2u;
+
+// The queue of the paths whose shadow ray waits for the occlusion stage
+const uint SHADOW_QUEUE = 2u;
+
+// Origin.w is the cone width, Direction.w the cone spread, Color.w the scatter pdf, IncomingLight.w the scatter distance,
+// State holds the seed, the bounce, the sample dimension and the flags
+struct Path
+{
+    vec4 Origin;
+    vec4 Direction;
+    vec4 Color;
+    vec4 IncomingLight;
+    uvec4 State;
+};
+
+// The collision manifold found by the intersection stage, Info holds the material, the face and the hit flag
+struct Hit
+{
+    vec4 PointDepth;
+    vec4 NormalUVDensity;
+    vec4 TangentU;
+    vec4 BitangentV;
+    ivec4 Info;
+};
+
+// The shadow ray of a light sample, Origin.w is the distance left to the light, Direction.w the cone width, IncomingLight.w the cone spread
+struct Shadow
+{
+    vec4 Origin;
+    vec4 Direction;
+    vec4 IncomingLight;
+};
+
+layout(std430, binding=0) buffer PathBuffer { Path Paths[]; };
+layout(std430, binding=1) buffer HitBuffer { Hit Hits[]; };
+layout(std430, binding=2) buffer QueueBuffer { uint Queues[]; };
+layout(std430, binding=3) buffer CounterBuffer { uint DispatchX; uint DispatchY; uint DispatchZ; uint QueueSizes[3]; };
+layout(std430, binding=4) buffer ShadowBuffer { Shadow Shadows[]; };
+
+layout(binding=0, rgba32f) uniform image2D AccumulatorImage;
+layout(binding=1, rgba32f) uniform image2D AlbedoImage;
+layout(binding=2, rgba32f) uniform image2D NormalImage;
+layout(binding=3, rgba32f) uniform image2D MomentsImage;
+
+uniform uvec2 RectPosition;
+uniform uvec2 RectSize;
+uniform uint Queue;
+uniform uint QueueCapacity;
+
+uint GetInvocationIndex()
+{
+    return (gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x) * WORKGROUP_SIZE + gl_LocalInvocationID.x;
+}
+
+ivec2 GetPixel(uint pathId)
+{
+    return ivec2(RectPosition + uvec2(pathId % RectSize.x, pathId / RectSize.x));
+}
+
+void PushPath(uint queue, uint pathId)
+{
+    uint slot = atomicAdd(QueueSizes[queue], 1u);
+    Queues[queue * QueueCapacity + slot] = pathId;
+}
+
+Ray LoadRay(in Path path)
+{
+    return Ray(path.Origin.xyz, path.Direction.xyz, 1 / path.Direction.xyz, path.Color.rgb, path.IncomingLight.rgb, path.Origin.w, path.Direction.w, path.Color.w, path.IncomingLight.w);
+}
+
+Path StorePath(in Ray ray, uint bounce, uint flags)
+{
+    return Path(vec4(ray.Origin, ray.ConeWidth), vec4(ray.Direction, ray.ConeSpread), vec4(ray.Color, ray.ScatterPdf), vec4(ray.IncomingLight, ray.ScatterDistance), uvec4(Seed, bounce, SampleDimension, flags));
+}
+
+Ray LoadShadowRay(in Shadow shadow)
+{
+    return Ray(shadow.Origin.xyz, shadow.Direction.xyz, 1 / shadow.Direction.xyz, vec3(1), shadow.IncomingLight.rgb, shadow.Direction.w, shadow.IncomingLight.w, 0, 0);
+}
+
+Shadow StoreShadow(in Ray shadowRay, float distance)
+{
+    return Shadow(vec4(shadowRay.Origin, distance), vec4(shadowRay.Direction, shadowRay.ConeWidth), vec4(shadowRay.IncomingLight, shadowRay.ConeSpread));
+}
+
+// Creates the camera ray of every pixel of the rectangle and queues it for the intersection stage
+void main()
+{
+    uint pathId = GetInvocationIndex();
+    if (pathId >= RectSize.x * RectSize.y)
+    {
+        return;
+    }
+
+    ivec2 pixel = GetPixel(pathId);
+
+    // Converged pixels keep their mean without tracing new paths
+    if (IsConverged(imageLoad(AccumulatorImage, pixel), imageLoad(MomentsImage, pixel)))
+    {
+        Paths[pathId].State = uvec4(0, 0, 0, PATH_CONVERGED);
+        return;
+    }
+
+    vec2 size = imageSize(AccumulatorImage);
+    vec2 texCoords = (vec2(pixel) + .5) / size;
+    InitSampler(uvec2(pixel));
+    Paths[pathId] = StorePath(GetCameraRay(texCoords, size), 0, 0);
+    PushPath(0, pathId);
+}
+
+)";
+
+const char* WavefrontTracer::intersectShaderSrc =
+R"(
+#version 430 core
+
+layout(local_size_x=64) in;
+
+struct Ray
+{
+    vec3 Origin;
+    vec3 Direction;
+    vec3 InvDirection;
+    vec3 Color;
+    vec3 IncomingLight;
+    float ConeWidth;
+    float ConeSpread;
+    float ScatterPdf;
+    float ScatterDistance;
+};
+
+struct Env
+{
+    bool Transparent;
+    float Intensity;
+    mat3 Rotation;
+};
+
+struct Cam
+{
+    vec3 Position;
+    vec3 Forward;
+    vec3 Up;
+    float FOV;
+    float FocalDistance;
+    float Aperture;
+    float Blur;
+};
+
+struct Material
+{
+    vec3 AlbedoColor;
+    float Roughness;
+    vec3 EmissionColor;
+    float EmissionStrength;
+    vec3 FresnelColor;
+    float FresnelStrength;
+    float Metalness;
+    float IOR;
+    float Density;
+    int AlbedoTextureId;
+    int MetalnessTextureId;
+    int EmissionTextureId;
+    int RoughnessTextureId;
+    int NormalTextureId;
+};
+
+struct Vertex
+{
+    vec3 Position;
+    vec3 Normal;
+    vec2 TextureCoordinate;
+};
+
+struct Triangle
+{
+    int V1;
+    int V2;
+    int V3;
+};
+
+struct Mesh
+{
+    mat4 Transform;
+    mat4 TransformInv;
+    int MaterialId;
+    int NodeOffset;
+    int TriangleOffset;
+};
+
+struct CollisionManifold
+{
+    float Depth;
+    vec3 Point;
+    vec2 TextureCoordinate;
+    float UVDensity;
+    vec3 Normal;
+    vec3 Tangent;
+    vec3 Bitangent;
+    int MaterialId;
+    bool IsFrontFace;
+};
+
+struct Light
+{
+    float Probability;
+    int Alias;
+    int MeshId;
+    int TriangleId;
+};
+
+struct Node
+{
+    vec3 BboxMin;
+    vec3 BboxMax;
+    int Start;
+    int PrimitiveCount;
+    int RightOffset;
+};
+const float INV_PI     = 0.31830988618379067;
+const float INV_TWO_PI = 0.15915494309189533;
+
+const uint BVH_LAYOUT_BINARY = 0u;
+const uint BVH_LAYOUT_WIDE   = 1u;
+const uint BVH_LAYOUT_QUANTIZED = 2u;
+
+layout(binding=0) uniform sampler2D AccumulatorTexture;
+layout(binding=1) uniform sampler2D EnvironmentTexture;
+layout(binding=2) uniform sampler2DArray Textures;
+layout(binding=3) uniform samplerBuffer Vertices;
+layout(binding=4) uniform isamplerBuffer Triangles;
+layout(binding=5) uniform samplerBuffer Meshes;
+layout(binding=6) uniform samplerBuffer Materials;
+layout(binding=7) uniform samplerBuffer BVH;
+layout(binding=8) uniform samplerBuffer TLAS;
+layout(binding=9) uniform usamplerBuffer BVHData;
+layout(binding=11) uniform sampler2DArray HalfTextures;
+layout(binding=12) uniform samplerBuffer TextureInfo;
+layout(binding=13) uniform sampler2D MomentsTexture;
+layout(binding=14) uniform sampler2D AlbedoTexture;
+layout(binding=15) uniform sampler2D NormalTexture;
+layout(binding=16) uniform samplerBuffer Lights;
+layout(binding=17) uniform samplerBuffer EnvironmentDistribution;
+layout(binding=18) uniform samplerBuffer BlueNoise;
+layout(binding=19) uniform usamplerBuffer MeshOffsets;
+
+// Only uploaded when the settings change, the layout is mirrored by Renderer::Settings
+layout(std140, binding=0) uniform Settings
+{
+    Cam Camera;
+    Env Environment;
+    uint MaxBounceCount;
+    float MinRenderDistance;
+    float MaxRenderDistance;
+    uint BVHLayout;
+    uint BVHQuantizationBits;
+    float Gamma;
+    float AdaptiveThreshold;
+    uint AdaptiveMinFrameCount;
+    uint SamplerType;
+    uint RussianRouletteDepth;
+};
+
+uniform uint FrameCount;
+
+Triangle GetTriangle(int index)
+{
+    ivec4 data = texelFetch(Triangles, index);
+    return Triangle(data.x, data.y, data.z);
+}
+
+Vertex GetVertex(int index)
+{
+    vec4 data1 = texelFetch(Vertices, index * 2 + 0);
+    vec4 data2 = texelFetch(Vertices, index * 2 + 1);
+    return Vertex(data1.xyz, data2.xyz, vec2(data1.w, data2.w));
+}
+
+Mesh GetMesh(int index)
+{
+    vec4 data1 = texelFetch(Meshes, index * 9 + 0);
+    vec4 data2 = texelFetch(Meshes, index * 9 + 1);
+    vec4 data3 = texelFetch(Meshes, index * 9 + 2);
+    vec4 data4 = texelFetch(Meshes, index * 9 + 3);
+    vec4 data5 = texelFetch(Meshes, index * 9 + 4);
+    vec4 data6 = texelFetch(Meshes, index * 9 + 5);
+    vec4 data7 = texelFetch(Meshes, index * 9 + 6);
+    vec4 data8 = texelFetch(Meshes, index * 9 + 7);
+    vec4 data9 = texelFetch(Meshes, index * 9 + 8);
+    uvec4 offsets = texelFetch(MeshOffsets, index);
+    return Mesh(mat4(data1, data2, data3, data4), mat4(data5, data6, data7, data8), int(data9.x), int(offsets.x), int(offsets.y));
+}
+
+int GetMeshCount()
+{
+    return textureSize(Meshes) / 9;
+}
+
+Material GetMaterial(int index)
+{
+    // Meshes without a material get the default one of the Material class
+    if (index < 0 || index >= textureSize(Materials) / 5)
+    {
+        return Material(vec3(1), 0, vec3(1), 0, vec3(1), 0, 0, 0, 0, -1, -1, -1, -1, -1);
+    }
+
+    vec4 data1 = texelFetch(Materials, index * 5 + 0);
+    vec4 data2 = texelFetch(Materials, index * 5 + 1);
+    vec4 data3 = texelFetch(Materials, index * 5 + 2);
+    vec4 data4 = texelFetch(Materials, index * 5 + 3);
+    vec4 data5 = texelFetch(Materials, index * 5 + 4);
+    return Material(data1.rgb, data1.a, data2.rgb, data2.a, data3.rgb, data3.a, data4.x, data4.y, data4.z, int(data4.w), int(data5.x), int(data5.y), int(data5.z), int(data5.w));
+}
+
+int GetLightCount()
+{
+    return textureSize(Lights) == 0 ? 0 : int(texelFetch(Lights, 0).x);
+}
+
+Light GetLight(int index)
+{
+    vec4 data = texelFetch(Lights, index + 1);
+    return Light(data.x, int(data.y), int(data.z), int(data.w));
+}
+
+float GetLightAreaPdf(int materialId)
+{
+    return texelFetch(Lights, GetLightCount() + 1 + materialId).x;
+}
+
+Node GetNode(int index)
+{
+    vec4 data1 = texelFetch(BVH, index * 3 + 0);
+    vec4 data2 = texelFetch(BVH, index * 3 + 1);
+    vec4 data3 = texelFetch(BVH, index * 3 + 2);
+    return Node(data1.xyz, data2.xyz, int(data3.x), int(data3.y), int(data3.z));
+}
+
+Node GetTLASNode(int index)
+{
+    vec4 data1 = texelFetch(TLAS, index * 3 + 0);
+    vec4 data2 = texelFetch(TLAS, index * 3 + 1);
+    vec4 data3 = texelFetch(TLAS, index * 3 + 2);
+    return Node(data1.xyz, data2.xyz, int(data3.x), int(data3.y), int(data3.z));
+}
+
+vec4 GetTexel(ivec3 coord, bool isHalf)
+{
+    return isHalf ? texelFetch(HalfTextures, coord, 0) : texelFetch(Textures, coord, 0);
+}
+
+vec4 GetTextureLevel(int entry, vec2 uv)
+{
+    // Bilinear filtering with repeat wrapping inside the atlas rectangle of the level
+    vec4 rect = texelFetch(TextureInfo, entry + 0);
+    vec4 info = texelFetch(TextureInfo, entry + 1);
+    bool isHalf = info.y > 0;
+
+    vec2 coord = uv * rect.zw - 0.5;
+    vec2 base = floor(coord);
+    vec2 t = coord - base;
+    ivec2 p0 = ivec2(rect.xy + mod(base, rect.zw));
+    ivec2 p1 = ivec2(rect.xy + mod(base + 1, rect.zw));
+    int layer = int(info.x);
+
+    vec4 c00 = GetTexel(ivec3(p0.x, p0.y, layer), isHalf);
+    vec4 c10 = GetTexel(ivec3(p1.x, p0.y, layer), isHalf);
+    vec4 c01 = GetTexel(ivec3(p0.x, p1.y, layer), isHalf);
+    vec4 c11 = GetTexel(ivec3(p1.x, p1.y, layer), isHalf);
+    return mix(mix(c00, c10, t.x), mix(c01, c11, t.x), t.y);
+}
+
+vec4 GetTexture(int textureId, vec2 uv, float footprint)
+{
+    if (any(isnan(uv)) || any(isinf(uv)))
+    {
+        return vec4(0);
+    }
+
+    // Trilinear filtering, the level of detail is the footprint measured in texels of the first level
+    vec4 header = texelFetch(TextureInfo, textureId);
+    int entry = int(header.x);
+    vec4 rect = texelFetch(TextureInfo, entry);
+    float lod = clamp(footprint + 0.5 * log2(rect.z * rect.w), 0, header.y - 1);
+    int level = int(lod);
+    float t = lod - level;
+
+    vec4 color = GetTextureLevel(entry + level * 2, uv);
+    if (t > 0)
+    {
+        color = mix(color, GetTextureLevel(entry + level * 2 + 2, uv), t);
+    }
+
+    return color;
+}
+
+vec3 GetEnvironment(in Ray ray)
+{
+    vec3 direction = Environment.Rotation * ray.Direction;
+    float u = atan(direction.z, direction.x) * INV_TWO_PI + 0.5;
+    float v = acos(direction.y) * INV_PI;
+    float lod = log2(ray.ConeSpread * textureSize(EnvironmentTexture, 0).y * INV_PI);
+    return textureLod(EnvironmentTexture, vec2(u, v), lod).rgb * Environment.Intensity;
+}
+const float TWO_PI     = 6.28318530717958648;
+
+const uint SAMPLER_RANDOM     = 0u;
+const uint SAMPLER_SOBOL      = 1u;
+const uint SAMPLER_BLUE_NOISE = 2u;
+
+// The camera takes the first dimensions, every bounce starts a block so that the samples of a pixel line up
+const uint CAMERA_DIMENSIONS = 4u;
+const uint BOUNCE_DIMENSIONS = 16u;
+const uint BLUE_NOISE_SIZE   = 64u;
+
+uint Seed;
+uvec2 SamplePixel;
+uint SampleDimension;
+
+uint Hash(uint x)
+{
+    x = x * 747796405u + 2891336453u;
+    x = ((x >> ((x >> 28) + 4u)) ^ x) * 277803737u;
+    return (x >> 22) ^ x;
+}
+
+void InitSampler(uvec2 pixel)
+{
+    SamplePixel = pixel;
+    SampleDimension = 0u;
+    Seed = Hash(pixel.x ^ Hash(pixel.y ^ Hash(FrameCount)));
+}
+
+// Moves to the block of the bounce, unless the previous bounce already went past its start
+void StartSampleBounce(uint bounce)
+{
+    SampleDimension = max(SampleDimension, CAMERA_DIMENSIONS + bounce * BOUNCE_DIMENSIONS);
+}
+
+// Hash based Owen scrambling, every bit is flipped depending on the bits above it (Laine-Karras permutation)
+uint OwenScramble(uint x, uint seed)
+{
+    x = bitfieldReverse(x);
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return bitfieldReverse(x);
+}
+
+// Second dimension of the Sobol sequence, the first one is the index with its bits reversed
+uint Sobol1(uint index)
+{
+    uint result = 0u;
+    for (uint direction = 1u << 31; index != 0u; index >>= 1, direction ^= direction >> 1)
+    {
+        if ((index & 1u) != 0u)
+        {
+            result ^= direction;
+        }
+    }
+
+    return result;
+}
+
+// Every pair of dimensions is a two dimensional Sobol sequence with its samples shuffled, so that the pairs are independent
+uint SobolSample(uint index, uint dimension, uint seed)
+{
+    index = OwenScramble(index, Hash(seed ^ Hash(dimension >> 1)));
+    uint value = (dimension & 1u) == 0u ? bitfieldReverse(index) : Sobol1(index);
+    return OwenScramble(value, Hash(seed ^ Hash(dimension) ^ 0x68bc21ebu));
+}
+
+float RandomValue()
+{
+    if (SamplerType == SAMPLER_RANDOM)
+    {
+        Seed = Seed * 747796405u + 2891336453u;
+        uint result = ((Seed >> ((Seed >> 28) + 4u)) ^ Seed) * 277803737u;
+        result = (result >> 22) ^ result;
+        return float(result) / 4294967295.0;
+    }
+
+    uint dimension = SampleDimension++;
+    uint value;
+    if (SamplerType == SAMPLER_SOBOL)
+    {
+        value = SobolSample(FrameCount, dimension, Hash(SamplePixel.x ^ Hash(SamplePixel.y)));
+    }
+    else
+    {
+        // The same sequence for all pixels, shifted modulo 1 by the mask offset for the dimension
+        uint offset = Hash(dimension);
+        uvec2 maskPixel = (SamplePixel + uvec2(offset, offset >> 16)) % BLUE_NOISE_SIZE;
+        float shift = texelFetch(BlueNoise, int(maskPixel.y * BLUE_NOISE_SIZE + maskPixel.x)).r;
+        value = SobolSample(FrameCount, dimension, 0u) + uint(shift * 4294967296.0);
+    }
+
+    // Strictly between 0 and 1
+    return (float(value >> 9) + 0.5) / 8388608.0;
+}
+
+// Two values of the same pair of dimensions, the Sobol samplers stratify them together
+vec2 RandomValue2()
+{
+    SampleDimension += SampleDimension & 1u;
+    float x = RandomValue();
+    float y = RandomValue();
+    return vec2(x, y);
+}
+
+vec2 RandomVector2()
+{
+    vec2 value = RandomValue2();
+    float angle = value.x * TWO_PI;
+    return vec2(cos(angle), sin(angle)) * sqrt(value.y);
+}
+
+// Uniform direction, from two values so that it keeps the stratification of the samplers
+vec3 RandomVector3()
+{
+    vec2 value = RandomValue2();
+    float z = 1 - 2 * value.x;
+    float radius = sqrt(max(1 - z * z, 0));
+    float angle = value.y * TWO_PI;
+    return vec3(radius * cos(angle), radius * sin(angle), z);
+}
+vec3 Slerp(in vec3 a, in vec3 b, float t)
+{
+    float angle = acos(dot(a, b));
+    return isnan(angle) || angle == 0 ? b : (sin((1 - t) * angle) * a + sin(t * angle) * b) / sin(angle);
+}
+
+vec3 Transform(in vec3 v, in mat4 matrix, in bool translate)
+{
+    return (matrix * vec4(v, translate ? 1 : 0)).xyz;
+}
+
+float Luminance(in vec3 color)
+{
+    return dot(color, vec3(.2126, .7152, .0722));
+}
+
+vec4 ToneMap(in vec4 pixel, in float gamma)
+{
+    // Reinhard tone mapping
+    pixel.rgb = pixel.rgb / (pixel.rgb + vec3(1));
+
+    // Gamma correction
+    pixel.rgb = pow(pixel.rgb, vec3(1 / gamma));
+
+    return pixel;
+}
+void swap(inout float a, inout float b)
+{
+    float tmp = a;
+    a = b;
+    b = tmp;
+}
+
+void swap(inout int a, inout int b)
+{
+    int tmp = a;
+    a = b;
+    b = tmp;
+}
+
+bool TriangleIntersection(in Ray ray, in Vertex v1, in Vertex v2, in Vertex v3, in int materialId, out CollisionManifold manifold)
+{
+    vec3 edge12 = v2.Position - v1.Position;
+    vec3 edge13 = v3.Position - v1.Position;
+    vec3 normal = cross(edge12, edge13);
+    float det = -dot(ray.Direction, normal);
+
+    if (abs(det) <= length(normal) * 0.01)
+    {
+        return false;
+    }
+
+    vec3 ao = ray.Origin - v1.Position;
+    vec3 dao = cross(ao, ray.Direction);
+
+    float invDet = 1.0 / det;
+    
+    float dst = dot(ao, normal) * invDet;
+    float u = dot(edge13, dao) * invDet;
+    float v = -dot(edge12, dao) * invDet;
+    float w = 1.0 - u - v;
+
+    if (dst <= 0.001 || u < 0.0 || v < 0.0 || w < 0.0)
+    {
+        return false;
+    }
+
+    vec2 edgeUV12 = v2.TextureCoordinate - v1.TextureCoordinate;
+    vec2 edgeUV13 = v3.TextureCoordinate - v1.TextureCoordinate;
+    float detUV = edgeUV12.x * edgeUV13.y - edgeUV12.y * edgeUV13.x;
+    float invDetUV = 1.0 / detUV;
+
+    manifold = CollisionManifold(
+        dst,
+        ray.Origin + ray.Direction * dst,
+        v1.TextureCoordinate * w + v2.TextureCoordinate * u + v3.TextureCoordinate * v,
+        0.5 * log2(abs(detUV) / length(normal)),
+        normalize(v1.Normal * w + v2.Normal * u + v3.Normal * v),
+        normalize((edge12 * edgeUV13.y - edge13 * edgeUV12.y) * invDetUV),
+        normalize((edge13 * edgeUV12.x - edge12 * edgeUV13.x) * invDetUV),
+        materialId,
+        det >= 0);
+    return true;
+}
+
+bool AABBIntersection(in Ray ray, in vec3 boxMin, in vec3 boxMax, out float tNear, out float tFar)
+{
+    vec3 tMin = (boxMin - ray.Origin) * ray.InvDirection;
+    vec3 tMax = (boxMax - ray.Origin) * ray.InvDirection;
+    vec3 t1 = min(tMin, tMax);
+    vec3 t2 = max(tMin, tMax);
+    tNear = max(max(t1.x, t1.y), t1.z);
+    tFar = min(min(t2.x, t2.y), t2.z);
+    return tNear <= tFar && tFar >= 0;
+}
+
+void LeafIntersection(in Ray ray, in Mesh mesh, in int start, in int count, in bool firstHit, in float localMinRenderDistance, inout CollisionManifold manifold)
+{
+    for (int o = 0; o < count; ++o)
+    {
+        Triangle triangle = GetTriangle(start + o + mesh.TriangleOffset);
+
+        Vertex v1 = GetVertex(triangle.V1);
+        Vertex v2 = GetVertex(triangle.V2);
+        Vertex v3 = GetVertex(triangle.V3);
+
+        CollisionManifold current;
+        if (TriangleIntersection(ray, v1, v2, v3, mesh.MaterialId, current) && current.Depth < manifold.Depth && (!firstHit || current.Depth >= localMinRenderDistance))
+        {
+            manifold = current;
+        }
+    }
+}
+
+void BinaryBVHIntersection(in Ray ray, in Mesh mesh, in bool firstHit, in float localMinRenderDistance, inout CollisionManifold manifold)
+{
+    float bbhits[4];
+
+    vec2 todo[64];
+    int stackptr = 0;
+
+    todo[stackptr] = vec2(mesh.NodeOffset, -1);
+
+    while (stackptr >= 0)
+    {
+        int ni = int(todo[stackptr].x);
+        float near = todo[stackptr].y;
+        stackptr--;
+
+        Node node = GetNode(ni);
+
+        if (near > manifold.Depth) continue;
+
+        if (node.RightOffset == 0)
+        {
+            LeafIntersection(ray, mesh, node.Start, node.PrimitiveCount, firstHit, localMinRenderDistance, manifold);
+        }
+        else
+        {
+            Node c0 = GetNode(ni + 1);
+            Node c1 = GetNode(ni + node.RightOffset);
+
+            bool hitc0 = AABBIntersection(ray, c0.BboxMin, c0.BboxMax, bbhits[0], bbhits[1]);
+            bool hitc1 = AABBIntersection(ray, c1.BboxMin, c1.BboxMax, bbhits[2], bbhits[3]);
+
+            if (hitc0 && hitc1)
+            {
+                int closer = ni + 1;
+                int other = ni + node.RightOffset;
+
+                if (bbhits[2] < bbhits[0])
+                {
+                    swap(bbhits[0], bbhits[2]);
+                    swap(bbhits[1], bbhits[3]);
+                    swap(closer, other);
+                }
+
+                todo[++stackptr] = vec2(other, bbhits[2]);
+                todo[++stackptr] = vec2(closer, bbhits[0]);
+            }
+            else if (hitc0)
+            {
+                todo[++stackptr] = vec2(ni + 1, bbhits[0]);
+            }
+            else if (hitc1)
+            {
+                todo[++stackptr] = vec2(ni + node.RightOffset, bbhits[2]);
+            }
+        }
+    }
+}
+
+void WideBVHIntersection(in Ray ray, in Mesh mesh, in bool firstHit, in float localMinRenderDistance, inout CollisionManifold manifold)
+{
+    // Up to 3 pending entries per level, the wide tree is at most half as deep as the binary one
+    vec2 todo[80];
+    int stackptr = 0;
+
+    todo[stackptr] = vec2(mesh.NodeOffset, -1);
+
+    while (stackptr >= 0)
+    {
+        int ni = int(todo[stackptr].x);
+        float near = todo[stackptr].y;
+        stackptr--;
+
+        if (near > manifold.Depth) continue;
+
+        if (ni < 0)
+        {
+            Node leaf = GetNode(-ni - 1);
+            LeafIntersection(ray, mesh, leaf.Start, leaf.PrimitiveCount, firstHit, localMinRenderDistance, manifold);
+            continue;
+        }
+
+        // Sort the hit children by distance
+        float nears[4];
+        int order[4];
+        int hitCount = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            Node child = GetNode(ni + i);
+
+            float tNear, tFar;
+            if ((child.PrimitiveCount == 0 && child.RightOffset == 0) ||
+                !AABBIntersection(ray, child.BboxMin, child.BboxMax, tNear, tFar))
+            {
+                continue;
+            }
+
+            int j = hitCount++;
+            for (; j > 0 && nears[j - 1] > tNear; j--)
+            {
+                nears[j] = nears[j - 1];
+                order[j] = order[j - 1];
+            }
+
+            nears[j] = tNear;
+            order[j] = i;
+        }
+
+        // Pushed farthest first, leaf children are pushed as negative record indices
+        for (int i = hitCount - 1; i >= 0; i--)
+        {
+            int rightOffset = int(texelFetch(BVH, (ni + order[i]) * 3 + 2).z);
+            todo[++stackptr] = vec2(rightOffset == 0 ? -(ni + order[i]) - 1 : ni + rightOffset, nears[i]);
+        }
+    }
+}
+
+void QuantizedBVHIntersection(in Ray ray, in Mesh mesh, in bool firstHit, in float localMinRenderDistance, inout CollisionManifold manifold)
+{
+    // See Scene::quantizeBVH for the layout of the words
+    uint boundWords = BVHQuantizationBits * 3u / 4u;
+    int nodeSize = int(boundWords + 9u) / 4;
+
+    // Integer indices, so large scenes do not lose precision
+    int todo[80];
+    float todoNear[80];
+    int stackptr = 0;
+
+    todo[stackptr] = int(mesh.NodeOffset);
+    todoNear[stackptr] = -1;
+
+    while (stackptr >= 0)
+    {
+        int ni = todo[stackptr];
+        float near = todoNear[stackptr];
+        stackptr--;
+
+        if (near > manifold.Depth) continue;
+
+        if (ni < 0)
+        {
+            // Leaf children are pushed as negative child indices
+            int record = -ni - 1;
+            uint child = uint(record & 3);
+            int base = (record >> 2) * nodeSize;
+            uint countWord = boundWords + child / 2u;
+            uint referenceWord = boundWords + 2u + child;
+            uint count = (texelFetch(BVHData, base + int(countWord / 4u))[countWord % 4u] >> (16u * (child % 2u))) & 0xFFFFu;
+            uint start = texelFetch(BVHData, base + int(referenceWord / 4u))[referenceWord % 4u];
+            LeafIntersection(ray, mesh, int(start), int(count), firstHit, localMinRenderDistance, manifold);
+            continue;
+        }
+
+        vec3 origin = texelFetch(BVH, ni * 2 + 0).xyz;
+        vec3 scale = texelFetch(BVH, ni * 2 + 1).xyz;
+        uvec4 data1 = texelFetch(BVHData, ni * nodeSize + 0);
+        uvec4 data2 = texelFetch(BVHData, ni * nodeSize + 1);
+        uvec4 data3 = texelFetch(BVHData, ni * nodeSize + 2);
+
+        // Unpack the four children at once
+        uvec4 minX, minY, minZ, maxX, maxY, maxZ, counts, references;
+        uvec4 countShifts = uvec4(0u, 16u, 0u, 16u);
+        if (BVHQuantizationBits == 8u)
+        {
+            uvec4 shifts = uvec4(0u, 8u, 16u, 24u);
+            minX = (uvec4(data1.x) >> shifts) & 0xFFu;
+            minY = (uvec4(data1.y) >> shifts) & 0xFFu;
+            minZ = (uvec4(data1.z) >> shifts) & 0xFFu;
+            maxX = (uvec4(data1.w) >> shifts) & 0xFFu;
+            maxY = (uvec4(data2.x) >> shifts) & 0xFFu;
+            maxZ = (uvec4(data2.y) >> shifts) & 0xFFu;
+            counts = (data2.zzww >> countShifts) & 0xFFFFu;
+            references = data3;
+        }
+        else
+        {
+            uvec4 data4 = texelFetch(BVHData, ni * nodeSize + 3);
+            uvec4 data5 = texelFetch(BVHData, ni * nodeSize + 4);
+            minX = (data1.xxyy >> countShifts) & 0xFFFFu;
+            minY = (data1.zzww >> countShifts) & 0xFFFFu;
+            minZ = (data2.xxyy >> countShifts) & 0xFFFFu;
+            maxX = (data2.zzww >> countShifts) & 0xFFFFu;
+            maxY = (data3.xxyy >> countShifts) & 0xFFFFu;
+            maxZ = (data3.zzww >> countShifts) & 0xFFFFu;
+            counts = (data4.xxyy >> countShifts) & 0xFFFFu;
+            references = uvec4(data4.zw, data5.xy);
+        }
+
+        // Slab test of the four children at once, same operations as AABBIntersection
+        vec4 x1 = (origin.x + vec4(minX) * scale.x - ray.Origin.x) * ray.InvDirection.x;
+        vec4 x2 = (origin.x + vec4(maxX) * scale.x - ray.Origin.x) * ray.InvDirection.x;
+        vec4 y1 = (origin.y + vec4(minY) * scale.y - ray.Origin.y) * ray.InvDirection.y;
+        vec4 y2 = (origin.y + vec4(maxY) * scale.y - ray.Origin.y) * ray.InvDirection.y;
+        vec4 z1 = (origin.z + vec4(minZ) * scale.z - ray.Origin.z) * ray.InvDirection.z;
+        vec4 z2 = (origin.z + vec4(maxZ) * scale.z - ray.Origin.z) * ray.InvDirection.z;
+        vec4 tNear = max(max(min(x1, x2), min(y1, y2)), min(z1, z2));
+        vec4 tFar = min(min(max(x1, x2), max(y1, y2)), max(z1, z2));
+        uvec4 hits = uvec4(lessThanEqual(tNear, tFar)) & uvec4(greaterThanEqual(tFar, vec4(0))) & uvec4(notEqual(counts | references, uvec4(0u)));
+
+        // Sort the hit children by distance
+        float nears[4];
+        int entries[4];
+        int hitCount = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            if (hits[i] == 0u)
+            {
+                continue;
+            }
+
+            int j = hitCount++;
+            for (; j > 0 && nears[j - 1] > tNear[i]; j--)
+            {
+                nears[j] = nears[j - 1];
+                entries[j] = entries[j - 1];
+            }
+
+            nears[j] = tNear[i];
+            entries[j] = counts[i] != 0u ? -(ni * 4 + i) - 1 : ni + int(references[i]);
+        }
+
+        // Pushed farthest first
+        for (int i = hitCount - 1; i >= 0; i--)
+        {
+            stackptr++;
+            todo[stackptr] = entries[i];
+            todoNear[stackptr] = nears[i];
+        }
+    }
+}
+
+bool MeshIntersection(in Ray ray, in Mesh mesh, in bool firstHit, out CollisionManifold manifold)
+{
+    vec3 rayOrigin = ray.Origin;
+    ray.Origin = Transform(ray.Origin, mesh.TransformInv, true);
+    ray.Direction = normalize(Transform(ray.Direction, mesh.TransformInv, false));
+    ray.InvDirection = 1 / ray.Direction;
+
+    float localMinRenderDistance = length(Transform(ray.Direction * MinRenderDistance, mesh.TransformInv, false));
+    float localMaxRenderDistance = length(Transform(ray.Direction * MaxRenderDistance, mesh.TransformInv, false));
+    manifold.Depth = localMaxRenderDistance;
+
+    if (BVHLayout == BVH_LAYOUT_WIDE)
+    {
+        WideBVHIntersection(ray, mesh, firstHit, localMinRenderDistance, manifold);
+    }
+    else if (BVHLayout == BVH_LAYOUT_QUANTIZED)
+    {
+        QuantizedBVHIntersection(ray, mesh, firstHit, localMinRenderDistance, manifold);
+    }
+    else
+    {
+        BinaryBVHIntersection(ray, mesh, firstHit, localMinRenderDistance, manifold);
+    }
+
+    if (manifold.Depth < localMaxRenderDistance)
+    {
+        manifold.Point = Transform(manifold.Point, mesh.Transform, true);
+        manifold.Depth = length(manifold.Point - rayOrigin);
+        manifold.UVDensity += log2(localMaxRenderDistance / MaxRenderDistance);
+        manifold.Normal = normalize(Transform(manifold.Normal, mesh.Transform, false));
+        manifold.Tangent = normalize(Transform(manifold.Tangent, mesh.Transform, false));
+        manifold.Bitangent = normalize(Transform(manifold.Bitangent, mesh.Transform, false));
+        return true;
+    }
+
+    return false;
+}
+
+bool FindIntersection(in Ray ray, in bool firstHit, out CollisionManifold manifold)
+{
+    manifold.Depth = MaxRenderDistance;
+
+    if (textureSize(TLAS) == 0)
+    {
+        return false;
+    }
+
+    float bbhits[4];
+
+    Node root = GetTLASNode(0);
+    if (!AABBIntersection(ray, root.BboxMin, root.BboxMax, bbhits[0], bbhits[1]))
+    {
+        return false;
+    }
+
+    vec2 todo[64];
+    int stackptr = 0;
+
+    todo[stackptr] = vec2(0, bbhits[0]);
+
+    while (stackptr >= 0)
+    {
+        int ni = int(todo[stackptr].x);
+        float near = todo[stackptr].y;
+        stackptr--;
+
+        if (near > manifold.Depth) continue;
+
+        Node node = GetTLASNode(ni);
+
+        if (node.RightOffset == 0)
+        {
+            // Leaf nodes hold a single mesh
+            CollisionManifold current;
+            if (MeshIntersection(ray, GetMesh(node.Start), firstHit, current) && current.Depth < manifold.Depth)
+            {
+                manifold = current;
+            }
+        }
+        else
+        {
+            Node c0 = GetTLASNode(ni + 1);
+            Node c1 = GetTLASNode(ni + node.RightOffset);
+
+            bool hitc0 = AABBIntersection(ray, c0.BboxMin, c0.BboxMax, bbhits[0], bbhits[1]);
+            bool hitc1 = AABBIntersection(ray, c1.BboxMin, c1.BboxMax, bbhits[2], bbhits[3]);
+
+            if (hitc0 && hitc1)
+            {
+                int closer = ni + 1;
+                int other = ni + node.RightOffset;
+
+                if (bbhits[2] < bbhits[0])
+                {
+                    swap(bbhits[0], bbhits[2]);
+                    swap(bbhits[1], bbhits[3]);
+                    swap(closer, other);
+                }
+
+                todo[++stackptr] = vec2(other, bbhits[2]);
+                todo[++stackptr] = vec2(closer, bbhits[0]);
+            }
+            else if (hitc0)
+            {
+                todo[++stackptr] = vec2(ni + 1, bbhits[0]);
+            }
+            else if (hitc1)
+            {
+                todo[++stackptr] = vec2(ni + node.RightOffset, bbhits[2]);
+            }
+        }
+    }
+
+    return manifold.Depth < MaxRenderDistance;
+}
+const uint WORKGROUP_SIZE = 64u;
+
+const uint PATH_BACKGROUND = 1u;
+const uint PATH_CONVERGED  = 2u;
+
+// The queue of the paths whose shadow ray waits for the occlusion stage
+const uint SHADOW_QUEUE = 2u;
+
+// Origin.w is the cone width, Direction.w the cone spread, Color.w the scatter pdf, IncomingLight.w the scatter distance,
+// State holds the seed, the bounce, the sample dimension and the flags
+struct Path
+{
+    vec4 Origin;
+    vec4 Direction;
+    vec4 Color;
+    vec4 IncomingLight;
+    uvec4 State;
+};
+
+// The collision manifold found by the intersection stage, Info holds the material, the face and the hit flag
+struct Hit
+{
+    vec4 PointDepth;
+    vec4 NormalUVDensity;
+    vec4 TangentU;
+    vec4 BitangentV;
+    ivec4 Info;
+};
+
+// The shadow ray of a light sample, Origin.w is the distance left to the light, Direction.w the cone width, IncomingLight.w the cone spread
+struct Shadow
+{
+    vec4 Origin;
+    vec4 Direction;
+    vec4 IncomingLight;
+};
+
+layout(std430, binding=0) buffer PathBuffer { Path Paths[]; };
+layout(std430, binding=1) buffer HitBuffer { Hit Hits[]; };
+layout(std430, binding=2) buffer QueueBuffer { uint Queues[]; };
+layout(std430, binding=3) buffer CounterBuffer { uint DispatchX; uint DispatchY; uint DispatchZ; uint QueueSizes[3]; };
+layout(std430, binding=4) buffer ShadowBuffer { Shadow Shadows[]; };
+
+layout(binding=0, rgba32f) uniform image2D AccumulatorImage;
+layout(binding=1, rgba32f) uniform image2D AlbedoImage;
+layout(binding=2, rgba32f) uniform image2D NormalImage;
+layout(binding=3, rgba32f) uniform image2D MomentsImage;
+
+uniform uvec2 RectPosition;
+uniform uvec2 RectSize;
+uniform uint Queue;
+uniform uint QueueCapacity;
+
+uint GetInvocationIndex()
+{
+    return (gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x) * WORKGROUP_SIZE + gl_LocalInvocationID.x;
+}
+
+ivec2 GetPixel(uint pathId)
+{
+    return ivec2(RectPosition + uvec2(pathId % RectSize.x, pathId / RectSize.x));
+}
+
+void PushPath(uint queue, uint pathId)
+{
+    uint slot = atomicAdd(QueueSizes[queue], 1u);
+    Queues[queue * QueueCapacity + slot] = pathId;
+}
+
+Ray LoadRay(in Path path)
+{
+    return Ray(path.Origin.xyz, path.Direction.xyz, 1 / path.Direction.xyz, path.Color.rgb, path.IncomingLight.rgb, path.Origin.w, path.Direction.w, path.Color.w, path.IncomingLight.w);
+}
+
+Path StorePath(in Ray ray, uint bounce, uint flags)
+{
+    return Path(vec4(ray.Origin, ray.ConeWidth), vec4(ray.Direction, ray.ConeSpread), vec4(ray.Color, ray.ScatterPdf), vec4(ray.IncomingLight, ray.ScatterDistance), uvec4(Seed, bounce, SampleDimension, flags));
+}
+
+Ray LoadShadowRay(in Shadow shadow)
+{
+    return Ray(shadow.Origin.xyz, shadow.Direction.xyz, 1 / shadow.Direction.xyz, vec3(1), shadow.IncomingLight.rgb, shadow.Direction.w, shadow.IncomingLight.w, 0, 0);
+}
+
+Shadow StoreShadow(in Ray shadowRay, float distance)
+{
+    return Shadow(vec4(shadowRay.Origin, distance), vec4(shadowRay.Direction, shadowRay.ConeWidth), vec4(shadowRay.IncomingLight, shadowRay.ConeSpread));
+}
+
+// Finds the closest collision of every queued path
+void main()
+{
+    uint index = GetInvocationIndex();
+    if (index >= QueueSizes[Queue])
+    {
+        return;
+    }
+
+    uint pathId = Queues[Queue * QueueCapacity + index];
+    Path path = Paths[pathId];
+
+    CollisionManifold manifold;
+    if (!FindIntersection(LoadRay(path), path.State.y == 0, manifold))
+    {
+        Hits[pathId].Info = ivec4(0);
+        return;
+    }
+
+    Hits[pathId] = Hit(
+        vec4(manifold.Point, manifold.Depth),
+        vec4(manifold.Normal, manifold.UVDensity),
+        vec4(manifold.Tangent, manifold.TextureCoordinate.x),
+        vec4(manifold.Bitangent, manifold.TextureCoordinate.y),
+        ivec4(manifold.MaterialId, manifold.IsFrontFace ? 1 : 0, 1, 0));
+}
+
+)";
+
+const char* WavefrontTracer::shadeShaderSrc =
+R"(
+#version 430 core
+
+layout(local_size_x=64) in;
+
+struct Ray
+{
+    vec3 Origin;
+    vec3 Direction;
+    vec3 InvDirection;
+    vec3 Color;
+    vec3 IncomingLight;
+    float ConeWidth;
+    float ConeSpread;
+    float ScatterPdf;
+    float ScatterDistance;
+};
+
+struct Env
+{
+    bool Transparent;
+    float Intensity;
+    mat3 Rotation;
+};
+
+struct Cam
+{
+    vec3 Position;
+    vec3 Forward;
+    vec3 Up;
+    float FOV;
+    float FocalDistance;
+    float Aperture;
+    float Blur;
+};
+
+struct Material
+{
+    vec3 AlbedoColor;
+    float Roughness;
+    vec3 EmissionColor;
+    float EmissionStrength;
+    vec3 FresnelColor;
+    float FresnelStrength;
+    float Metalness;
+    float IOR;
+    float Density;
+    int AlbedoTextureId;
+    int MetalnessTextureId;
+    int EmissionTextureId;
+    int RoughnessTextureId;
+    int NormalTextureId;
+};
+
+struct Vertex
+{
+    vec3 Position;
+    vec3 Normal;
+    vec2 TextureCoordinate;
+};
+
+struct Triangle
+{
+    int V1;
+    int V2;
+    int V3;
+};
+
+struct Mesh
+{
+    mat4 Transform;
+    mat4 TransformInv;
+    int MaterialId;
+    int NodeOffset;
+    int TriangleOffset;
+};
+
+struct CollisionManifold
+{
+    float Depth;
+    vec3 Point;
+    vec2 TextureCoordinate;
+    float UVDensity;
+    vec3 Normal;
+    vec3 Tangent;
+    vec3 Bitangent;
+    int MaterialId;
+    bool IsFrontFace;
+};
+
+struct Light
+{
+    float Probability;
+    int Alias;
+    int MeshId;
+    int TriangleId;
+};
+
+struct Node
+{
+    vec3 BboxMin;
+    vec3 BboxMax;
+    int Start;
+    int PrimitiveCount;
+    int RightOffset;
+};
+const float INV_PI     = 0.31830988618379067;
+const float INV_TWO_PI = 0.15915494309189533;
+
+const uint BVH_LAYOUT_BINARY = 0u;
+const uint BVH_LAYOUT_WIDE   = 1u;
+const uint BVH_LAYOUT_QUANTIZED = 2u;
+
+layout(binding=0) uniform sampler2D AccumulatorTexture;
+layout(binding=1) uniform sampler2D EnvironmentTexture;
+layout(binding=2) uniform sampler2DArray Textures;
+layout(binding=3) uniform samplerBuffer Vertices;
+layout(binding=4) uniform isamplerBuffer Triangles;
+layout(binding=5) uniform samplerBuffer Meshes;
+layout(binding=6) uniform samplerBuffer Materials;
+layout(binding=7) uniform samplerBuffer BVH;
+layout(binding=8) uniform samplerBuffer TLAS;
+layout(binding=9) uniform usamplerBuffer BVHData;
+layout(binding=11) uniform sampler2DArray HalfTextures;
+layout(binding=12) uniform samplerBuffer TextureInfo;
+layout(binding=13) uniform sampler2D MomentsTexture;
+layout(binding=14) uniform sampler2D AlbedoTexture;
+layout(binding=15) uniform sampler2D NormalTexture;
+layout(binding=16) uniform samplerBuffer Lights;
+layout(binding=17) uniform samplerBuffer EnvironmentDistribution;
+layout(binding=18) uniform samplerBuffer BlueNoise;
+layout(binding=19) uniform usamplerBuffer MeshOffsets;
+
+// Only uploaded when the settings change, the layout is mirrored by Renderer::Settings
+layout(std140, binding=0) uniform Settings
+{
+    Cam Camera;
+    Env Environment;
+    uint MaxBounceCount;
+    float MinRenderDistance;
+    float MaxRenderDistance;
+    uint BVHLayout;
+    uint BVHQuantizationBits;
+    float Gamma;
+    float AdaptiveThreshold;
+    uint AdaptiveMinFrameCount;
+    uint SamplerType;
+    uint RussianRouletteDepth;
+};
+
+uniform uint FrameCount;
+
+Triangle GetTriangle(int index)
+{
+    ivec4 data = texelFetch(Triangles, index);
+    return Triangle(data.x, data.y, data.z);
+}
+
+Vertex GetVertex(int index)
+{
+    vec4 data1 = texelFetch(Vertices, index * 2 + 0);
+    vec4 data2 = texelFetch(Vertices, index * 2 + 1);
+    return Vertex(data1.xyz, data2.xyz, vec2(data1.w, data2.w));
+}
+
+Mesh GetMesh(int index)
+{
+    vec4 data1 = texelFetch(Meshes, index * 9 + 0);
+    vec4 data2 = texelFetch(Meshes, index * 9 + 1);
+    vec4 data3 = texelFetch(Meshes, index * 9 + 2);
+    vec4 data4 = texelFetch(Meshes, index * 9 + 3);
+    vec4 data5 = texelFetch(Meshes, index * 9 + 4);
+    vec4 data6 = texelFetch(Meshes, index * 9 + 5);
+    vec4 data7 = texelFetch(Meshes, index * 9 + 6);
+    vec4 data8 = texelFetch(Meshes, index * 9 + 7);
+    vec4 data9 = texelFetch(Meshes, index * 9 + 8);
+    uvec4 offsets = texelFetch(MeshOffsets, index);
+    return Mesh(mat4(data1, data2, data3, data4), mat4(data5, data6, data7, data8), int(data9.x), int(offsets.x), int(offsets.y));
+}
+
+int GetMeshCount()
+{
+    return textureSize(Meshes) / 9;
+}
+
+Material GetMaterial(int index)
+{
+    // Meshes without a material get the default one of the Material class
+    if (index < 0 || index >= textureSize(Materials) / 5)
+    {
+        return Material(vec3(1), 0, vec3(1), 0, vec3(1), 0, 0, 0, 0, -1, -1, -1, -1, -1);
+    }
+
+    vec4 data1 = texelFetch(Materials, index * 5 + 0);
+    vec4 data2 = texelFetch(Materials, index * 5 + 1);
+    vec4 data3 = texelFetch(Materials, index * 5 + 2);
+    vec4 data4 = texelFetch(Materials, index * 5 + 3);
+    vec4 data5 = texelFetch(Materials, index * 5 + 4);
+    return Material(data1.rgb, data1.a, data2.rgb, data2.a, data3.rgb, data3.a, data4.x, data4.y, data4.z, int(data4.w), int(data5.x), int(data5.y), int(data5.z), int(data5.w));
+}
+
+int GetLightCount()
+{
+    return textureSize(Lights) == 0 ? 0 : int(texelFetch(Lights, 0).x);
+}
+
+Light GetLight(int index)
+{
+    vec4 data = texelFetch(Lights, index + 1);
+    return Light(data.x, int(data.y), int(data.z), int(data.w));
+}
+
+float GetLightAreaPdf(int materialId)
+{
+    return texelFetch(Lights, GetLightCount() + 1 + materialId).x;
+}
+
+Node GetNode(int index)
+{
+    vec4 data1 = texelFetch(BVH, index * 3 + 0);
+    vec4 data2 = texelFetch(BVH, index * 3 + 1);
+    vec4 data3 = texelFetch(BVH, index * 3 + 2);
+    return Node(data1.xyz, data2.xyz, int(data3.x), int(data3.y), int(data3.z));
+}
+
+Node GetTLASNode(int index)
+{
+    vec4 data1 = texelFetch(TLAS, index * 3 + 0);
+    vec4 data2 = texelFetch(TLAS, index * 3 + 1);
+    vec4 data3 = texelFetch(TLAS, index * 3 + 2);
+    return Node(data1.xyz, data2.xyz, int(data3.x), int(data3.y), int(data3.z));
+}
+
+vec4 GetTexel(ivec3 coord, bool isHalf)
+{
+    return isHalf ? texelFetch(HalfTextures, coord, 0) : texelFetch(Textures, coord, 0);
+}
+
+vec4 GetTextureLevel(int entry, vec2 uv)
+{
+    // Bilinear filtering with repeat wrapping inside the atlas rectangle of the level
+    vec4 rect = texelFetch(TextureInfo, entry + 0);
+    vec4 info = texelFetch(TextureInfo, entry + 1);
+    bool isHalf = info.y > 0;
+
+    vec2 coord = uv * rect.zw - 0.5;
+    vec2 base = floor(coord);
+    vec2 t = coord - base;
+    ivec2 p0 = ivec2(rect.xy + mod(base, rect.zw));
+    ivec2 p1 = ivec2(rect.xy + mod(base + 1, rect.zw));
+    int layer = int(info.x);
+
+    vec4 c00 = GetTexel(ivec3(p0.x, p0.y, layer), isHalf);
+    vec4 c10 = GetTexel(ivec3(p1.x, p0.y, layer), isHalf);
+    vec4 c01 = GetTexel(ivec3(p0.x, p1.y, layer), isHalf);
+    vec4 c11 = GetTexel(ivec3(p1.x, p1.y, layer), isHalf);
+    return mix(mix(c00, c10, t.x), mix(c01, c11, t.x), t.y);
+}
+
+vec4 GetTexture(int textureId, vec2 uv, float footprint)
+{
+    if (any(isnan(uv)) || any(isinf(uv)))
+    {
+        return vec4(0);
+    }
+
+    // Trilinear filtering, the level of detail is the footprint measured in texels of the first level
+    vec4 header = texelFetch(TextureInfo, textureId);
+    int entry = int(header.x);
+    vec4 rect = texelFetch(TextureInfo, entry);
+    float lod = clamp(footprint + 0.5 * log2(rect.z * rect.w), 0, header.y - 1);
+    int level = int(lod);
+    float t = lod - level;
+
+    vec4 color = GetTextureLevel(entry + level * 2, uv);
+    if (t > 0)
+    {
+        color = mix(color, GetTextureLevel(entry + level * 2 + 2, uv), t);
+    }
+
+    return color;
+}
+
+vec3 GetEnvironment(in Ray ray)
+{
+    vec3 direction = Environment.Rotation * ray.Direction;
+    float u = atan(direction.z, direction.x) * INV_TWO_PI + 0.5;
+    float v = acos(direction.y) * INV_PI;
+    float lod = log2(ray.ConeSpread * textureSize(EnvironmentTexture, 0).y * INV_PI);
+    return textureLod(EnvironmentTexture, vec2(u, v), lod).rgb * Environment.Intensity;
+}
+const float TWO_PI     = 6.28318530717958648;
+
+const uint SAMPLER_RANDOM     = 0u;
+const uint SAMPLER_SOBOL      = 1u;
+const uint SAMPLER_BLUE_NOISE = 2u;
+
+// The camera takes the first dimensions, every bounce starts a block so that the samples of a pixel line up
+const uint CAMERA_DIMENSIONS = 4u;
+const uint BOUNCE_DIMENSIONS = 16u;
+const uint BLUE_NOISE_SIZE   = 64u;
+
+uint Seed;
+uvec2 SamplePixel;
+uint SampleDimension;
+
+uint Hash(uint x)
+{
+    x = x * 747796405u + 2891336453u;
+    x = ((x >> ((x >> 28) + 4u)) ^ x) * 277803737u;
+    return (x >> 22) ^ x;
+}
+
+void InitSampler(uvec2 pixel)
+{
+    SamplePixel = pixel;
+    SampleDimension = 0u;
+    Seed = Hash(pixel.x ^ Hash(pixel.y ^ Hash(FrameCount)));
+}
+
+// Moves to the block of the bounce, unless the previous bounce already went past its start
+void StartSampleBounce(uint bounce)
+{
+    SampleDimension = max(SampleDimension, CAMERA_DIMENSIONS + bounce * BOUNCE_DIMENSIONS);
+}
+
+// Hash based Owen scrambling, every bit is flipped depending on the bits above it (Laine-Karras permutation)
+uint OwenScramble(uint x, uint seed)
+{
+    x = bitfieldReverse(x);
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return bitfieldReverse(x);
+}
+
+// Second dimension of the Sobol sequence, the first one is the index with its bits reversed
+uint Sobol1(uint index)
+{
+    uint result = 0u;
+    for (uint direction = 1u << 31; index != 0u; index >>= 1, direction ^= direction >> 1)
+    {
+        if ((index & 1u) != 0u)
+        {
+            result ^= direction;
+        }
+    }
+
+    return result;
+}
+
+// Every pair of dimensions is a two dimensional Sobol sequence with its samples shuffled, so that the pairs are independent
+uint SobolSample(uint index, uint dimension, uint seed)
+{
+    index = OwenScramble(index, Hash(seed ^ Hash(dimension >> 1)));
+    uint value = (dimension & 1u) == 0u ? bitfieldReverse(index) : Sobol1(index);
+    return OwenScramble(value, Hash(seed ^ Hash(dimension) ^ 0x68bc21ebu));
+}
+
+float RandomValue()
+{
+    if (SamplerType == SAMPLER_RANDOM)
+    {
+        Seed = Seed * 747796405u + 2891336453u;
+        uint result = ((Seed >> ((Seed >> 28) + 4u)) ^ Seed) * 277803737u;
+        result = (result >> 22) ^ result;
+        return float(result) / 4294967295.0;
+    }
+
+    uint dimension = SampleDimension++;
+    uint value;
+    if (SamplerType == SAMPLER_SOBOL)
+    {
+        value = SobolSample(FrameCount, dimension, Hash(SamplePixel.x ^ Hash(SamplePixel.y)));
+    }
+    else
+    {
+        // The same sequence for all pixels, shifted modulo 1 by the mask offset for the dimension
+        uint offset = Hash(dimension);
+        uvec2 maskPixel = (SamplePixel + uvec2(offset, offset >> 16)) % BLUE_NOISE_SIZE;
+        float shift = texelFetch(BlueNoise, int(maskPixel.y * BLUE_NOISE_SIZE + maskPixel.x)).r;
+        value = SobolSample(FrameCount, dimension, 0u) + uint(shift * 4294967296.0);
+    }
+
+    // Strictly between 0 and 1
+    return (float(value >> 9) + 0.5) / 8388608.0;
+}
+
+// Two values of the same pair of dimensions, the Sobol samplers stratify them together
+vec2 RandomValue2()
+{
+    SampleDimension += SampleDimension & 1u;
+    float x = RandomValue();
+    float y = RandomValue();
+    return vec2(x, y);
+}
+
+vec2 RandomVector2()
+{
+    vec2 value = RandomValue2();
+    float angle = value.x * TWO_PI;
+    return vec2(cos(angle), sin(angle)) * sqrt(value.y);
+}
+
+// Uniform direction, from two values so that it keeps the stratification of the samplers
+vec3 RandomVector3()
+{
+    vec2 value = RandomValue2();
+    float z = 1 - 2 * value.x;
+    float radius = sqrt(max(1 - z * z, 0));
+    float angle = value.y * TWO_PI;
+    return vec3(radius * cos(angle), radius * sin(angle), z);
+}
+vec3 Slerp(in vec3 a, in vec3 b, float t)
+{
+    float angle = acos(dot(a, b));
+    return isnan(angle) || angle == 0 ? b : (sin((1 - t) * angle) * a + sin(t * angle) * b) / sin(angle);
+}
+
+vec3 Transform(in vec3 v, in mat4 matrix, in bool translate)
+{
+    return (matrix * vec4(v, translate ? 1 : 0)).xyz;
+}
+
+float Luminance(in vec3 color)
+{
+    return dot(color, vec3(.2126, .7152, .0722));
+}
+
+vec4 ToneMap(in vec4 pixel, in float gamma)
+{
+    // Reinhard tone mapping
+    pixel.rgb = pixel.rgb / (pixel.rgb + vec3(1));
+
+    // Gamma correction
+    pixel.rgb = pow(pixel.rgb, vec3(1 / gamma));
+
+    return pixel;
+}
+void swap(inout float a, inout float b)
+{
+    float tmp = a;
+    a = b;
+    b = tmp;
+}
+
+void swap(inout int a, inout int b)
+{
+    int tmp = a;
+    a = b;
+    b = tmp;
+}
+
+bool TriangleIntersection(in Ray ray, in Vertex v1, in Vertex v2, in Vertex v3, in int materialId, out CollisionManifold manifold)
+{
+    vec3 edge12 = v2.Position - v1.Position;
+    vec3 edge13 = v3.Position - v1.Position;
+    vec3 normal = cross(edge12, edge13);
+    float det = -dot(ray.Direction, normal);
+
+    if (abs(det) <= length(normal) * 0.01)
+    {
+        return false;
+    }
+
+    vec3 ao = ray.Origin - v1.Position;
+    vec3 dao = cross(ao, ray.Direction);
+
+    float invDet = 1.0 / det;
+    
+    float dst = dot(ao, normal) * invDet;
+    float u = dot(edge13, dao) * invDet;
+    float v = -dot(edge12, dao) * invDet;
+    float w = 1.0 - u - v;
+
+    if (dst <= 0.001 || u < 0.0 || v < 0.0 || w < 0.0)
+    {
+        return false;
+    }
+
+    vec2 edgeUV12 = v2.TextureCoordinate - v1.TextureCoordinate;
+    vec2 edgeUV13 = v3.TextureCoordinate - v1.TextureCoordinate;
+    float detUV = edgeUV12.x * edgeUV13.y - edgeUV12.y * edgeUV13.x;
+    float invDetUV = 1.0 / detUV;
+
+    manifold = CollisionManifold(
+        dst,
+        ray.Origin + ray.Direction * dst,
+        v1.TextureCoordinate * w + v2.TextureCoordinate * u + v3.TextureCoordinate * v,
+        0.5 * log2(abs(detUV) / length(normal)),
+        normalize(v1.Normal * w + v2.Normal * u + v3.Normal * v),
+        normalize((edge12 * edgeUV13.y - edge13 * edgeUV12.y) * invDetUV),
+        normalize((edge13 * edgeUV12.x - edge12 * edgeUV13.x) * invDetUV),
+        materialId,
+        det >= 0);
+    return true;
+}
+
+bool AABBIntersection(in Ray ray, in vec3 boxMin, in vec3 boxMax, out float tNear, out float tFar)
+{
+    vec3 tMin = (boxMin - ray.Origin) * ray.InvDirection;
+    vec3 tMax = (boxMax - ray.Origin) * ray.InvDirection;
+    vec3 t1 = min(tMin, tMax);
+    vec3 t2 = max(tMin, tMax);
+    tNear = max(max(t1.x, t1.y), t1.z);
+    tFar = min(min(t2.x, t2.y), t2.z);
+    return tNear <= tFar && tFar >= 0;
+}
+
+void LeafIntersection(in Ray ray, in Mesh mesh, in int start, in int count, in bool firstHit, in float localMinRenderDistance, inout CollisionManifold manifold)
+{
+    for (int o = 0; o < count; ++o)
+    {
+        Triangle triangle = GetTriangle(start + o + mesh.TriangleOffset);
+
+        Vertex v1 = GetVertex(triangle.V1);
+        Vertex v2 = GetVertex(triangle.V2);
+        Vertex v3 = GetVertex(triangle.V3);
+
+        CollisionManifold current;
+        if (TriangleIntersection(ray, v1, v2, v3, mesh.MaterialId, current) && current.Depth < manifold.Depth && (!firstHit || current.Depth >= localMinRenderDistance))
+        {
+            manifold = current;
+        }
+    }
+}
+
+void BinaryBVHIntersection(in Ray ray, in Mesh mesh, in bool firstHit, in float localMinRenderDistance, inout CollisionManifold manifold)
+{
+    float bbhits[4];
+
+    vec2 todo[64];
+    int stackptr = 0;
+
+    todo[stackptr] = vec2(mesh.NodeOffset, -1);
+
+    while (stackptr >= 0)
+    {
+        int ni = int(todo[stackptr].x);
+        float near = todo[stackptr].y;
+        stackptr--;
+
+        Node node = GetNode(ni);
+
+        if (near > manifold.Depth) continue;
+
+        if (node.RightOffset == 0)
+        {
+            LeafIntersection(ray, mesh, node.Start, node.PrimitiveCount, firstHit, localMinRenderDistance, manifold);
+        }
+        else
+        {
+            Node c0 = GetNode(ni + 1);
+            Node c1 = GetNode(ni + node.RightOffset);
+
+            bool hitc0 = AABBIntersection(ray, c0.BboxMin, c0.BboxMax, bbhits[0], bbhits[1]);
+            bool hitc1 = AABBIntersection(ray, c1.BboxMin, c1.BboxMax, bbhits[2], bbhits[3]);
+
+            if (hitc0 && hitc1)
+            {
+                int closer = ni + 1;
+                int other = ni + node.RightOffset;
+
+                if (bbhits[2] < bbhits[0])
+                {
+                    swap(bbhits[0], bbhits[2]);
+                    swap(bbhits[1], bbhits[3]);
+                    swap(closer, other);
+                }
+
+                todo[++stackptr] = vec2(other, bbhits[2]);
+                todo[++stackptr] = vec2(closer, bbhits[0]);
+            }
+            else if (hitc0)
+            {
+                todo[++stackptr] = vec2(ni + 1, bbhits[0]);
+            }
+            else if (hitc1)
+            {
+                todo[++stackptr] = vec2(ni + node.RightOffset, bbhits[2]);
+            }
+        }
+    }
+}
+
+void WideBVHIntersection(in Ray ray, in Mesh mesh, in bool firstHit, in float localMinRenderDistance, inout CollisionManifold manifold)
+{
+    // Up to 3 pending entries per level, the wide tree is at most half as deep as the binary one
+    vec2 todo[80];
+    int stackptr = 0;
+
+    todo[stackptr] = vec2(mesh.NodeOffset, -1);
+
+    while (stackptr >= 0)
+    {
+        int ni = int(todo[stackptr].x);
+        float near = todo[stackptr].y;
+        stackptr--;
+
+        if (near > manifold.Depth) continue;
+
+        if (ni < 0)
+        {
+            Node leaf = GetNode(-ni - 1);
+            LeafIntersection(ray, mesh, leaf.Start, leaf.PrimitiveCount, firstHit, localMinRenderDistance, manifold);
+            continue;
+        }
+
+        // Sort the hit children by distance
+        float nears[4];
+        int order[4];
+        int hitCount = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            Node child = GetNode(ni + i);
+
+            float tNear, tFar;
+            if ((child.PrimitiveCount == 0 && child.RightOffset == 0) ||
+                !AABBIntersection(ray, child.BboxMin, child.BboxMax, tNear, tFar))
+            {
+                continue;
+            }
+
+            int j = hitCount++;
+            for (; j > 0 && nears[j - 1] > tNear; j--)
+            {
+                nears[j] = nears[j - 1];
+                order[j] = order[j - 1];
+            }
+
+            nears[j] = tNear;
+            order[j] = i;
+        }
+
+        // Pushed farthest first, leaf children are pushed as negative record indices
+        for (int i = hitCount - 1; i >= 0; i--)
+        {
+            int rightOffset = int(texelFetch(BVH, (ni + order[i]) * 3 + 2).z);
+            todo[++stackptr] = vec2(rightOffset == 0 ? -(ni + order[i]) - 1 : ni + rightOffset, nears[i]);
+        }
+    }
+}
+
+void QuantizedBVHIntersection(in Ray ray, in Mesh mesh, in bool firstHit, in float localMinRenderDistance, inout CollisionManifold manifold)
+{
+    // See Scene::quantizeBVH for the layout of the words
+    uint boundWords = BVHQuantizationBits * 3u / 4u;
+    int nodeSize = int(boundWords + 9u) / 4;
+
+    // Integer indices, so large scenes do not lose precision
+    int todo[80];
+    float todoNear[80];
+    int stackptr = 0;
+
+    todo[stackptr] = int(mesh.NodeOffset);
+    todoNear[stackptr] = -1;
+
+    while (stackptr >= 0)
+    {
+        int ni = todo[stackptr];
+        float near = todoNear[stackptr];
+        stackptr--;
+
+        if (near > manifold.Depth) continue;
+
+        if (ni < 0)
+        {
+            // Leaf children are pushed as negative child indices
+            int record = -ni - 1;
+            uint child = uint(record & 3);
+            int base = (record >> 2) * nodeSize;
+            uint countWord = boundWords + child / 2u;
+            uint referenceWord = boundWords + 2u + child;
+            uint count = (texelFetch(BVHData, base + int(countWord / 4u))[countWord % 4u] >> (16u * (child % 2u))) & 0xFFFFu;
+            uint start = texelFetch(BVHData, base + int(referenceWord / 4u))[referenceWord % 4u];
+            LeafIntersection(ray, mesh, int(start), int(count), firstHit, localMinRenderDistance, manifold);
+            continue;
+        }
+
+        vec3 origin = texelFetch(BVH, ni * 2 + 0).xyz;
+        vec3 scale = texelFetch(BVH, ni * 2 + 1).xyz;
+        uvec4 data1 = texelFetch(BVHData, ni * nodeSize + 0);
+        uvec4 data2 = texelFetch(BVHData, ni * nodeSize + 1);
+        uvec4 data3 = texelFetch(BVHData, ni * nodeSize + 2);
+
+        // Unpack the four children at once
+        uvec4 minX, minY, minZ, maxX, maxY, maxZ, counts, references;
+        uvec4 countShifts = uvec4(0u, 16u, 0u, 16u);
+        if (BVHQuantizationBits == 8u)
+        {
+            uvec4 shifts = uvec4(0u, 8u, 16u, 24u);
+            minX = (uvec4(data1.x) >> shifts) & 0xFFu;
+            minY = (uvec4(data1.y) >> shifts) & 0xFFu;
+            minZ = (uvec4(data1.z) >> shifts) & 0xFFu;
+            maxX = (uvec4(data1.w) >> shifts) & 0xFFu;
+            maxY = (uvec4(data2.x) >> shifts) & 0xFFu;
+            maxZ = (uvec4(data2.y) >> shifts) & 0xFFu;
+            counts = (data2.zzww >> countShifts) & 0xFFFFu;
+            references = data3;
+        }
+        else
+        {
+            uvec4 data4 = texelFetch(BVHData, ni * nodeSize + 3);
+            uvec4 data5 = texelFetch(BVHData, ni * nodeSize + 4);
+            minX = (data1.xxyy >> countShifts) & 0xFFFFu;
+            minY = (data1.zzww >> countShifts) & 0xFFFFu;
+            minZ = (data2.xxyy >> countShifts) & 0xFFFFu;
+            maxX = (data2.zzww >> countShifts) & 0xFFFFu;
+            maxY = (data3.xxyy >> countShifts) & 0xFFFFu;
+            maxZ = (data3.zzww >> countShifts) & 0xFFFFu;
+            counts = (data4.xxyy >> countShifts) & 0xFFFFu;
+            references = uvec4(data4.zw, data5.xy);
+        }
+
+        // Slab test of the four children at once, same operations as AABBIntersection
+        vec4 x1 = (origin.x + vec4(minX) * scale.x - ray.Origin.x) * ray.InvDirection.x;
+        vec4 x2 = (origin.x + vec4(maxX) * scale.x - ray.Origin.x) * ray.InvDirection.x;
+        vec4 y1 = (origin.y + vec4(minY) * scale.y - ray.Origin.y) * ray.InvDirection.y;
+        vec4 y2 = (origin.y + vec4(maxY) * scale.y - ray.Origin.y) * ray.InvDirection.y;
+        vec4 z1 = (origin.z + vec4(minZ) * scale.z - ray.Origin.z) * ray.InvDirection.z;
+        vec4 z2 = (origin.z + vec4(maxZ) * scale.z - ray.Origin.z) * ray.InvDirection.z;
+        vec4 tNear = max(max(min(x1, x2), min(y1, y2)), min(z1, z2));
+        vec4 tFar = min(min(max(x1, x2), max(y1, y2)), max(z1, z2));
+        uvec4 hits = uvec4(lessThanEqual(tNear, tFar)) & uvec4(greaterThanEqual(tFar, vec4(0))) & uvec4(notEqual(counts | references, uvec4(0u)));
+
+        // Sort the hit children by distance
+        float nears[4];
+        int entries[4];
+        int hitCount = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            if (hits[i] == 0u)
+            {
+                continue;
+            }
+
+            int j = hitCount++;
+            for (; j > 0 && nears[j - 1] > tNear[i]; j--)
+            {
+                nears[j] = nears[j - 1];
+                entries[j] = entries[j - 1];
+            }
+
+            nears[j] = tNear[i];
+            entries[j] = counts[i] != 0u ? -(ni * 4 + i) - 1 : ni + int(references[i]);
+        }
+
+        // Pushed farthest first
+        for (int i = hitCount - 1; i >= 0; i--)
+        {
+            stackptr++;
+            todo[stackptr] = entries[i];
+            todoNear[stackptr] = nears[i];
+        }
+    }
+}
+
+bool MeshIntersection(in Ray ray, in Mesh mesh, in bool firstHit, out CollisionManifold manifold)
+{
+    vec3 rayOrigin = ray.Origin;
+    ray.Origin = Transform(ray.Origin, mesh.TransformInv, true);
+    ray.Direction = normalize(Transform(ray.Direction, mesh.TransformInv, false));
+    ray.InvDirection = 1 / ray.Direction;
+
+    float localMinRenderDistance = length(Transform(ray.Direction * MinRenderDistance, mesh.TransformInv, false));
+    float localMaxRenderDistance = length(Transform(ray.Direction * MaxRenderDistance, mesh.TransformInv, false));
+    manifold.Depth = localMaxRenderDistance;
+
+    if (BVHLayout == BVH_LAYOUT_WIDE)
+    {
+        WideBVHIntersection(ray, mesh, firstHit, localMinRenderDistance, manifold);
+    }
+    else if (BVHLayout == BVH_LAYOUT_QUANTIZED)
+    {
+        QuantizedBVHIntersection(ray, mesh, firstHit, localMinRenderDistance, manifold);
+    }
+    else
+    {
+        BinaryBVHIntersection(ray, mesh, firstHit, localMinRenderDistance, manifold);
+    }
+
+    if (manifold.Depth < localMaxRenderDistance)
+    {
+        manifold.Point = Transform(manifold.Point, mesh.Transform, true);
+        manifold.Depth = length(manifold.Point - rayOrigin);
+        manifold.UVDensity += log2(localMaxRenderDistance / MaxRenderDistance);
+        manifold.Normal = normalize(Transform(manifold.Normal, mesh.Transform, false));
+        manifold.Tangent = normalize(Transform(manifold.Tangent, mesh.Transform, false));
+        manifold.Bitangent = normalize(Transform(manifold.Bitangent, mesh.Transform, false));
+        return true;
+    }
+
+    return false;
+}
+
+bool FindIntersection(in Ray ray, in bool firstHit, out CollisionManifold manifold)
+{
+    manifold.Depth = MaxRenderDistance;
+
+    if (textureSize(TLAS) == 0)
+    {
+        return false;
+    }
+
+    float bbhits[4];
+
+    Node root = GetTLASNode(0);
+    if (!AABBIntersection(ray, root.BboxMin, root.BboxMax, bbhits[0], bbhits[1]))
+    {
+        return false;
+    }
+
+    vec2 todo[64];
+    int stackptr = 0;
+
+    todo[stackptr] = vec2(0, bbhits[0]);
+
+    while (stackptr >= 0)
+    {
+        int ni = int(todo[stackptr].x);
+        float near = todo[stackptr].y;
+        stackptr--;
+
+        if (near > manifold.Depth) continue;
+
+        Node node = GetTLASNode(ni);
+
+        if (node.RightOffset == 0)
+        {
+            // Leaf nodes hold a single mesh
+            CollisionManifold current;
+            if (MeshIntersection(ray, GetMesh(node.Start), firstHit, current) && current.Depth < manifold.Depth)
+            {
+                manifold = current;
+            }
+        }
+        else
+        {
+            Node c0 = GetTLASNode(ni + 1);
+            Node c1 = GetTLASNode(ni + node.RightOffset);
+
+            bool hitc0 = AABBIntersection(ray, c0.BboxMin, c0.BboxMax, bbhits[0], bbhits[1]);
+            bool hitc1 = AABBIntersection(ray, c1.BboxMin, c1.BboxMax, bbhits[2], bbhits[3]);
+
+            if (hitc0 && hitc1)
+            {
+                int closer = ni + 1;
+                int other = ni + node.RightOffset;
+
+                if (bbhits[2] < bbhits[0])
+                {
+                    swap(bbhits[0], bbhits[2]);
+                    swap(bbhits[1], bbhits[3]);
+                    swap(closer, other);
+                }
+
+                todo[++stackptr] = vec2(other, bbhits[2]);
+                todo[++stackptr] = vec2(closer, bbhits[0]);
+            }
+            else if (hitc0)
+            {
+                todo[++stackptr] = vec2(ni + 1, bbhits[0]);
+            }
+            else if (hitc1)
+            {
+                todo[++stackptr] = vec2(ni + node.RightOffset, bbhits[2]);
+            }
+        }
+    }
+
+    return manifold.Depth < MaxRenderDistance;
+}
+// The light sample of the last Lambertian bounce, its light counts once the shadow ray reaches the light
+Ray ShadowRay;
+float ShadowDistance = 0;
+
+float PowerHeuristic(float pdf, float otherPdf)
+{
+    float pdf2 = pdf * pdf;
+    return pdf2 / (pdf2 + otherPdf * otherPdf);
+}
+
+bool HasEnvironmentLight()
+{
+    return Environment.Intensity > 0 && texelFetch(EnvironmentDistribution, 0).x > 0;
+}
+
+// Share of the light samples taken by the emissive triangles, the environment takes the rest
+float GetTriangleLightShare()
+{
+    if (GetLightCount() == 0)
+    {
+        return 0;
+    }
+
+    return HasEnvironmentLight() ? 0.5 : 1;
+}
+
+// Solid angle density of picking a point of an emissive material by light sampling
+float GetLightPdf(int materialId, float distance, float cosine)
+{
+    if (GetLightCount() == 0)
+    {
+        return 0;
+    }
+
+    return GetTriangleLightShare() * GetLightAreaPdf(materialId) * distance * distance / max(cosine, 1e-6);
+}
+
+// Solid angle density of picking a direction of the environment by light sampling
+float GetEnvironmentPdf(in vec3 direction)
+{
+    if (!HasEnvironmentLight())
+    {
+        return 0;
+    }
+
+    vec4 header = texelFetch(EnvironmentDistribution, 0);
+    ivec2 size = ivec2(header.xy);
+    direction = Environment.Rotation * direction;
+    float u = atan(direction.z, direction.x) * INV_TWO_PI + 0.5;
+    float v = acos(clamp(direction.y, -1.0, 1.0)) * INV_PI;
+    ivec2 pixel = min(ivec2(vec2(u, v) * size), size - 1);
+    float weight = texelFetch(EnvironmentDistribution, 1 + size.y + pixel.y * size.x + pixel.x).z;
+    float sinTheta = sqrt(max(1 - direction.y * direction.y, 0));
+    return (1 - GetTriangleLightShare()) * weight * header.z * size.x * size.y * INV_TWO_PI * INV_PI / max(sinTheta, 1e-6);
+}
+
+// Environment reached by the path, the escapes after a Lambertian bounce were sampled there as well
+vec3 GetEnvironmentLight(in Ray ray)
+{
+    vec3 light = GetEnvironment(ray);
+    if (ray.ScatterPdf > 0.0)
+    {
+        light *= PowerHeuristic(ray.ScatterPdf, GetEnvironmentPdf(ray.Direction));
+    }
+
+    return light;
+}
+
+// The shadow rays pass through the surfaces the paths pass through
+bool IsTransmitted(in Ray ray, in CollisionManifold manifold)
+{
+    Material material = GetMaterial(manifold.MaterialId);
+    float footprint = manifold.UVDensity + log2(ray.ConeWidth / max(abs(dot(manifold.Normal, ray.Direction)), 0.01));
+    if (material.AlbedoTextureId >= 0 && GetTexture(material.AlbedoTextureId, manifold.TextureCoordinate, footprint).a < RandomValue())
+    {
+        return true;
+    }
+
+    if (material.Density <= 0.0)
+    {
+        return false;
+    }
+
+    vec3 normal = manifold.IsFrontFace ? manifold.Normal : -manifold.Normal;
+    if (material.FresnelStrength > 0.0 &&
+        1.0 - pow(dot(normal, -ray.Direction), material.FresnelStrength) >= RandomValue())
+    {
+        return false;
+    }
+
+    return manifold.IsFrontFace || -log(RandomValue()) / material.Density >= manifold.Depth;
+}
+
+// Follows the shadow ray past the surface it found, the light is added once the ray reaches it
+void ContinueShadow(inout Ray ray, bool isHit, in CollisionManifold manifold)
+{
+    if (!isHit || manifold.Depth >= ShadowDistance)
+    {
+        ray.IncomingLight += ShadowRay.IncomingLight;
+        ShadowDistance = 0;
+        return;
+    }
+
+    ShadowRay.ConeWidth += ShadowRay.ConeSpread * manifold.Depth;
+    if (!IsTransmitted(ShadowRay, manifold))
+    {
+        ShadowDistance = 0;
+        return;
+    }
+
+    ShadowRay.Origin = manifold.Point;
+    ShadowDistance -= manifold.Depth;
+}
+
+// Picks a point on an emissive triangle in proportion to its power
+void SampleTriangleLight(in Ray ray, in CollisionManifold manifold, in vec3 albedo, float share)
+{
+    int lightCount = GetLightCount();
+
+    // Alias table
+    float slot = RandomValue() * lightCount;
+    int index = min(int(slot), lightCount - 1);
+    Light light = GetLight(index);
+    if (slot - index >= light.Probability)
+    {
+        light = GetLight(light.Alias);
+    }
+
+    Mesh mesh = GetMesh(light.MeshId);
+    Triangle triangle = GetTriangle(light.TriangleId);
+    Vertex v1 = GetVertex(triangle.V1);
+    Vertex v2 = GetVertex(triangle.V2);
+    Vertex v3 = GetVertex(triangle.V3);
+
+    // Uniform point on the triangle
+    vec2 value = RandomValue2();
+    float r = sqrt(value.x);
+    float s = value.y;
+    vec3 weights = vec3(1 - r, r * (1 - s), r * s);
+
+    vec3 p1 = Transform(v1.Position, mesh.Transform, true);
+    vec3 p2 = Transform(v2.Position, mesh.Transform, true);
+    vec3 p3 = Transform(v3.Position, mesh.Transform, true);
+    vec3 normal = cross(p2 - p1, p3 - p1);
+    vec3 toLight = p1 * weights.x + p2 * weights.y + p3 * weights.z - manifold.Point;
+    float distance = length(toLight);
+    vec3 direction = toLight / distance;
+    float cosine = dot(manifold.Normal, direction);
+    float lightCosine = abs(dot(normal, direction)) / length(normal);
+    if (cosine <= 0 || lightCosine <= 0)
+    {
+        return;
+    }
+
+    Material material = GetMaterial(mesh.MaterialId);
+    vec2 uv = v1.TextureCoordinate * weights.x + v2.TextureCoordinate * weights.y + v3.TextureCoordinate * weights.z;
+    vec2 edgeUV12 = v2.TextureCoordinate - v1.TextureCoordinate;
+    vec2 edgeUV13 = v3.TextureCoordinate - v1.TextureCoordinate;
+    float uvDensity = 0.5 * log2(abs(edgeUV12.x * edgeUV13.y - edgeUV12.y * edgeUV13.x) / length(normal));
+    float footprint = uvDensity + log2((ray.ConeWidth + ray.ConeSpread * distance) / max(lightCosine, 0.01));
+
+    vec3 emission = material.EmissionColor * material.EmissionStrength;
+    if (material.EmissionTextureId >= 0)
+    {
+        emission *= GetTexture(material.EmissionTextureId, uv, footprint).rgb;
+    }
+
+    // Alpha blended lights are only there for a part of the paths
+    if (material.AlbedoTextureId >= 0)
+    {
+        emission *= GetTexture(material.AlbedoTextureId, uv, footprint).a;
+    }
+
+    if (emission == vec3(0))
+    {
+        return;
+    }
+
+    // The hits of the BSDF sampling only know the interpolated normal, the weights use it on both sides
+    float areaPdf = GetLightAreaPdf(mesh.MaterialId);
+    vec3 lightNormal = normalize(Transform(v1.Normal * weights.x + v2.Normal * weights.y + v3.Normal * weights.z, mesh.Transform, false));
+    float weight = PowerHeuristic(GetLightPdf(mesh.MaterialId, distance, abs(dot(lightNormal, direction))), cosine * INV_PI);
+
+    vec3 contribution = emission * albedo * INV_PI * cosine * weight * lightCosine / (share * areaPdf * distance * distance);
+    ShadowRay = Ray(manifold.Point, direction, 1 / direction, vec3(1), contribution * ray.Color, ray.ConeWidth, ray.ConeSpread, 0, 0);
+
+    // Stop short of the light itself
+    ShadowDistance = distance * 0.999;
+}
+
+// Picks a direction of the environment in proportion to its luminance
+void SampleEnvironmentLight(in Ray ray, in CollisionManifold manifold, in vec3 albedo, float share)
+{
+    vec4 header = texelFetch(EnvironmentDistribution, 0);
+    ivec2 size = ivec2(header.xy);
+
+    // Row from the alias table of the rows, then the pixel from the alias table of the row
+    vec2 value = RandomValue2();
+    float slot = value.x * size.y;
+    int row = min(int(slot), size.y - 1);
+    vec4 entry = texelFetch(EnvironmentDistribution, 1 + row);
+    if (slot - row >= entry.x)
+    {
+        row = int(entry.y);
+    }
+
+    slot = value.y * size.x;
+    int column = min(int(slot), size.x - 1);
+    entry = texelFetch(EnvironmentDistribution, 1 + size.y + row * size.x + column);
+    if (slot - column >= entry.x)
+    {
+        column = int(entry.y);
+        entry = texelFetch(EnvironmentDistribution, 1 + size.y + row * size.x + column);
+    }
+
+    // Uniform point in the pixel, mapped the same way as GetEnvironment
+    value = RandomValue2();
+    float phi = ((column + value.x) / size.x - 0.5) * TWO_PI;
+    float theta = (row + value.y) / size.y * TWO_PI * 0.5;
+    float sinTheta = sin(theta);
+    vec3 direction = transpose(Environment.Rotation) * vec3(sinTheta * cos(phi), cos(theta), sinTheta * sin(phi));
+    float cosine = dot(manifold.Normal, direction);
+    if (cosine <= 0 || sinTheta <= 0)
+    {
+        return;
+    }
+
+    float pdf = share * entry.z * header.z * size.x * size.y * INV_TWO_PI * INV_PI / sinTheta;
+    float weight = PowerHeuristic(pdf, cosine * INV_PI);
+    ShadowRay = Ray(manifold.Point, direction, 1 / direction, vec3(1), vec3(0), ray.ConeWidth, ray.ConeSpread, 0, 0);
+    ShadowRay.IncomingLight = GetEnvironment(ShadowRay) * albedo * INV_PI * cosine * weight / pdf * ray.Color;
+
+    // Nothing lies beyond the environment
+    ShadowDistance = 1e30;
+}
+
+// Samples the lights for a Lambertian surface, the shadow ray carries their light weighted against the BSDF sampling
+void SampleLight(in Ray ray, in CollisionManifold manifold, in vec3 albedo)
+{
+    ShadowDistance = 0;
+    float triangleShare = GetTriangleLightShare();
+    if (triangleShare == 0 && !HasEnvironmentLight())
+    {
+        return;
+    }
+
+    if (RandomValue() < triangleShare)
+    {
+        SampleTriangleLight(ray, manifold, albedo, triangleShare);
+    }
+    else
+    {
+        SampleEnvironmentLight(ray, manifold, albedo, 1 - triangleShare);
+    }
+}
+// Starts the next segment of the path, the pdf is only known for Lambertian bounces
+void Bounce(inout Ray ray, in vec3 origin, in vec3 direction, float pdf)
+{
+    ray.Origin = origin;
+    ray.Direction = direction;
+    ray.ScatterPdf = pdf;
+    ray.ScatterDistance = 0;
+}
+
+bool CollisionReact(inout Ray ray, inout CollisionManifold manifold)
+{
+    Material material = GetMaterial(manifold.MaterialId);
+    ray.ScatterDistance += manifold.Depth;
+
+    // Ray cone footprint, without the size of the texture
+    float footprint = manifold.UVDensity + log2(ray.ConeWidth / max(abs(dot(manifold.Normal, ray.Direction)), 0.01));
+
+    if (material.AlbedoTextureId >= 0)
+    {
+        vec4 texAlbedo = GetTexture(material.AlbedoTextureId, manifold.TextureCoordinate, footprint);
+        material.AlbedoColor *= texAlbedo.rgb;
+
+        // Alpha blend
+        if (texAlbedo.a < RandomValue())
+        {
+            return false;
+        }
+    }
+
+    if (material.MetalnessTextureId >= 0)
+    {
+        material.Metalness *= GetTexture(material.MetalnessTextureId, manifold.TextureCoordinate, footprint).b;
+    }
+
+    if (material.RoughnessTextureId >= 0)
+    {
+        material.Roughness *= GetTexture(material.RoughnessTextureId, manifold.TextureCoordinate, footprint).g;
+    }
+
+    material.EmissionColor *= material.EmissionStrength;
+    if (material.EmissionTextureId >= 0)
+    {
+        material.EmissionColor *= GetTexture(material.EmissionTextureId, manifold.TextureCoordinate, footprint).rgb;
+    }
+
+    // Lights found after a Lambertian bounce were sampled there as well
+    if (ray.ScatterPdf > 0.0)
+    {
+        float lightPdf = GetLightPdf(manifold.MaterialId, ray.ScatterDistance, abs(dot(manifold.Normal, ray.Direction)));
+        material.EmissionColor *= PowerHeuristic(ray.ScatterPdf, lightPdf);
+    }
+
+    if (material.NormalTextureId >= 0)
+    {
+        vec3 texNormal = GetTexture(material.NormalTextureId, manifold.TextureCoordinate, footprint).rgb;
+        texNormal.y = 1 - texNormal.y;
+        texNormal = normalize(texNormal * 2 - 1);
+        manifold.Normal = normalize(manifold.Tangent * texNormal.x + manifold.Bitangent * texNormal.y + manifold.Normal * texNormal.z);
+    }
+
+    if (!manifold.IsFrontFace)
+    {
+        manifold.Normal *= -1;
+    }
+
+    vec3 specularDir = reflect(ray.Direction, manifold.Normal);
+    vec3 diffuseDir = normalize(RandomVector3() + manifold.Normal);
+
+    if (material.Metalness <= RandomValue() && RandomValue() >= 0.2)
+    {
+        material.Roughness = 1;
+    }
+
+    // Fresnel
+    if (material.FresnelStrength > 0.0 &&
+        1.0 - pow(dot(manifold.Normal, -ray.Direction), material.FresnelStrength) >= RandomValue())
+    {
+        Bounce(ray, manifold.Point, specularDir, 0);
+
+        ray.IncomingLight += material.EmissionColor * ray.Color;
+        ray.Color *= material.FresnelColor;
+        return true;
+    }
+
+    // Density
+    if (material.Density > 0.0)
+    {
+        float depth = -log(RandomValue()) / material.Density;
+        if (manifold.IsFrontFace || depth >= manifold.Depth)
+        {
+            return false;
+        }
+
+        Bounce(ray, ray.Origin + ray.Direction * depth, RandomVector3(), 0);
+
+        ray.IncomingLight += material.EmissionColor * ray.Color;
+        ray.Color *= material.AlbedoColor;
+        return true;
+    }
+
+    // Refract
+    if (material.IOR > 0.0)
+    {
+        vec3 refractedDir = refract(ray.Direction, manifold.Normal, manifold.IsFrontFace ? 1.0 / material.IOR : material.IOR);
+        if (refractedDir == vec3(0))
+        {
+            refractedDir = specularDir;
+        }
+
+        Bounce(ray, manifold.Point, refractedDir, 0);
+
+        ray.IncomingLight += material.EmissionColor * ray.Color;
+        ray.Color *= material.AlbedoColor;
+        return true;
+    }
+
+    // Scatter
+    ray.IncomingLight += material.EmissionColor * ray.Color;
+    if (material.Roughness >= 1.0)
+    {
+        // Lambertian, the cosine weighted direction is combined with a light sample
+        SampleLight(ray, manifold, material.AlbedoColor);
+        Bounce(ray, manifold.Point, diffuseDir, max(dot(manifold.Normal, diffuseDir), 0) * INV_PI);
+    }
+    else
+    {
+        Bounce(ray, manifold.Point, Slerp(specularDir, diffuseDir, material.Roughness), 0);
+    }
+
+    ray.Color *= material.AlbedoColor;
+    return true;
+}
+
+// Russian roulette, the paths carrying little light stop early and the survivors are weighted up so the mean is kept
+bool SurviveRoulette(inout Ray ray, uint bounce)
+{
+    if (RussianRouletteDepth == 0u || bounce < RussianRouletteDepth)
+    {
+        return true;
+    }
+
+    float probability = min(max(ray.Color.r, max(ray.Color.g, ray.Color.b)), 1.0);
+    if (probability >= 1.0)
+    {
+        return true;
+    }
+
+    if (RandomValue() >= probability)
+    {
+        return false;
+    }
+
+    ray.Color /= probability;
+    return true;
+}
+const uint WORKGROUP_SIZE = 64u;
+
+const uint PATH_BACKGROUND = 1u;
+const uint PATH_CONVERGED  = 2u;
+
+// The queue of the paths whose shadow ray waits for the occlusion stage
+const uint SHADOW_QUEUE = 2u;
+
+// Origin.w is the cone width, Direction.w the cone spread, Color.w the scatter pdf, IncomingLight.w the scatter distance,
+// State holds the seed, the bounce, the sample dimension and the flags
+struct Path
+{
+    vec4 Origin;
+    vec4 Direction;
+    vec4 Color;
+    vec4 IncomingLight;
+    uvec4 State;
+};
+
+// The collision manifold found by the intersection stage, Info holds the material, the face and the hit flag
+struct Hit
+{
+    vec4 PointDepth;
+    vec4 NormalUVDensity;
+    vec4 TangentU;
+    vec4 BitangentV;
+    ivec4 Info;
+};
+
+// The shadow ray of a light sample, Origin.w is the distance left to the light, Direction.w the cone width, IncomingLight.w the cone spread
+struct Shadow
+{
+    vec4 Origin;
+    vec4 Direction;
+    vec4 IncomingLight;
+};
+
+layout(std430, binding=0) buffer PathBuffer { Path Paths[]; };
+layout(std430, binding=1) buffer HitBuffer { Hit Hits[]; };
+layout(std430, binding=2) buffer QueueBuffer { uint Queues[]; };
+layout(std430, binding=3) buffer CounterBuffer { uint DispatchX; uint DispatchY; uint DispatchZ; uint QueueSizes[3]; };
+layout(std430, binding=4) buffer ShadowBuffer { Shadow Shadows[]; };
+
+layout(binding=0, rgba32f) uniform image2D AccumulatorImage;
+layout(binding=1, rgba32f) uniform image2D AlbedoImage;
+layout(binding=2, rgba32f) uniform image2D NormalImage;
+layout(binding=3, rgba32f) uniform image2D MomentsImage;
+
+uniform uvec2 RectPosition;
+uniform uvec2 RectSize;
+uniform uint Queue;
+uniform uint QueueCapacity;
+
+uint GetInvocationIndex()
+{
+    return (gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x) * WORKGROUP_SIZE + gl_LocalInvocationID.x;
+}
+
+ivec2 GetPixel(uint pathId)
+{
+    return ivec2(RectPosition + uvec2(pathId % RectSize.x, pathId / RectSize.x));
+}
+
+void PushPath(uint queue, uint pathId)
+{
+    uint slot = atomicAdd(QueueSizes[queue], 1u);
+    Queues[queue * QueueCapacity + slot] = pathId;
+}
+
+Ray LoadRay(in Path path)
+{
+    return Ray(path.Origin.xyz, path.Direction.xyz, 1 / path.Direction.xyz, path.Color.rgb, path.IncomingLight.rgb, path.Origin.w, path.Direction.w, path.Color.w, path.IncomingLight.w);
+}
+
+Path StorePath(in Ray ray, uint bounce, uint flags)
+{
+    return Path(vec4(ray.Origin, ray.ConeWidth), vec4(ray.Direction, ray.ConeSpread), vec4(ray.Color, ray.ScatterPdf), vec4(ray.IncomingLight, ray.ScatterDistance), uvec4(Seed, bounce, SampleDimension, flags));
+}
+
+Ray LoadShadowRay(in Shadow shadow)
+{
+    return Ray(shadow.Origin.xyz, shadow.Direction.xyz, 1 / shadow.Direction.xyz, vec3(1), shadow.IncomingLight.rgb, shadow.Direction.w, shadow.IncomingLight.w, 0, 0);
+}
+
+Shadow StoreShadow(in Ray shadowRay, float distance)
+{
+    return Shadow(vec4(shadowRay.Origin, distance), vec4(shadowRay.Direction, shadowRay.ConeWidth), vec4(shadowRay.IncomingLight, shadowRay.ConeSpread));
+}
+
+// Evaluates the material of every queued path and queues the paths that keep bouncing
+void main()
+{
+    uint index = GetInvocationIndex();
+    if (index >= QueueSizes[Queue])
+    {
+        return;
+    }
+
+    uint pathId = Queues[Queue * QueueCapacity + index];
+    Path path = Paths[pathId];
+    Hit hit = Hits[pathId];
+    Ray ray = LoadRay(path);
+    uint bounce = path.State.y;
+    uint flags = path.State.w;
+    ivec2 pixel = GetPixel(pathId);
+    InitSampler(uvec2(pixel));
+    Seed = path.State.x;
+    SampleDimension = path.State.z;
+
+    if (hit.Info.z == 0)
+    {
+        ray.IncomingLight += GetEnvironmentLight(ray) * ray.Color;
+        if (bounce == 0)
+        {
+            flags |= PATH_BACKGROUND;
+            imageStore(AlbedoImage, pixel, ToneMap(vec4(ray.IncomingLight, 1), Gamma));
+            imageStore(NormalImage, pixel, vec4((1 - ray.Direction) / 2, 1));
+        }
+
+        Paths[pathId] = StorePath(ray, bounce, flags);
+        return;
+    }
+
+    CollisionManifold manifold = CollisionManifold(
+        hit.PointDepth.w,
+        hit.PointDepth.xyz,
+        vec2(hit.TangentU.w, hit.BitangentV.w),
+        hit.NormalUVDensity.w,
+        hit.NormalUVDensity.xyz,
+        hit.TangentU.xyz,
+        hit.BitangentV.xyz,
+        hit.Info.x,
+        hit.Info.y != 0);
+
+    ray.ConeWidth += ray.ConeSpread * manifold.Depth;
+    bool isBounce = CollisionReact(ray, manifold);
+    bool isTerminated = false;
+
+    if (isBounce)
+    {
+        if (bounce == 0)
+        {
+            imageStore(AlbedoImage, pixel, ToneMap(vec4(ray.Color, 1), Gamma));
+            imageStore(NormalImage, pixel, vec4((manifold.Normal + 1) / 2, 1));
+        }
+
+        bounce++;
+        StartSampleBounce(bounce);
+        isTerminated = !SurviveRoulette(ray, bounce);
+    }
+    else
+    {
+        ray.Origin = manifold.Point;
+    }
+
+    Paths[pathId] = StorePath(ray, bounce, flags);
+
+    // The shadow ray of a light sample is traced by the occlusion stage, so this stage never traverses the hierarchy
+    if (ShadowDistance > 0)
+    {
+        Shadows[pathId] = StoreShadow(ShadowRay, ShadowDistance);
+        PushPath(SHADOW_QUEUE, pathId);
+    }
+
+    if (bounce <= MaxBounceCount && !isTerminated)
+    {
+        PushPath(1u - Queue, pathId);
+    }
+}
+
+)";
+
+const char* WavefrontTracer::occlusionShaderSrc =
+R"(
+#version 430 core
+
+layout(local_size_x=64) in;
+
+struct Ray
+{
+    vec3 Origin;
+    vec3 Direction;
+    vec3 InvDirection;
+    vec3 Color;
+    vec3 IncomingLight;
+    float ConeWidth;
+    float ConeSpread;
+    float ScatterPdf;
+    float ScatterDistance;
+};
+
+struct Env
+{
+    bool Transparent;
+    float Intensity;
+    mat3 Rotation;
+};
+
+struct Cam
+{
+    vec3 Position;
+    vec3 Forward;
+    vec3 Up;
+    float FOV;
+    float FocalDistance;
+    float Aperture;
+    float Blur;
+};
+
+struct Material
+{
+    vec3 AlbedoColor;
+    float Roughness;
+    vec3 EmissionColor;
+    float EmissionStrength;
+    vec3 FresnelColor;
+    float FresnelStrength;
+    float Metalness;
+    float IOR;
+    float Density;
+    int AlbedoTextureId;
+    int MetalnessTextureId;
+    int EmissionTextureId;
+    int RoughnessTextureId;
+    int NormalTextureId;
+};
+
+struct Vertex
+{
+    vec3 Position;
+    vec3 Normal;
+    vec2 TextureCoordinate;
+};
+
+struct Triangle
+{
+    int V1;
+    int V2;
+    int V3;
+};
+
+struct Mesh
+{
+    mat4 Transform;
+    mat4 TransformInv;
+    int MaterialId;
+    int NodeOffset;
+    int TriangleOffset;
+};
+
+struct CollisionManifold
+{
+    float Depth;
+    vec3 Point;
+    vec2 TextureCoordinate;
+    float UVDensity;
+    vec3 Normal;
+    vec3 Tangent;
+    vec3 Bitangent;
+    int MaterialId;
+    bool IsFrontFace;
+};
+
+struct Light
+{
+    float Probability;
+    int Alias;
+    int MeshId;
+    int TriangleId;
+};
+
+struct Node
+{
+    vec3 BboxMin;
+    vec3 BboxMax;
+    int Start;
+    int PrimitiveCount;
+    int RightOffset;
+};
+const float INV_PI     = 0.31830988618379067;
+const float INV_TWO_PI = 0.15915494309189533;
+
+const uint BVH_LAYOUT_BINARY = 0u;
+const uint BVH_LAYOUT_WIDE   = 1u;
+const uint BVH_LAYOUT_QUANTIZED = 2u;
+
+layout(binding=0) uniform sampler2D AccumulatorTexture;
+layout(binding=1) uniform sampler2D EnvironmentTexture;
+layout(binding=2) uniform sampler2DArray Textures;
+layout(binding=3) uniform samplerBuffer Vertices;
+layout(binding=4) uniform isamplerBuffer Triangles;
+layout(binding=5) uniform samplerBuffer Meshes;
+layout(binding=6) uniform samplerBuffer Materials;
+layout(binding=7) uniform samplerBuffer BVH;
+layout(binding=8) uniform samplerBuffer TLAS;
+layout(binding=9) uniform usamplerBuffer BVHData;
+layout(binding=11) uniform sampler2DArray HalfTextures;
+layout(binding=12) uniform samplerBuffer TextureInfo;
+layout(binding=13) uniform sampler2D MomentsTexture;
+layout(binding=14) uniform sampler2D AlbedoTexture;
+layout(binding=15) uniform sampler2D NormalTexture;
+layout(binding=16) uniform samplerBuffer Lights;
+layout(binding=17) uniform samplerBuffer EnvironmentDistribution;
+layout(binding=18) uniform samplerBuffer BlueNoise;
+layout(binding=19) uniform usamplerBuffer MeshOffsets;
+
+// Only uploaded when the settings change, the layout is mirrored by Renderer::Settings
+layout(std140, binding=0) uniform Settings
+{
+    Cam Camera;
+    Env Environment;
+    uint MaxBounceCount;
+    float MinRenderDistance;
+    float MaxRenderDistance;
+    uint BVHLayout;
+    uint BVHQuantizationBits;
+    float Gamma;
+    float AdaptiveThreshold;
+    uint AdaptiveMinFrameCount;
+    uint SamplerType;
+    uint RussianRouletteDepth;
+};
+
+uniform uint FrameCount;
+
+Triangle GetTriangle(int index)
+{
+    ivec4 data = texelFetch(Triangles, index);
+    return Triangle(data.x, data.y, data.z);
+}
+
+Vertex GetVertex(int index)
+{
+    vec4 data1 = texelFetch(Vertices, index * 2 + 0);
+    vec4 data2 = texelFetch(Vertices, index * 2 + 1);
+    return Vertex(data1.xyz, data2.xyz, vec2(data1.w, data2.w));
+}
+
+Mesh GetMesh(int index)
+{
+    vec4 data1 = texelFetch(Meshes, index * 9 + 0);
+    vec4 data2 = texelFetch(Meshes, index * 9 + 1);
+    vec4 data3 = texelFetch(Meshes, index * 9 + 2);
+    vec4 data4 = texelFetch(Meshes, index * 9 + 3);
+    vec4 data5 = texelFetch(Meshes, index * 9 + 4);
+    vec4 data6 = texelFetch(Meshes, index * 9 + 5);
+    vec4 data7 = texelFetch(Meshes, index * 9 + 6);
+    vec4 data8 = texelFetch(Meshes, index * 9 + 7);
+    vec4 data9 = texelFetch(Meshes, index * 9 + 8);
+    uvec4 offsets = texelFetch(MeshOffsets, index);
+    return Mesh(mat4(data1, data2, data3, data4), mat4(data5, data6, data7, data8), int(data9.x), int(offsets.x), int(offsets.y));
+}
+
+int GetMeshCount()
+{
+    return textureSize(Meshes) / 9;
+}
+
+Material GetMaterial(int index)
+{
+    // Meshes without a material get the default one of the Material class
+    if (index < 0 || index >= textureSize(Materials) / 5)
+    {
+        return Material(vec3(1), 0, vec3(1), 0, vec3(1), 0, 0, 0, 0, -1, -1, -1, -1, -1);
+    }
+
+    vec4 data1 = texelFetch(Materials, index * 5 + 0);
+    vec4 data2 = texelFetch(Materials, index * 5 + 1);
+    vec4 data3 = texelFetch(Materials, index * 5 + 2);
+    vec4 data4 = texelFetch(Materials, index * 5 + 3);
+    vec4 data5 = texelFetch(Materials, index * 5 + 4);
+    return Material(data1.rgb, data1.a, data2.rgb, data2.a, data3.rgb, data3.a, data4.x, data4.y, data4.z, int(data4.w), int(data5.x), int(data5.y), int(data5.z), int(data5.w));
+}
+
+int GetLightCount()
+{
+    return textureSize(Lights) == 0 ? 0 : int(texelFetch(Lights, 0).x);
+}
+
+Light GetLight(int index)
+{
+    vec4 data = texelFetch(Lights, index + 1);
+    return Light(data.x, int(data.y), int(data.z), int(data.w));
+}
+
+float GetLightAreaPdf(int materialId)
+{
+    return texelFetch(Lights, GetLightCount() + 1 + materialId).x;
+}
+
+Node GetNode(int index)
+{
+    vec4 data1 = texelFetch(BVH, index * 3 + 0);
+    vec4 data2 = texelFetch(BVH, index * 3 + 1);
+    vec4 data3 = texelFetch(BVH, index * 3 + 2);
+    return Node(data1.xyz, data2.xyz, int(data3.x), int(data3.y), int(data3.z));
+}
+
+Node GetTLASNode(int index)
+{
+    vec4 data1 = texelFetch(TLAS, index * 3 + 0);
+    vec4 data2 = texelFetch(TLAS, index * 3 + 1);
+    vec4 data3 = texelFetch(TLAS, index * 3 + 2);
+    return Node(data1.xyz, data2.xyz, int(data3.x), int(data3.y), int(data3.z));
+}
+
+vec4 GetTexel(ivec3 coord, bool isHalf)
+{
+    return isHalf ? texelFetch(HalfTextures, coord, 0) : texelFetch(Textures, coord, 0);
+}
+
+vec4 GetTextureLevel(int entry, vec2 uv)
+{
+    // Bilinear filtering with repeat wrapping inside the atlas rectangle of the level
+    vec4 rect = texelFetch(TextureInfo, entry + 0);
+    vec4 info = texelFetch(TextureInfo, entry + 1);
+    bool isHalf = info.y > 0;
+
+    vec2 coord = uv * rect.zw - 0.5;
+    vec2 base = floor(coord);
+    vec2 t = coord - base;
+    ivec2 p0 = ivec2(rect.xy + mod(base, rect.zw));
+    ivec2 p1 = ivec2(rect.xy + mod(base + 1, rect.zw));
+    int layer = int(info.x);
+
+    vec4 c00 = GetTexel(ivec3(p0.x, p0.y, layer), isHalf);
+    vec4 c10 = GetTexel(ivec3(p1.x, p0.y, layer), isHalf);
+    vec4 c01 = GetTexel(ivec3(p0.x, p1.y, layer), isHalf);
+    vec4 c11 = GetTexel(ivec3(p1.x, p1.y, layer), isHalf);
+    return mix(mix(c00, c10, t.x), mix(c01, c11, t.x), t.y);
+}
+
+vec4 GetTexture(int textureId, vec2 uv, float footprint)
+{
+    if (any(isnan(uv)) || any(isinf(uv)))
+    {
+        return vec4(0);
+    }
+
+    // Trilinear filtering, the level of detail is the footprint measured in texels of the first level
+    vec4 header = texelFetch(TextureInfo, textureId);
+    int entry = int(header.x);
+    vec4 rect = texelFetch(TextureInfo, entry);
+    float lod = clamp(footprint + 0.5 * log2(rect.z * rect.w), 0, header.y - 1);
+    int level = int(lod);
+    float t = lod - level;
+
+    vec4 color = GetTextureLevel(entry + level * 2, uv);
+    if (t > 0)
+    {
+        color = mix(color, GetTextureLevel(entry + level * 2 + 2, uv), t);
+    }
+
+    return color;
+}
+
+vec3 GetEnvironment(in Ray ray)
+{
+    vec3 direction = Environment.Rotation * ray.Direction;
+    float u = atan(direction.z, direction.x) * INV_TWO_PI + 0.5;
+    float v = acos(direction.y) * INV_PI;
+    float lod = log2(ray.ConeSpread * textureSize(EnvironmentTexture, 0).y * INV_PI);
+    return textureLod(EnvironmentTexture, vec2(u, v), lod).rgb * Environment.Intensity;
+}
+const float TWO_PI     = 6.28318530717958648;
+
+const uint SAMPLER_RANDOM     = 0u;
+const uint SAMPLER_SOBOL      = 1u;
+const uint SAMPLER_BLUE_NOISE = 2u;
+
+// The camera takes the first dimensions, every bounce starts a block so that the samples of a pixel line up
+const uint CAMERA_DIMENSIONS = 4u;
+const uint BOUNCE_DIMENSIONS = 16u;
+const uint BLUE_NOISE_SIZE   = 64u;
+
+uint Seed;
+uvec2 SamplePixel;
+uint SampleDimension;
+
+uint Hash(uint x)
+{
+    x = x * 747796405u + 2891336453u;
+    x = ((x >> ((x >> 28) + 4u)) ^ x) * 277803737u;
+    return (x >> 22) ^ x;
+}
+
+void InitSampler(uvec2 pixel)
+{
+    SamplePixel = pixel;
+    SampleDimension = 0u;
+    Seed = Hash(pixel.x ^ Hash(pixel.y ^ Hash(FrameCount)));
+}
+
+// Moves to the block of the bounce, unless the previous bounce already went past its start
+void StartSampleBounce(uint bounce)
+{
+    SampleDimension = max(SampleDimension, CAMERA_DIMENSIONS + bounce * BOUNCE_DIMENSIONS);
+}
+
+// Hash based Owen scrambling, every bit is flipped depending on the bits above it (Laine-Karras permutation)
+uint OwenScramble(uint x, uint seed)
+{
+    x = bitfieldReverse(x);
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return bitfieldReverse(x);
+}
+
+// Second dimension of the Sobol sequence, the first one is the index with its bits reversed
+uint Sobol1(uint index)
+{
+    uint result = 0u;
+    for (uint direction = 1u << 31; index != 0u; index >>= 1, direction ^= direction >> 1)
+    {
+        if ((index & 1u) != 0u)
+        {
+            result ^= direction;
+        }
+    }
+
+    return result;
+}
+
+// Every pair of dimensions is a two dimensional Sobol sequence with its samples shuffled, so that the pairs are independent
+uint SobolSample(uint index, uint dimension, uint seed)
+{
+    index = OwenScramble(index, Hash(seed ^ Hash(dimension >> 1)));
+    uint value = (dimension & 1u) == 0u ? bitfieldReverse(index) : Sobol1(index);
+    return OwenScramble(value, Hash(seed ^ Hash(dimension) ^ 0x68bc21ebu));
+}
+
+float RandomValue()
+{
+    if (SamplerType == SAMPLER_RANDOM)
+    {
+        Seed = Seed * 747796405u + 2891336453u;
+        uint result = ((Seed >> ((Seed >> 28) + 4u)) ^ Seed) * 277803737u;
+        result = (result >> 22) ^ result;
+        return float(result) / 4294967295.0;
+    }
+
+    uint dimension = SampleDimension++;
+    uint value;
+    if (SamplerType == SAMPLER_SOBOL)
+    {
+        value = SobolSample(FrameCount, dimension, Hash(SamplePixel.x ^ Hash(SamplePixel.y)));
+    }
+    else
+    {
+        // The same sequence for all pixels, shifted modulo 1 by the mask offset for the dimension
+        uint offset = Hash(dimension);
+        uvec2 maskPixel = (SamplePixel + uvec2(offset, offset >> 16)) % BLUE_NOISE_SIZE;
+        float shift = texelFetch(BlueNoise, int(maskPixel.y * BLUE_NOISE_SIZE + maskPixel.x)).r;
+        value = SobolSample(FrameCount, dimension, 0u) + uint(shift * 4294967296.0);
+    }
+
+    // Strictly between 0 and 1
+    return (float(value >> 9) + 0.5) / 8388608.0;
+}
+
+// Two values of the same pair of dimensions, the Sobol samplers stratify them together
+vec2 RandomValue2()
+{
+    SampleDimension += SampleDimension & 1u;
+    float x = RandomValue();
+    float y = RandomValue();
+    return vec2(x, y);
+}
+
+vec2 RandomVector2()
+{
+    vec2 value = RandomValue2();
+    float angle = value.x * TWO_PI;
+    return vec2(cos(angle), sin(angle)) * sqrt(value.y);
+}
+
+// Uniform direction, from two values so that it keeps the stratification of the samplers
+vec3 RandomVector3()
+{
+    vec2 value = RandomValue2();
+    float z = 1 - 2 * value.x;
+    float radius = sqrt(max(1 - z * z, 0));
+    float angle = value.y * TWO_PI;
+    return vec3(radius * cos(angle), radius * sin(angle), z);
+}
+vec3 Slerp(in vec3 a, in vec3 b, float t)
+{
+    float angle = acos(dot(a, b));
+    return isnan(angle) || angle == 0 ? b : (sin((1 - t) * angle) * a + sin(t * angle) * b) / sin(angle);
+}
+
+vec3 Transform(in vec3 v, in mat4 matrix, in bool translate)
+{
+    return (matrix * vec4(v, translate ? 1 : 0)).xyz;
+}
+
+float Luminance(in vec3 color)
+{
+    return dot(color, vec3(.2126, .7152, .0722));
+}
+
+vec4 ToneMap(in vec4 pixel, in float gamma)
+{
+    // Reinhard tone mapping
+    pixel.rgb = pixel.rgb / (pixel.rgb + vec3(1));
+
+    // Gamma correction
+    pixel.rgb = pow(pixel.rgb, vec3(1 / gamma));
+
+    return pixel;
+}
+void swap(inout float a, inout float b)
+{
+    float tmp = a;
+    a = b;
+    b = tmp;
+}
+
+void swap(inout int a, inout int b)
+{
+    int tmp = a;
+    a = b;
+    b = tmp;
+}
+
+bool TriangleIntersection(in Ray ray, in Vertex v1, in Vertex v2, in Vertex v3, in int materialId, out CollisionManifold manifold)
+{
+    vec3 edge12 = v2.Position - v1.Position;
+    vec3 edge13 = v3.Position - v1.Position;
+    vec3 normal = cross(edge12, edge13);
+    float det = -dot(ray.Direction, normal);
+
+    if (abs(det) <= length(normal) * 0.01)
+    {
+        return false;
+    }
+
+    vec3 ao = ray.Origin - v1.Position;
+    vec3 dao = cross(ao, ray.Direction);
+
+    float invDet = 1.0 / det;
+    
+    float dst = dot(ao, normal) * invDet;
+    float u = dot(edge13, dao) * invDet;
+    float v = -dot(edge12, dao) * invDet;
+    float w = 1.0 - u - v;
+
+    if (dst <= 0.001 || u < 0.0 || v < 0.0 || w < 0.0)
+    {
+        return false;
+    }
+
+    vec2 edgeUV12 = v2.TextureCoordinate - v1.TextureCoordinate;
+    vec2 edgeUV13 = v3.TextureCoordinate - v1.TextureCoordinate;
+    float detUV = edgeUV12.x * edgeUV13.y - edgeUV12.y * edgeUV13.x;
+    float invDetUV = 1.0 / detUV;
+
+    manifold = CollisionManifold(
+        dst,
+        ray.Origin + ray.Direction * dst,
+        v1.TextureCoordinate * w + v2.TextureCoordinate * u + v3.TextureCoordinate * v,
+        0.5 * log2(abs(detUV) / length(normal)),
+        normalize(v1.Normal * w + v2.Normal * u + v3.Normal * v),
+        normalize((edge12 * edgeUV13.y - edge13 * edgeUV12.y) * invDetUV),
+        normalize((edge13 * edgeUV12.x - edge12 * edgeUV13.x) * invDetUV),
+        materialId,
+        det >= 0);
+    return true;
+}
+
+bool AABBIntersection(in Ray ray, in vec3 boxMin, in vec3 boxMax, out float tNear, out float tFar)
+{
+    vec3 tMin = (boxMin - ray.Origin) * ray.InvDirection;
+    vec3 tMax = (boxMax - ray.Origin) * ray.InvDirection;
+    vec3 t1 = min(tMin, tMax);
+    vec3 t2 = max(tMin, tMax);
+    tNear = max(max(t1.x, t1.y), t1.z);
+    tFar = min(min(t2.x, t2.y), t2.z);
+    return tNear <= tFar && tFar >= 0;
+}
+
+void LeafIntersection(in Ray ray, in Mesh mesh, in int start, in int count, in bool firstHit, in float localMinRenderDistance, inout CollisionManifold manifold)
+{
+    for (int o = 0; o < count; ++o)
+    {
+        Triangle triangle = GetTriangle(start + o + mesh.TriangleOffset);
+
+        Vertex v1 = GetVertex(triangle.V1);
+        Vertex v2 = GetVertex(triangle.V2);
+        Vertex v3 = GetVertex(triangle.V3);
+
+        CollisionManifold current;
+        if (TriangleIntersection(ray, v1, v2, v3, mesh.MaterialId, current) && current.Depth < manifold.Depth && (!firstHit || current.Depth >= localMinRenderDistance))
+        {
+            manifold = current;
+        }
+    }
+}
+
+void BinaryBVHIntersection(in Ray ray, in Mesh mesh, in bool firstHit, in float localMinRenderDistance, inout CollisionManifold manifold)
+{
+    float bbhits[4];
+
+    vec2 todo[64];
+    int stackptr = 0;
+
+    todo[stackptr] = vec2(mesh.NodeOffset, -1);
+
+    while (stackptr >= 0)
+    {
+        int ni = int(todo[stackptr].x);
+        float near = todo[stackptr].y;
+        stackptr--;
+
+        Node node = GetNode(ni);
+
+        if (near > manifold.Depth) continue;
+
+        if (node.RightOffset == 0)
+        {
+            LeafIntersection(ray, mesh, node.Start, node.PrimitiveCount, firstHit, localMinRenderDistance, manifold);
+        }
+        else
+        {
+            Node c0 = GetNode(ni + 1);
+            Node c1 = GetNode(ni + node.RightOffset);
+
+            bool hitc0 = AABBIntersection(ray, c0.BboxMin, c0.BboxMax, bbhits[0], bbhits[1]);
+            bool hitc1 = AABBIntersection(ray, c1.BboxMin, c1.BboxMax, bbhits[2], bbhits[3]);
+
+            if (hitc0 && hitc1)
+            {
+                int closer = ni + 1;
+                int other = ni + node.RightOffset;
+
+                if (bbhits[2] < bbhits[0])
+                {
+                    swap(bbhits[0], bbhits[2]);
+                    swap(bbhits[1], bbhits[3]);
+                    swap(closer, other);
+                }
+
+                todo[++stackptr] = vec2(other, bbhits[2]);
+                todo[++stackptr] = vec2(closer, bbhits[0]);
+            }
+            else if (hitc0)
+            {
+                todo[++stackptr] = vec2(ni + 1, bbhits[0]);
+            }
+            else if (hitc1)
+            {
+                todo[++stackptr] = vec2(ni + node.RightOffset, bbhits[2]);
+            }
+        }
+    }
+}
+
+void WideBVHIntersection(in Ray ray, in Mesh mesh, in bool firstHit, in float localMinRenderDistance, inout CollisionManifold manifold)
+{
+    // Up to 3 pending entries per level, the wide tree is at most half as deep as the binary one
+    vec2 todo[80];
+    int stackptr = 0;
+
+    todo[stackptr] = vec2(mesh.NodeOffset, -1);
+
+    while (stackptr >= 0)
+    {
+        int ni = int(todo[stackptr].x);
+        float near = todo[stackptr].y;
+        stackptr--;
+
+        if (near > manifold.Depth) continue;
+
+        if (ni < 0)
+        {
+            Node leaf = GetNode(-ni - 1);
+            LeafIntersection(ray, mesh, leaf.Start, leaf.PrimitiveCount, firstHit, localMinRenderDistance, manifold);
+            continue;
+        }
+
+        // Sort the hit children by distance
+        float nears[4];
+        int order[4];
+        int hitCount = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            Node child = GetNode(ni + i);
+
+            float tNear, tFar;
+            if ((child.PrimitiveCount == 0 && child.RightOffset == 0) ||
+                !AABBIntersection(ray, child.BboxMin, child.BboxMax, tNear, tFar))
+            {
+                continue;
+            }
+
+            int j = hitCount++;
+            for (; j > 0 && nears[j - 1] > tNear; j--)
+            {
+                nears[j] = nears[j - 1];
+                order[j] = order[j - 1];
+            }
+
+            nears[j] = tNear;
+            order[j] = i;
+        }
+
+        // Pushed farthest first, leaf children are pushed as negative record indices
+        for (int i = hitCount - 1; i >= 0; i--)
+        {
+            int rightOffset = int(texelFetch(BVH, (ni + order[i]) * 3 + 2).z);
+            todo[++stackptr] = vec2(rightOffset == 0 ? -(ni + order[i]) - 1 : ni + rightOffset, nears[i]);
+        }
+    }
+}
+
+void QuantizedBVHIntersection(in Ray ray, in Mesh mesh, in bool firstHit, in float localMinRenderDistance, inout CollisionManifold manifold)
+{
+    // See Scene::quantizeBVH for the layout of the words
+    uint boundWords = BVHQuantizationBits * 3u / 4u;
+    int nodeSize = int(boundWords + 9u) / 4;
+
+    // Integer indices, so large scenes do not lose precision
+    int todo[80];
+    float todoNear[80];
+    int stackptr = 0;
+
+    todo[stackptr] = int(mesh.NodeOffset);
+    todoNear[stackptr] = -1;
+
+    while (stackptr >= 0)
+    {
+        int ni = todo[stackptr];
+        float near = todoNear[stackptr];
+        stackptr--;
+
+        if (near > manifold.Depth) continue;
+
+        if (ni < 0)
+        {
+            // Leaf children are pushed as negative child indices
+            int record = -ni - 1;
+            uint child = uint(record & 3);
+            int base = (record >> 2) * nodeSize;
+            uint countWord = boundWords + child / 2u;
+            uint referenceWord = boundWords + 2u + child;
+            uint count = (texelFetch(BVHData, base + int(countWord / 4u))[countWord % 4u] >> (16u * (child % 2u))) & 0xFFFFu;
+            uint start = texelFetch(BVHData, base + int(referenceWord / 4u))[referenceWord % 4u];
+            LeafIntersection(ray, mesh, int(start), int(count), firstHit, localMinRenderDistance, manifold);
+            continue;
+        }
+
+        vec3 origin = texelFetch(BVH, ni * 2 + 0).xyz;
+        vec3 scale = texelFetch(BVH, ni * 2 + 1).xyz;
+        uvec4 data1 = texelFetch(BVHData, ni * nodeSize + 0);
+        uvec4 data2 = texelFetch(BVHData, ni * nodeSize + 1);
+        uvec4 data3 = texelFetch(BVHData, ni * nodeSize + 2);
+
+        // Unpack the four children at once
+        uvec4 minX, minY, minZ, maxX, maxY, maxZ, counts, references;
+        uvec4 countShifts = uvec4(0u, 16u, 0u, 16u);
+        if (BVHQuantizationBits == 8u)
+        {
+            uvec4 shifts = uvec4(0u, 8u, 16u, 24u);
+            minX = (uvec4(data1.x) >> shifts) & 0xFFu;
+            minY = (uvec4(data1.y) >> shifts) & 0xFFu;
+            minZ = (uvec4(data1.z) >> shifts) & 0xFFu;
+            maxX = (uvec4(data1.w) >> shifts) & 0xFFu;
+            maxY = (uvec4(data2.x) >> shifts) & 0xFFu;
+            maxZ = (uvec4(data2.y) >> shifts) & 0xFFu;
+            counts = (data2.zzww >> countShifts) & 0xFFFFu;
+            references = data3;
+        }
+        else
+        {
+            uvec4 data4 = texelFetch(BVHData, ni * nodeSize + 3);
+            uvec4 data5 = texelFetch(BVHData, ni * nodeSize + 4);
+            minX = (data1.xxyy >> countShifts) & 0xFFFFu;
+            minY = (data1.zzww >> countShifts) & 0xFFFFu;
+            minZ = (data2.xxyy >> countShifts) & 0xFFFFu;
+            maxX = (data2.zzww >> countShifts) & 0xFFFFu;
+            maxY = (data3.xxyy >> countShifts) & 0xFFFFu;
+            maxZ = (data3.zzww >> countShifts) & 0xFFFFu;
+            counts = (data4.xxyy >> countShifts) & 0xFFFFu;
+            references = uvec4(data4.zw, data5.xy);
+        }
+
+        // Slab test of the four children at once, same operations as AABBIntersection
+        vec4 x1 = (origin.x + vec4(minX) * scale.x - ray.Origin.x) * ray.InvDirection.x;
+        vec4 x2 = (origin.x + vec4(maxX) * scale.x - ray.Origin.x) * ray.InvDirection.x;
+        vec4 y1 = (origin.y + vec4(minY) * scale.y - ray.Origin.y) * ray.InvDirection.y;
+        vec4 y2 = (origin.y + vec4(maxY) * scale.y - ray.Origin.y) * ray.InvDirection.y;
+        vec4 z1 = (origin.z + vec4(minZ) * scale.z - ray.Origin.z) * ray.InvDirection.z;
+        vec4 z2 = (origin.z + vec4(maxZ) * scale.z - ray.Origin.z) * ray.InvDirection.z;
+        vec4 tNear = max(max(min(x1, x2), min(y1, y2)), min(z1, z2));
+        vec4 tFar = min(min(max(x1, x2), max(y1, y2)), max(z1, z2));
+        uvec4 hits = uvec4(lessThanEqual(tNear, tFar)) & uvec4(greaterThanEqual(tFar, vec4(0))) & uvec4(notEqual(counts | references, uvec4(0u)));
+
+        // Sort the hit children by distance
+        float nears[4];
+        int entries[4];
+        int hitCount = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            if (hits[i] == 0u)
+            {
+                continue;
+            }
+
+            int j = hitCount++;
+            for (; j > 0 && nears[j - 1] > tNear[i]; j--)
+            {
+                nears[j] = nears[j - 1];
+                entries[j] = entries[j - 1];
+            }
+
+            nears[j] = tNear[i];
+            entries[j] = counts[i] != 0u ? -(ni * 4 + i) - 1 : ni + int(references[i]);
+        }
+
+        // Pushed farthest first
+        for (int i = hitCount - 1; i >= 0; i--)
+        {
+            stackptr++;
+            todo[stackptr] = entries[i];
+            todoNear[stackptr] = nears[i];
+        }
+    }
+}
+
+bool MeshIntersection(in Ray ray, in Mesh mesh, in bool firstHit, out CollisionManifold manifold)
+{
+    vec3 rayOrigin = ray.Origin;
+    ray.Origin = Transform(ray.Origin, mesh.TransformInv, true);
+    ray.Direction = normalize(Transform(ray.Direction, mesh.TransformInv, false));
+    ray.InvDirection = 1 / ray.Direction;
+
+    float localMinRenderDistance = length(Transform(ray.Direction * MinRenderDistance, mesh.TransformInv, false));
+    float localMaxRenderDistance = length(Transform(ray.Direction * MaxRenderDistance, mesh.TransformInv, false));
+    manifold.Depth = localMaxRenderDistance;
+
+    if (BVHLayout == BVH_LAYOUT_WIDE)
+    {
+        WideBVHIntersection(ray, mesh, firstHit, localMinRenderDistance, manifold);
+    }
+    else if (BVHLayout == BVH_LAYOUT_QUANTIZED)
+    {
+        QuantizedBVHIntersection(ray, mesh, firstHit, localMinRenderDistance, manifold);
+    }
+    else
+    {
+        BinaryBVHIntersection(ray, mesh, firstHit, localMinRenderDistance, manifold);
+    }
+
+    if (manifold.Depth < localMaxRenderDistance)
+    {
+        manifold.Point = Transform(manifold.Point, mesh.Transform, true);
+        manifold.Depth = length(manifold.Point - rayOrigin);
+        manifold.UVDensity += log2(localMaxRenderDistance / MaxRenderDistance);
+        manifold.Normal = normalize(Transform(manifold.Normal, mesh.Transform, false));
+        manifold.Tangent = normalize(Transform(manifold.Tangent, mesh.Transform, false));
+        manifold.Bitangent = normalize(Transform(manifold.Bitangent, mesh.Transform, false));
+        return true;
+    }
+
+    return false;
+}
+
+bool FindIntersection(in Ray ray, in bool firstHit, out CollisionManifold manifold)
+{
+    manifold.Depth = MaxRenderDistance;
+
+    if (textureSize(TLAS) == 0)
+    {
+        return false;
+    }
+
+    float bbhits[4];
+
+    Node root = GetTLASNode(0);
+    if (!AABBIntersection(ray, root.BboxMin, root.BboxMax, bbhits[0], bbhits[1]))
+    {
+        return false;
+    }
+
+    vec2 todo[64];
+    int stackptr = 0;
+
+    todo[stackptr] = vec2(0, bbhits[0]);
+
+    while (stackptr >= 0)
+    {
+        int ni = int(todo[stackptr].x);
+        float near = todo[stackptr].y;
+        stackptr--;
+
+        if (near > manifold.Depth) continue;
+
+        Node node = GetTLASNode(ni);
+
+        if (node.RightOffset == 0)
+        {
+            // Leaf nodes hold a single mesh
+            CollisionManifold current;
+            if (MeshIntersection(ray, GetMesh(node.Start), firstHit, current) && current.Depth < manifold.Depth)
+            {
+                manifold = current;
+            }
+        }
+        else
+        {
+            Node c0 = GetTLASNode(ni + 1);
+            Node c1 = GetTLASNode(ni + node.RightOffset);
+
+            bool hitc0 = AABBIntersection(ray, c0.BboxMin, c0.BboxMax, bbhits[0], bbhits[1]);
+            bool hitc1 = AABBIntersection(ray, c1.BboxMin, c1.BboxMax, bbhits[2], bbhits[3]);
+
+            if (hitc0 && hitc1)
+            {
+                int closer = ni + 1;
+                int other = ni + node.RightOffset;
+
+                if (bbhits[2] < bbhits[0])
+                {
+                    swap(bbhits[0], bbhits[2]);
+                    swap(bbhits[1], bbhits[3]);
+                    swap(closer, other);
+                }
+
+                todo[++stackptr] = vec2(other, bbhits[2]);
+                todo[++stackptr] = vec2(closer, bbhits[0]);
+            }
+            else if (hitc0)
+            {
+                todo[++stackptr] = vec2(ni + 1, bbhits[0]);
+            }
+            else if (hitc1)
+            {
+                todo[++stackptr] = vec2(ni + node.RightOffset, bbhits[2]);
+            }
+        }
+    }
+
+    return manifold.Depth < MaxRenderDistance;
+}
+// The light sample of the last Lambertian bounce, its light counts once the shadow ray reaches the light
+Ray ShadowRay;
+float ShadowDistance = 0;
+
+float PowerHeuristic(float pdf, float otherPdf)
+{
+    float pdf2 = pdf * pdf;
+    return pdf2 / (pdf2 + otherPdf * otherPdf);
+}
+
+bool HasEnvironmentLight()
+{
+    return Environment.Intensity > 0 && texelFetch(EnvironmentDistribution, 0).x > 0;
+}
+
+// Share of the light samples taken by the emissive triangles, the environment takes the rest
+float GetTriangleLightShare()
+{
+    if (GetLightCount() == 0)
+    {
+        return 0;
+    }
+
+    return HasEnvironmentLight() ? 0.5 : 1;
+}
+
+// Solid angle density of picking a point of an emissive material by light sampling
+float GetLightPdf(int materialId, float distance, float cosine)
+{
+    if (GetLightCount() == 0)
+    {
+        return 0;
+    }
+
+    return GetTriangleLightShare() * GetLightAreaPdf(materialId) * distance * distance / max(cosine, 1e-6);
+}
+
+// Solid angle density of picking a direction of the environment by light sampling
+float GetEnvironmentPdf(in vec3 direction)
+{
+    if (!HasEnvironmentLight())
+    {
+        return 0;
+    }
+
+    vec4 header = texelFetch(EnvironmentDistribution, 0);
+    ivec2 size = ivec2(header.xy);
+    direction = Environment.Rotation * direction;
+    float u = atan(direction.z, direction.x) * INV_TWO_PI + 0.5;
+    float v = acos(clamp(direction.y, -1.0, 1.0)) * INV_PI;
+    ivec2 pixel = min(ivec2(vec2(u, v) * size), size - 1);
+    float weight = texelFetch(EnvironmentDistribution, 1 + size.y + pixel.y * size.x + pixel.x).z;
+    float sinTheta = sqrt(max(1 - direction.y * direction.y, 0));
+    return (1 - GetTriangleLightShare()) * weight * header.z * size.x * size.y * INV_TWO_PI * INV_PI / max(sinTheta, 1e-6);
+}
+
+// Environment reached by the path, the escapes after a Lambertian bounce were sampled there as well
+vec3 GetEnvironmentLight(in Ray ray)
+{
+    vec3 light = GetEnvironment(ray);
+    if (ray.ScatterPdf > 0.0)
+    {
+        light *= PowerHeuristic(ray.ScatterPdf, GetEnvironmentPdf(ray.Direction));
+    }
+
+    return light;
+}
+
+// The shadow rays pass through the surfaces the paths pass through
+bool IsTransmitted(in Ray ray, in CollisionManifold manifold)
+{
+    Material material = GetMaterial(manifold.MaterialId);
+    float footprint = manifold.UVDensity + log2(ray.ConeWidth / max(abs(dot(manifold.Normal, ray.Direction)), 0.01));
+    if (material.AlbedoTextureId >= 0 && GetTexture(material.AlbedoTextureId, manifold.TextureCoordinate, footprint).a < RandomValue())
+    {
+        return true;
+    }
+
+    if (material.Density <= 0.0)
+    {
+        return false;
+    }
+
+    vec3 normal = manifold.IsFrontFace ? manifold.Normal : -manifold.Normal;
+    if (material.FresnelStrength > 0.0 &&
+        1.0 - pow(dot(normal, -ray.Direction), material.FresnelStrength) >= RandomValue())
+    {
+        return false;
+    }
+
+    return manifold.IsFrontFace || -log(RandomValue()) / material.Density >= manifold.Depth;
+}
+
+// Follows the shadow ray past the surface it found, the light is added once the ray reaches it
+void ContinueShadow(inout Ray ray, bool isHit, in CollisionManifold manifold)
+{
+    if (!isHit || manifold.Depth >= ShadowDistance)
+    {
+        ray.IncomingLight += ShadowRay.IncomingLight;
+        ShadowDistance = 0;
+        return;
+    }
+
+    ShadowRay.ConeWidth += ShadowRay.ConeSpread * manifold.Depth;
+    if (!IsTransmitted(ShadowRay, manifold))
+    {
+        ShadowDistance = 0;
+        return;
+    }
+
+    ShadowRay.Origin = manifold.Point;
+    ShadowDistance -= manifold.Depth;
+}
+
+// Picks a point on an emissive triangle in proportion to its power
+void SampleTriangleLight(in Ray ray, in CollisionManifold manifold, in vec3 albedo, float share)
+{
+    int lightCount = GetLightCount();
+
+    // Alias table
+    float slot = RandomValue() * lightCount;
+    int index = min(int(slot), lightCount - 1);
+    Light light = GetLight(index);
+    if (slot - index >= light.Probability)
+    {
+        light = GetLight(light.Alias);
+    }
+
+    Mesh mesh = GetMesh(light.MeshId);
+    Triangle triangle = GetTriangle(light.TriangleId);
+    Vertex v1 = GetVertex(triangle.V1);
+    Vertex v2 = GetVertex(triangle.V2);
+    Vertex v3 = GetVertex(triangle.V3);
+
+    // Uniform point on the triangle
+    vec2 value = RandomValue2();
+    float r = sqrt(value.x);
+    float s = value.y;
+    vec3 weights = vec3(1 - r, r * (1 - s), r * s);
+
+    vec3 p1 = Transform(v1.Position, mesh.Transform, true);
+    vec3 p2 = Transform(v2.Position, mesh.Transform, true);
+    vec3 p3 = Transform(v3.Position, mesh.Transform, true);
+    vec3 normal = cross(p2 - p1, p3 - p1);
+    vec3 toLight = p1 * weights.x + p2 * weights.y + p3 * weights.z - manifold.Point;
+    float distance = length(toLight);
+    vec3 direction = toLight / distance;
+    float cosine = dot(manifold.Normal, direction);
+    float lightCosine = abs(dot(normal, direction)) / length(normal);
+    if (cosine <= 0 || lightCosine <= 0)
+    {
+        return;
+    }
+
+    Material material = GetMaterial(mesh.MaterialId);
+    vec2 uv = v1.TextureCoordinate * weights.x + v2.TextureCoordinate * weights.y + v3.TextureCoordinate * weights.z;
+    vec2 edgeUV12 = v2.TextureCoordinate - v1.TextureCoordinate;
+    vec2 edgeUV13 = v3.TextureCoordinate - v1.TextureCoordinate;
+    float uvDensity = 0.5 * log2(abs(edgeUV12.x * edgeUV13.y - edgeUV12.y * edgeUV13.x) / length(normal));
+    float footprint = uvDensity + log2((ray.ConeWidth + ray.ConeSpread * distance) / max(lightCosine, 0.01));
+
+    vec3 emission = material.EmissionColor * material.EmissionStrength;
+    if (material.EmissionTextureId >= 0)
+    {
+        emission *= GetTexture(material.EmissionTextureId, uv, footprint).rgb;
+    }
+
+    // Alpha blended lights are only there for a part of the paths
+    if (material.AlbedoTextureId >= 0)
+    {
+        emission *= GetTexture(material.AlbedoTextureId, uv, footprint).a;
+    }
+
+    if (emission == vec3(0))
+    {
+        return;
+    }
+
+    // The hits of the BSDF sampling only know the interpolated normal, the weights use it on both sides
+    float areaPdf = GetLightAreaPdf(mesh.MaterialId);
+    vec3 lightNormal = normalize(Transform(v1.Normal * weights.x + v2.Normal * weights.y + v3.Normal * weights.z, mesh.Transform, false));
+    float weight = PowerHeuristic(GetLightPdf(mesh.MaterialId, distance, abs(dot(lightNormal, direction))), cosine * INV_PI);
+
+    vec3 contribution = emission * albedo * INV_PI * cosine * weight * lightCosine / (share * areaPdf * distance * distance);
+    ShadowRay = Ray(manifold.Point, direction, 1 / direction, vec3(1), contribution * ray.Color, ray.ConeWidth, ray.ConeSpread, 0, 0);
+
+    // Stop short of the light itself
+    ShadowDistance = distance * 0.999;
+}
+
+// Picks a direction of the environment in proportion to its luminance
+void SampleEnvironmentLight(in Ray ray, in CollisionManifold manifold, in vec3 albedo, float share)
+{
+    vec4 header = texelFetch(EnvironmentDistribution, 0);
+    ivec2 size = ivec2(header.xy);
+
+    // Row from the alias table of the rows, then the pixel from the alias table of the row
+    vec2 value = RandomValue2();
+    float slot = value.x * size.y;
+    int row = min(int(slot), size.y - 1);
+    vec4 entry = texelFetch(EnvironmentDistribution, 1 + row);
+    if (slot - row >= entry.x)
+    {
+        row = int(entry.y);
+    }
+
+    slot = value.y * size.x;
+    int column = min(int(slot), size.x - 1);
+    entry = texelFetch(EnvironmentDistribution, 1 + size.y + row * size.x + column);
+    if (slot - column >= entry.x)
+    {
+        column = int(entry.y);
+        entry = texelFetch(EnvironmentDistribution, 1 + size.y + row * size.x + column);
+    }
+
+    // Uniform point in the pixel, mapped the same way as GetEnvironment
+    value = RandomValue2();
+    float phi = ((column + value.x) / size.x - 0.5) * TWO_PI;
+    float theta = (row + value.y) / size.y * TWO_PI * 0.5;
+    float sinTheta = sin(theta);
+    vec3 direction = transpose(Environment.Rotation) * vec3(sinTheta * cos(phi), cos(theta), sinTheta * sin(phi));
+    float cosine = dot(manifold.Normal, direction);
+    if (cosine <= 0 || sinTheta <= 0)
+    {
+        return;
+    }
+
+    float pdf = share * entry.z * header.z * size.x * size.y * INV_TWO_PI * INV_PI / sinTheta;
+    float weight = PowerHeuristic(pdf, cosine * INV_PI);
+    ShadowRay = Ray(manifold.Point, direction, 1 / direction, vec3(1), vec3(0), ray.ConeWidth, ray.ConeSpread, 0, 0);
+    ShadowRay.IncomingLight = GetEnvironment(ShadowRay) * albedo * INV_PI * cosine * weight / pdf * ray.Color;
+
+    // Nothing lies beyond the environment
+    ShadowDistance = 1e30;
+}
+
+// Samples the lights for a Lambertian surface, the shadow ray carries their light weighted against the BSDF sampling
+void SampleLight(in Ray ray, in CollisionManifold manifold, in vec3 albedo)
+{
+    ShadowDistance = 0;
+    float triangleShare = GetTriangleLightShare();
+    if (triangleShare == 0 && !HasEnvironmentLight())
+    {
+        return;
+    }
+
+    if (RandomValue() < triangleShare)
+    {
+        SampleTriangleLight(ray, manifold, albedo, triangleShare);
+    }
+    else
+    {
+        SampleEnvironmentLight(ray, manifold, albedo, 1 - triangleShare);
+    }
+}
+const uint WORKGROUP_SIZE = 64u;
+
+const uint PATH_BACKGROUND = 1u;
+const uint PATH_CONVERGED  = 2u;
+
+// The queue of the paths whose shadow ray waits for the occlusion stage
+const uint SHADOW_QUEUE = 2u;
+
+// Origin.w is the cone width, Direction.w the cone spread, Color.w the scatter pdf, IncomingLight.w the scatter distance,
+// State holds the seed, the bounce, the sample dimension and the flags
+struct Path
+{
+    vec4 Origin;
+    vec4 Direction;
+    vec4 Color;
+    vec4 IncomingLight;
+    uvec4 State;
+};
+
+// The collision manifold found by the intersection stage, Info holds the material, the face and the hit flag
+struct Hit
+{
+    vec4 PointDepth;
+    vec4 NormalUVDensity;
+    vec4 TangentU;
+    vec4 BitangentV;
+    ivec4 Info;
+};
+
+// The shadow ray of a light sample, Origin.w is the distance left to the light, Direction.w the cone width, IncomingLight.w the cone spread
+struct Shadow
+{
+    vec4 Origin;
+    vec4 Direction;
+    vec4 IncomingLight;
+};
+
+layout(std430, binding=0) buffer PathBuffer { Path Paths[]; };
+layout(std430, binding=1) buffer HitBuffer { Hit Hits[]; };
+layout(std430, binding=2) buffer QueueBuffer { uint Queues[]; };
+layout(std430, binding=3) buffer CounterBuffer { uint DispatchX; uint DispatchY; uint DispatchZ; uint QueueSizes[3]; };
+layout(std430, binding=4) buffer ShadowBuffer { Shadow Shadows[]; };
+
+layout(binding=0, rgba32f) uniform image2D AccumulatorImage;
+layout(binding=1, rgba32f) uniform image2D AlbedoImage;
+layout(binding=2, rgba32f) uniform image2D NormalImage;
+layout(binding=3, rgba32f) uniform image2D MomentsImage;
+
+uniform uvec2 RectPosition;
+uniform uvec2 RectSize;
+uniform uint Queue;
+uniform uint QueueCapacity;
+
+uint GetInvocationIndex()
+{
+    return (gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x) * WORKGROUP_SIZE + gl_LocalInvocationID.x;
+}
+
+ivec2 GetPixel(uint pathId)
+{
+    return ivec2(RectPosition + uvec2(pathId % RectSize.x, pathId / RectSize.x));
+}
+
+void PushPath(uint queue, uint pathId)
+{
+    uint slot = atomicAdd(QueueSizes[queue], 1u);
+    Queues[queue * QueueCapacity + slot] = pathId;
+}
+
+Ray LoadRay(in Path path)
+{
+    return Ray(path.Origin.xyz, path.Direction.xyz, 1 / path.Direction.xyz, path.Color.rgb, path.IncomingLight.rgb, path.Origin.w, path.Direction.w, path.Color.w, path.IncomingLight.w);
+}
+
+Path StorePath(in Ray ray, uint bounce, uint flags)
+{
+    return Path(vec4(ray.Origin, ray.ConeWidth), vec4(ray.Direction, ray.ConeSpread), vec4(ray.Color, ray.ScatterPdf), vec4(ray.IncomingLight, ray.ScatterDistance), uvec4(Seed, bounce, SampleDimension, flags));
+}
+
+Ray LoadShadowRay(in Shadow shadow)
+{
+    return Ray(shadow.Origin.xyz, shadow.Direction.xyz, 1 / shadow.Direction.xyz, vec3(1), shadow.IncomingLight.rgb, shadow.Direction.w, shadow.IncomingLight.w, 0, 0);
+}
+
+Shadow StoreShadow(in Ray shadowRay, float distance)
+{
+    return Shadow(vec4(shadowRay.Origin, distance), vec4(shadowRay.Direction, shadowRay.ConeWidth), vec4(shadowRay.IncomingLight, shadowRay.ConeSpread));
+}
+
+// Traces the queued shadow rays and adds the light of the ones reaching their light to their path
+void main()
+{
+    uint index = GetInvocationIndex();
+    if (index >= QueueSizes[SHADOW_QUEUE])
+    {
+        return;
+    }
+
+    uint pathId = Queues[SHADOW_QUEUE * QueueCapacity + index];
+    Path path = Paths[pathId];
+    Shadow shadow = Shadows[pathId];
+    Ray ray = LoadRay(path);
+    InitSampler(uvec2(GetPixel(pathId)));
+    Seed = path.State.x;
+    SampleDimension = path.State.z;
+    ShadowRay = LoadShadowRay(shadow);
+    ShadowDistance = shadow.Origin.w;
+
+    // The transparent surfaces crossed by the shadow ray draw from the sampler of the path
+    while (ShadowDistance > 0)
+    {
+        CollisionManifold manifold;
+        ContinueShadow(ray, FindIntersection(ShadowRay, false, manifold), manifold);
+    }
+
+    Paths[pathId].IncomingLight.rgb = ray.IncomingLight;
+    Paths[pathId].State.xz = uvec2(Seed, SampleDimension);
+}
+
+)";
+
+const char* WavefrontTracer::accumulateShaderSrc =
+R"(
+#version 430 core
+
+layout(local_size_x=64) in;
+
+struct Ray
+{
+    vec3 Origin;
+    vec3 Direction;
+    vec3 InvDirection;
+    vec3 Color;
+    vec3 IncomingLight;
+    float ConeWidth;
+    float ConeSpread;
+    float ScatterPdf;
+    float ScatterDistance;
+};
+
+struct Env
+{
+    bool Transparent;
+    float Intensity;
+    mat3 Rotation;
+};
+
+struct Cam
+{
+    vec3 Position;
+    vec3 Forward;
+    vec3 Up;
+    float FOV;
+    float FocalDistance;
+    float Aperture;
+    float Blur;
+};
+
+struct Material
+{
+    vec3 AlbedoColor;
+    float Roughness;
+    vec3 EmissionColor;
+    float EmissionStrength;
+    vec3 FresnelColor;
+    float FresnelStrength;
+    float Metalness;
+    float IOR;
+    float Density;
+    int AlbedoTextureId;
+    int MetalnessTextureId;
+    int EmissionTextureId;
+    int RoughnessTextureId;
+    int NormalTextureId;
+};
+
+struct Vertex
+{
+    vec3 Position;
+    vec3 Normal;
+    vec2 TextureCoordinate;
+};
+
+struct Triangle
+{
+    int V1;
+    int V2;
+    int V3;
+};
+
+struct Mesh
+{
+    mat4 Transform;
+    mat4 TransformInv;
+    int MaterialId;
+    int NodeOffset;
+    int TriangleOffset;
+};
+
+struct CollisionManifold
+{
+    float Depth;
+    vec3 Point;
+    vec2 TextureCoordinate;
+    float UVDensity;
+    vec3 Normal;
+    vec3 Tangent;
+    vec3 Bitangent;
+    int MaterialId;
+    bool IsFrontFace;
+};
+
+struct Light
+{
+    float Probability;
+    int Alias;
+    int MeshId;
+    int TriangleId;
+};
+
+struct Node
+{
+    vec3 BboxMin;
+    vec3 BboxMax;
+    int Start;
+    int PrimitiveCount;
+    int RightOffset;
+};
+const float INV_PI     = 0.31830988618379067;
+const float INV_TWO_PI = 0.15915494309189533;
+
+const uint BVH_LAYOUT_BINARY = 0u;
+const uint BVH_LAYOUT_WIDE   = 1u;
+const uint BVH_LAYOUT_QUANTIZED = 2u;
+
+layout(binding=0) uniform sampler2D AccumulatorTexture;
+layout(binding=1) uniform sampler2D EnvironmentTexture;
+layout(binding=2) uniform sampler2DArray Textures;
+layout(binding=3) uniform samplerBuffer Vertices;
+layout(binding=4) uniform isamplerBuffer Triangles;
+layout(binding=5) uniform samplerBuffer Meshes;
+layout(binding=6) uniform samplerBuffer Materials;
+layout(binding=7) uniform samplerBuffer BVH;
+layout(binding=8) uniform samplerBuffer TLAS;
+layout(binding=9) uniform usamplerBuffer BVHData;
+layout(binding=11) uniform sampler2DArray HalfTextures;
+layout(binding=12) uniform samplerBuffer TextureInfo;
+layout(binding=13) uniform sampler2D MomentsTexture;
+layout(binding=14) uniform sampler2D AlbedoTexture;
+layout(binding=15) uniform sampler2D NormalTexture;
+layout(binding=16) uniform samplerBuffer Lights;
+layout(binding=17) uniform samplerBuffer EnvironmentDistribution;
+layout(binding=18) uniform samplerBuffer BlueNoise;
+layout(binding=19) uniform usamplerBuffer MeshOffsets;
+
+// Only uploaded when the settings change, the layout is mirrored by Renderer::Settings
+layout(std140, binding=0) uniform Settings
+{
+    Cam Camera;
+    Env Environment;
+    uint MaxBounceCount;
+    float MinRenderDistance;
+    float MaxRenderDistance;
+    uint BVHLayout;
+    uint BVHQuantizationBits;
+    float Gamma;
+    float AdaptiveThreshold;
+    uint AdaptiveMinFrameCount;
+    uint SamplerType;
+    uint RussianRouletteDepth;
+};
+
+uniform uint FrameCount;
+
+Triangle GetTriangle(int index)
+{
+    ivec4 data = texelFetch(Triangles, index);
+    return Triangle(data.x, data.y, data.z);
+}
+
+Vertex GetVertex(int index)
+{
+    vec4 data1 = texelFetch(Vertices, index * 2 + 0);
+    vec4 data2 = texelFetch(Vertices, index * 2 + 1);
+    return Vertex(data1.xyz, data2.xyz, vec2(data1.w, data2.w));
+}
+
+Mesh GetMesh(int index)
+{
+    vec4 data1 = texelFetch(Meshes, index * 9 + 0);
+    vec4 data2 = texelFetch(Meshes, index * 9 + 1);
+    vec4 data3 = texelFetch(Meshes, index * 9 + 2);
+    vec4 data4 = texelFetch(Meshes, index * 9 + 3);
+    vec4 data5 = texelFetch(Meshes, index * 9 + 4);
+    vec4 data6 = texelFetch(Meshes, index * 9 + 5);
+    vec4 data7 = texelFetch(Meshes, index * 9 + 6);
+    vec4 data8 = texelFetch(Meshes, index * 9 + 7);
+    vec4 data9 = texelFetch(Meshes, index * 9 + 8);
+    uvec4 offsets = texelFetch(MeshOffsets, index);
+    return Mesh(mat4(data1, data2, data3, data4), mat4(data5, data6, data7, data8), int(data9.x), int(offsets.x), int(offsets.y));
+}
+
+int GetMeshCount()
+{
+    return textureSize(Meshes) / 9;
+}
+
+Material GetMaterial(int index)
+{
+    // Meshes without a material get the default one of the Material class
+    if (index < 0 || index >= textureSize(Materials) / 5)
+    {
+        return Material(vec3(1), 0, vec3(1), 0, vec3(1), 0, 0, 0, 0, -1, -1, -1, -1, -1);
+    }
+
+    vec4 data1 = texelFetch(Materials, index * 5 + 0);
+    vec4 data2 = texelFetch(Materials, index * 5 + 1);
+    vec4 data3 = texelFetch(Materials, index * 5 + 2);
+    vec4 data4 = texelFetch(Materials, index * 5 + 3);
+    vec4 data5 = texelFetch(Materials, index * 5 + 4);
+    return Material(data1.rgb, data1.a, data2.rgb, data2.a, data3.rgb, data3.a, data4.x, data4.y, data4.z, int(data4.w), int(data5.x), int(data5.y), int(data5.z), int(data5.w));
+}
+
+int GetLightCount()
+{
+    return textureSize(Lights) == 0 ? 0 : int(texelFetch(Lights, 0).x);
+}
+
+Light GetLight(int index)
+{
+    vec4 data = texelFetch(Lights, index + 1);
+    return Light(data.x, int(data.y), int(data.z), int(data.w));
+}
+
+float GetLightAreaPdf(int materialId)
+{
+    return texelFetch(Lights, GetLightCount() + 1 + materialId).x;
+}
+
+Node GetNode(int index)
+{
+    vec4 data1 = texelFetch(BVH, index * 3 + 0);
+    vec4 data2 = texelFetch(BVH, index * 3 + 1);
+    vec4 data3 = texelFetch(BVH, index * 3 + 2);
+    return Node(data1.xyz, data2.xyz, int(data3.x), int(data3.y), int(data3.z));
+}
+
+Node GetTLASNode(int index)
+{
+    vec4 data1 = texelFetch(TLAS, index * 3 + 0);
+    vec4 data2 = texelFetch(TLAS, index * 3 + 1);
+    vec4 data3 = texelFetch(TLAS, index * 3 + 2);
+    return Node(data1.xyz, data2.xyz, int(data3.x), int(data3.y), int(data3.z));
+}
+
+vec4 GetTexel(ivec3 coord, bool isHalf)
+{
+    return isHalf ? texelFetch(HalfTextures, coord, 0) : texelFetch(Textures, coord, 0);
+}
+
+vec4 GetTextureLevel(int entry, vec2 uv)
+{
+    // Bilinear filtering with repeat wrapping inside the atlas rectangle of the level
+    vec4 rect = texelFetch(TextureInfo, entry + 0);
+    vec4 info = texelFetch(TextureInfo, entry + 1);
+    bool isHalf = info.y > 0;
+
+    vec2 coord = uv * rect.zw - 0.5;
+    vec2 base = floor(coord);
+    vec2 t = coord - base;
+    ivec2 p0 = ivec2(rect.xy + mod(base, rect.zw));
+    ivec2 p1 = ivec2(rect.xy + mod(base + 1, rect.zw));
+    int layer = int(info.x);
+
+    vec4 c00 = GetTexel(ivec3(p0.x, p0.y, layer), isHalf);
+    vec4 c10 = GetTexel(ivec3(p1.x, p0.y, layer), isHalf);
+    vec4 c01 = GetTexel(ivec3(p0.x, p1.y, layer), isHalf);
+    vec4 c11 = GetTexel(ivec3(p1.x, p1.y, layer), isHalf);
+    return mix(mix(c00, c10, t.x), mix(c01, c11, t.x), t.y);
+}
+
+vec4 GetTexture(int textureId, vec2 uv, float footprint)
+{
+    if (any(isnan(uv)) || any(isinf(uv)))
+    {
+        return vec4(0);
+    }
+
+    // Trilinear filtering, the level of detail is the footprint measured in texels of the first level
+    vec4 header = texelFetch(TextureInfo, textureId);
+    int entry = int(header.x);
+    vec4 rect = texelFetch(TextureInfo, entry);
+    float lod = clamp(footprint + 0.5 * log2(rect.z * rect.w), 0, header.y - 1);
+    int level = int(lod);
+    float t = lod - level;
+
+    vec4 color = GetTextureLevel(entry + level * 2, uv);
+    if (t > 0)
+    {
+        color = mix(color, GetTextureLevel(entry + level * 2 + 2, uv), t);
+    }
+
+    return color;
+}
+
+vec3 GetEnvironment(in Ray ray)
+{
+    vec3 direction = Environment.Rotation * ray.Direction;
+    float u = atan(direction.z, direction.x) * INV_TWO_PI + 0.5;
+    float v = acos(direction.y) * INV_PI;
+    float lod = log2(ray.ConeSpread * textureSize(EnvironmentTexture, 0).y * INV_PI);
+    return textureLod(EnvironmentTexture, vec2(u, v), lod).rgb * Environment.Intensity;
+}
+const float TWO_PI     = 6.28318530717958648;
+
+const uint SAMPLER_RANDOM     = 0u;
+const uint SAMPLER_SOBOL      = 1u;
+const uint SAMPLER_BLUE_NOISE = 2u;
+
+// The camera takes the first dimensions, every bounce starts a block so that the samples of a pixel line up
+const uint CAMERA_DIMENSIONS = 4u;
+const uint BOUNCE_DIMENSIONS = 16u;
+const uint BLUE_NOISE_SIZE   = 64u;
+
+uint Seed;
+uvec2 SamplePixel;
+uint SampleDimension;
+
+uint Hash(uint x)
+{
+    x = x * 747796405u + 2891336453u;
+    x = ((x >> ((x >> 28) + 4u)) ^ x) * 277803737u;
+    return (x >> 22) ^ x;
+}
+
+void InitSampler(uvec2 pixel)
+{
+    SamplePixel = pixel;
+    SampleDimension = 0u;
+    Seed = Hash(pixel.x ^ Hash(pixel.y ^ Hash(FrameCount)));
+}
+
+// Moves to the block of the bounce, unless the previous bounce already went past its start
+void StartSampleBounce(uint bounce)
+{
+    SampleDimension = max(SampleDimension, CAMERA_DIMENSIONS + bounce * BOUNCE_DIMENSIONS);
+}
+
+// Hash based Owen scrambling, every bit is flipped depending on the bits above it (Laine-Karras permutation)
+uint OwenScramble(uint x, uint seed)
+{
+    x = bitfieldReverse(x);
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return bitfieldReverse(x);
+}
+
+// Second dimension of the Sobol sequence, the first one is the index with its bits reversed
+uint Sobol1(uint index)
+{
+    uint result = 0u;
+    for (uint direction = 1u << 31; index != 0u; index >>= 1, direction ^= direction >> 1)
+    {
+        if ((index & 1u) != 0u)
+        {
+            result ^= direction;
+        }
+    }
+
+    return result;
+}
+
+// Every pair of dimensions is a two dimensional Sobol sequence with its samples shuffled, so that the pairs are independent
+uint SobolSample(uint index, uint dimension, uint seed)
+{
+    index = OwenScramble(index, Hash(seed ^ Hash(dimension >> 1)));
+    uint value = (dimension & 1u) == 0u ? bitfieldReverse(index) : Sobol1(index);
+    return OwenScramble(value, Hash(seed ^ Hash(dimension) ^ 0x68bc21ebu));
+}
+
+float RandomValue()
+{
+    if (SamplerType == SAMPLER_RANDOM)
+    {
+        Seed = Seed * 747796405u + 2891336453u;
+        uint result = ((Seed >> ((Seed >> 28) + 4u)) ^ Seed) * 277803737u;
+        result = (result >> 22) ^ result;
+        return float(result) / 4294967295.0;
+    }
+
+    uint dimension = SampleDimension++;
+    uint value;
+    if (SamplerType == SAMPLER_SOBOL)
+    {
+        value = SobolSample(FrameCount, dimension, Hash(SamplePixel.x ^ Hash(SamplePixel.y)));
+    }
+    else
+    {
+        // The same sequence for all pixels, shifted modulo 1 by the mask offset for the dimension
+        uint offset = Hash(dimension);
+        uvec2 maskPixel = (SamplePixel + uvec2(offset, offset >> 16)) % BLUE_NOISE_SIZE;
+        float shift = texelFetch(BlueNoise, int(maskPixel.y * BLUE_NOISE_SIZE + maskPixel.x)).r;
+        value = SobolSample(FrameCount, dimension, 0u) + uint(shift * 4294967296.0);
+    }
+
+    // Strictly between 0 and 1
+    return (float(value >> 9) + 0.5) / 8388608.0;
+}
+
+// Two values of the same pair of dimensions, the Sobol samplers stratify them together
+vec2 RandomValue2()
+{
+    SampleDimension += SampleDimension & 1u;
+    float x = RandomValue();
+    float y = RandomValue();
+    return vec2(x, y);
+}
+
+vec2 RandomVector2()
+{
+    vec2 value = RandomValue2();
+    float angle = value.x * TWO_PI;
+    return vec2(cos(angle), sin(angle)) * sqrt(value.y);
+}
+
+// Uniform direction, from two values so that it keeps the stratification of the samplers
+vec3 RandomVector3()
+{
+    vec2 value = RandomValue2();
+    float z = 1 - 2 * value.x;
+    float radius = sqrt(max(1 - z * z, 0));
+    float angle = value.y * TWO_PI;
+    return vec3(radius * cos(angle), radius * sin(angle), z);
+}
+vec3 Slerp(in vec3 a, in vec3 b, float t)
+{
+    float angle = acos(dot(a, b));
+    return isnan(angle) || angle == 0 ? b : (sin((1 - t) * angle) * a + sin(t * angle) * b) / sin(angle);
+}
+
+vec3 Transform(in vec3 v, in mat4 matrix, in bool translate)
+{
+    return (matrix * vec4(v, translate ? 1 : 0)).xyz;
+}
+
+float Luminance(in vec3 color)
+{
+    return dot(color, vec3(.2126, .7152, .0722));
+}
+
+vec4 ToneMap(in vec4 pixel, in float gamma)
+{
+    // Reinhard tone mapping
+    pixel.rgb = pixel.rgb / (pixel.rgb + vec3(1));
+
+    // Gamma correction
+    pixel.rgb = pow(pixel.rgb, vec3(1 / gamma));
+
+    return pixel;
+}
+const uint WORKGROUP_SIZE = 64u;
+
+const uint PATH_BACKGROUND = 1u;
+const uint PATH_CONVERGED  = 2u;
+
+// The queue of the paths whose shadow ray waits for the occlusion stage
+const uint SHADOW_QUEUE = 2u;
+
+// Origin.w is the cone width, Direction.w the cone spread, Color.w the scatter pdf, IncomingLight.w the scatter distance,
+// State holds the seed, the bounce, the sample dimension and the flags
+struct Path
+{
+    vec4 Origin;
+    vec4 Direction;
+    vec4 Color;
+    vec4 IncomingLight;
+    uvec4 State;
+};
+
+// The collision manifold found by the intersection stage, Info holds the material, the face and the hit flag
+struct Hit
+{
+    vec4 PointDepth;
+    vec4 NormalUVDensity;
+    vec4 TangentU;
+    vec4 BitangentV;
+    ivec4 Info;
+};
+
+// The shadow ray of a light sample, Origin.w is the distance left to the light, Direction.w the cone width, IncomingLight.w the cone spread
+struct Shadow
+{
+    vec4 Origin;
+    vec4 Direction;
+    vec4 IncomingLight;
+};
+
+layout(std430, binding=0) buffer PathBuffer { Path Paths[]; };
+layout(std430, binding=1) buffer HitBuffer { Hit Hits[]; };
+layout(std430, binding=2) buffer QueueBuffer { uint Queues[]; };
+layout(std430, binding=3) buffer CounterBuffer { uint DispatchX; uint DispatchY; uint DispatchZ; uint QueueSizes[3]; };
+layout(std430, binding=4) buffer ShadowBuffer { Shadow Shadows[]; };
+
+layout(binding=0, rgba32f) uniform image2D AccumulatorImage;
+layout(binding=1, rgba32f) uniform image2D AlbedoImage;
+layout(binding=2, rgba32f) uniform image2D NormalImage;
+layout(binding=3, rgba32f) uniform image2D MomentsImage;
+
+uniform uvec2 RectPosition;
+uniform uvec2 RectSize;
+uniform uint Queue;
+uniform uint QueueCapacity;
+
+uint GetInvocationIndex()
+{
+    return (gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x) * WORKGROUP_SIZE + gl_LocalInvocationID.x;
+}
+
+ivec2 GetPixel(uint pathId)
+{
+    return ivec2(RectPosition + uvec2(pathId % RectSize.x, pathId / RectSize.x));
+}
+
+void PushPath(uint queue, uint pathId)
+{
+    uint slot = atomicAdd(QueueSizes[queue], 1u);
+    Queues[queue * QueueCapacity + slot] = pathId;
+}
+
+Ray LoadRay(in Path path)
+{
+    return Ray(path.Origin.xyz, path.Direction.xyz, 1 / path.Direction.xyz, path.Color.rgb, path.IncomingLight.rgb, path.Origin.w, path.Direction.w, path.Color.w, path.IncomingLight.w);
+}
+
+Path StorePath(in Ray ray, uint bounce, uint flags)
+{
+    return Path(vec4(ray.Origin, ray.ConeWidth), vec4(ray.Direction, ray.ConeSpread), vec4(ray.Color, ray.ScatterPdf), vec4(ray.IncomingLight, ray.ScatterDistance), uvec4(Seed, bounce, SampleDimension, flags));
+}
+
+Ray LoadShadowRay(in Shadow shadow)
+{
+    return Ray(shadow.Origin.xyz, shadow.Direction.xyz, 1 / shadow.Direction.xyz, vec3(1), shadow.IncomingLight.rgb, shadow.Direction.w, shadow.IncomingLight.w, 0, 0);
+}
+
+Shadow StoreShadow(in Ray shadowRay, float distance)
+{
+    return Shadow(vec4(shadowRay.Origin, distance), vec4(shadowRay.Direction, shadowRay.ConeWidth), vec4(shadowRay.IncomingLight, shadowRay.ConeSpread));
+}
+
+// Adds the finished paths to the accumulation
+void main()
+{
+    uint pathId = GetInvocationIndex();
+    if (pathId >= RectSize.x * RectSize.y)
+    {
+        return;
+    }
+
+    ivec2 pixel = GetPixel(pathId);
+    vec4 accumColor = imageLoad(AccumulatorImage, pixel);
+    vec4 moments = imageLoad(MomentsImage, pixel);
+    uint bounce = Paths[pathId].State.y;
+    uint flags = Paths[pathId].State.w;
+
+    if ((flags & PATH_CONVERGED) != 0)
+    {
+        imageStore(AccumulatorImage, pixel, accumColor + accumColor / FrameCount);
+        imageStore(MomentsImage, pixel, vec4(moments.r, 1, moments.b, moments.a));
+        return;
+    }
+
+    vec4 pixelColor = vec4(Paths[pathId].IncomingLight.rgb, Environment.Transparent && (flags & PATH_BACKGROUND) != 0 ? 0 : 1);
+
+    // Invalid samples would spread through the filtered accumulation and poison the moments
+    if (any(isnan(pixelColor.rgb)) || any(isinf(pixelColor.rgb)))
+    {
+        pixelColor.rgb = vec3(0);
+    }
+
+    // The alpha of the moments sums the path lengths
+    float luminance = Luminance(pixelColor.rgb);
+    imageStore(AccumulatorImage, pixel, pixelColor + accumColor);
+    imageStore(MomentsImage, pixel, vec4(moments.r + luminance * luminance, 0, moments.b + 1, moments.a + bounce));
+}
+
+)";
+
+const char* WavefrontTracer::dispatchShaderSrc =
+R"(
+#version 430 core
+
+layout(local_size_x=1) in;
+
+struct Ray
+{
+    vec3 Origin;
+    vec3 Direction;
+    vec3 InvDirection;
+    vec3 Color;
+    vec3 IncomingLight;
+    float ConeWidth;
+    float ConeSpread;
+    float ScatterPdf;
+    float ScatterDistance;
+};
+
+struct Env
+{
+    bool Transparent;
+    float Intensity;
+    mat3 Rotation;
+};
+
+struct Cam
+{
+    vec3 Position;
+    vec3 Forward;
+    vec3 Up;
+    float FOV;
+    float FocalDistance;
+    float Aperture;
+    float Blur;
+};
+
+struct Material
+{
+    vec3 AlbedoColor;
+    float Roughness;
+    vec3 EmissionColor;
+    float EmissionStrength;
+    vec3 FresnelColor;
+    float FresnelStrength;
+    float Metalness;
+    float IOR;
+    float Density;
+    int AlbedoTextureId;
+    int MetalnessTextureId;
+    int EmissionTextureId;
+    int RoughnessTextureId;
+    int NormalTextureId;
+};
+
+struct Vertex
+{
+    vec3 Position;
+    vec3 Normal;
+    vec2 TextureCoordinate;
+};
+
+struct Triangle
+{
+    int V1;
+    int V2;
+    int V3;
+};
+
+struct Mesh
+{
+    mat4 Transform;
+    mat4 TransformInv;
+    int MaterialId;
+    int NodeOffset;
+    int TriangleOffset;
+};
+
+struct CollisionManifold
+{
+    float Depth;
+    vec3 Point;
+    vec2 TextureCoordinate;
+    float UVDensity;
+    vec3 Normal;
+    vec3 Tangent;
+    vec3 Bitangent;
+    int MaterialId;
+    bool IsFrontFace;
+};
+
+struct Light
+{
+    float Probability;
+    int Alias;
+    int MeshId;
+    int TriangleId;
+};
+
+struct Node
+{
+    vec3 BboxMin;
+    vec3 BboxMax;
+    int Start;
+    int PrimitiveCount;
+    int RightOffset;
+};
+const float INV_PI     = 0.31830988618379067;
+const float INV_TWO_PI = 0.15915494309189533;
+
+const uint BVH_LAYOUT_BINARY = 0u;
+const uint BVH_LAYOUT_WIDE   = 1u;
+const uint BVH_LAYOUT_QUANTIZED = 2u;
+
+layout(binding=0) uniform sampler2D AccumulatorTexture;
+layout(binding=1) uniform sampler2D EnvironmentTexture;
+layout(binding=2) uniform sampler2DArray Textures;
+layout(binding=3) uniform samplerBuffer Vertices;
+layout(binding=4) uniform isamplerBuffer Triangles;
+layout(binding=5) uniform samplerBuffer Meshes;
+layout(binding=6) uniform samplerBuffer Materials;
+layout(binding=7) uniform samplerBuffer BVH;
+layout(binding=8) uniform samplerBuffer TLAS;
+layout(binding=9) uniform usamplerBuffer BVHData;
+layout(binding=11) uniform sampler2DArray HalfTextures;
+layout(binding=12) uniform samplerBuffer TextureInfo;
+layout(binding=13) uniform sampler2D MomentsTexture;
+layout(binding=14) uniform sampler2D AlbedoTexture;
+layout(binding=15) uniform sampler2D NormalTexture;
+layout(binding=16) uniform samplerBuffer Lights;
+layout(binding=17) uniform samplerBuffer EnvironmentDistribution;
+layout(binding=18) uniform samplerBuffer BlueNoise;
+layout(binding=19) uniform usamplerBuffer MeshOffsets;
+
+// Only uploaded when the settings change, the layout is mirrored by Renderer::Settings
+layout(std140, binding=0) uniform Settings
+{
+    Cam Camera;
+    Env Environment;
+    uint MaxBounceCount;
+    float MinRenderDistance;
+    float MaxRenderDistance;
+    uint BVHLayout;
+    uint BVHQuantizationBits;
+    float Gamma;
+    float AdaptiveThreshold;
+    uint AdaptiveMinFrameCount;
+    uint SamplerType;
+    uint RussianRouletteDepth;
+};
+
+uniform uint FrameCount;
+
+Triangle GetTriangle(int index)
+{
+    ivec4 data = texelFetch(Triangles, index);
+    return Triangle(data.x, data.y, data.z);
+}
+
+Vertex GetVertex(int index)
+{
+    vec4 data1 = texelFetch(Vertices, index * 2 + 0);
+    vec4 data2 = texelFetch(Vertices, index * 2 + 1);
+    return Vertex(data1.xyz, data2.xyz, vec2(data1.w, data2.w));
+}
+
+Mesh GetMesh(int index)
+{
+    vec4 data1 = texelFetch(Meshes, index * 9 + 0);
+    vec4 data2 = texelFetch(Meshes, index * 9 + 1);
+    vec4 data3 = texelFetch(Meshes, index * 9 + 2);
+    vec4 data4 = texelFetch(Meshes, index * 9 + 3);
+    vec4 data5 = texelFetch(Meshes, index * 9 + 4);
+    vec4 data6 = texelFetch(Meshes, index * 9 + 5);
+    vec4 data7 = texelFetch(Meshes, index * 9 + 6);
+    vec4 data8 = texelFetch(Meshes, index * 9 + 7);
+    vec4 data9 = texelFetch(Meshes, index * 9 + 8);
+    uvec4 offsets = texelFetch(MeshOffsets, index);
+    return Mesh(mat4(data1, data2, data3, data4), mat4(data5, data6, data7, data8), int(data9.x), int(offsets.x), int(offsets.y));
+}
+
+int GetMeshCount()
+{
+    return textureSize(Meshes) / 9;
+}
+
+Material GetMaterial(int index)
+{
+    // Meshes without a material get the default one of the Material class
+    if (index < 0 || index >= textureSize(Materials) / 5)
+    {
+        return Material(vec3(1), 0, vec3(1), 0, vec3(1), 0, 0, 0, 0, -1, -1, -1, -1, -1);
+    }
+
+    vec4 data1 = texelFetch(Materials, index * 5 + 0);
+    vec4 data2 = texelFetch(Materials, index * 5 + 1);
+    vec4 data3 = texelFetch(Materials, index * 5 + 2);
+    vec4 data4 = texelFetch(Materials, index * 5 + 3);
+    vec4 data5 = texelFetch(Materials, index * 5 + 4);
+    return Material(data1.rgb, data1.a, data2.rgb, data2.a, data3.rgb, data3.a, data4.x, data4.y, data4.z, int(data4.w), int(data5.x), int(data5.y), int(data5.z), int(data5.w));
+}
+
+int GetLightCount()
+{
+    return textureSize(Lights) == 0 ? 0 : int(texelFetch(Lights, 0).x);
+}
+
+Light GetLight(int index)
+{
+    vec4 data = texelFetch(Lights, index + 1);
+    return Light(data.x, int(data.y), int(data.z), int(data.w));
+}
+
+float GetLightAreaPdf(int materialId)
+{
+    return texelFetch(Lights, GetLightCount() + 1 + materialId).x;
+}
+
+Node GetNode(int index)
+{
+    vec4 data1 = texelFetch(BVH, index * 3 + 0);
+    vec4 data2 = texelFetch(BVH, index * 3 + 1);
+    vec4 data3 = texelFetch(BVH, index * 3 + 2);
+    return Node(data1.xyz, data2.xyz, int(data3.x), int(data3.y), int(data3.z));
+}
+
+Node GetTLASNode(int index)
+{
+    vec4 data1 = texelFetch(TLAS, index * 3 + 0);
+    vec4 data2 = texelFetch(TLAS, index * 3 + 1);
+    vec4 data3 = texelFetch(TLAS, index * 3 + 2);
+    return Node(data1.xyz, data2.xyz, int(data3.x), int(data3.y), int(data3.z));
+}
+
+vec4 GetTexel(ivec3 coord, bool isHalf)
+{
+    return isHalf ? texelFetch(HalfTextures, coord, 0) : texelFetch(Textures, coord, 0);
+}
+
+vec4 GetTextureLevel(int entry, vec2 uv)
+{
+    // Bilinear filtering with repeat wrapping inside the atlas rectangle of the level
+    vec4 rect = texelFetch(TextureInfo, entry + 0);
+    vec4 info = texelFetch(TextureInfo, entry + 1);
+    bool isHalf = info.y > 0;
+
+    vec2 coord = uv * rect.zw - 0.5;
+    vec2 base = floor(coord);
+    vec2 t = coord - base;
+    ivec2 p0 = ivec2(rect.xy + mod(base, rect.zw));
+    ivec2 p1 = ivec2(rect.xy + mod(base + 1, rect.zw));
+    int layer = int(info.x);
+
+    vec4 c00 = GetTexel(ivec3(p0.x, p0.y, layer), isHalf);
+    vec4 c10 = GetTexel(ivec3(p1.x, p0.y, layer), isHalf);
+    vec4 c01 = GetTexel(ivec3(p0.x, p1.y, layer), isHalf);
+    vec4 c11 = GetTexel(ivec3(p1.x, p1.y, layer), isHalf);
+    return mix(mix(c00, c10, t.x), mix(c01, c11, t.x), t.y);
+}
+
+vec4 GetTexture(int textureId, vec2 uv, float footprint)
+{
+    if (any(isnan(uv)) || any(isinf(uv)))
+    {
+        return vec4(0);
+    }
+
+    // Trilinear filtering, the level of detail is the footprint measured in texels of the first level
+    vec4 header = texelFetch(TextureInfo, textureId);
+    int entry = int(header.x);
+    vec4 rect = texelFetch(TextureInfo, entry);
+    float lod = clamp(footprint + 0.5 * log2(rect.z * rect.w), 0, header.y - 1);
+    int level = int(lod);
+    float t = lod - level;
+
+    vec4 color = GetTextureLevel(entry + level * 2, uv);
+    if (t > 0)
+    {
+        color = mix(color, GetTextureLevel(entry + level * 2 + 2, uv), t);
+    }
+
+    return color;
+}
+
+vec3 GetEnvironment(in Ray ray)
+{
+    vec3 direction = Environment.Rotation * ray.Direction;
+    float u = atan(direction.z, direction.x) * INV_TWO_PI + 0.5;
+    float v = acos(direction.y) * INV_PI;
+    float lod = log2(ray.ConeSpread * textureSize(EnvironmentTexture, 0).y * INV_PI);
+    return textureLod(EnvironmentTexture, vec2(u, v), lod).rgb * Environment.Intensity;
+}
+const float TWO_PI     = 6.28318530717958648;
+
+const uint SAMPLER_RANDOM     = 0u;
+const uint SAMPLER_SOBOL      = 1u;
+const uint SAMPLER_BLUE_NOISE = 2u;
+
+// The camera takes the first dimensions, every bounce starts a block so that the samples of a pixel line up
+const uint CAMERA_DIMENSIONS = 4u;
+const uint BOUNCE_DIMENSIONS = 16u;
+const uint BLUE_NOISE_SIZE   = 64u;
+
+uint Seed;
+uvec2 SamplePixel;
+uint SampleDimension;
+
+uint Hash(uint x)
+{
+    x = x * 747796405u + 2891336453u;
+    x = ((x >> ((x >> 28) + 4u)) ^ x) * 277803737u;
+    return (x >> 22) ^ x;
+}
+
+void InitSampler(uvec2 pixel)
+{
+    SamplePixel = pixel;
+    SampleDimension = 0u;
+    Seed = Hash(pixel.x ^ Hash(pixel.y ^ Hash(FrameCount)));
+}
+
+// Moves to the block of the bounce, unless the previous bounce already went past its start
+void StartSampleBounce(uint bounce)
+{
+    SampleDimension = max(SampleDimension, CAMERA_DIMENSIONS + bounce * BOUNCE_DIMENSIONS);
+}
+
+// Hash based Owen scrambling, every bit is flipped depending on the bits above it (Laine-Karras permutation)
+uint OwenScramble(uint x, uint seed)
+{
+    x = bitfieldReverse(x);
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return bitfieldReverse(x);
+}
+
+// Second dimension of the Sobol sequence, the first one is the index with its bits reversed
+uint Sobol1(uint index)
+{
+    uint result = 0u;
+    for (uint direction = 1u << 31; index != 0u; index >>= 1, direction ^= direction >> 1)
+    {
+        if ((index & 1u) != 0u)
+        {
+            result ^= direction;
+        }
+    }
+
+    return result;
+}
+
+// Every pair of dimensions is a two dimensional Sobol sequence with its samples shuffled, so that the pairs are independent
+uint SobolSample(uint index, uint dimension, uint seed)
+{
+    index = OwenScramble(index, Hash(seed ^ Hash(dimension >> 1)));
+    uint value = (dimension & 1u) == 0u ? bitfieldReverse(index) : Sobol1(index);
+    return OwenScramble(value, Hash(seed ^ Hash(dimension) ^ 0x68bc21ebu));
+}
+
+float RandomValue()
+{
+    if (SamplerType == SAMPLER_RANDOM)
+    {
+        Seed = Seed * 747796405u + 2891336453u;
+        uint result = ((Seed >> ((Seed >> 28) + 4u)) ^ Seed) * 277803737u;
+        result = (result >> 22) ^ result;
+        return float(result) / 4294967295.0;
+    }
+
+    uint dimension = SampleDimension++;
+    uint value;
+    if (SamplerType == SAMPLER_SOBOL)
+    {
+        value = SobolSample(FrameCount, dimension, Hash(SamplePixel.x ^ Hash(SamplePixel.y)));
+    }
+    else
+    {
+        // The same sequence for all pixels, shifted modulo 1 by the mask offset for the dimension
+        uint offset = Hash(dimension);
+        uvec2 maskPixel = (SamplePixel + uvec2(offset, offset >> 16)) % BLUE_NOISE_SIZE;
+        float shift = texelFetch(BlueNoise, int(maskPixel.y * BLUE_NOISE_SIZE + maskPixel.x)).r;
+        value = SobolSample(FrameCount, dimension, 0u) + uint(shift * 4294967296.0);
+    }
+
+    // Strictly between 0 and 1
+    return (float(value >> 9) + 0.5) / 8388608.0;
+}
+
+// Two values of the same pair of dimensions, the Sobol samplers stratify them together
+vec2 RandomValue2()
+{
+    SampleDimension += SampleDimension & 1u;
+    float x = RandomValue();
+    float y = RandomValue();
+    return vec2(x, y);
+}
+
+vec2 RandomVector2()
+{
+    vec2 value = RandomValue2();
+    float angle = value.x * TWO_PI;
+    return vec2(cos(angle), sin(angle)) * sqrt(value.y);
+}
+
+// Uniform direction, from two values so that it keeps the stratification of the samplers
+vec3 RandomVector3()
+{
+    vec2 value = RandomValue2();
+    float z = 1 - 2 * value.x;
+    float radius = sqrt(max(1 - z * z, 0));
+    float angle = value.y * TWO_PI;
+    return vec3(radius * cos(angle), radius * sin(angle), z);
+}
+const uint WORKGROUP_SIZE = 64u;
+
+const uint PATH_BACKGROUND = 1u;
+const uint PATH_CONVERGED  = 2u;
+
+// The queue of the paths whose shadow ray waits for the occlusion stage
+const uint SHADOW_QUEUE = 2u;
+
+// Origin.w is the cone width, Direction.w the cone spread, Color.w the scatter pdf, IncomingLight.w the scatter distance,
+// State holds the seed, the bounce, the sample dimension and the flags
+struct Path
+{
+    vec4 Origin;
+    vec4 Direction;
+    vec4 Color;
+    vec4 IncomingLight;
+    uvec4 State;
+};
+
+// The collision manifold found by the intersection stage, Info holds the material, the face and the hit flag
+struct Hit
+{
+    vec4 PointDepth;
+    vec4 NormalUVDensity;
+    vec4 TangentU;
+    vec4 BitangentV;
+    ivec4 Info;
+};
+
+// The shadow ray of a light sample, Origin.w is the distance left to the light, Direction.w the cone width, IncomingLight.w the cone spread
+struct Shadow
+{
+    vec4 Origin;
+    vec4 Direction;
+    vec4 IncomingLight;
+};
+
+layout(std430, binding=0) buffer PathBuffer { Path Paths[]; };
+layout(std430, binding=1) buffer HitBuffer { Hit Hits[]; };
+layout(std430, binding=2) buffer QueueBuffer { uint Queues[]; };
+layout(std430, binding=3) buffer CounterBuffer { uint DispatchX; uint DispatchY; uint DispatchZ; uint QueueSizes[3]; };
+layout(std430, binding=4) buffer ShadowBuffer { Shadow Shadows[]; };
+
+layout(binding=0, rgba32f) uniform image2D AccumulatorImage;
+layout(binding=1, rgba32f) uniform image2D AlbedoImage;
+layout(binding=2, rgba32f) uniform image2D NormalImage;
+layout(binding=3, rgba32f) uniform image2D MomentsImage;
+
+uniform uvec2 RectPosition;
+uniform uvec2 RectSize;
+uniform uint Queue;
+uniform uint QueueCapacity;
+
+uint GetInvocationIndex()
+{
+    return (gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x) * WORKGROUP_SIZE + gl_LocalInvocationID.x;
+}
+
+ivec2 GetPixel(uint pathId)
+{
+    return ivec2(RectPosition + uvec2(pathId % RectSize.x, pathId / RectSize.x));
+}
+
+void PushPath(uint queue, uint pathId)
+{
+    uint slot = atomicAdd(QueueSizes[queue], 1u);
+    Queues[queue * QueueCapacity + slot] = pathId;
+}
+
+Ray LoadRay(in Path path)
+{
+    return Ray(path.Origin.xyz, path.Direction.xyz, 1 / path.Direction.xyz, path.Color.rgb, path.IncomingLight.rgb, path.Origin.w, path.Direction.w, path.Color.w, path.IncomingLight.w);
+}
+
+Path StorePath(in Ray ray, uint bounce, uint flags)
+{
+    return Path(vec4(ray.Origin, ray.ConeWidth), vec4(ray.Direction, ray.ConeSpread), vec4(ray.Color, ray.ScatterPdf), vec4(ray.IncomingLight, ray.ScatterDistance), uvec4(Seed, bounce, SampleDimension, flags));
+}
+
+Ray LoadShadowRay(in Shadow shadow)
+{
+    return Ray(shadow.Origin.xyz, shadow.Direction.xyz, 1 / shadow.Direction.xyz, vec3(1), shadow.IncomingLight.rgb, shadow.Direction.w, shadow.IncomingLight.w, 0, 0);
+}
+
+Shadow StoreShadow(in Ray shadowRay, float distance)
+{
+    return Shadow(vec4(shadowRay.Origin, distance), vec4(shadowRay.Direction, shadowRay.ConeWidth), vec4(shadowRay.IncomingLight, shadowRay.ConeSpread));
+}
+
+// Sizes the indirect dispatches over the current queue, the path queues also empty the other one and the shadow queue
+void main()
+{
+    uint groupCount = (QueueSizes[Queue] + WORKGROUP_SIZE - 1u) / WORKGROUP_SIZE;
+    DispatchX = min(groupCount, 65535u);
+    DispatchY = groupCount == 0u ? 0u : (groupCount + DispatchX - 1u) / DispatchX;
+    DispatchZ = 1u;
+    if (Queue != SHADOW_QUEUE)
+    {
+        QueueSizes[1u - Queue] = 0u;
+        QueueSizes[SHADOW_QUEUE] = 0u;
+    }
+}
+
+)";
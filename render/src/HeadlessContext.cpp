@@ -0,0 +1,65 @@
+#include "HeadlessContext.h"
+
+#include <stdexcept>
+#include <EGL/eglext.h>
+
+void HeadlessContext::init()
+{
+    this->display = HeadlessContext::createDisplay();
+    if (!eglBindAPI(EGL_OPENGL_API))
+    {
+        throw std::runtime_error("Failed to bind the OpenGL API");
+    }
+
+    // Surfaceless displays do not need a config, others get any OpenGL one
+    EGLConfig config = EGL_NO_CONFIG_KHR;
+    EGLint configAttributes[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+    EGLint configCount = 0;
+    if (!eglChooseConfig(this->display, configAttributes, &config, 1, &configCount) || configCount == 0)
+    {
+        config = EGL_NO_CONFIG_KHR;
+    }
+
+    EGLint contextAttributes[] =
+    {
+        EGL_CONTEXT_MAJOR_VERSION, 4,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE,
+    };
+
+    this->context = eglCreateContext(this->display, config, EGL_NO_CONTEXT, contextAttributes);
+    if (this->context == EGL_NO_CONTEXT || !eglMakeCurrent(this->display, EGL_NO_SURFACE, EGL_NO_SURFACE, this->context))
+    {
+        throw std::runtime_error("Failed to create an OpenGL 4.3 context");
+    }
+}
+
+void HeadlessContext::shutdown()
+{
+    eglMakeCurrent(this->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(this->display, this->context);
+    eglTerminate(this->display);
+}
+
+EGLDisplay HeadlessContext::createDisplay()
+{
+    // The surfaceless Mesa platform needs neither a window system nor a GPU (llvmpipe)
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay != nullptr)
+    {
+        EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        if (display != EGL_NO_DISPLAY && eglInitialize(display, nullptr, nullptr))
+        {
+            return display;
+        }
+    }
+
+    EGLDisplay display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr))
+    {
+        throw std::runtime_error("Failed to initialize an EGL display");
+    }
+
+    return display;
+}
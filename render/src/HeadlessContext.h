@@ -0,0 +1,15 @@
+#pragma once
+
+#include <EGL/egl.h>
+
+class HeadlessContext
+{
+public:
+    void init();
+    void shutdown();
+private:
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+
+    static EGLDisplay createDisplay();
+};
@@ -0,0 +1,153 @@
+#include "Job.h"
+
+#include <fstream>
+#include <json.hpp>
+#include <stdexcept>
+#include <filesystem>
+
+using json = nlohmann::json;
+
+static glm::vec3 parseVector(const json& value)
+{
+    return glm::vec3(value.at(0).get<float>(), value.at(1).get<float>(), value.at(2).get<float>());
+}
+
+static Job parseJob(const json& value, const std::filesystem::path& folder)
+{
+    // Relative paths are relative to the job file
+    auto path = [&](const char* key)
+    {
+        std::string fileName = value.at(key).get<std::string>();
+        return (folder / fileName).lexically_normal().string();
+    };
+
+    Job job;
+    job.scene = path("scene");
+    job.output = path("output");
+    if (value.contains("environment"))
+    {
+        job.environment = path("environment");
+    }
+
+    job.environmentIntensity = value.value("environmentIntensity", job.environmentIntensity);
+    job.sampleCount = value.value("samples", job.sampleCount);
+    job.adaptiveThreshold = value.value("adaptiveThreshold", job.adaptiveThreshold);
+    job.adaptiveMinSampleCount = value.value("adaptiveMinSamples", job.adaptiveMinSampleCount);
+    job.maxBounceCount = value.value("maxBounceCount", job.maxBounceCount);
+    job.russianRouletteDepth = value.value("russianRouletteDepth", job.russianRouletteDepth);
+    job.gamma = value.value("gamma", job.gamma);
+    job.denoise = value.value("denoise", job.denoise);
+    job.sceneCache = value.value("sceneCache", job.sceneCache);
+    if (value.contains("size"))
+    {
+        job.size = glm::uvec2(value["size"].at(0).get<unsigned int>(), value["size"].at(1).get<unsigned int>());
+    }
+
+    std::string layout = value.value("bvhLayout", "binary");
+    if (layout == "binary")
+    {
+        job.bvhLayout = TracerX::BVHSettings::Layout::Binary;
+    }
+    else if (layout == "wide")
+    {
+        job.bvhLayout = TracerX::BVHSettings::Layout::Wide;
+    }
+    else if (layout == "quantized")
+    {
+        job.bvhLayout = TracerX::BVHSettings::Layout::Quantized;
+    }
+    else
+    {
+        throw std::runtime_error("Unknown BVH layout: " + layout);
+    }
+
+    std::string backend = value.value("backend", "fragment");
+    if (backend == "fragment")
+    {
+        job.backend = TracerX::Renderer::Backend::Fragment;
+    }
+    else if (backend == "wavefront")
+    {
+        job.backend = TracerX::Renderer::Backend::Wavefront;
+    }
+    else
+    {
+        throw std::runtime_error("Unknown backend: " + backend);
+    }
+
+    std::string sampler = value.value("sampler", "sobol");
+    if (sampler == "random")
+    {
+        job.sampler = TracerX::Sampler::Random;
+    }
+    else if (sampler == "sobol")
+    {
+        job.sampler = TracerX::Sampler::Sobol;
+    }
+    else if (sampler == "blueNoise")
+    {
+        job.sampler = TracerX::Sampler::BlueNoise;
+    }
+    else
+    {
+        throw std::runtime_error("Unknown sampler: " + sampler);
+    }
+
+    // Either the index of a camera of the scene, or the camera settings
+    const json& camera = value.contains("camera") ? value["camera"] : json::object();
+    if (camera.is_number_integer())
+    {
+        job.sceneCamera = camera.get<int>();
+        return job;
+    }
+
+    if (camera.contains("position"))
+    {
+        job.camera.position = parseVector(camera["position"]);
+    }
+
+    if (camera.contains("up"))
+    {
+        job.camera.up = glm::normalize(parseVector(camera["up"]));
+    }
+
+    if (camera.contains("forward"))
+    {
+        job.camera.forward = glm::normalize(parseVector(camera["forward"]));
+    }
+
+    if (camera.contains("target"))
+    {
+        job.camera.lookAt(parseVector(camera["target"]));
+    }
+
+    job.camera.fov = glm::radians(camera.value("fov", glm::degrees(job.camera.fov)));
+    job.camera.focalDistance = camera.value("focalDistance", job.camera.focalDistance);
+    job.camera.aperture = camera.value("aperture", job.camera.aperture);
+    job.camera.blur = camera.value("blur", job.camera.blur);
+    return job;
+}
+
+std::vector<Job> Job::loadFromFile(const std::string& fileName)
+{
+    std::ifstream file(fileName);
+    if (!file)
+    {
+        throw std::runtime_error("Failed to open the job file: " + fileName);
+    }
+
+    json root = json::parse(file);
+    std::filesystem::path folder = std::filesystem::absolute(fileName).parent_path();
+
+    // Every job overrides the defaults shared by all jobs
+    json defaults = root.value("defaults", json::object());
+    std::vector<Job> jobs;
+    for (const json& value : root.at("jobs"))
+    {
+        json merged = defaults;
+        merged.update(value);
+        jobs.push_back(parseJob(merged, folder));
+    }
+
+    return jobs;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <TracerX/Camera.h>
+#include <TracerX/Renderer.h>
+#include <TracerX/BVHSettings.h>
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+struct Job
+{
+    std::string scene;
+    std::string environment;
+    std::string output;
+    float environmentIntensity = 1;
+    int sceneCamera = -1;
+    TracerX::Camera camera;
+    TracerX::BVHSettings::Layout bvhLayout = TracerX::BVHSettings::Layout::Binary;
+    TracerX::Renderer::Backend backend = TracerX::Renderer::Backend::Fragment;
+    TracerX::Sampler sampler = TracerX::Sampler::Sobol;
+    glm::uvec2 size = glm::uvec2(512, 512);
+    unsigned int sampleCount = 64;
+    float adaptiveThreshold = 0;
+    unsigned int adaptiveMinSampleCount = 16;
+    unsigned int maxBounceCount = 5;
+    unsigned int russianRouletteDepth = 3;
+    float gamma = 2.2f;
+    bool denoise = false;
+    bool sceneCache = false;
+
+    static std::vector<Job> loadFromFile(const std::string& fileName);
+};
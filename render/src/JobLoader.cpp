@@ -0,0 +1,56 @@
+#include "JobLoader.h"
+
+using namespace TracerX;
+
+bool JobLoader::load(Renderer& renderer, const Job& job)
+{
+    // The scene and the environment stay uploaded while consecutive jobs share them
+    bool sceneLoaded = false;
+    if (job.scene != this->sceneName || job.bvhLayout != this->sceneLayout)
+    {
+        this->sceneName.clear();
+        BVHSettings settings;
+        settings.layout = job.bvhLayout;
+        this->scene = job.sceneCache ? Scene::loadGLTFCached(job.scene, settings) : Scene::loadGLTF(job.scene, settings);
+        renderer.loadScene(this->scene);
+        this->sceneName = job.scene;
+        this->sceneLayout = job.bvhLayout;
+        sceneLoaded = true;
+    }
+
+    if (job.environment != this->environmentName)
+    {
+        this->environmentName.clear();
+        if (job.environment.empty())
+        {
+            renderer.environment.reset();
+        }
+        else
+        {
+            renderer.environment.loadFromFile(job.environment);
+        }
+
+        this->environmentName = job.environment;
+    }
+
+    return sceneLoaded;
+}
+
+void JobLoader::setup(Renderer& renderer, const Job& job) const
+{
+    renderer.environment.intensity = job.environmentIntensity;
+    renderer.camera = job.sceneCamera >= 0 ? this->scene.cameras.at(job.sceneCamera) : job.camera;
+    renderer.maxBounceCount = job.maxBounceCount;
+    renderer.russianRouletteDepth = job.russianRouletteDepth;
+    renderer.gamma = job.gamma;
+    renderer.adaptiveThreshold = job.adaptiveThreshold;
+    renderer.adaptiveMinFrameCount = job.adaptiveMinSampleCount;
+    renderer.backend = job.backend;
+    renderer.sampler = job.sampler;
+    if (renderer.getSize() != job.size)
+    {
+        renderer.resize(job.size);
+    }
+
+    renderer.clear();
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "Job.h"
+
+#include <TracerX/Scene.h>
+#include <TracerX/Renderer.h>
+
+#include <string>
+
+class JobLoader
+{
+public:
+    TracerX::Scene scene;
+
+    bool load(TracerX::Renderer& renderer, const Job& job);
+    void setup(TracerX::Renderer& renderer, const Job& job) const;
+private:
+    std::string sceneName;
+    TracerX::BVHSettings::Layout sceneLayout = TracerX::BVHSettings::Layout::Binary;
+    std::string environmentName;
+};
@@ -0,0 +1,185 @@
+#include "TileCoordinator.h"
+
+#include <poll.h>
+#include <csignal>
+#include <algorithm>
+#include <stdexcept>
+
+using namespace TracerX;
+
+void TileCoordinator::init(unsigned int workerCount, const std::string& workerCommand)
+{
+    // A dead worker fails the write instead of killing the coordinator
+    std::signal(SIGPIPE, SIG_IGN);
+
+    this->workers.resize(workerCount);
+    for (WorkerProcess& worker : this->workers)
+    {
+        worker.init(workerCommand);
+    }
+}
+
+void TileCoordinator::shutdown()
+{
+    for (WorkerProcess& worker : this->workers)
+    {
+        worker.shutdown();
+    }
+
+    this->workers.clear();
+}
+
+Image TileCoordinator::render(const Job& job, uint32_t jobId, unsigned int tileSize)
+{
+    std::vector<TileRequest> tiles;
+    for (unsigned int y = 0; y < job.size.y; y += tileSize)
+    {
+        for (unsigned int x = 0; x < job.size.x; x += tileSize)
+        {
+            glm::uvec2 position(x, y);
+            tiles.push_back(TileRequest{ jobId, position, glm::min(glm::uvec2(tileSize), job.size - position) });
+        }
+    }
+
+    // Every worker gets a new tile as soon as it returns one, so faster workers render more tiles
+    Image accumulation = Image::loadFromMemory(job.size, std::vector<float>((size_t)job.size.x * job.size.y * 4));
+    std::vector<TileRequest> pending(this->workers.size());
+    std::vector<TileRequest> retried;
+    std::vector<bool> busy(this->workers.size(), false);
+    std::vector<bool> exited(this->workers.size(), false);
+    size_t nextTile = 0;
+    auto dispatch = [&](size_t workerId)
+    {
+        if (!retried.empty())
+        {
+            pending[workerId] = retried.back();
+            retried.pop_back();
+        }
+        else if (nextTile < tiles.size())
+        {
+            pending[workerId] = tiles[nextTile++];
+        }
+        else
+        {
+            return;
+        }
+
+        try
+        {
+            this->workers[workerId].write(&pending[workerId], sizeof(TileRequest));
+            busy[workerId] = true;
+        }
+        catch (const std::runtime_error&)
+        {
+            exited[workerId] = true;
+            retried.push_back(pending[workerId]);
+        }
+    };
+
+    std::string error;
+    while (true)
+    {
+        // The idle workers take the tiles left, including the ones of the workers that exited
+        for (size_t workerId = 0; workerId < this->workers.size(); workerId++)
+        {
+            if (!busy[workerId] && !exited[workerId])
+            {
+                dispatch(workerId);
+            }
+        }
+
+        std::vector<pollfd> files;
+        std::vector<size_t> fileWorkers;
+        for (size_t workerId = 0; workerId < this->workers.size(); workerId++)
+        {
+            if (busy[workerId])
+            {
+                files.push_back(pollfd{ this->workers[workerId].getOutput(), POLLIN, 0 });
+                fileWorkers.push_back(workerId);
+            }
+        }
+
+        if (files.empty())
+        {
+            break;
+        }
+
+        if (poll(files.data(), files.size(), -1) < 0)
+        {
+            throw std::runtime_error("Failed to wait for the workers");
+        }
+
+        for (size_t i = 0; i < files.size(); i++)
+        {
+            if (files[i].revents == 0)
+            {
+                continue;
+            }
+
+            size_t workerId = fileWorkers[i];
+            WorkerProcess& worker = this->workers[workerId];
+            const TileRequest& tile = pending[workerId];
+            busy[workerId] = false;
+
+            try
+            {
+                uint32_t status;
+                worker.read(&status, sizeof(status));
+                if (status != 0)
+                {
+                    // The tiles already sent are drained, the others are dropped
+                    uint32_t length;
+                    worker.read(&length, sizeof(length));
+                    error.resize(length);
+                    worker.read(error.data(), length);
+                    nextTile = tiles.size();
+                    retried.clear();
+                    continue;
+                }
+
+                // The rows of the tile go straight into the merged accumulation
+                for (unsigned int y = tile.position.y; y < tile.position.y + tile.size.y; y++)
+                {
+                    float* row = accumulation.pixels.data() + ((size_t)y * job.size.x + tile.position.x) * 4;
+                    worker.read(row, (size_t)tile.size.x * 4 * sizeof(float));
+                }
+            }
+            catch (const std::runtime_error&)
+            {
+                // A worker that exited gives its tile back, the rows it sent are rendered again by another one
+                exited[workerId] = true;
+                if (error.empty())
+                {
+                    retried.push_back(tile);
+                }
+            }
+        }
+    }
+
+    // The workers that exited are dropped, the next jobs run on the others
+    for (size_t workerId = this->workers.size(); workerId-- > 0;)
+    {
+        if (exited[workerId])
+        {
+            this->workers[workerId].shutdown();
+            this->workers.erase(this->workers.begin() + workerId);
+        }
+    }
+
+    if (!error.empty())
+    {
+        throw std::runtime_error(error);
+    }
+
+    if (!retried.empty() || nextTile < tiles.size())
+    {
+        throw std::runtime_error("Every worker exited");
+    }
+
+    return accumulation;
+}
+
+size_t TileCoordinator::getWorkerCount() const
+{
+    return this->workers.size();
+}
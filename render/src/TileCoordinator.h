@@ -0,0 +1,19 @@
+#pragma once
+
+#include "Job.h"
+#include "WorkerProcess.h"
+
+#include <vector>
+#include <string>
+#include <TracerX/Image.h>
+
+class TileCoordinator
+{
+public:
+    void init(unsigned int workerCount, const std::string& workerCommand);
+    void shutdown();
+    TracerX::Image render(const Job& job, uint32_t jobId, unsigned int tileSize);
+    size_t getWorkerCount() const;
+private:
+    std::vector<WorkerProcess> workers;
+};
@@ -0,0 +1,116 @@
+#include "WorkerProcess.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdexcept>
+#include <sys/wait.h>
+
+void WorkerProcess::init(const std::string& command)
+{
+    // The ends kept by the coordinator are not inherited by the next workers, so closing them ends the worker
+    int toWorker[2], fromWorker[2];
+    if (pipe2(toWorker, O_CLOEXEC) != 0)
+    {
+        throw std::runtime_error("Failed to create the worker pipes");
+    }
+
+    if (pipe2(fromWorker, O_CLOEXEC) != 0)
+    {
+        close(toWorker[0]);
+        close(toWorker[1]);
+        throw std::runtime_error("Failed to create the worker pipes");
+    }
+
+    this->pid = fork();
+    if (this->pid == 0)
+    {
+        dup2(toWorker[0], STDIN_FILENO);
+        dup2(fromWorker[1], STDOUT_FILENO);
+        execl("/bin/sh", "sh", "-c", command.c_str(), nullptr);
+        _exit(127);
+    }
+
+    close(toWorker[0]);
+    close(fromWorker[1]);
+    this->input = toWorker[1];
+    this->output = fromWorker[0];
+    if (this->pid < 0)
+    {
+        this->shutdown();
+        throw std::runtime_error("Failed to start the worker: " + command);
+    }
+}
+
+void WorkerProcess::shutdown()
+{
+    if (this->input >= 0)
+    {
+        close(this->input);
+    }
+
+    if (this->output >= 0)
+    {
+        close(this->output);
+    }
+
+    if (this->pid > 0)
+    {
+        waitpid(this->pid, nullptr, 0);
+    }
+
+    this->pid = -1;
+    this->input = -1;
+    this->output = -1;
+}
+
+void WorkerProcess::write(const void* data, size_t size)
+{
+    WorkerProcess::writeAll(this->input, data, size);
+}
+
+void WorkerProcess::read(void* data, size_t size)
+{
+    if (!WorkerProcess::readAll(this->output, data, size))
+    {
+        throw std::runtime_error("A worker exited");
+    }
+}
+
+int WorkerProcess::getOutput() const
+{
+    return this->output;
+}
+
+void WorkerProcess::writeAll(int file, const void* data, size_t size)
+{
+    const char* bytes = (const char*)data;
+    while (size > 0)
+    {
+        ssize_t written = ::write(file, bytes, size);
+        if (written <= 0)
+        {
+            throw std::runtime_error("Failed to write to a worker pipe");
+        }
+
+        bytes += written;
+        size -= written;
+    }
+}
+
+bool WorkerProcess::readAll(int file, void* data, size_t size)
+{
+    char* bytes = (char*)data;
+    while (size > 0)
+    {
+        ssize_t count = ::read(file, bytes, size);
+        if (count <= 0)
+        {
+            return false;
+        }
+
+        bytes += count;
+        size -= count;
+    }
+
+    return true;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <sys/types.h>
+
+struct TileRequest
+{
+    uint32_t jobId;
+    glm::uvec2 position;
+    glm::uvec2 size;
+};
+
+class WorkerProcess
+{
+public:
+    void init(const std::string& command);
+    void shutdown();
+    void write(const void* data, size_t size);
+    void read(void* data, size_t size);
+    int getOutput() const;
+
+    static void writeAll(int file, const void* data, size_t size);
+    static bool readAll(int file, void* data, size_t size);
+private:
+    pid_t pid = -1;
+    int input = -1;
+    int output = -1;
+};
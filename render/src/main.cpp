@@ -0,0 +1,279 @@
+#include "Job.h"
+#include "JobLoader.h"
+#include "WorkerProcess.h"
+#include "HeadlessContext.h"
+#include "TileCoordinator.h"
+
+#include <TracerX/Scene.h>
+#include <TracerX/Renderer.h>
+
+#include <chrono>
+#include <string>
+#include <unistd.h>
+#include <iostream>
+#include <filesystem>
+
+using namespace std;
+using namespace TracerX;
+
+double elapsedSeconds(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+string quote(const string& text)
+{
+    string quoted = "'";
+    for (char c : text)
+    {
+        quoted += c == '\'' ? string("'\\''") : string(1, c);
+    }
+
+    return quoted + "'";
+}
+
+void printTimings(const Scene& scene)
+{
+    const Scene::LoadTimings& timings = scene.loadTimings;
+    cout << "    cache " << timings.cache << "s, parse " << timings.parse << "s, texture decode " << timings.textureDecode << "s, texture conversion " << timings.textureConversion
+        << "s, geometry " << timings.geometry << "s, bvh " << timings.bvh << "s" << endl;
+}
+
+// Renders in batches until every pixel converged or all the samples are taken
+void renderAdaptive(Renderer& renderer, const Job& job)
+{
+    const unsigned int batchSize = 16;
+    while (renderer.getFrameCount() < job.sampleCount)
+    {
+        renderer.accumulate(min(batchSize, job.sampleCount - renderer.getFrameCount()), glm::uvec2(0), job.size);
+        if (renderer.getConvergedRatio() >= 1)
+        {
+            break;
+        }
+    }
+
+    renderer.toneMap(glm::uvec2(0), job.size);
+}
+
+// Renders the tiles sent by the coordinator on the standard input and returns their accumulation on the standard output
+int runWorker(const string& jobFileName)
+{
+    // The protocol owns the standard output, anything else printed goes to the standard error
+    int output = dup(STDOUT_FILENO);
+    dup2(STDERR_FILENO, STDOUT_FILENO);
+
+    vector<Job> jobs;
+    HeadlessContext context;
+    Renderer renderer;
+    try
+    {
+        jobs = Job::loadFromFile(jobFileName);
+        context.init();
+        renderer.init(glm::uvec2(1, 1));
+    }
+    catch (const exception& e)
+    {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    JobLoader loader;
+    TileRequest tile;
+    while (WorkerProcess::readAll(STDIN_FILENO, &tile, sizeof(tile)))
+    {
+        try
+        {
+            const Job& job = jobs.at(tile.jobId);
+            if (glm::any(glm::greaterThan(tile.position + tile.size, job.size)))
+            {
+                throw runtime_error("Tile out of the image: " + job.output);
+            }
+
+            loader.load(renderer, job);
+            loader.setup(renderer, job);
+            renderer.accumulate(job.sampleCount, tile.position, tile.size);
+
+            // Only the tile is read back, its rows are sent as they are
+            Image accumulation = renderer.getAccumulationImage(tile.position, tile.size);
+            uint32_t status = 0;
+            WorkerProcess::writeAll(output, &status, sizeof(status));
+            WorkerProcess::writeAll(output, accumulation.pixels.data(), accumulation.pixels.size() * sizeof(float));
+        }
+        catch (const exception& e)
+        {
+            string message = e.what();
+            uint32_t status = 1;
+            uint32_t length = (uint32_t)message.size();
+            WorkerProcess::writeAll(output, &status, sizeof(status));
+            WorkerProcess::writeAll(output, &length, sizeof(length));
+            WorkerProcess::writeAll(output, message.data(), length);
+        }
+    }
+
+    renderer.shutdown();
+    context.shutdown();
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    string jobFileName;
+    unsigned int workerCount = 0;
+    string workerCommand;
+    unsigned int tileSize = 128;
+    bool isWorker = false;
+    for (int i = 1; i < argc; i++)
+    {
+        string argument = argv[i];
+        if (argument == "--worker")
+        {
+            isWorker = true;
+        }
+        else if (argument == "--workers" && i + 1 < argc)
+        {
+            workerCount = stoi(argv[++i]);
+        }
+        else if (argument == "--worker-command" && i + 1 < argc)
+        {
+            workerCommand = argv[++i];
+        }
+        else if (argument == "--tile-size" && i + 1 < argc)
+        {
+            tileSize = max(stoi(argv[++i]), 1);
+        }
+        else
+        {
+            jobFileName = argument;
+        }
+    }
+
+    if (jobFileName.empty())
+    {
+        cout << "Usage: tracerx-render <jobs.json> [--workers <count>] [--worker-command <command>] [--tile-size <pixels>]" << endl;
+        return 1;
+    }
+
+    if (isWorker)
+    {
+        return runWorker(jobFileName);
+    }
+
+    vector<Job> jobs;
+    HeadlessContext context;
+    Renderer renderer;
+    TileCoordinator coordinator;
+    try
+    {
+        jobs = Job::loadFromFile(jobFileName);
+
+        // Workers run this executable unless another command is given, e.g. to start them on other nodes
+        if (workerCount > 0)
+        {
+            string command = workerCommand.empty() ? quote(filesystem::read_symlink("/proc/self/exe").string()) : workerCommand;
+            coordinator.init(workerCount, command + " --worker " + quote(filesystem::absolute(jobFileName).string()));
+        }
+
+        context.init();
+        renderer.init(jobs.empty() ? glm::uvec2(1, 1) : jobs[0].size);
+    }
+    catch (const exception& e)
+    {
+        cerr << e.what() << endl;
+        coordinator.shutdown();
+        return 1;
+    }
+
+    JobLoader loader;
+    int failedCount = 0;
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+        const Job& job = jobs[i];
+        cout << "[" << i + 1 << "/" << jobs.size() << "] " << job.output << endl;
+
+        try
+        {
+            // With workers, the coordinator only needs the scene to render the albedo and the normals for the denoiser
+            double loadTime = 0;
+            bool isDistributed = coordinator.getWorkerCount() > 0;
+            if (!isDistributed || job.denoise)
+            {
+                chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                if (loader.load(renderer, job))
+                {
+                    printTimings(loader.scene);
+                }
+
+                loadTime = elapsedSeconds(start);
+                loader.setup(renderer, job);
+            }
+            else
+            {
+                renderer.gamma = job.gamma;
+                if (renderer.getSize() != job.size)
+                {
+                    renderer.resize(job.size);
+                }
+            }
+
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            if (isDistributed)
+            {
+                Image accumulation = coordinator.render(job, (uint32_t)i, tileSize);
+                if (job.denoise)
+                {
+                    renderer.render();
+                }
+
+                renderer.loadAccumulationImage(accumulation, job.sampleCount);
+                renderer.toneMap(glm::uvec2(0), job.size);
+            }
+            else if (job.adaptiveThreshold > 0)
+            {
+                renderAdaptive(renderer, job);
+            }
+            else
+            {
+                renderer.render(job.sampleCount);
+            }
+
+            renderer.synchronize();
+            double renderTime = elapsedSeconds(start);
+
+#ifdef TX_DENOISE
+            if (job.denoise)
+            {
+                renderer.denoise();
+            }
+#endif
+
+            renderer.getImage().saveToFile(job.output);
+            cout << "    load " << loadTime << "s, render " << renderTime << "s (" << renderer.getFrameCount() << " samples, " << renderer.getFrameCount() / renderTime << " samples/s";
+            if (isDistributed)
+            {
+                cout << ", " << coordinator.getWorkerCount() << " workers";
+            }
+            else if (job.adaptiveThreshold > 0)
+            {
+                cout << ", " << renderer.getConvergedRatio() * 100 << "% converged";
+            }
+
+            // The tiles of the workers arrive without their path lengths
+            if (!isDistributed && job.russianRouletteDepth > 0)
+            {
+                cout << ", average path length " << renderer.getAveragePathLength();
+            }
+
+            cout << ")" << endl;
+        }
+        catch (const exception& e)
+        {
+            cerr << "    " << e.what() << endl;
+            failedCount++;
+        }
+    }
+
+    coordinator.shutdown();
+    renderer.shutdown();
+    context.shutdown();
+    return failedCount == 0 ? 0 : 1;
+}
@@ -35,6 +35,36 @@ def write_shaders(path: str, accumulator: str, toneMapper: str, vertex: str) ->
         file.write('\n)";\n')
 
 
+def write_wavefront_shaders(path: str, generate: str, intersect: str, shade: str, occlusion: str, accumulate: str, dispatch: str) -> None:
+    with open(path, "w") as file:
+        file.write("#include <TracerX/WavefrontTracer.h>\n\n")
+        file.write("using namespace TracerX::core;\n\n")
+
+        file.write('const char* WavefrontTracer::generateShaderSrc =\nR"(\n')
+        file.write(generate)
+        file.write('\n)";\n\n')
+
+        file.write('const char* WavefrontTracer::intersectShaderSrc =\nR"(\n')
+        file.write(intersect)
+        file.write('\n)";\n\n')
+
+        file.write('const char* WavefrontTracer::shadeShaderSrc =\nR"(\n')
+        file.write(shade)
+        file.write('\n)";\n\n')
+
+        file.write('const char* WavefrontTracer::occlusionShaderSrc =\nR"(\n')
+        file.write(occlusion)
+        file.write('\n)";\n\n')
+
+        file.write('const char* WavefrontTracer::accumulateShaderSrc =\nR"(\n')
+        file.write(accumulate)
+        file.write('\n)";\n\n')
+
+        file.write('const char* WavefrontTracer::dispatchShaderSrc =\nR"(\n')
+        file.write(dispatch)
+        file.write('\n)";\n')
+
+
 project = join(dirname(__file__), "..")
 shaders = join(project, "core", "shaders")
 
@@ -55,6 +85,24 @@ try:
         vertex,
     )
 
+    generate = build_shader(join(shaders, "compute", "generate.glsl"))
+    intersect = build_shader(join(shaders, "compute", "intersect.glsl"))
+    shade = build_shader(join(shaders, "compute", "shade.glsl"))
+    occlusion = build_shader(join(shaders, "compute", "occlusion.glsl"))
+    accumulate = build_shader(join(shaders, "compute", "accumulate.glsl"))
+    dispatch = build_shader(join(shaders, "compute", "dispatch.glsl"))
+    print("[Info] Build wavefront shaders")
+
+    write_wavefront_shaders(
+        join(project, "core", "src", "WavefrontTracerShaderSrc.cpp"),
+        generate,
+        intersect,
+        shade,
+        occlusion,
+        accumulate,
+        dispatch,
+    )
+
     print("[Info] Build completed")
 except ValueError as err:
     print(f"[Error] {err}")